@@ -1,17 +1,36 @@
 // main.c : 此文件包含 "main" 函数。程序执行将在此处开始并结束。
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// memfd_create, accept4 and MSG_CMSG_CLOEXEC of the compute service
+#define _GNU_SOURCE
+#endif // __linux__
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <float.h>
 #include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
 #include <vulkan/vulkan.h>
 
+// Define VVB_USE_SHADERC and link shaderc_shared.lib of the Vulkan SDK to compile GLSL at runtime (`--glsl-dir`)
+#ifdef VVB_USE_SHADERC
+#include <shaderc/shaderc.h>
+#endif // VVB_USE_SHADERC
+
 #ifdef _WIN32
 
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+
 static inline FILE* OpenFileWithRead(const char *filePath)
 {
     FILE* fp = NULL;
@@ -26,19 +45,189 @@ static inline FILE* OpenFileWithRead(const char *filePath)
     return fp;
 }
 
+static inline FILE* OpenFileWithWrite(const char* filePath)
+{
+    FILE* fp = NULL;
+    if (fopen_s(&fp, filePath, "wb") != 0)
+    {
+        if (fp != NULL)
+        {
+            fclose(fp);
+            fp = NULL;
+        }
+    }
+    return fp;
+}
+
+// Returns false if the environment variable does not exist or its value does not fit in `buffer`
+static inline bool GetEnvironmentString(const char* name, char* buffer, size_t bufferSize)
+{
+    size_t requiredSize = 0;
+    if (getenv_s(&requiredSize, buffer, bufferSize, name) != 0) {
+        return false;
+    }
+    return requiredSize > 1;
+}
+
+static inline int CompareStringIgnoreCase(const char* s1, const char* s2)
+{
+    return _stricmp(s1, s2);
+}
+
+// Returns true if the directory exists afterwards
+static inline bool CreateDirectoryIfMissing(const char* path)
+{
+    return _mkdir(path) == 0 || errno == EEXIST;
+}
+
+// NUMBER_OF_PROCESSORS is set by Windows for every process
+static inline uint32_t GetProcessorCount(void)
+{
+    char value[16];
+    const unsigned long count = GetEnvironmentString("NUMBER_OF_PROCESSORS", value, sizeof(value)) ? strtoul(value, NULL, 10) : 0;
+    return count > 0 ? (uint32_t)count : 1;
+}
+
+static inline uint64_t GetCurrentTimeNanoseconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static double s_nanosecondsPerThreadCycle;
+static once_flag s_threadCycleCalibrationFlag = ONCE_FLAG_INIT;
+
+// Spins for 10ms and compares the cycles the thread ran with the performance counter
+static void CalibrateThreadCycleTime(void)
+{
+    LARGE_INTEGER frequency, beginCounter, counter;
+    ULONG64 beginCycles = 0;
+    ULONG64 endCycles = 0;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&beginCounter);
+    QueryThreadCycleTime(GetCurrentThread(), &beginCycles);
+    do {
+        QueryPerformanceCounter(&counter);
+    } while (counter.QuadPart - beginCounter.QuadPart < frequency.QuadPart / 100);
+    QueryThreadCycleTime(GetCurrentThread(), &endCycles);
+
+    const double elapsedNanoseconds = (double)(counter.QuadPart - beginCounter.QuadPart) * 1e9 / (double)frequency.QuadPart;
+    s_nanosecondsPerThreadCycle = endCycles > beginCycles ? elapsedNanoseconds / (double)(endCycles - beginCycles) : 0.0;
+}
+
+// GetThreadTimes only advances once per scheduler tick of about 15.6ms, far too coarse for single waits. The cycles
+// charged to the thread are counted exactly instead, and converted with a rate calibrated on first use.
+static inline uint64_t GetThreadCpuTimeNanoseconds(void)
+{
+    call_once(&s_threadCycleCalibrationFlag, CalibrateThreadCycleTime);
+    ULONG64 cycles = 0;
+    if (!QueryThreadCycleTime(GetCurrentThread(), &cycles)) {
+        return 0;
+    }
+    return (uint64_t)((double)cycles * s_nanosecondsPerThreadCycle);
+}
+
+// Hints a spin-wait loop to the processor
+static inline void PauseProcessor(void)
+{
+    YieldProcessor();
+}
+
 #else
 
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif // __linux__
+
 static inline FILE* OpenFileWithRead(const char* filePath)
 {
     return fopen(filePath, "r");
 }
 
+static inline FILE* OpenFileWithWrite(const char* filePath)
+{
+    return fopen(filePath, "w");
+}
+
+// Returns false if the environment variable does not exist or its value does not fit in `buffer`
+static inline bool GetEnvironmentString(const char* name, char* buffer, size_t bufferSize)
+{
+    const char* value = getenv(name);
+    if (value == NULL || value[0] == '\0') {
+        return false;
+    }
+    const int len = snprintf(buffer, bufferSize, "%s", value);
+    return len > 0 && (size_t)len < bufferSize;
+}
+
+static inline int CompareStringIgnoreCase(const char* s1, const char* s2)
+{
+    return strcasecmp(s1, s2);
+}
+
+// Returns true if the directory exists afterwards
+static inline bool CreateDirectoryIfMissing(const char* path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static inline uint32_t GetProcessorCount(void)
+{
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+}
+
+static inline uint64_t GetCurrentTimeNanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t GetThreadCpuTimeNanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Hints a spin-wait loop to the processor
+static inline void PauseProcessor(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
 #endif // _WIN32
 
 #ifndef max
 #define max(a,b) (((a) > (b)) ? (a) : (b))
 #endif // !max
 
+#ifndef min
+#define min(a,b) (((a) < (b)) ? (a) : (b))
+#endif // !min
+
+// Environment variable used to choose the working device when `--device` is not specified
+#define DEVICE_SELECTOR_ENV_NAME    "VVB_DEVICE"
+// Environment variable naming a directory of .spv files that replace the embedded shaders when neither `--shader-dir` nor `--glsl-dir` is specified
+#define SHADER_DIRECTORY_ENV_NAME   "VVB_SHADER_DIR"
+// Part of the shader cache key; must change whenever CompileGlslToSpirv changes the compile options
+#define SHADER_COMPILE_OPTIONS      "vulkan1.1 spirv1.3 -Os"
+// First bytes of a workload trace file
+#define TRACE_MAGIC                 "VVBT"
 
 enum MY_CONSTANTS
 {
@@ -46,10 +235,272 @@ enum MY_CONSTANTS
     MAX_VULKAN_GLOBAL_EXT_PROPS = 256,
 
     MAX_GPU_COUNT = 8,
+    // Entries of s_embeddedShaders
+    EMBEDDED_SHADER_COUNT = 19,
+    MAX_SHADER_PATH_LENGTH = 1024,
+    SPIRV_MAGIC_NUMBER = 0x07230203,
+    // Magic number, version, generator, bound and schema
+    SPIRV_HEADER_SIZE = 5 * sizeof(uint32_t),
     MAX_QUEUE_FAMILY_PROPERTY_COUNT = 8,
+    MAX_COMPUTE_QUEUE_COUNT = 16,
+    // Logical devices; several of them may be created on one physical device
+    MAX_DEVICE_CONTEXT_COUNT = 16,
 
     // additional 64 bytes to store enough adresses (up to 8 addresses)
-    ADDITIONAL_ADDRESS_BUFFER_SIZE = 64
+    ADDITIONAL_ADDRESS_BUFFER_SIZE = 64,
+
+    // local_size_x of the compute shader
+    COMPUTE_WORKGROUP_SIZE = 1024,
+    DEFAULT_ELEMENT_COUNT = 25 * 1024 * 1024,
+
+    MAX_JOB_NAME_LENGTH = 64,
+    MAX_BATCH_JOB_COUNT = 256,
+    MAX_BATCH_LINE_LENGTH = 512,
+    MAX_CACHED_PIPELINE_COUNT = 16,
+
+    DEFAULT_QUEUE_BENCHMARK_JOB_COUNT = 32,
+    QUEUE_BENCHMARK_ELEMENT_COUNT = 1024 * 1024,
+    QUEUE_BENCHMARK_ITERATIONS = 4,
+
+    // Size of each chunk when a large input is partitioned across devices
+    MULTI_DEVICE_CHUNK_ELEMENT_COUNT = 1024 * 1024,
+
+    DEFAULT_ASYNC_JOB_COUNT = 64,
+
+    // Jobs a SubmissionBatcher submits with one vkQueueSubmit at most
+    MAX_COALESCED_BATCH_SIZE = 128,
+    MAX_COALESCING_WINDOW_MICROSECONDS = 100 * 1000,
+    DEFAULT_COALESCING_JOB_COUNT = 256,
+    COALESCING_BENCHMARK_ELEMENT_COUNT = 4 * 1024,
+    // Arrival rate of the small jobs in the coalescing benchmark
+    COALESCING_JOB_INTERVAL_MICROSECONDS = 20,
+    // The longest a completion wait polls before it blocks, unless `--spin-us` is given
+    DEFAULT_MAX_SPIN_MICROSECONDS = 200,
+    MAX_SPIN_MICROSECONDS = 100000,
+    // Pause instructions between two polls; doubled after every poll up to the maximum
+    MAX_SPIN_BACKOFF_PAUSES = 256,
+    DEFAULT_WAIT_BENCHMARK_JOB_COUNT = 500,
+    MAX_WAIT_BENCHMARK_JOB_COUNT = 100000,
+    // Jobs much shorter and jobs longer than the default spin window
+    WAIT_BENCHMARK_SMALL_ELEMENT_COUNT = 4 * 1024,
+    WAIT_BENCHMARK_LARGE_ELEMENT_COUNT = 1024 * 1024,
+
+    MAX_RECORDING_THREAD_COUNT = 8,
+    DEFAULT_RECORDING_BENCHMARK_JOB_COUNT = 128,
+    RECORDING_BENCHMARK_ELEMENT_COUNT = 64 * 1024,
+
+    MAX_COMPUTE_GRAPH_RESOURCES = 64,
+    MAX_COMPUTE_GRAPH_PASSES = 64,
+    MAX_COMPUTE_GRAPH_PASS_USAGES = 4,
+    // Distinct stages that read a resource between two writes; further ones are merged into the last
+    MAX_COMPUTE_GRAPH_READ_STAGES = 4,
+    GRAPH_BENCHMARK_CHAIN_COUNT = 4,
+    GRAPH_BENCHMARK_CHAIN_DEPTH = 3,
+    GRAPH_BENCHMARK_ELEMENT_COUNT = 1024 * 1024,
+    GRAPH_BENCHMARK_ITERATIONS = 8,
+
+    // Upper bound of reduction steps, enough for 2^64 elements
+    MAX_INDIRECT_STEP_COUNT = 64,
+    // Must be even, see RecordGpuDrivenReductionSteps
+    INDIRECT_STEPS_PER_SUBMISSION = 8,
+    DEFAULT_INDIRECT_ELEMENT_COUNT = 16 * 1024 * 1024,
+    // Size of the device heap the filter kernels allocate their output blocks from, including its header
+    DEVICE_HEAP_CAPACITY = 64 * 1024 * 1024,
+    DEFAULT_DEVICE_HEAP_ELEMENT_COUNT = 8 * 1024 * 1024,
+    // Keeps the heap from running out even if every element is kept: each workgroup then allocates a 16 byte block header and
+    // 4 bytes per element behind the 16 byte heap header
+    MAX_DEVICE_HEAP_ELEMENT_COUNT = (DEVICE_HEAP_CAPACITY - 16) / (16 + COMPUTE_WORKGROUP_SIZE * 4) * COMPUTE_WORKGROUP_SIZE,
+    // Job slots in the ring of the persistent kernel
+    PERSISTENT_QUEUE_CAPACITY = 64,
+    // Polls of an empty ring before the persistent kernel leaves, which keeps it below the GPU timeout of the OS
+    PERSISTENT_QUEUE_MAX_IDLE_POLLS = 256 * 1024,
+    PERSISTENT_QUEUE_JOB_ELEMENT_COUNT = 4096,
+    DEFAULT_PERSISTENT_QUEUE_JOB_COUNT = 1000,
+    MAX_PERSISTENT_QUEUE_JOB_COUNT = 1000 * 1000,
+    // Virtual buffers commit memory in multiples of this, rounded up to the sparse block size
+    VIRTUAL_BUFFER_COMMIT_GRANULARITY = 4 * 1024 * 1024,
+    MAX_VIRTUAL_BUFFER_COMMIT_COUNT = 64,
+    SPARSE_GROWTH_STEP_COUNT = 7,
+    DEFAULT_SPARSE_ELEMENT_COUNT = 64 * 1024 * 1024,
+    DEFAULT_ELEMENT_TYPE_ELEMENT_COUNT = 16 * 1024 * 1024,
+    // An fp64 buffer of this many elements takes 512MB
+    MAX_ELEMENT_TYPE_ELEMENT_COUNT = 64 * 1024 * 1024,
+    ELEMENT_TYPE_BENCHMARK_ITERATIONS = 10,
+    // Must match MAX_BUFFER_COUNT of access_pattern.comp.glsl
+    ACCESS_BENCHMARK_MAX_BUFFER_COUNT = 64,
+    ACCESS_BENCHMARK_FIXED_BINDING_COUNT = 8,
+    // Elements of every data buffer, a power of 2
+    ACCESS_BENCHMARK_ELEMENT_COUNT = 256 * 1024,
+    ACCESS_BENCHMARK_INVOCATION_COUNT = 256 * 1024,
+    ACCESS_BENCHMARK_READS_PER_BUFFER = 4,
+    ACCESS_BENCHMARK_ITERATIONS = 10,
+    // Data buffers of the gather/scatter benchmark, reached through an address table
+    GATHER_SCATTER_MAX_BUFFER_COUNT = 64,
+    GATHER_SCATTER_BUFFER_ELEMENT_COUNT = 32 * 1024,
+    // Entries of every index stream, one invocation each; as many as the elements of all buffers
+    GATHER_SCATTER_INDEX_COUNT = GATHER_SCATTER_MAX_BUFFER_COUNT * GATHER_SCATTER_BUFFER_ELEMENT_COUNT,
+    // The sorting pre-pass sorts the (slot, offset) keys of at most 22 bits in two passes
+    GATHER_SCATTER_SORT_DIGIT_BITS = 11,
+    GATHER_SCATTER_ITERATIONS = 8,
+    // Must match the workgroup size of decode_blocks.comp.glsl, which decodes one block per workgroup
+    COMPRESSED_BLOCK_ELEMENT_COUNT = 1024,
+    // The 100MB upload of the default test
+    DEFAULT_COMPRESSED_UPLOAD_ELEMENT_COUNT = 25 * 1024 * 1024,
+    MAX_COMPRESSED_UPLOAD_ELEMENT_COUNT = 64 * 1024 * 1024,
+    MAX_ENCODER_THREAD_COUNT = 64,
+    // Runs per upload path and dataset, the fastest one is reported
+    COMPRESSED_UPLOAD_ITERATIONS = 5,
+    SERVICE_MAX_CLIENT_COUNT = 16,
+    // Jobs recorded into one submission of the compute service
+    SERVICE_MAX_BATCH_SIZE = 16,
+    // Requests read from one client per batch, so that a busy client cannot starve the others
+    SERVICE_MAX_REQUESTS_PER_CLIENT = 4,
+    // Job sizes are rounded up to powers of 2 from COMPUTE_WORKGROUP_SIZE to this, one pipeline each
+    SERVICE_MAX_ELEMENT_COUNT = 4 * 1024 * 1024,
+    SERVICE_POLL_MILLISECONDS = 100,
+    // Size of sun_path of struct sockaddr_un
+    MAX_SERVICE_SOCKET_PATH_LENGTH = 108,
+    DEFAULT_SERVICE_TEST_CLIENT_COUNT = 4,
+    SERVICE_TEST_JOBS_PER_CLIENT = 64,
+    // Requests every test client keeps in flight
+    SERVICE_TEST_CLIENT_WINDOW = 4,
+    MAX_CPU_BACKEND_THREAD_COUNT = 64,
+    // Elements a worker of the CPU backend takes at a time
+    CPU_BACKEND_CHUNK_ELEMENT_COUNT = 64 * 1024,
+    DEFAULT_BACKEND_BENCHMARK_ELEMENT_COUNT = 4 * 1024 * 1024,
+    MAX_BACKEND_BENCHMARK_ELEMENT_COUNT = 64 * 1024 * 1024,
+    BACKEND_BENCHMARK_JOB_COUNT = 8,
+    BACKEND_BENCHMARK_ITERATIONS = 4,
+    // Device memory blocks the defragmentation test suballocates BDA buffers from
+    BUFFER_POOL_BLOCK_SIZE = 16 * 1024 * 1024,
+    MAX_BUFFER_POOL_BLOCK_COUNT = 8,
+    BUFFER_POOL_TABLE_SLOT_COUNT = 256,
+    DEFRAG_MIN_BUFFER_SIZE = 64 * 1024,
+    // Allocated once the pool is fragmented; fits only after defragmentation
+    DEFRAG_LARGE_BUFFER_SIZE = 8 * 1024 * 1024,
+    DEFAULT_DEFRAG_PASS_BUDGET_MILLISECONDS = 2,
+    MAX_DEFRAG_PASS_BUDGET_MILLISECONDS = 1000,
+    DEFRAG_MAX_PASS_COUNT = 256,
+    // Copy bandwidth assumed by the first pass, before one has been measured
+    DEFRAG_INITIAL_COPY_BYTES_PER_MILLISECOND = 1024 * 1024,
+    TRACE_VERSION = 3,
+    MAX_TRACE_NAME_LENGTH = 32,
+    MAX_TRACE_BUFFER_COUNT = 16,
+    MAX_TRACE_PIPELINE_COUNT = 4,
+    MAX_TRACE_DISPATCH_COUNT = 64,
+    CAPTURE_SESSION_ELEMENT_COUNT = 1024 * 1024,
+    CAPTURE_SESSION_PASS_COUNT = 4,
+    REPLAY_ITERATIONS = 8,
+    // VK_KHR_performance_query counters collected around every dispatch at most
+    MAX_PERFORMANCE_COUNTER_COUNT = 8,
+    MAX_ENUMERATED_PERFORMANCE_COUNTER_COUNT = 512,
+    DEFAULT_COUNTER_DUMP_INTERVAL_MILLISECONDS = 1000,
+    MAX_COUNTER_DUMP_INTERVAL_MILLISECONDS = 60 * 60 * 1000
+};
+
+enum BACKEND_SELECTION
+{
+    // Vulkan, with jobs failing over to the CPU backend when no usable device is found or the device fails them
+    BACKEND_SELECTION_AUTO,
+    BACKEND_SELECTION_VULKAN,
+    BACKEND_SELECTION_CPU
+};
+
+// How the host waits for the completion of a submission, see struct CompletionWaiter
+enum WAIT_STRATEGY
+{
+    // vkWaitForFences or vkWaitSemaphores right away
+    WAIT_STRATEGY_BLOCK,
+    // Polls for the whole maximum spin window, then blocks
+    WAIT_STRATEGY_SPIN,
+    // Polls only while recent job durations predict the completion within the maximum spin window, then blocks
+    WAIT_STRATEGY_ADAPTIVE,
+    WAIT_STRATEGY_COUNT
+};
+
+static const char* const s_waitStrategyNames[WAIT_STRATEGY_COUNT] = { "block", "spin", "adaptive" };
+
+struct ProgramOptions
+{
+    // `--device=<index|discrete|integrated|virtual|cpu|name>`, overrides the VVB_DEVICE environment variable
+    const char* deviceSelector;
+    // `--shader-dir=<dir>`, loads `<name>[_<variant>].spv` from the directory instead of the embedded SPIR-V
+    const char* shaderDirectory;
+    // `--glsl-dir=<dir>`, compiles the shaders from the GLSL sources in the directory at runtime
+    const char* glslDirectory;
+    // `--shader-cache=<dir>`, where the runtime compiled SPIR-V is cached, `<glsl dir>/cache` by default
+    const char* shaderCacheDirectory;
+    // `--bench-shader-compile`, measures compiling every shader from GLSL against loading it from the shader cache
+    bool shaderCompileBenchmark;
+    // `--batch=<file>`, runs the job list in the file instead of the single default test
+    const char* batchFilePath;
+    // `--results=<file>`, where to write the JSON results of a batch run (stdout by default)
+    const char* resultsFilePath;
+    // `--queues=<n>`, number of compute queues to create; 0 means all queues of the selected queue family
+    uint32_t queueCount;
+    // `--queue-priorities=<p0,p1,...>`, the last priority is repeated for the remaining queues
+    uint32_t queuePriorityCount;
+    float queuePriorities[MAX_COMPUTE_QUEUE_COUNT];
+    // `--bench-queues[=<job count>]`, measures the aggregate throughput with 1..N queues
+    uint32_t queueBenchmarkJobCount;
+    // `--multi-device`, creates a logical device on every eligible physical device and distributes jobs across them
+    bool multiDevice;
+    // `--logical-devices=<n>`, number of logical devices per physical device in multi-device mode
+    uint32_t logicalDevicesPerGpu;
+    // `--async[=<job count>]`, submits jobs through the asynchronous API from a single producer thread
+    uint32_t asyncJobCount;
+    // `--bench-coalescing[=<job count>]`, compares a submission per job with coalesced submissions signaling a timeline semaphore
+    uint32_t coalescingJobCount;
+    // `--coalesce=<max jobs>,<window us>`, the batch size and window the coalescing benchmark measures instead of its default set
+    uint32_t coalescingBatchSize;
+    uint32_t coalescingWindowMicroseconds;
+    // `--bench-recording[=<job count>]`, measures the command recording throughput with 1..N recording threads
+    uint32_t recordingBenchmarkJobCount;
+    // `--bench-graph`, compares planned barriers of a multi-pass compute graph with a barrier after every pass
+    bool graphBenchmark;
+    // `--indirect[=<element count>]`, runs a reduction whose step sizes are produced by the previous steps on the GPU
+    uint32_t indirectElementCount;
+    // `--device-heap[=<element count>]`, filters into output blocks allocated by the kernels from a device heap
+    uint32_t deviceHeapElementCount;
+    // `--persistent[=<job count>]`, compares the latency of a persistent kernel polling a job ring with a submit per job
+    uint32_t persistentJobCount;
+    // `--sparse[=<max element count>]`, grows the data of the test kernel in sparse buffers with stable device addresses
+    uint32_t sparseElementCount;
+    // `--bench-access`, compares reaching a variable number of buffers through device addresses, descriptor arrays and fixed bindings
+    bool accessBenchmark;
+    // `--bench-gather-scatter`, gathers and scatters along index streams over many buffers of an address table
+    bool gatherScatterBenchmark;
+    // `--bench-compressed-upload[=<element count>]`, compares raw uploads with compressed ones decoded on the device
+    uint32_t compressedUploadElementCount;
+    // `--bench-types[=<element count>]`, reports the throughput of the same kernel for every supported element type
+    uint32_t elementTypeElementCount;
+    // `--serve=<socket path>`, runs the compute service on a UNIX domain socket until a client asks it to shut down
+    const char* serviceSocketPath;
+    // `--serve-test[=<client count>]`, runs the compute service and client threads that submit memfd payloads to it
+    uint32_t serviceTestClientCount;
+    // `--backend=<auto|vulkan|cpu>`, which backend runs the jobs of the job API
+    enum BACKEND_SELECTION backendSelection;
+    // `--cpu-threads=<n>`, worker threads of the CPU backend, one per processor by default
+    uint32_t cpuThreadCount;
+    // `--wait=<block|spin|adaptive>`, how the job API waits for completions, block by default
+    enum WAIT_STRATEGY waitStrategy;
+    // `--spin-us=<us>`, the longest a wait polls before it blocks, DEFAULT_MAX_SPIN_MICROSECONDS if 0
+    uint32_t maxSpinMicroseconds;
+    // `--bench-wait[=<job count>]`, compares the wait strategies on fences and timeline semaphores
+    uint32_t waitBenchmarkJobCount;
+    // `--bench-backends[=<element count>]`, compares the Vulkan device with the CPU backend at 1..N threads
+    uint32_t backendBenchmarkElementCount;
+    // `--defrag[=<budget ms>]`, fragments a pool of BDA buffers and defragments it in passes of at most <budget ms>
+    uint32_t defragPassBudgetMilliseconds;
+    // `--capture=<trace file>`, records a session of chained kernels with its buffer addresses into a trace file
+    const char* captureFilePath;
+    // `--replay=<trace file>`, recreates the buffers of a trace at their captured addresses and replays its dispatches with timing
+    const char* replayFilePath;
+    // `--counters[=<json file>]`, collects host and GPU counters, printed at exit and periodically dumped to the file as JSON lines
+    bool countersEnabled;
+    const char* countersFilePath;
+    // `--counters-interval=<ms>`, period of the counter dumps
+    uint32_t counterDumpIntervalMilliseconds;
 };
 
 static VkLayerProperties s_layerProperties[MAX_VULKAN_LAYER_COUNT];
@@ -59,9 +510,55 @@ static uint32_t s_layerCount;
 static uint32_t s_instanceExtensionCounts[MAX_VULKAN_LAYER_COUNT];
 
 static VkInstance s_instance = VK_NULL_HANDLE;
-static VkDevice s_specDevice = VK_NULL_HANDLE;
-static uint32_t s_specQueueFamilyIndex = 0;
-static VkPhysicalDeviceMemoryProperties s_memoryProperties = { 0 };
+
+// Everything that belongs to one logical device. Each device context is only used by one thread at a time.
+struct DeviceContext
+{
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDevice device;
+    uint32_t queueFamilyIndex;
+    uint32_t queueCount;
+    VkQueue queues[MAX_COMPUTE_QUEUE_COUNT];
+    // Each queue owns its command pool, so command buffers scheduled to different queues never share a pool
+    VkCommandPool commandPools[MAX_COMPUTE_QUEUE_COUNT];
+    // NULL if synchronization2 is not available, barriers are then recorded with vkCmdPipelineBarrier
+    PFN_vkCmdPipelineBarrier2KHR cmdPipelineBarrier2;
+    // NULL if timeline semaphores are not available
+    PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue;
+    PFN_vkWaitSemaphoresKHR waitSemaphores;
+    // NULL if bufferDeviceAddressCaptureReplay is not available
+    PFN_vkGetBufferOpaqueCaptureAddressKHR getBufferOpaqueCaptureAddress;
+    PFN_vkGetDeviceMemoryOpaqueCaptureAddressKHR getDeviceMemoryOpaqueCaptureAddress;
+    // The sparseBinding and sparseResidencyBuffer features are enabled and the queues support sparse binding operations
+    bool supportSparseResidencyBuffer;
+    // Element types beyond int32, int64 and fp32 that kernels may load and store
+    bool supportInt8;
+    bool supportFloat16;
+    bool supportFloat64;
+    // NULL if VK_EXT_external_memory_host is not available, host allocations then cannot be imported
+    PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerProperties;
+    VkDeviceSize minImportedHostPointerAlignment;
+    // Only set up with `--counters`: pipeline statistics queries, and the VK_KHR_performance_query counters that fit in a single
+    // pass. releaseProfilingLock is not NULL while the profiling lock their queries need is held.
+    bool supportPipelineStatistics;
+    // Performance queries must not be reset in the command buffer that uses them, so they are reset from the host
+    PFN_vkResetQueryPool resetQueryPool;
+    uint32_t performanceCounterCount;
+    uint32_t performanceCounterIndices[MAX_PERFORMANCE_COUNTER_COUNT];
+    VkPerformanceCounterStorageKHR performanceCounterStorages[MAX_PERFORMANCE_COUNTER_COUNT];
+    char performanceCounterNames[MAX_PERFORMANCE_COUNTER_COUNT][VK_MAX_DESCRIPTION_SIZE];
+    PFN_vkReleaseProfilingLockKHR releaseProfilingLock;
+    // Shared by all kernels on the device, created on first use; indexed like s_embeddedShaders
+    VkShaderModule shaderModules[EMBEDDED_SHADER_COUNT];
+};
+
+// s_deviceContexts[0] is the primary device used by the single device paths
+static struct DeviceContext s_deviceContexts[MAX_DEVICE_CONTEXT_COUNT];
+static uint32_t s_deviceContextCount = 0;
+
+static struct ProgramOptions s_options = { 0 };
 
 static PFN_vkGetBufferDeviceAddressEXT s_vkGetBufferDeviceAddressEXT = NULL;
 
@@ -73,6 +570,127 @@ static const char* const s_deviceTypes[] = {
     "CPU"
 };
 
+enum HOST_COUNTER
+{
+    HOST_COUNTER_SUBMITS,
+    HOST_COUNTER_COMMAND_BUFFERS,
+    HOST_COUNTER_UPLOADED_BYTES,
+    HOST_COUNTER_DOWNLOADED_BYTES,
+    HOST_COUNTER_ALLOCATIONS,
+    HOST_COUNTER_ALLOCATED_BYTES,
+    HOST_COUNTER_MAP_CALLS,
+    HOST_COUNTER_DISPATCHES,
+    HOST_COUNTER_COUNT
+};
+
+static const char* const s_hostCounterNames[] = {
+    "submits",
+    "commandBuffers",
+    "uploadedBytes",
+    "downloadedBytes",
+    "allocations",
+    "allocatedBytes",
+    "mapCalls",
+    "dispatches"
+};
+
+// GPU counters of the job dispatches whose queries have been read back
+struct DeviceCounters
+{
+    uint64_t profiledDispatchCount;
+    // From pipeline statistics queries
+    uint64_t computeShaderInvocations;
+    // From timestamps written before and after each dispatch
+    double dispatchMilliseconds;
+    // Indexed like performanceCounterIndices of the device context
+    double performanceCounterTotals[MAX_PERFORMANCE_COUNTER_COUNT];
+};
+
+struct InstrumentationSnapshot
+{
+    uint64_t elapsedNanoseconds;
+    uint64_t hostCounters[HOST_COUNTER_COUNT];
+    uint32_t deviceCount;
+    struct DeviceCounters devices[MAX_DEVICE_CONTEXT_COUNT];
+};
+
+// Counters collected with `--counters`. `mutex` guards `counters` and `dumpStopRequested`.
+struct Instrumentation
+{
+    bool enabled;
+    mtx_t mutex;
+    struct InstrumentationSnapshot counters;
+    uint64_t beginTime;
+    // Periodic dumps, NULL if they are not written
+    FILE* dumpFile;
+    uint32_t dumpIntervalMilliseconds;
+    thrd_t dumpThread;
+    cnd_t dumpCondition;
+    bool dumpStopRequested;
+};
+
+static struct Instrumentation s_instrumentation;
+
+static bool InitializeInstrumentation(void)
+{
+    memset(&s_instrumentation, 0, sizeof(s_instrumentation));
+    if (mtx_init(&s_instrumentation.mutex, mtx_plain) != thrd_success)
+    {
+        fprintf(stderr, "mtx_init failed!\n");
+        return false;
+    }
+    if (cnd_init(&s_instrumentation.dumpCondition) != thrd_success)
+    {
+        fprintf(stderr, "cnd_init failed!\n");
+        mtx_destroy(&s_instrumentation.mutex);
+        return false;
+    }
+    s_instrumentation.beginTime = GetCurrentTimeNanoseconds();
+    s_instrumentation.enabled = true;
+    return true;
+}
+
+static void DestroyInstrumentation(void)
+{
+    if (!s_instrumentation.enabled) {
+        return;
+    }
+    cnd_destroy(&s_instrumentation.dumpCondition);
+    mtx_destroy(&s_instrumentation.mutex);
+    memset(&s_instrumentation, 0, sizeof(s_instrumentation));
+}
+
+// Called by the shared helpers and the job API from any thread; does nothing without `--counters`
+static void AddHostCounter(enum HOST_COUNTER counter, uint64_t value)
+{
+    if (!s_instrumentation.enabled) {
+        return;
+    }
+    mtx_lock(&s_instrumentation.mutex);
+    s_instrumentation.counters.hostCounters[counter] += value;
+    mtx_unlock(&s_instrumentation.mutex);
+}
+
+static void CountDeviceAllocation(VkDeviceSize size)
+{
+    AddHostCounter(HOST_COUNTER_ALLOCATIONS, 1);
+    AddHostCounter(HOST_COUNTER_ALLOCATED_BYTES, size);
+}
+
+// Pull API: copies all counters collected so far. Everything is zero without `--counters`.
+static void GetInstrumentationSnapshot(struct InstrumentationSnapshot* pSnapshot)
+{
+    memset(pSnapshot, 0, sizeof(*pSnapshot));
+    if (!s_instrumentation.enabled) {
+        return;
+    }
+    mtx_lock(&s_instrumentation.mutex);
+    *pSnapshot = s_instrumentation.counters;
+    mtx_unlock(&s_instrumentation.mutex);
+    pSnapshot->elapsedNanoseconds = GetCurrentTimeNanoseconds() - s_instrumentation.beginTime;
+    pSnapshot->deviceCount = s_deviceContextCount;
+}
+
 static VkResult init_global_extension_properties(uint32_t layerIndex)
 {
     uint32_t instance_extension_count;
@@ -212,78 +830,326 @@ static VkResult InitializeInstance(void)
     return result;
 }
 
-static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemoryProperties* pMemoryProperties)
+static VkResult InitializeCommandPools(uint32_t queueFamilyIndex, VkDevice device, VkCommandPool commandPools[], uint32_t commandPoolCount)
 {
-    VkPhysicalDevice physicalDevices[MAX_GPU_COUNT] = { VK_NULL_HANDLE };
-    uint32_t gpu_count = 0;
-    VkResult res = vkEnumeratePhysicalDevices(s_instance, &gpu_count, NULL);
-    if (res != VK_SUCCESS)
+    const VkCommandPoolCreateInfo cmd_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queueFamilyIndex = queueFamilyIndex
+    };
+
+    for (uint32_t i = 0; i < commandPoolCount; i++)
     {
-        fprintf(stderr, "vkEnumeratePhysicalDevices failed: %d\n", res);
-        return res;
+        VkResult res = vkCreateCommandPool(device, &cmd_pool_info, NULL, &commandPools[i]);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateCommandPool failed: %d\n", res);
+            return res;
+        }
     }
 
-    if (gpu_count > MAX_GPU_COUNT) {
-        gpu_count = MAX_GPU_COUNT;
+    return VK_SUCCESS;
+}
+
+// Device type ranks used by the automatic device selection: discrete > integrated > virtual > CPU > other
+static const uint32_t s_deviceTypeRanks[] = {
+    0,  // Other
+    3,  // Integrated GPU
+    4,  // Discrete GPU
+    2,  // Virtual GPU
+    1   // CPU
+};
+
+struct PhysicalDeviceCandidate
+{
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties properties;
+    VkDeviceSize deviceLocalHeapSize;
+    uint32_t queueFamilyIndex;
+    uint32_t queueCount;
+    VkQueueFlags queueFlags;
+    bool hasDedicatedComputeFamily;
+    bool supportBufferDeviceAddress;
+    // 0 means the device is not eligible for this demo
+    uint64_t score;
+};
+
+static void EvaluatePhysicalDevice(VkPhysicalDevice physicalDevice, VkQueueFlags queueFlag, struct PhysicalDeviceCandidate* pCandidate)
+{
+    memset(pCandidate, 0, sizeof(*pCandidate));
+    pCandidate->physicalDevice = physicalDevice;
+    vkGetPhysicalDeviceProperties(physicalDevice, &pCandidate->properties);
+
+    VkPhysicalDeviceBufferDeviceAddressFeatures bufferAddressFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
+        .pNext = NULL
+    };
+    VkPhysicalDeviceFeatures2 features2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &bufferAddressFeatures
+    };
+    if (VK_VERSION_MINOR(pCandidate->properties.apiVersion) > 0 || VK_VERSION_MAJOR(pCandidate->properties.apiVersion) > 1) {
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
     }
+    pCandidate->supportBufferDeviceAddress = bufferAddressFeatures.bufferDeviceAddress != VK_FALSE;
 
-    res = vkEnumeratePhysicalDevices(s_instance, &gpu_count, physicalDevices);
-    if (res != VK_SUCCESS)
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
     {
-        fprintf(stderr, "vkEnumeratePhysicalDevices failed: %d\n", res);
-        return res;
+        if ((memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0) {
+            pCandidate->deviceLocalHeapSize = max(pCandidate->deviceLocalHeapSize, memoryProperties.memoryHeaps[i].size);
+        }
     }
 
-    // TODO: The following code is used to choose the working device and may be not necessary to other projects...
-    const bool isSingle = gpu_count == 1;
-    printf("This application has detected there %s %u Vulkan capable device%s installed: \n",
-        isSingle ? "is" : "are",
-        gpu_count,
-        isSingle ? "" : "s");
+    uint32_t queueFamilyPropertyCount = 0;
+    VkQueueFamilyProperties queueFamilyProperties[MAX_QUEUE_FAMILY_PROPERTY_COUNT];
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, NULL);
+    if (queueFamilyPropertyCount > MAX_QUEUE_FAMILY_PROPERTY_COUNT) {
+        queueFamilyPropertyCount = MAX_QUEUE_FAMILY_PROPERTY_COUNT;
+    }
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, queueFamilyProperties);
 
-    VkPhysicalDeviceProperties props = { 0 };
-    for (uint32_t i = 0; i < gpu_count; i++)
+    // Queue families supporting graphics or compute operations implicitly support transfer operations
+    // and are not required to report VK_QUEUE_TRANSFER_BIT
+    VkQueueFlags requiredFlags = queueFlag;
+    if ((requiredFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) != 0) {
+        requiredFlags &= ~(VkQueueFlags)VK_QUEUE_TRANSFER_BIT;
+    }
+
+    bool found = false;
+    for (uint32_t i = 0; i < queueFamilyPropertyCount; i++)
     {
-        vkGetPhysicalDeviceProperties(physicalDevices[i], &props);
-        printf("\n======== Device %u info ========\n", i);
-        printf("Device name: %s\n", props.deviceName);
-        printf("Device type: %s\n", s_deviceTypes[props.deviceType]);
-        printf("Vulkan API version: %u.%u.%u\n", VK_VERSION_MAJOR(props.apiVersion), VK_VERSION_MINOR(props.apiVersion), VK_VERSION_PATCH(props.apiVersion));
-        printf("Driver version: %08X\n", props.driverVersion);
+        if ((queueFamilyProperties[i].queueFlags & requiredFlags) != requiredFlags) {
+            continue;
+        }
+        // Prefer the family with the most queues; on ties prefer a compute family without graphics
+        const bool isDedicated = (queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0;
+        if (!found || queueFamilyProperties[i].queueCount > pCandidate->queueCount ||
+            (queueFamilyProperties[i].queueCount == pCandidate->queueCount && isDedicated && !pCandidate->hasDedicatedComputeFamily))
+        {
+            pCandidate->queueFamilyIndex = i;
+            pCandidate->queueCount = queueFamilyProperties[i].queueCount;
+            pCandidate->queueFlags = queueFamilyProperties[i].queueFlags;
+            pCandidate->hasDedicatedComputeFamily = isDedicated;
+            found = true;
+        }
     }
-    puts("\nPlease choose which device to use...");
 
-#ifdef _WIN32
-    char inputBuffer[8] = { '\0' };
-    const char* input = gets_s(inputBuffer, sizeof(inputBuffer));
-    if (input == NULL) {
-        input = "0";
+    if (!found || !pCandidate->supportBufferDeviceAddress) {
+        return;
     }
-    const uint32_t deviceIndex = atoi(input);
-#else
-    char* input = NULL;
-    ssize_t initLen = 0;
-    const ssize_t len = getline(&input, &initLen, stdin);
-    input[len - 1] = '\0';
-    errno = 0;
-    const uint32_t deviceIndex = (uint32_t)strtoul(input, NULL, 10);
-    if (errno != 0)
+
+    // score layout (from high bits to low bits): device type rank | device local memory in MB | queue topology
+    const uint32_t typeRank = (uint32_t)pCandidate->properties.deviceType < sizeof(s_deviceTypeRanks) / sizeof(s_deviceTypeRanks[0]) ?
+        s_deviceTypeRanks[pCandidate->properties.deviceType] : 0;
+    uint64_t localMemoryMB = pCandidate->deviceLocalHeapSize / (1024 * 1024);
+    if (localMemoryMB > 0xFFFFFFFFFFULL) {
+        localMemoryMB = 0xFFFFFFFFFFULL;
+    }
+    uint64_t queueScore = (uint64_t)(pCandidate->queueCount > 127 ? 127 : pCandidate->queueCount) * 2;
+    if (pCandidate->hasDedicatedComputeFamily) {
+        queueScore += 1;
+    }
+    pCandidate->score = ((uint64_t)(typeRank + 1) << 56) | (localMemoryMB << 8) | queueScore;
+}
+
+// `selector` may be a device index, one of `discrete`, `integrated`, `virtual`, `cpu`, or a case-insensitive substring of the device name.
+// Returns UINT32_MAX if no eligible device matches.
+static uint32_t SelectPhysicalDevice(const struct PhysicalDeviceCandidate candidates[], uint32_t candidateCount, const char* selector)
+{
+    uint32_t bestIndex = UINT32_MAX;
+
+    if (selector != NULL && selector[0] != '\0')
+    {
+        char* endPtr = NULL;
+        errno = 0;
+        const unsigned long index = strtoul(selector, &endPtr, 10);
+        if (errno == 0 && endPtr != selector && *endPtr == '\0')
+        {
+            if (index >= candidateCount)
+            {
+                fprintf(stderr, "Device index %lu exceeds the number of available devices (%u)\n", index, candidateCount);
+                return UINT32_MAX;
+            }
+            if (candidates[index].score == 0) {
+                fprintf(stderr, "Device %lu (%s) is not eligible for this demo!\n", index, candidates[index].properties.deviceName);
+            }
+            return candidates[index].score == 0 ? UINT32_MAX : (uint32_t)index;
+        }
+
+        int deviceType = -1;
+        if (CompareStringIgnoreCase(selector, "discrete") == 0) {
+            deviceType = VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+        }
+        else if (CompareStringIgnoreCase(selector, "integrated") == 0) {
+            deviceType = VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+        }
+        else if (CompareStringIgnoreCase(selector, "virtual") == 0) {
+            deviceType = VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU;
+        }
+        else if (CompareStringIgnoreCase(selector, "cpu") == 0) {
+            deviceType = VK_PHYSICAL_DEVICE_TYPE_CPU;
+        }
+
+        for (uint32_t i = 0; i < candidateCount; i++)
+        {
+            if (candidates[i].score == 0) {
+                continue;
+            }
+
+            bool matched = false;
+            if (deviceType >= 0) {
+                matched = (int)candidates[i].properties.deviceType == deviceType;
+            }
+            else
+            {
+                // case-insensitive substring match against the device name
+                const char* name = candidates[i].properties.deviceName;
+                const size_t selectorLen = strlen(selector);
+                for (size_t pos = 0; name[pos] != '\0' && !matched; pos++)
+                {
+                    size_t n = 0;
+                    while (n < selectorLen && name[pos + n] != '\0' &&
+                        tolower((unsigned char)name[pos + n]) == tolower((unsigned char)selector[n])) {
+                        n++;
+                    }
+                    matched = n == selectorLen;
+                }
+            }
+
+            if (matched && (bestIndex == UINT32_MAX || candidates[i].score > candidates[bestIndex].score)) {
+                bestIndex = i;
+            }
+        }
+
+        if (bestIndex == UINT32_MAX) {
+            fprintf(stderr, "No eligible device matches the device selector `%s`!\n", selector);
+        }
+        return bestIndex;
+    }
+
+    for (uint32_t i = 0; i < candidateCount; i++)
+    {
+        if (candidates[i].score != 0 && (bestIndex == UINT32_MAX || candidates[i].score > candidates[bestIndex].score)) {
+            bestIndex = i;
+        }
+    }
+    return bestIndex;
+}
+
+// Mask of the valid timestamp bits of the compute queue family, 0 if it does not support timestamps
+static uint64_t GetQueueTimestampMask(const struct DeviceContext* deviceContext)
+{
+    uint32_t queueFamilyCount = MAX_QUEUE_FAMILY_PROPERTY_COUNT;
+    VkQueueFamilyProperties queueFamilyProperties[MAX_QUEUE_FAMILY_PROPERTY_COUNT];
+    vkGetPhysicalDeviceQueueFamilyProperties(deviceContext->physicalDevice, &queueFamilyCount, queueFamilyProperties);
+    const uint32_t timestampValidBits = deviceContext->queueFamilyIndex < queueFamilyCount ?
+        queueFamilyProperties[deviceContext->queueFamilyIndex].timestampValidBits : 0;
+    return timestampValidBits >= 64 ? UINT64_MAX : (1ULL << timestampValidBits) - 1;
+}
+
+// Selects the counters of command scope that can be collected around a dispatch in a single pass, so that every submission
+// of a job is profiled, and acquires the profiling lock for the lifetime of the device
+static void SetUpPerformanceCounters(struct DeviceContext* pContext)
+{
+    const PFN_vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR enumerateCounters =
+        (PFN_vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR)vkGetInstanceProcAddr(s_instance,
+            "vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR");
+    const PFN_vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR getPassCount =
+        (PFN_vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR)vkGetInstanceProcAddr(s_instance,
+            "vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR");
+    const PFN_vkAcquireProfilingLockKHR acquireProfilingLock = (PFN_vkAcquireProfilingLockKHR)vkGetDeviceProcAddr(pContext->device,
+        "vkAcquireProfilingLockKHR");
+    const PFN_vkReleaseProfilingLockKHR releaseProfilingLock = (PFN_vkReleaseProfilingLockKHR)vkGetDeviceProcAddr(pContext->device,
+        "vkReleaseProfilingLockKHR");
+    if (enumerateCounters == NULL || getPassCount == NULL || acquireProfilingLock == NULL || releaseProfilingLock == NULL)
+    {
+        fprintf(stderr, "The VK_KHR_performance_query functions cannot be loaded!\n");
+        return;
+    }
+
+    // Device contexts are created one after another, so the enumeration may use static storage
+    static VkPerformanceCounterKHR counters[MAX_ENUMERATED_PERFORMANCE_COUNTER_COUNT];
+    static VkPerformanceCounterDescriptionKHR descriptions[MAX_ENUMERATED_PERFORMANCE_COUNTER_COUNT];
+    for (uint32_t i = 0; i < MAX_ENUMERATED_PERFORMANCE_COUNTER_COUNT; i++)
+    {
+        counters[i] = (VkPerformanceCounterKHR){ .sType = VK_STRUCTURE_TYPE_PERFORMANCE_COUNTER_KHR, .pNext = NULL };
+        descriptions[i] = (VkPerformanceCounterDescriptionKHR){ .sType = VK_STRUCTURE_TYPE_PERFORMANCE_COUNTER_DESCRIPTION_KHR, .pNext = NULL };
+    }
+    uint32_t counterCount = MAX_ENUMERATED_PERFORMANCE_COUNTER_COUNT;
+    VkResult res = enumerateCounters(pContext->physicalDevice, pContext->queueFamilyIndex, &counterCount, counters, descriptions);
+    if (res != VK_SUCCESS && res != VK_INCOMPLETE)
+    {
+        fprintf(stderr, "vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR failed: %d\n", res);
+        return;
+    }
+
+    uint32_t selectedCount = 0;
+    for (uint32_t i = 0; i < counterCount && selectedCount < MAX_PERFORMANCE_COUNTER_COUNT; i++)
+    {
+        // Counters of command buffer or render pass scope cannot be begun and ended around a single dispatch
+        if (counters[i].scope != VK_PERFORMANCE_COUNTER_SCOPE_COMMAND_KHR) {
+            continue;
+        }
+
+        pContext->performanceCounterIndices[selectedCount] = i;
+        const VkQueryPoolPerformanceCreateInfoKHR performanceCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_PERFORMANCE_CREATE_INFO_KHR,
+            .pNext = NULL,
+            .queueFamilyIndex = pContext->queueFamilyIndex,
+            .counterIndexCount = selectedCount + 1,
+            .pCounterIndices = pContext->performanceCounterIndices
+        };
+        uint32_t passCount = 0;
+        getPassCount(pContext->physicalDevice, &performanceCreateInfo, &passCount);
+        if (passCount != 1) {
+            continue;
+        }
+
+        pContext->performanceCounterStorages[selectedCount] = counters[i].storage;
+        snprintf(pContext->performanceCounterNames[selectedCount], VK_MAX_DESCRIPTION_SIZE, "%s", descriptions[i].name);
+        selectedCount++;
+    }
+    if (selectedCount == 0)
     {
-        printf("Input error: %d! Invalid integer input!!\n", errno);
-        return VK_ERROR_DEVICE_LOST;
+        puts("No performance counter of command scope can be collected in a single pass.");
+        return;
     }
-#endif // WIN32
 
-    if (deviceIndex >= gpu_count)
+    const VkAcquireProfilingLockInfoKHR lockInfo = {
+        .sType = VK_STRUCTURE_TYPE_ACQUIRE_PROFILING_LOCK_INFO_KHR,
+        .pNext = NULL,
+        .flags = 0,
+        .timeout = UINT64_MAX
+    };
+    res = acquireProfilingLock(pContext->device, &lockInfo);
+    if (res != VK_SUCCESS)
     {
-        fprintf(stderr, "Your input (%u) exceeds the max number of available devices (%u)\n", deviceIndex, gpu_count);
-        return VK_ERROR_DEVICE_LOST;
+        fprintf(stderr, "vkAcquireProfilingLockKHR failed: %d\n", res);
+        return;
+    }
+    pContext->releaseProfilingLock = releaseProfilingLock;
+    pContext->performanceCounterCount = selectedCount;
+
+    printf("Collecting %u performance counter(s) around each dispatch:", selectedCount);
+    for (uint32_t i = 0; i < selectedCount; i++) {
+        printf("%s %s", i == 0 ? "" : ",", pContext->performanceCounterNames[i]);
     }
-    printf("You have chosen device[%u]...\n", deviceIndex);
+    putchar('\n');
+}
+
+// Creates a logical device with its queues and command pools on the physical device of `pCandidate`
+static VkResult CreateDeviceContext(const struct PhysicalDeviceCandidate* pCandidate, const struct ProgramOptions* pOptions, struct DeviceContext* pContext)
+{
+    memset(pContext, 0, sizeof(*pContext));
+    pContext->physicalDevice = pCandidate->physicalDevice;
+    pContext->properties = pCandidate->properties;
 
     // Query Vulkan extensions the current selected physical device supports
     uint32_t extPropCount = 0U;
-    res = vkEnumerateDeviceExtensionProperties(physicalDevices[deviceIndex], NULL, &extPropCount, NULL);
+    VkResult res = vkEnumerateDeviceExtensionProperties(pCandidate->physicalDevice, NULL, &extPropCount, NULL);
     if (res != VK_SUCCESS)
     {
         fprintf(stderr, "vkEnumerateDeviceExtensionProperties for count failed: %d\n", res);
@@ -295,7 +1161,7 @@ static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemo
     }
 
     VkExtensionProperties extProps[MAX_VULKAN_GLOBAL_EXT_PROPS];
-    res = vkEnumerateDeviceExtensionProperties(physicalDevices[deviceIndex], NULL, &extPropCount, extProps);
+    res = vkEnumerateDeviceExtensionProperties(pCandidate->physicalDevice, NULL, &extPropCount, extProps);
     if (res != VK_SUCCESS)
     {
         fprintf(stderr, "vkEnumerateDeviceExtensionProperties for content failed: %d\n", res);
@@ -303,6 +1169,13 @@ static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemo
     }
 
     bool supportBufferDeviceAddress = false;
+    bool supportSynchronization2Extension = false;
+    bool supportFloat16Int8Extension = false;
+    bool support8BitStorageExtension = false;
+    bool support16BitStorageExtension = false;
+    bool supportExternalMemoryHostExtension = false;
+    bool supportTimelineSemaphoreExtension = false;
+    bool supportPerformanceQueryExtension = false;
     for (uint32_t i = 0; i < extPropCount; ++i)
     {
         // Here, just determine whether VK_KHR_buffer_device_address feature is supported.
@@ -311,7 +1184,36 @@ static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemo
             supportBufferDeviceAddress = true;
             puts("The current device supports `VK_KHR_buffer_device_address` extension!");
         }
+        if (strcmp(extProps[i].extensionName, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME) == 0) {
+            supportSynchronization2Extension = true;
+        }
+        if (strcmp(extProps[i].extensionName, VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME) == 0) {
+            supportFloat16Int8Extension = true;
+        }
+        if (strcmp(extProps[i].extensionName, VK_KHR_8BIT_STORAGE_EXTENSION_NAME) == 0) {
+            support8BitStorageExtension = true;
+        }
+        if (strcmp(extProps[i].extensionName, VK_KHR_16BIT_STORAGE_EXTENSION_NAME) == 0) {
+            support16BitStorageExtension = true;
+        }
+        if (strcmp(extProps[i].extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0) {
+            supportExternalMemoryHostExtension = true;
+        }
+        if (strcmp(extProps[i].extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) {
+            supportTimelineSemaphoreExtension = true;
+        }
+        if (strcmp(extProps[i].extensionName, VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME) == 0) {
+            supportPerformanceQueryExtension = true;
+        }
     }
+    // synchronization2 is core since Vulkan 1.3, shader_float16_int8, 8bit_storage and timeline_semaphore since Vulkan 1.2,
+    // 16bit_storage since Vulkan 1.1
+    const bool synchronization2IsCore = VK_VERSION_MAJOR(pCandidate->properties.apiVersion) > 1 ||
+        VK_VERSION_MINOR(pCandidate->properties.apiVersion) >= 3;
+    const bool vulkan12IsCore = VK_VERSION_MAJOR(pCandidate->properties.apiVersion) > 1 ||
+        VK_VERSION_MINOR(pCandidate->properties.apiVersion) >= 2;
+    const bool vulkan11IsCore = VK_VERSION_MAJOR(pCandidate->properties.apiVersion) > 1 ||
+        VK_VERSION_MINOR(pCandidate->properties.apiVersion) >= 1;
 
     if (!supportBufferDeviceAddress)
     {
@@ -326,9 +1228,74 @@ static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemo
         }
     }
 
+    VkPhysicalDeviceSynchronization2Features synchronization2Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+        .pNext = NULL
+    };
+    VkPhysicalDeviceShaderFloat16Int8Features float16Int8Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES,
+        .pNext = NULL
+    };
+    VkPhysicalDevice8BitStorageFeatures storage8BitFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES,
+        .pNext = NULL
+    };
+    VkPhysicalDevice16BitStorageFeatures storage16BitFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES,
+        .pNext = NULL
+    };
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+        .pNext = NULL
+    };
+    VkPhysicalDevicePerformanceQueryFeaturesKHR performanceQueryFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PERFORMANCE_QUERY_FEATURES_KHR,
+        .pNext = NULL
+    };
+    VkPhysicalDeviceHostQueryResetFeatures hostQueryResetFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES,
+        .pNext = NULL
+    };
+
+    // Optional feature structures may only be chained if the device knows them
+    void* optionalFeatures = NULL;
+    if (synchronization2IsCore || supportSynchronization2Extension)
+    {
+        synchronization2Features.pNext = optionalFeatures;
+        optionalFeatures = &synchronization2Features;
+    }
+    if (vulkan12IsCore || supportFloat16Int8Extension)
+    {
+        float16Int8Features.pNext = optionalFeatures;
+        optionalFeatures = &float16Int8Features;
+    }
+    if (vulkan12IsCore || support8BitStorageExtension)
+    {
+        storage8BitFeatures.pNext = optionalFeatures;
+        optionalFeatures = &storage8BitFeatures;
+    }
+    if (vulkan11IsCore || support16BitStorageExtension)
+    {
+        storage16BitFeatures.pNext = optionalFeatures;
+        optionalFeatures = &storage16BitFeatures;
+    }
+    if (vulkan12IsCore || supportTimelineSemaphoreExtension)
+    {
+        timelineSemaphoreFeatures.pNext = optionalFeatures;
+        optionalFeatures = &timelineSemaphoreFeatures;
+    }
+    // Performance counters may slow the device down, so they are only enabled when they are collected. Their queries are
+    // reset with hostQueryReset of Vulkan 1.2.
+    if (pOptions->countersEnabled && supportPerformanceQueryExtension && vulkan12IsCore)
+    {
+        performanceQueryFeatures.pNext = optionalFeatures;
+        hostQueryResetFeatures.pNext = &performanceQueryFeatures;
+        optionalFeatures = &hostQueryResetFeatures;
+    }
+
     VkPhysicalDeviceBufferDeviceAddressFeatures deviceBufferAddresFeatures = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
-        .pNext = NULL
+        .pNext = optionalFeatures
     };
 
     // physical device feature 2
@@ -339,12 +1306,13 @@ static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemo
     };
 
     // Query all above features
-    vkGetPhysicalDeviceFeatures2(physicalDevices[deviceIndex], &features2);
+    vkGetPhysicalDeviceFeatures2(pCandidate->physicalDevice, &features2);
 
+    // test.comp.glsl compares buffer references as 64-bit integers
     if (features2.features.shaderInt64 == VK_FALSE)
     {
-        puts("ShaderInt64 feature is not enabled by default...");
-        features2.features.shaderInt64 = VK_TRUE;
+        fprintf(stderr, "The current device does not support the shaderInt64 feature! The demo cannot be run...\n");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
     }
     if (deviceBufferAddresFeatures.bufferDeviceAddress != VK_FALSE) {
         puts("Support bufferDeviceAddress!");
@@ -360,11 +1328,41 @@ static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemo
     if (deviceBufferAddresFeatures.bufferDeviceAddressMultiDevice != VK_FALSE) {
         puts("Support bufferDeviceAddressMultiDevice!");
     }
+    const bool enableSynchronization2 = synchronization2Features.synchronization2 != VK_FALSE;
+    if (enableSynchronization2) {
+        puts("Support synchronization2!");
+    }
+    const bool enableTimelineSemaphore = timelineSemaphoreFeatures.timelineSemaphore != VK_FALSE;
+    if (enableTimelineSemaphore) {
+        puts("Support timelineSemaphore!");
+    }
+    const bool enablePerformanceQuery = performanceQueryFeatures.performanceCounterQueryPools != VK_FALSE;
+    if (enablePerformanceQuery) {
+        puts("Support performanceCounterQueryPools!");
+    }
+    pContext->supportPipelineStatistics = pOptions->countersEnabled && features2.features.pipelineStatisticsQuery != VK_FALSE;
+    // All queried features are enabled, sparseBinding and sparseResidencyBuffer included. Without residency, a sparse buffer
+    // must be fully bound before the device accesses it, which defeats committing memory on demand.
+    pContext->supportSparseResidencyBuffer = features2.features.sparseBinding != VK_FALSE && features2.features.sparseResidencyBuffer != VK_FALSE &&
+        (pCandidate->queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) != 0;
+    if (pContext->supportSparseResidencyBuffer) {
+        puts("Support sparseResidencyBuffer!");
+    }
+    // Loading and storing narrow types from buffers needs the storage features besides the arithmetic ones
+    pContext->supportInt8 = float16Int8Features.shaderInt8 != VK_FALSE && storage8BitFeatures.storageBuffer8BitAccess != VK_FALSE;
+    pContext->supportFloat16 = float16Int8Features.shaderFloat16 != VK_FALSE && storage16BitFeatures.storageBuffer16BitAccess != VK_FALSE;
+    pContext->supportFloat64 = features2.features.shaderFloat64 != VK_FALSE;
+    printf("Element types: int8 %s, fp16 %s, fp64 %s\n", pContext->supportInt8 ? "supported" : "not supported",
+        pContext->supportFloat16 ? "supported" : "not supported", pContext->supportFloat64 ? "supported" : "not supported");
 
     // ==== Query the current selected device properties corresponding the above features ====
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT externalMemoryHostProps = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+        .pNext = NULL
+    };
     VkPhysicalDeviceDriverProperties driverProps = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DRIVER_PROPERTIES,
-        .pNext = NULL
+        .pNext = supportExternalMemoryHostExtension ? &externalMemoryHostProps : NULL
     };
 
     VkPhysicalDeviceProperties2 properties2 = {
@@ -374,50 +1372,68 @@ static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemo
     };
 
     // Query all above properties
-    vkGetPhysicalDeviceProperties2(physicalDevices[deviceIndex], &properties2);
+    vkGetPhysicalDeviceProperties2(pCandidate->physicalDevice, &properties2);
 
     printf("Detail driver info: %s %s\n", driverProps.driverName, driverProps.driverInfo);
     printf("Current device max workgroup size: %u\n", properties2.properties.limits.maxComputeWorkGroupInvocations);
 
     // Get device memory properties
-    vkGetPhysicalDeviceMemoryProperties(physicalDevices[deviceIndex], pMemoryProperties);
-
-    const float queue_priorities[1] = { 0.0f };
-    VkDeviceQueueCreateInfo queue_info = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .pNext = NULL,
-        .queueCount = 1,
-        .pQueuePriorities = queue_priorities
-    };
-
-    uint32_t queueFamilyPropertyCount = 0;
-    VkQueueFamilyProperties queueFamilyProperties[MAX_QUEUE_FAMILY_PROPERTY_COUNT];
+    vkGetPhysicalDeviceMemoryProperties(pCandidate->physicalDevice, &pContext->memoryProperties);
 
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[deviceIndex], &queueFamilyPropertyCount, NULL);
-    if (queueFamilyPropertyCount > MAX_QUEUE_FAMILY_PROPERTY_COUNT) {
-        queueFamilyPropertyCount = MAX_QUEUE_FAMILY_PROPERTY_COUNT;
+    // Create all queues of the selected family unless fewer are requested
+    uint32_t queueCount = min(pCandidate->queueCount, (uint32_t)MAX_COMPUTE_QUEUE_COUNT);
+    if (pOptions->queueCount != 0 && pOptions->queueCount < queueCount) {
+        queueCount = pOptions->queueCount;
     }
 
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[deviceIndex], &queueFamilyPropertyCount, queueFamilyProperties);
-
-    bool found = false;
-    for (uint32_t i = 0; i < queueFamilyPropertyCount; i++)
+    float queue_priorities[MAX_COMPUTE_QUEUE_COUNT];
+    for (uint32_t i = 0; i < queueCount; i++)
     {
-        if ((queueFamilyProperties[i].queueFlags & queueFlag) != 0)
-        {
-            queue_info.queueFamilyIndex = i;
-            found = true;
-            break;
+        if (pOptions->queuePriorityCount == 0) {
+            queue_priorities[i] = 0.0f;
+        }
+        else {
+            queue_priorities[i] = pOptions->queuePriorities[min(i, pOptions->queuePriorityCount - 1)];
         }
     }
 
-    s_specQueueFamilyIndex = queue_info.queueFamilyIndex;
+    VkDeviceQueueCreateInfo queue_info = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .pNext = NULL,
+        .queueFamilyIndex = pCandidate->queueFamilyIndex,
+        .queueCount = queueCount,
+        .pQueuePriorities = queue_priorities
+    };
+
+    pContext->queueFamilyIndex = queue_info.queueFamilyIndex;
+    printf("Create %u queue(s) of queue family %u\n", queueCount, pContext->queueFamilyIndex);
 
     uint32_t extCount = 0;
-    const char* extensionNames[1] = { NULL };
+    const char* extensionNames[8] = { NULL };
     if (supportBufferDeviceAddress) {
         extensionNames[extCount++] = VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME;
     }
+    if (enableSynchronization2 && !synchronization2IsCore) {
+        extensionNames[extCount++] = VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME;
+    }
+    if (supportFloat16Int8Extension && !vulkan12IsCore) {
+        extensionNames[extCount++] = VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME;
+    }
+    if (support8BitStorageExtension && !vulkan12IsCore) {
+        extensionNames[extCount++] = VK_KHR_8BIT_STORAGE_EXTENSION_NAME;
+    }
+    if (support16BitStorageExtension && !vulkan11IsCore) {
+        extensionNames[extCount++] = VK_KHR_16BIT_STORAGE_EXTENSION_NAME;
+    }
+    if (supportExternalMemoryHostExtension) {
+        extensionNames[extCount++] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+    }
+    if (enableTimelineSemaphore && !vulkan12IsCore) {
+        extensionNames[extCount++] = VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME;
+    }
+    if (enablePerformanceQuery) {
+        extensionNames[extCount++] = VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME;
+    }
 
     // There are two ways to enable features:
     // (1) Set pNext to a VkPhysicalDeviceFeatures2 structure and set pEnabledFeatures to NULL;
@@ -435,41 +1451,328 @@ static VkResult InitializeDevice(VkQueueFlagBits queueFlag, VkPhysicalDeviceMemo
         .pEnabledFeatures = NULL
     };
 
-    res = vkCreateDevice(physicalDevices[deviceIndex], &device_info, NULL, &s_specDevice);
-    if (res != VK_SUCCESS) {
+    res = vkCreateDevice(pCandidate->physicalDevice, &device_info, NULL, &pContext->device);
+    if (res != VK_SUCCESS)
+    {
         fprintf(stderr, "vkCreateDevice failed: %d\n", res);
+        return res;
+    }
+
+    for (uint32_t i = 0; i < queueCount; i++) {
+        vkGetDeviceQueue(pContext->device, pContext->queueFamilyIndex, i, &pContext->queues[i]);
+    }
+    pContext->queueCount = queueCount;
+
+    if (enableSynchronization2)
+    {
+        pContext->cmdPipelineBarrier2 = (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(pContext->device,
+            synchronization2IsCore ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier2KHR");
+    }
+    if (enableTimelineSemaphore)
+    {
+        pContext->getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(pContext->device,
+            vulkan12IsCore ? "vkGetSemaphoreCounterValue" : "vkGetSemaphoreCounterValueKHR");
+        pContext->waitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(pContext->device,
+            vulkan12IsCore ? "vkWaitSemaphores" : "vkWaitSemaphoresKHR");
+    }
+    // Opaque capture addresses only exist in VK_KHR_buffer_device_address and Vulkan 1.2, not in VK_EXT_buffer_device_address
+    if (deviceBufferAddresFeatures.bufferDeviceAddressCaptureReplay != VK_FALSE && (vulkan12IsCore || supportBufferDeviceAddress))
+    {
+        pContext->getBufferOpaqueCaptureAddress = (PFN_vkGetBufferOpaqueCaptureAddressKHR)vkGetDeviceProcAddr(pContext->device,
+            vulkan12IsCore ? "vkGetBufferOpaqueCaptureAddress" : "vkGetBufferOpaqueCaptureAddressKHR");
+        pContext->getDeviceMemoryOpaqueCaptureAddress = (PFN_vkGetDeviceMemoryOpaqueCaptureAddressKHR)vkGetDeviceProcAddr(pContext->device,
+            vulkan12IsCore ? "vkGetDeviceMemoryOpaqueCaptureAddress" : "vkGetDeviceMemoryOpaqueCaptureAddressKHR");
+    }
+    if (supportExternalMemoryHostExtension)
+    {
+        pContext->getMemoryHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(pContext->device,
+            "vkGetMemoryHostPointerPropertiesEXT");
+        pContext->minImportedHostPointerAlignment = externalMemoryHostProps.minImportedHostPointerAlignment;
+    }
+    if (enablePerformanceQuery && hostQueryResetFeatures.hostQueryReset != VK_FALSE)
+    {
+        pContext->resetQueryPool = (PFN_vkResetQueryPool)vkGetDeviceProcAddr(pContext->device, "vkResetQueryPool");
+        if (pContext->resetQueryPool != NULL) {
+            SetUpPerformanceCounters(pContext);
+        }
+    }
+
+    res = InitializeCommandPools(pContext->queueFamilyIndex, pContext->device, pContext->commandPools, queueCount);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "InitializeCommandPools failed!\n");
     }
 
     return res;
 }
 
-static VkResult InitializeCommandBuffer(uint32_t queueFamilyIndex, VkDevice device, VkCommandPool* pCommandPool,
-    VkCommandBuffer commandBuffers[], uint32_t commandBufferCount)
+static void DestroyDeviceContext(struct DeviceContext* pContext)
 {
-    const VkCommandPoolCreateInfo cmd_pool_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .queueFamilyIndex = queueFamilyIndex
-    };
+    if (pContext->device != VK_NULL_HANDLE)
+    {
+        for (uint32_t i = 0; i < EMBEDDED_SHADER_COUNT; i++)
+        {
+            if (pContext->shaderModules[i] != VK_NULL_HANDLE) {
+                vkDestroyShaderModule(pContext->device, pContext->shaderModules[i], NULL);
+            }
+        }
+        for (uint32_t i = 0; i < pContext->queueCount; i++)
+        {
+            if (pContext->commandPools[i] != VK_NULL_HANDLE) {
+                vkDestroyCommandPool(pContext->device, pContext->commandPools[i], NULL);
+            }
+        }
+        if (pContext->releaseProfilingLock != NULL) {
+            pContext->releaseProfilingLock(pContext->device);
+        }
+        vkDestroyDevice(pContext->device, NULL);
+    }
+    memset(pContext, 0, sizeof(*pContext));
+}
+
+static VkResult InitializeDevice(VkQueueFlagBits queueFlag, const struct ProgramOptions* pOptions)
+{
+    VkPhysicalDevice physicalDevices[MAX_GPU_COUNT] = { VK_NULL_HANDLE };
+    uint32_t gpu_count = 0;
+    VkResult res = vkEnumeratePhysicalDevices(s_instance, &gpu_count, NULL);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkEnumeratePhysicalDevices failed: %d\n", res);
+        return res;
+    }
+
+    if (gpu_count > MAX_GPU_COUNT) {
+        gpu_count = MAX_GPU_COUNT;
+    }
+
+    res = vkEnumeratePhysicalDevices(s_instance, &gpu_count, physicalDevices);
+    if (res != VK_SUCCESS && res != VK_INCOMPLETE)
+    {
+        fprintf(stderr, "vkEnumeratePhysicalDevices failed: %d\n", res);
+        return res;
+    }
+
+    const bool isSingle = gpu_count == 1;
+    printf("This application has detected there %s %u Vulkan capable device%s installed: \n",
+        isSingle ? "is" : "are",
+        gpu_count,
+        isSingle ? "" : "s");
+
+    struct PhysicalDeviceCandidate candidates[MAX_GPU_COUNT];
+    for (uint32_t i = 0; i < gpu_count; i++)
+    {
+        EvaluatePhysicalDevice(physicalDevices[i], queueFlag, &candidates[i]);
+
+        const VkPhysicalDeviceProperties* props = &candidates[i].properties;
+        printf("\n======== Device %u info ========\n", i);
+        printf("Device name: %s\n", props->deviceName);
+        printf("Device type: %s\n", s_deviceTypes[props->deviceType]);
+        printf("Vulkan API version: %u.%u.%u\n", VK_VERSION_MAJOR(props->apiVersion), VK_VERSION_MINOR(props->apiVersion), VK_VERSION_PATCH(props->apiVersion));
+        printf("Driver version: %08X\n", props->driverVersion);
+        printf("Device local memory: %lluMB\n", (unsigned long long)(candidates[i].deviceLocalHeapSize / (1024 * 1024)));
+        printf("Queue family: %u with %u queue(s)%s\n", candidates[i].queueFamilyIndex, candidates[i].queueCount,
+            candidates[i].hasDedicatedComputeFamily ? " (dedicated compute)" : "");
+        if (candidates[i].score != 0) {
+            printf("Selection score: %016llX\n", (unsigned long long)candidates[i].score);
+        }
+        else {
+            puts(candidates[i].supportBufferDeviceAddress ? "Not eligible: no suitable queue family" : "Not eligible: bufferDeviceAddress is not supported");
+        }
+    }
+
+    if (pOptions->multiDevice)
+    {
+        // Every eligible device gets `logicalDevicesPerGpu` logical devices; this also allows testing
+        // the multi-device paths with several logical devices on a single software ICD
+        const uint32_t logicalDevicesPerGpu = pOptions->logicalDevicesPerGpu == 0 ? 1 : pOptions->logicalDevicesPerGpu;
+        for (uint32_t i = 0; i < gpu_count; i++)
+        {
+            if (candidates[i].score == 0) {
+                continue;
+            }
+            for (uint32_t n = 0; n < logicalDevicesPerGpu && s_deviceContextCount < MAX_DEVICE_CONTEXT_COUNT; n++)
+            {
+                printf("\nCreate logical device %u on device[%u] (%s)...\n", s_deviceContextCount, i, candidates[i].properties.deviceName);
+                res = CreateDeviceContext(&candidates[i], pOptions, &s_deviceContexts[s_deviceContextCount]);
+                if (res != VK_SUCCESS)
+                {
+                    DestroyDeviceContext(&s_deviceContexts[s_deviceContextCount]);
+                    return res;
+                }
+                s_deviceContextCount++;
+            }
+        }
+
+        if (s_deviceContextCount == 0)
+        {
+            fprintf(stderr, "There's no eligible device to run this demo!\n");
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+        return VK_SUCCESS;
+    }
+
+    // The command line selector takes precedence over the environment variable
+    const char* deviceSelector = pOptions->deviceSelector;
+    char envSelector[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+    if ((deviceSelector == NULL || deviceSelector[0] == '\0') && GetEnvironmentString(DEVICE_SELECTOR_ENV_NAME, envSelector, sizeof(envSelector)))
+    {
+        deviceSelector = envSelector;
+        printf("\nUsing device selector from %s: %s\n", DEVICE_SELECTOR_ENV_NAME, deviceSelector);
+    }
+
+    const uint32_t deviceIndex = SelectPhysicalDevice(candidates, gpu_count, deviceSelector);
+    if (deviceIndex == UINT32_MAX)
+    {
+        fprintf(stderr, "There's no eligible device to run this demo!\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    printf("\nDevice[%u] (%s) is selected...\n", deviceIndex, candidates[deviceIndex].properties.deviceName);
 
-    VkResult res = vkCreateCommandPool(device, &cmd_pool_info, NULL, pCommandPool);
+    res = CreateDeviceContext(&candidates[deviceIndex], pOptions, &s_deviceContexts[0]);
     if (res != VK_SUCCESS)
     {
-        fprintf(stderr, "vkCreateCommandPool failed: %d\n", res);
+        DestroyDeviceContext(&s_deviceContexts[0]);
         return res;
     }
+    s_deviceContextCount = 1;
+
+    return res;
+}
 
+
+static VkResult AllocateCommandBuffers(VkDevice device, VkCommandPool commandPool, VkCommandBufferLevel level, VkCommandBuffer commandBuffers[],
+    uint32_t commandBufferCount)
+{
     // Create the command buffer from the command pool
     const VkCommandBufferAllocateInfo cmdInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .pNext = NULL,
-        .commandPool = *pCommandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandPool = commandPool,
+        .level = level,
         .commandBufferCount = commandBufferCount
     };
 
-    res = vkAllocateCommandBuffers(device, &cmdInfo, commandBuffers);
+    return vkAllocateCommandBuffers(device, &cmdInfo, commandBuffers);
+}
+
+static void InitializeSourceData(int* srcMem, int elemCount, int firstElement)
+{
+    for (int i = 0; i < elemCount; i++) {
+        srcMem[i] = firstElement + i;
+    }
+}
+
+// The test kernel doubles the source and stores the element count in the first element
+// `totalElemCount` is the element count of the whole array if the output is a chunk of it, starting at `firstElement`, and 0 otherwise
+static bool VerifyTestKernelOutput(const int* dstMem, uint32_t elemCount, int firstElement, uint32_t totalElemCount)
+{
+    // Only the first element of the whole array holds its element count
+    const bool hasHeader = totalElemCount == 0 || firstElement == 0;
+    const uint32_t headerValue = totalElemCount == 0 ? elemCount : totalElemCount;
+    bool passed = true;
+    for (int i = hasHeader ? 1 : 0; i < (int)elemCount; i++)
+    {
+        if (dstMem[i] != (firstElement + i) * 2)
+        {
+            fprintf(stderr, "Result error @ %d, result is: %d\n", firstElement + i, dstMem[i]);
+            passed = false;
+            break;
+        }
+    }
+    if (hasHeader && dstMem[0] != (int)headerValue)
+    {
+        fprintf(stderr, "total_data_elem_count (%d) is not the same as elemCount (%u)!\n", dstMem[0], headerValue);
+        passed = false;
+    }
+    return passed;
+}
+
+static VkDeviceAddress GetBufferDeviceAddress(VkDevice device, VkBuffer buffer)
+{
+    const VkBufferDeviceAddressInfo addressInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .pNext = NULL,
+        .buffer = buffer
+    };
+    if (s_vkGetBufferDeviceAddressEXT != NULL) {
+        return s_vkGetBufferDeviceAddressEXT(device, &addressInfo);
+    }
+    return vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
+// Returns UINT32_MAX if no memory type allowed by `memoryTypeBits` has all of `propertyFlags` and a large enough heap
+static uint32_t FindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* pMemoryProperties, uint32_t memoryTypeBits,
+    VkMemoryPropertyFlags propertyFlags, VkDeviceSize size)
+{
+    for (uint32_t memoryTypeIndex = 0; memoryTypeIndex < pMemoryProperties->memoryTypeCount; memoryTypeIndex++)
+    {
+        if ((memoryTypeBits & (1U << memoryTypeIndex)) == 0U) {
+            continue;
+        }
+        const VkMemoryType memoryType = pMemoryProperties->memoryTypes[memoryTypeIndex];
+        if ((memoryType.propertyFlags & propertyFlags) == propertyFlags && pMemoryProperties->memoryHeaps[memoryType.heapIndex].size >= size) {
+            return memoryTypeIndex;
+        }
+    }
+    return UINT32_MAX;
+}
+
+// Creates a buffer with a dedicated allocation. Memory of buffers with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+// is allocated with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT.
+static VkResult CreateBufferWithMemory(const struct DeviceContext* deviceContext, VkDeviceSize size, VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags memoryFlags, VkBuffer* pBuffer, VkDeviceMemory* pMemory)
+{
+    const VkDevice device = deviceContext->device;
+    const VkBufferCreateInfo bufCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &deviceContext->queueFamilyIndex
+    };
+
+    VkResult res = vkCreateBuffer(device, &bufCreateInfo, NULL, pBuffer);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateBuffer failed: %d\n", res);
+        return res;
+    }
+
+    VkMemoryRequirements memRequirements = { 0 };
+    vkGetBufferMemoryRequirements(device, *pBuffer, &memRequirements);
+    const uint32_t memoryTypeIndex = FindMemoryTypeIndex(&deviceContext->memoryProperties, memRequirements.memoryTypeBits, memoryFlags, memRequirements.size);
+    if (memoryTypeIndex == UINT32_MAX)
+    {
+        fprintf(stderr, "No memory type with flags 0x%x for %zu bytes!\n", (unsigned)memoryFlags, (size_t)memRequirements.size);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    const VkMemoryAllocateFlagsInfo memAllocFlagsInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+        .pNext = NULL,
+        .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+    };
+    const VkMemoryAllocateInfo memAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0 ? &memAllocFlagsInfo : NULL,
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+    res = vkAllocateMemory(device, &memAllocInfo, NULL, pMemory);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkAllocateMemory failed: %d\n", res);
+        return res;
+    }
+    CountDeviceAllocation(memAllocInfo.allocationSize);
+
+    res = vkBindBufferMemory(device, *pBuffer, *pMemory, 0);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkBindBufferMemory failed: %d\n", res);
+    }
+
     return res;
 }
 
@@ -481,7 +1784,7 @@ static VkResult InitializeCommandBuffer(uint32_t queueFamilyIndex, VkDevice devi
 // deviceBuffers[2] as src device buffer;
 // deviceBuffers[3] as address storage device buffer;
 static VkResult AllocateMemoryAndBuffers(VkDevice device, const VkPhysicalDeviceMemoryProperties* pMemoryProperties, VkDeviceMemory deviceMemories[3],
-    VkBuffer deviceBuffers[4], VkDeviceSize bufferSize, uint32_t queueFamilyIndex)
+    VkBuffer deviceBuffers[4], VkDeviceSize bufferSize, uint32_t firstElement, uint32_t queueFamilyIndex)
 {
     const VkDeviceSize hostBufferSize = bufferSize + ADDITIONAL_ADDRESS_BUFFER_SIZE;
 
@@ -537,6 +1840,7 @@ static VkResult AllocateMemoryAndBuffers(VkDevice device, const VkPhysicalDevice
         fprintf(stderr, "vkAllocateMemory for deviceMemories[0] failed: %d\n", res);
         return res;
     }
+    CountDeviceAllocation(hostMemAllocInfo.allocationSize);
 
     res = vkBindBufferMemory(device, deviceBuffers[0], deviceMemories[0], 0);
     if (res != VK_SUCCESS)
@@ -613,6 +1917,7 @@ static VkResult AllocateMemoryAndBuffers(VkDevice device, const VkPhysicalDevice
         fprintf(stderr, "vkAllocateMemory for deviceMemories[1] failed: %d\n", res);
         return res;
     }
+    CountDeviceAllocation(deviceMemAllocInfo.allocationSize);
 
     res = vkBindBufferMemory(device, deviceBuffers[1], deviceMemories[1], 0);
     if (res != VK_SUCCESS)
@@ -672,6 +1977,7 @@ static VkResult AllocateMemoryAndBuffers(VkDevice device, const VkPhysicalDevice
         fprintf(stderr, "vkAllocateMemory for deviceMemories[2] failed: %d\n", res);
         return res;
     }
+    CountDeviceAllocation(deviceMemAllocInfo.allocationSize);
 
     res = vkBindBufferMemory(device, deviceBuffers[3], deviceMemories[2], 0);
     if (res != VK_SUCCESS)
@@ -689,38 +1995,22 @@ static VkResult AllocateMemoryAndBuffers(VkDevice device, const VkPhysicalDevice
         fprintf(stderr, "vkMapMemory failed: %d\n", res);
         return res;
     }
+    AddHostCounter(HOST_COUNTER_MAP_CALLS, 1);
 
     // Initialize the host buffer for buffer data
-    int* srcMem = hostBuffer;
-    for (int i = 0; i < elemCount; i++) {
-        srcMem[i] = i;
-    }
+    InitializeSourceData(hostBuffer, elemCount, (int)firstElement);
 
     // Initialize the host buffer for addresses
     VkDeviceAddress* addrMem = (VkDeviceAddress*)((uint8_t*)hostBuffer + bufferSize);
     memset(addrMem, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
 
     // Store dst device buffer address
-    VkBufferDeviceAddressInfo addressInfo = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-        .pNext = NULL,
-        .buffer = deviceBuffers[1]
-    };
-    if (s_vkGetBufferDeviceAddressEXT != NULL) {
-        addrMem[0] = s_vkGetBufferDeviceAddressEXT(device, &addressInfo);
-    }
-    else {
-        addrMem[0] = vkGetBufferDeviceAddress(device, &addressInfo);
-    }
+    addrMem[0] = GetBufferDeviceAddress(device, deviceBuffers[1]);
 
     // Store src device buffer address
-    addressInfo.buffer = deviceBuffers[2];
-    if (s_vkGetBufferDeviceAddressEXT != NULL) {
-        addrMem[1] = s_vkGetBufferDeviceAddressEXT(device, &addressInfo);
-    }
-    else {
-        addrMem[1] = vkGetBufferDeviceAddress(device, &addressInfo);
-    }
+    addrMem[1] = GetBufferDeviceAddress(device, deviceBuffers[2]);
+
+    // Slot 2 stays null, which the kernel checks
 
     vkUnmapMemory(device, deviceMemories[0]);
 
@@ -794,42 +2084,349 @@ static void SyncAndReadBuffer(VkCommandBuffer commandBuffer, uint32_t queueFamil
     vkCmdCopyBuffer(commandBuffer, srcDeviceBuffer, dstHostBuffer, 1, &copyRegion);
 }
 
-static VkResult CreateShaderModule(VkDevice device, const char* fileName, VkShaderModule* pShaderModule)
+// SPIR-V compiled by shaders/glsl_builder.bat (shaders/glsl_builder.sh outside Visual Studio) before the build, embedded as uint32_t arrays
+#include "shaders/test.spv.h"
+#include "shaders/reduce_step.spv.h"
+#include "shaders/device_heap_filter.spv.h"
+#include "shaders/persistent_queue.spv.h"
+#include "shaders/typed_double_int8.spv.h"
+#include "shaders/typed_double_fp16.spv.h"
+#include "shaders/typed_double_int32.spv.h"
+#include "shaders/typed_double_fp32.spv.h"
+#include "shaders/typed_double_int64.spv.h"
+#include "shaders/typed_double_fp64.spv.h"
+#include "shaders/access_pattern_bda_reload.spv.h"
+#include "shaders/access_pattern_bda_hoisted.spv.h"
+#include "shaders/access_pattern_descriptor_array.spv.h"
+#include "shaders/access_pattern_fixed_bindings.spv.h"
+#include "shaders/gather_scatter_gather.spv.h"
+#include "shaders/gather_scatter_scatter_add.spv.h"
+#include "shaders/gather_scatter_scatter_min.spv.h"
+#include "shaders/gather_scatter_scatter_max.spv.h"
+#include "shaders/decode_blocks.spv.h"
+
+struct EmbeddedShader
 {
-    FILE* fp = OpenFileWithRead(fileName);
-    if (fp == NULL)
-    {
-        fprintf(stderr, "Shader file %s not found!\n", fileName);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-    fseek(fp, 0, SEEK_END);
-    size_t fileLen = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    const char* name;
+    // NULL for shaders compiled only once
+    const char* variant;
+    // For runtime compilation, the GLSL source in the GLSL directory and the macro that selects the variant (or NULL)
+    const char* sourceFileName;
+    const char* define;
+    const uint32_t* code;
+    size_t codeSize;
+};
 
-    uint32_t* codeBuffer = malloc(fileLen);
-    if (codeBuffer != NULL) {
-        fread(codeBuffer, 1, fileLen, fp);
-    }
-    fclose(fp);
+static const struct EmbeddedShader s_embeddedShaders[EMBEDDED_SHADER_COUNT] = {
+    { "test", NULL, "test.comp.glsl", NULL, test_spv, sizeof(test_spv) },
+    { "reduce_step", NULL, "reduce_step.comp.glsl", NULL, reduce_step_spv, sizeof(reduce_step_spv) },
+    { "device_heap_filter", NULL, "device_heap_filter.comp.glsl", NULL, device_heap_filter_spv, sizeof(device_heap_filter_spv) },
+    { "persistent_queue", NULL, "persistent_queue.comp.glsl", NULL, persistent_queue_spv, sizeof(persistent_queue_spv) },
+    { "typed_double", "int8", "typed_double.comp.glsl", "ELEMENT_TYPE_INT8", typed_double_int8_spv, sizeof(typed_double_int8_spv) },
+    { "typed_double", "fp16", "typed_double.comp.glsl", "ELEMENT_TYPE_FP16", typed_double_fp16_spv, sizeof(typed_double_fp16_spv) },
+    { "typed_double", "int32", "typed_double.comp.glsl", "ELEMENT_TYPE_INT32", typed_double_int32_spv, sizeof(typed_double_int32_spv) },
+    { "typed_double", "fp32", "typed_double.comp.glsl", "ELEMENT_TYPE_FP32", typed_double_fp32_spv, sizeof(typed_double_fp32_spv) },
+    { "typed_double", "int64", "typed_double.comp.glsl", "ELEMENT_TYPE_INT64", typed_double_int64_spv, sizeof(typed_double_int64_spv) },
+    { "typed_double", "fp64", "typed_double.comp.glsl", "ELEMENT_TYPE_FP64", typed_double_fp64_spv, sizeof(typed_double_fp64_spv) },
+    { "access_pattern", "bda_reload", "access_pattern.comp.glsl", "ACCESS_BDA_RELOAD", access_pattern_bda_reload_spv, sizeof(access_pattern_bda_reload_spv) },
+    { "access_pattern", "bda_hoisted", "access_pattern.comp.glsl", "ACCESS_BDA_HOISTED", access_pattern_bda_hoisted_spv, sizeof(access_pattern_bda_hoisted_spv) },
+    { "access_pattern", "descriptor_array", "access_pattern.comp.glsl", "ACCESS_DESCRIPTOR_ARRAY", access_pattern_descriptor_array_spv,
+        sizeof(access_pattern_descriptor_array_spv) },
+    { "access_pattern", "fixed_bindings", "access_pattern.comp.glsl", "ACCESS_FIXED_BINDINGS", access_pattern_fixed_bindings_spv,
+        sizeof(access_pattern_fixed_bindings_spv) },
+    { "gather_scatter", "gather", "gather_scatter.comp.glsl", "GATHER_SCATTER_GATHER", gather_scatter_gather_spv, sizeof(gather_scatter_gather_spv) },
+    { "gather_scatter", "scatter_add", "gather_scatter.comp.glsl", "GATHER_SCATTER_ADD", gather_scatter_scatter_add_spv,
+        sizeof(gather_scatter_scatter_add_spv) },
+    { "gather_scatter", "scatter_min", "gather_scatter.comp.glsl", "GATHER_SCATTER_MIN", gather_scatter_scatter_min_spv,
+        sizeof(gather_scatter_scatter_min_spv) },
+    { "gather_scatter", "scatter_max", "gather_scatter.comp.glsl", "GATHER_SCATTER_MAX", gather_scatter_scatter_max_spv,
+        sizeof(gather_scatter_scatter_max_spv) },
+    { "decode_blocks", NULL, "decode_blocks.comp.glsl", NULL, decode_blocks_spv, sizeof(decode_blocks_spv) }
+};
 
+static VkResult CreateShaderModuleFromCode(VkDevice device, const uint32_t* code, size_t codeSize, VkShaderModule* pShaderModule)
+{
     const VkShaderModuleCreateInfo moduleCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .codeSize = fileLen,
-        .pCode = codeBuffer
+        .codeSize = codeSize,
+        .pCode = code
     };
 
     VkResult res = vkCreateShaderModule(device, &moduleCreateInfo, NULL, pShaderModule);
     if (res != VK_SUCCESS) {
         fprintf(stderr, "vkCreateShaderModule failed: %d\n", res);
     }
+    return res;
+}
+
+// Reads the whole file into a malloc'ed buffer that the caller frees
+static bool ReadWholeFile(const char* filePath, void** ppData, size_t* pSize)
+{
+    FILE* fp = OpenFileWithRead(filePath);
+    if (fp == NULL) {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    const long fileLen = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    void* data = fileLen > 0 ? malloc((size_t)fileLen) : NULL;
+    const bool loaded = data != NULL && fread(data, 1, (size_t)fileLen, fp) == (size_t)fileLen;
+    fclose(fp);
+
+    if (!loaded)
+    {
+        free(data);
+        return false;
+    }
+    *ppData = data;
+    *pSize = (size_t)fileLen;
+    return true;
+}
+
+static inline bool IsSpirvCode(const uint32_t* code, size_t codeSize)
+{
+    return codeSize >= SPIRV_HEADER_SIZE && codeSize % sizeof(uint32_t) == 0 && code[0] == SPIRV_MAGIC_NUMBER;
+}
+
+// Only used with a shader override directory
+static VkResult CreateShaderModuleFromFile(VkDevice device, const char* fileName, VkShaderModule* pShaderModule)
+{
+    uint32_t* code = NULL;
+    size_t codeSize = 0;
+    if (!ReadWholeFile(fileName, (void**)&code, &codeSize))
+    {
+        fprintf(stderr, "Shader file %s not found!\n", fileName);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    VkResult res = VK_ERROR_INITIALIZATION_FAILED;
+    if (IsSpirvCode(code, codeSize)) {
+        res = CreateShaderModuleFromCode(device, code, codeSize, pShaderModule);
+    }
+    else {
+        fprintf(stderr, "Shader file %s is not valid SPIR-V!\n", fileName);
+    }
 
-    free(codeBuffer);
+    free(code);
 
     return res;
 }
 
+// FNV-1a over the source, the compile options and the define, i.e. everything that changes the compiled SPIR-V
+static uint64_t HashShaderSource(const char* source, size_t sourceSize, const char* define)
+{
+    const char* const parts[] = { source, SHADER_COMPILE_OPTIONS, define != NULL ? define : "" };
+    const size_t partSizes[] = { sourceSize, sizeof(SHADER_COMPILE_OPTIONS), define != NULL ? strlen(define) + 1 : 1 };
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+    {
+        for (size_t j = 0; j < partSizes[i]; j++)
+        {
+            hash ^= (uint8_t)parts[i][j];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+#ifdef VVB_USE_SHADERC
+
+// Created in main() when runtime compilation is enabled; compilations may run concurrently on it
+static shaderc_compiler_t s_shaderCompiler = NULL;
+
+// Mirrors the glslangValidator command line in shaders/glsl_builder.bat
+static bool CompileGlslToSpirv(const char* sourcePath, const char* source, size_t sourceSize, const char* define, uint32_t** ppCode, size_t* pCodeSize)
+{
+    shaderc_compile_options_t options = shaderc_compile_options_initialize();
+    if (s_shaderCompiler == NULL || options == NULL)
+    {
+        fprintf(stderr, "shaderc is not initialized!\n");
+        shaderc_compile_options_release(options);
+        return false;
+    }
+    shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_1);
+    shaderc_compile_options_set_target_spirv(options, shaderc_spirv_version_1_3);
+    shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_size);
+    if (define != NULL) {
+        shaderc_compile_options_add_macro_definition(options, define, strlen(define), "1", 1);
+    }
+
+    shaderc_compilation_result_t result = shaderc_compile_into_spv(s_shaderCompiler, source, sourceSize, shaderc_compute_shader, sourcePath, "main", options);
+    bool compiled = false;
+    if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success) {
+        fprintf(stderr, "Compiling %s failed:\n%s\n", sourcePath, shaderc_result_get_error_message(result));
+    }
+    else
+    {
+        const size_t codeSize = shaderc_result_get_length(result);
+        uint32_t* code = malloc(codeSize);
+        if (code != NULL)
+        {
+            memcpy(code, shaderc_result_get_bytes(result), codeSize);
+            *ppCode = code;
+            *pCodeSize = codeSize;
+            compiled = true;
+        }
+    }
+
+    shaderc_result_release(result);
+    shaderc_compile_options_release(options);
+
+    return compiled;
+}
+
+#endif // VVB_USE_SHADERC
+
+// Writes through a temporary file, so that readers never see a partially written cache entry
+static void WriteShaderCache(const char* cachePath, const uint32_t* code, size_t codeSize)
+{
+    char tempPath[MAX_SHADER_PATH_LENGTH];
+    snprintf(tempPath, sizeof(tempPath), "%s.%llx.tmp", cachePath, (unsigned long long)GetCurrentTimeNanoseconds());
+
+    FILE* fp = OpenFileWithWrite(tempPath);
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Failed to create shader cache file %s!\n", tempPath);
+        return;
+    }
+    const bool written = fwrite(code, 1, codeSize, fp) == codeSize;
+    fclose(fp);
+
+    // Another thread may have stored the same entry in the meantime
+    if (!written || rename(tempPath, cachePath) != 0) {
+        remove(tempPath);
+    }
+}
+
+// Compiles the GLSL source of `shader` from the GLSL directory, unless the shader cache already holds the SPIR-V of the same
+// source and options. Returns the malloc'ed SPIR-V. With `bypassCache`, the shader is always compiled and the cache entry rewritten.
+static bool LoadOrCompileShader(const struct EmbeddedShader* shader, bool bypassCache, uint32_t** ppCode, size_t* pCodeSize, bool* pCacheHit)
+{
+    char path[MAX_SHADER_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", s_options.glslDirectory, shader->sourceFileName);
+
+    char* source = NULL;
+    size_t sourceSize = 0;
+    if (!ReadWholeFile(path, (void**)&source, &sourceSize))
+    {
+        fprintf(stderr, "Shader source %s not found!\n", path);
+        return false;
+    }
+
+    char cachePath[MAX_SHADER_PATH_LENGTH];
+    snprintf(cachePath, sizeof(cachePath), "%s/%s%s%s-%016llx.spv", s_options.shaderCacheDirectory, shader->name,
+        shader->variant != NULL ? "_" : "", shader->variant != NULL ? shader->variant : "",
+        (unsigned long long)HashShaderSource(source, sourceSize, shader->define));
+
+    bool loaded = false;
+    *pCacheHit = !bypassCache && ReadWholeFile(cachePath, (void**)ppCode, pCodeSize);
+    if (*pCacheHit)
+    {
+        loaded = IsSpirvCode(*ppCode, *pCodeSize);
+        if (!loaded)
+        {
+            fprintf(stderr, "Shader cache file %s is corrupted, recompiling...\n", cachePath);
+            free(*ppCode);
+            *ppCode = NULL;
+            *pCodeSize = 0;
+            *pCacheHit = false;
+        }
+    }
+
+    if (!loaded)
+    {
+#ifdef VVB_USE_SHADERC
+        loaded = CompileGlslToSpirv(path, source, sourceSize, shader->define, ppCode, pCodeSize);
+        if (loaded) {
+            WriteShaderCache(cachePath, *ppCode, *pCodeSize);
+        }
+#else
+        fprintf(stderr, "%s is not cached and this build cannot compile GLSL (define VVB_USE_SHADERC)!\n", cachePath);
+#endif // VVB_USE_SHADERC
+    }
+
+    free(source);
+
+    return loaded;
+}
+
+// Returns the module of the shader `name` compiled as `variant` (NULL if the shader has no variants). The module is created
+// on first use and shared until the device context is destroyed, so callers must not destroy it.
+// With a shader directory, `<dir>/<name>[_<variant>].spv` replaces the embedded SPIR-V; with a GLSL directory, the shader is
+// compiled from its source at runtime.
+static VkResult AcquireShaderModule(struct DeviceContext* deviceContext, const char* name, const char* variant, VkShaderModule* pShaderModule)
+{
+    uint32_t index = 0;
+    for (; index < EMBEDDED_SHADER_COUNT; index++)
+    {
+        const struct EmbeddedShader* shader = &s_embeddedShaders[index];
+        if (strcmp(shader->name, name) == 0 && (variant == NULL ? shader->variant == NULL : shader->variant != NULL && strcmp(shader->variant, variant) == 0)) {
+            break;
+        }
+    }
+    if (index == EMBEDDED_SHADER_COUNT)
+    {
+        fprintf(stderr, "Shader %s%s%s is not embedded!\n", name, variant != NULL ? "_" : "", variant != NULL ? variant : "");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    if (deviceContext->shaderModules[index] == VK_NULL_HANDLE)
+    {
+        VkResult res;
+        if (s_options.shaderDirectory != NULL)
+        {
+            char path[MAX_SHADER_PATH_LENGTH];
+            snprintf(path, sizeof(path), "%s/%s%s%s.spv", s_options.shaderDirectory, name, variant != NULL ? "_" : "", variant != NULL ? variant : "");
+            res = CreateShaderModuleFromFile(deviceContext->device, path, &deviceContext->shaderModules[index]);
+        }
+        else if (s_options.glslDirectory != NULL)
+        {
+            uint32_t* code = NULL;
+            size_t codeSize = 0;
+            bool cacheHit = false;
+            res = VK_ERROR_INITIALIZATION_FAILED;
+            if (LoadOrCompileShader(&s_embeddedShaders[index], false, &code, &codeSize, &cacheHit))
+            {
+                res = CreateShaderModuleFromCode(deviceContext->device, code, codeSize, &deviceContext->shaderModules[index]);
+                free(code);
+            }
+        }
+        else {
+            res = CreateShaderModuleFromCode(deviceContext->device, s_embeddedShaders[index].code, s_embeddedShaders[index].codeSize,
+                &deviceContext->shaderModules[index]);
+        }
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+    }
+
+    *pShaderModule = deviceContext->shaderModules[index];
+    return VK_SUCCESS;
+}
+
+// Push constants of test.comp.glsl: both 0 for a whole array, otherwise the offset of the chunk in an array of
+// `totalElemCount` elements
+struct TestKernelChunk
+{
+    uint32_t offset;
+    uint32_t totalElemCount;
+};
+
+static bool IsSameTestKernelChunk(struct TestKernelChunk a, struct TestKernelChunk b)
+{
+    return a.offset == b.offset && a.totalElemCount == b.totalElemCount;
+}
+
+// Every pipeline of CreateComputePipeline has the push constant range; kernels that don't declare it ignore it
+static void PushTestKernelChunk(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, struct TestKernelChunk chunk)
+{
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(chunk), &chunk);
+}
+
 static VkResult CreateComputePipeline(VkDevice device, VkShaderModule computeShaderModule, VkPipeline* pComputePipeline,
     VkPipelineLayout* pPipelineLayout, VkDescriptorSetLayout* pDescLayout, uint32_t totalDataElemCount)
 {
@@ -849,14 +2446,19 @@ static VkResult CreateComputePipeline(VkDevice device, VkShaderModule computeSha
         return res;
     }
 
+    const VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(struct TestKernelChunk)
+    };
     const VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
         .setLayoutCount = 1,
         .pSetLayouts = pDescLayout,
-        .pushConstantRangeCount = 0,
-        .pPushConstantRanges = NULL
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
     };
 
     res = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, pPipelineLayout);
@@ -974,6 +2576,59 @@ static VkResult CreateDescriptorSets(VkDevice device, VkBuffer addressWrapperBuf
     return res;
 }
 
+enum COMPUTE_BACKEND
+{
+    COMPUTE_BACKEND_VULKAN,
+    // Runs the kernels as multithreaded C loops with host memory in place of device memory
+    COMPUTE_BACKEND_CPU,
+    COMPUTE_BACKEND_COUNT
+};
+
+static const char* const s_computeBackendNames[COMPUTE_BACKEND_COUNT] = {
+    "vulkan",
+    "cpu"
+};
+
+struct ComputeJob
+{
+    char name[MAX_JOB_NAME_LENGTH];
+    // Must be a multiple of COMPUTE_WORKGROUP_SIZE
+    uint32_t elemCount;
+    uint32_t iterations;
+    // Value of the first source element, so that a chunk of a partitioned input holds its own part of the sequence
+    uint32_t firstElement;
+    // If not 0, the job is the chunk of an array of this many elements starting at `firstElement`, and its output is
+    // the matching part of the output of a single run over the whole array
+    uint32_t totalElemCount;
+    // If not NULL, the result of the last iteration is copied here (`elemCount` elements)
+    int* outputData;
+};
+
+static struct TestKernelChunk GetTestKernelChunk(const struct ComputeJob* job)
+{
+    if (job->totalElemCount == 0) {
+        return (struct TestKernelChunk){ 0 };
+    }
+    return (struct TestKernelChunk){ .offset = job->firstElement, .totalElemCount = job->totalElemCount };
+}
+
+struct ComputeJobResult
+{
+    VkResult result;
+    bool passed;
+    enum COMPUTE_BACKEND backend;
+    // Which device context and queue ran the job, 0 on the CPU backend
+    uint32_t deviceIndex;
+    uint32_t queueIndex;
+    uint32_t completedIterations;
+    // Time spent creating buffers, pipeline and command buffer
+    double setupMilliseconds;
+    // Per iteration time from vkQueueSubmit to the fence being signaled
+    double totalMilliseconds;
+    double minMilliseconds;
+    double maxMilliseconds;
+};
+
 static VkResult InitializeInstanceAndeDevice(void)
 {
     VkResult result = InitializeInstance();
@@ -983,7 +2638,7 @@ static VkResult InitializeInstanceAndeDevice(void)
         return result;
     }
 
-    result = InitializeDevice(VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, &s_memoryProperties);
+    result = InitializeDevice(VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, &s_options);
     if (result != VK_SUCCESS) {
         fprintf(stderr, "InitializeDevice failed!\n");
     }
@@ -993,219 +2648,11670 @@ static VkResult InitializeInstanceAndeDevice(void)
 
 static void DestroyInstanceAndDevice(void)
 {
-    if (s_specDevice != VK_NULL_HANDLE) {
-        vkDestroyDevice(s_specDevice, NULL);
+    for (uint32_t i = 0; i < s_deviceContextCount; i++) {
+        DestroyDeviceContext(&s_deviceContexts[i]);
     }
-    if (s_instance != VK_NULL_HANDLE) {
+    s_deviceContextCount = 0;
+
+    if (s_instance != VK_NULL_HANDLE)
+    {
         vkDestroyInstance(s_instance, NULL);
+        s_instance = VK_NULL_HANDLE;
     }
 }
 
-static void RunComputeTest(void)
+struct ComputePipelineState
 {
-    puts("\n================ Begin the compute test ================\n");
+    uint32_t elemCount;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSetLayout descriptorSetLayout;
+};
 
-    VkDeviceMemory deviceMemories[3] = { VK_NULL_HANDLE };
-    // deviceBuffers[0] as host temporal buffer, deviceBuffers[1] as device dst buffer, deviceBuffers[2] as device src buffer,
-    // deviceBuffer[3] as address wrapper buffer
-    VkBuffer deviceBuffers[4] = { VK_NULL_HANDLE };
-    VkShaderModule computeShaderModule = VK_NULL_HANDLE;
-    VkPipeline computePipeline = VK_NULL_HANDLE;
-    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
-    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-    VkCommandPool commandPool = VK_NULL_HANDLE;
-    VkCommandBuffer commandBuffers[1] = { VK_NULL_HANDLE };
-    VkFence fence = VK_NULL_HANDLE;
-    uint32_t const commandBufferCount = (uint32_t)(sizeof(commandBuffers) / sizeof(commandBuffers[0]));
+// Pipelines are specialized by the element count, so jobs of the same size share one pipeline. A full cache replaces the
+// least recently acquired pipeline that nobody holds. Acquiring and releasing must be serialized by the owner of the cache.
+struct ComputePipelineCache
+{
+    VkDevice device;
+    // Owned by the device context
+    VkShaderModule shaderModule;
+    uint32_t stateCount;
+    struct ComputePipelineState states[MAX_CACHED_PIPELINE_COUNT];
+    // Acquisitions of each state that have not been released yet
+    uint32_t useCounts[MAX_CACHED_PIPELINE_COUNT];
+    // Value of `acquireCount` when each state was acquired last
+    uint64_t lastAcquires[MAX_CACHED_PIPELINE_COUNT];
+    uint64_t acquireCount;
+};
 
-    do
-    {
-        const uint32_t elemCount = 25 * 1024 * 1024;
-        const VkDeviceSize bufferSize = elemCount * sizeof(int);
+static void DestroyComputePipelineState(VkDevice device, struct ComputePipelineState* state)
+{
+    if (state->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, state->pipeline, NULL);
+    }
+    if (state->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, state->pipelineLayout, NULL);
+    }
+    if (state->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, state->descriptorSetLayout, NULL);
+    }
+    memset(state, 0, sizeof(*state));
+}
 
-        VkResult result = AllocateMemoryAndBuffers(s_specDevice, &s_memoryProperties, deviceMemories, deviceBuffers, bufferSize, s_specQueueFamilyIndex);
-        if (result != VK_SUCCESS)
+// If every cached pipeline is held, the pipeline is created outside the cache and destroyed when it is released.
+// Pipelines that may be replaced while still in use must be released with ReleaseComputePipeline.
+static VkResult AcquireComputePipeline(struct ComputePipelineCache* pCache, uint32_t elemCount, const struct ComputePipelineState** ppState)
+{
+    pCache->acquireCount++;
+    for (uint32_t i = 0; i < pCache->stateCount; i++)
+    {
+        if (pCache->states[i].elemCount == elemCount)
         {
-            fprintf(stderr, "AllocateMemoryAndBuffers failed!\n");
-            break;
+            pCache->useCounts[i]++;
+            pCache->lastAcquires[i] = pCache->acquireCount;
+            *ppState = &pCache->states[i];
+            return VK_SUCCESS;
         }
+    }
 
-        result = CreateShaderModule(s_specDevice, "shaders/test.spv", &computeShaderModule);
-        if (result != VK_SUCCESS)
-        {
-            fprintf(stderr, "CreateShaderModule failed!\n");
-            break;
+    uint32_t index = pCache->stateCount;
+    for (uint32_t i = 0; i < pCache->stateCount && pCache->stateCount == MAX_CACHED_PIPELINE_COUNT; i++)
+    {
+        if (pCache->useCounts[i] == 0 && (index == MAX_CACHED_PIPELINE_COUNT || pCache->lastAcquires[i] < pCache->lastAcquires[index])) {
+            index = i;
         }
+    }
 
-        result = CreateComputePipeline(s_specDevice, computeShaderModule, &computePipeline, &pipelineLayout, &descriptorSetLayout, elemCount);
-        if (result != VK_SUCCESS)
+    struct ComputePipelineState* state = NULL;
+    if (index == MAX_CACHED_PIPELINE_COUNT)
+    {
+        state = calloc(1, sizeof(*state));
+        if (state == NULL)
         {
-            fprintf(stderr, "CreateComputePipeline failed!\n");
-            break;
+            fprintf(stderr, "Failed to allocate an uncached pipeline!\n");
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
         }
-
-        // There's no need to destroy `descriptorSet`, since VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT flag is not set
-        // in `flags` in `VkDescriptorPoolCreateInfo`
-        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-        result = CreateDescriptorSets(s_specDevice, deviceBuffers[3], ADDITIONAL_ADDRESS_BUFFER_SIZE, 
-            descriptorSetLayout, &descriptorPool, &descriptorSet);
-        if (result != VK_SUCCESS)
-        {
-            fprintf(stderr, "CreateDescriptorSets failed!\n");
-            break;
+    }
+    else
+    {
+        state = &pCache->states[index];
+        if (index < pCache->stateCount) {
+            DestroyComputePipelineState(pCache->device, state);
         }
+        else {
+            memset(state, 0, sizeof(*state));
+        }
+    }
+    state->elemCount = elemCount;
 
-        result = InitializeCommandBuffer(s_specQueueFamilyIndex, s_specDevice, &commandPool, commandBuffers, commandBufferCount);
-        if (result != VK_SUCCESS)
-        {
-            fprintf(stderr, "InitializeCommandBuffer failed!\n");
-            break;
+    VkResult result = CreateComputePipeline(pCache->device, pCache->shaderModule, &state->pipeline, &state->pipelineLayout, &state->descriptorSetLayout, elemCount);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "CreateComputePipeline failed!\n");
+        // A replaced entry stays behind with element count 0, which matches no job
+        DestroyComputePipelineState(pCache->device, state);
+        if (index == MAX_CACHED_PIPELINE_COUNT) {
+            free(state);
         }
+        return result;
+    }
 
-        VkQueue queue = VK_NULL_HANDLE;
-        vkGetDeviceQueue(s_specDevice, s_specQueueFamilyIndex, 0, &queue);
+    if (index < MAX_CACHED_PIPELINE_COUNT)
+    {
+        pCache->stateCount = max(pCache->stateCount, index + 1);
+        pCache->useCounts[index] = 1;
+        pCache->lastAcquires[index] = pCache->acquireCount;
+    }
+    *ppState = state;
+    return VK_SUCCESS;
+}
 
-        const VkCommandBufferBeginInfo cmdBufBeginInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .pNext = NULL,
-            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-            .pInheritanceInfo = NULL
-        };
-        result = vkBeginCommandBuffer(commandBuffers[0], &cmdBufBeginInfo);
-        if (result != VK_SUCCESS)
+static void ReleaseComputePipeline(struct ComputePipelineCache* pCache, const struct ComputePipelineState* pState)
+{
+    for (uint32_t i = 0; i < pCache->stateCount; i++)
+    {
+        if (&pCache->states[i] == pState)
         {
-            fprintf(stderr, "vkBeginCommandBuffer failed: %d\n", result);
-            break;
+            pCache->useCounts[i]--;
+            return;
         }
+    }
 
-        vkCmdBindPipeline(commandBuffers[0], VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
-        vkCmdBindDescriptorSets(commandBuffers[0], VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+    struct ComputePipelineState* state = (struct ComputePipelineState*)pState;
+    DestroyComputePipelineState(pCache->device, state);
+    free(state);
+}
 
-        WriteBufferAndSync(commandBuffers[0], s_specQueueFamilyIndex, deviceBuffers[2], deviceBuffers[3], deviceBuffers[0], bufferSize);
+// Pipelines acquired outside the cache must have been released before
+static void DestroyComputePipelineCache(struct ComputePipelineCache* pCache)
+{
+    for (uint32_t i = 0; i < pCache->stateCount; i++)
+    {
+        DestroyComputePipelineState(pCache->device, &pCache->states[i]);
+        pCache->useCounts[i] = 0;
+    }
+    pCache->stateCount = 0;
+    pCache->shaderModule = VK_NULL_HANDLE;
+}
 
-        vkCmdDispatch(commandBuffers[0], elemCount / 1024, 1, 1);
+// Queries around the dispatch of a job with `--counters`. Pools of counters the device cannot provide are VK_NULL_HANDLE.
+struct DispatchQueries
+{
+    VkQueryPool statisticsPool;
+    VkQueryPool timestampPool;
+    VkQueryPool performancePool;
+    uint64_t timestampMask;
+};
 
-        SyncAndReadBuffer(commandBuffers[0], s_specQueueFamilyIndex, deviceBuffers[0], deviceBuffers[1], bufferSize);
+static void DestroyDispatchQueries(VkDevice device, struct DispatchQueries* pQueries)
+{
+    if (pQueries->statisticsPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, pQueries->statisticsPool, NULL);
+    }
+    if (pQueries->timestampPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, pQueries->timestampPool, NULL);
+    }
+    if (pQueries->performancePool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, pQueries->performancePool, NULL);
+    }
+    memset(pQueries, 0, sizeof(*pQueries));
+}
 
-        result = vkEndCommandBuffer(commandBuffers[0]);
-        if (result != VK_SUCCESS)
-        {
-            fprintf(stderr, "vkEndCommandBuffer failed: %d\n", result);
-            break;
-        }
+static VkResult CreateDispatchQueries(const struct DeviceContext* deviceContext, struct DispatchQueries* pQueries)
+{
+    memset(pQueries, 0, sizeof(*pQueries));
+    if (!s_instrumentation.enabled) {
+        return VK_SUCCESS;
+    }
 
-        const VkFenceCreateInfo fenceCreateInfo = {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+    VkResult res = VK_SUCCESS;
+    if (deviceContext->supportPipelineStatistics)
+    {
+        const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
             .pNext = NULL,
-            .flags = 0
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = 1,
+            .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT
         };
-        result = vkCreateFence(s_specDevice, &fenceCreateInfo, NULL, &fence);
-        if (result != VK_SUCCESS)
+        res = vkCreateQueryPool(deviceContext->device, &queryPoolCreateInfo, NULL, &pQueries->statisticsPool);
+        if (res != VK_SUCCESS)
         {
-            fprintf(stderr, "vkCreateFence failed: %d\n", result);
-            break;
+            fprintf(stderr, "vkCreateQueryPool for pipeline statistics failed: %d\n", res);
+            return res;
         }
+    }
 
-        const VkSubmitInfo submit_info = {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    pQueries->timestampMask = GetQueueTimestampMask(deviceContext);
+    if (pQueries->timestampMask != 0)
+    {
+        const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
             .pNext = NULL,
-            .waitSemaphoreCount = 0,
-            .pWaitSemaphores = NULL,
-            .pWaitDstStageMask = NULL,
-            .commandBufferCount = commandBufferCount,
-            .pCommandBuffers = commandBuffers,
-            .signalSemaphoreCount = 0,
-            .pSignalSemaphores = NULL
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+            .pipelineStatistics = 0
         };
-        result = vkQueueSubmit(queue, 1, &submit_info, fence);
-        if (result != VK_SUCCESS)
+        res = vkCreateQueryPool(deviceContext->device, &queryPoolCreateInfo, NULL, &pQueries->timestampPool);
+        if (res != VK_SUCCESS)
         {
-            fprintf(stderr, "vkQueueSubmit failed: %d\n", result);
-            break;
+            fprintf(stderr, "vkCreateQueryPool for timestamps failed: %d\n", res);
+            return res;
         }
+    }
 
-        result = vkWaitForFences(s_specDevice, 1, &fence, VK_TRUE, UINT64_MAX);
-        if (result != VK_SUCCESS)
+    if (deviceContext->performanceCounterCount > 0)
+    {
+        const VkQueryPoolPerformanceCreateInfoKHR performanceCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_PERFORMANCE_CREATE_INFO_KHR,
+            .pNext = NULL,
+            .queueFamilyIndex = deviceContext->queueFamilyIndex,
+            .counterIndexCount = deviceContext->performanceCounterCount,
+            .pCounterIndices = deviceContext->performanceCounterIndices
+        };
+        const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = &performanceCreateInfo,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_PERFORMANCE_QUERY_KHR,
+            .queryCount = 1,
+            .pipelineStatistics = 0
+        };
+        res = vkCreateQueryPool(deviceContext->device, &queryPoolCreateInfo, NULL, &pQueries->performancePool);
+        if (res != VK_SUCCESS)
         {
-            fprintf(stderr, "vkWaitForFences failed: %d\n", result);
-            break;
+            fprintf(stderr, "vkCreateQueryPool for performance counters failed: %d\n", res);
+            return res;
         }
+        deviceContext->resetQueryPool(deviceContext->device, pQueries->performancePool, 0, 1);
+    }
 
-        // Verify the result
-        void* hostBuffer = NULL;
-        result = vkMapMemory(s_specDevice, deviceMemories[0], 0, bufferSize, 0, &hostBuffer);
-        if (result != VK_SUCCESS)
-        {
-            fprintf(stderr, "vkMapMemory failed: %d\n", result);
-            break;
+    return res;
+}
+
+static void RecordDispatchQueriesBegin(const struct DispatchQueries* pQueries, VkCommandBuffer commandBuffer)
+{
+    if (pQueries->statisticsPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, pQueries->statisticsPool, 0, 1);
+        vkCmdBeginQuery(commandBuffer, pQueries->statisticsPool, 0, 0);
+    }
+    if (pQueries->performancePool != VK_NULL_HANDLE) {
+        vkCmdBeginQuery(commandBuffer, pQueries->performancePool, 0, 0);
+    }
+    if (pQueries->timestampPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, pQueries->timestampPool, 0, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pQueries->timestampPool, 0);
+    }
+}
+
+static void RecordDispatchQueriesEnd(const struct DispatchQueries* pQueries, VkCommandBuffer commandBuffer)
+{
+    if (pQueries->timestampPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pQueries->timestampPool, 1);
+    }
+    if (pQueries->performancePool != VK_NULL_HANDLE) {
+        vkCmdEndQuery(commandBuffer, pQueries->performancePool, 0);
+    }
+    if (pQueries->statisticsPool != VK_NULL_HANDLE) {
+        vkCmdEndQuery(commandBuffer, pQueries->statisticsPool, 0);
+    }
+}
+
+static double GetPerformanceCounterValue(VkPerformanceCounterStorageKHR storage, const VkPerformanceCounterResultKHR* pResult)
+{
+    switch (storage)
+    {
+    case VK_PERFORMANCE_COUNTER_STORAGE_INT32_KHR:
+        return (double)pResult->int32;
+    case VK_PERFORMANCE_COUNTER_STORAGE_INT64_KHR:
+        return (double)pResult->int64;
+    case VK_PERFORMANCE_COUNTER_STORAGE_UINT32_KHR:
+        return (double)pResult->uint32;
+    case VK_PERFORMANCE_COUNTER_STORAGE_UINT64_KHR:
+        return (double)pResult->uint64;
+    case VK_PERFORMANCE_COUNTER_STORAGE_FLOAT32_KHR:
+        return (double)pResult->float32;
+    default:
+        return pResult->float64;
+    }
+}
+
+// Reads the queries of a completed submission and adds them to the counters of the device
+static void CollectDispatchQueries(const struct DeviceContext* deviceContext, const struct DispatchQueries* pQueries)
+{
+    if (pQueries->statisticsPool == VK_NULL_HANDLE && pQueries->timestampPool == VK_NULL_HANDLE && pQueries->performancePool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    const VkDevice device = deviceContext->device;
+    uint64_t invocations = 0;
+    double dispatchMilliseconds = 0.0;
+    VkPerformanceCounterResultKHR performanceResults[MAX_PERFORMANCE_COUNTER_COUNT] = { 0 };
+
+    if (pQueries->statisticsPool != VK_NULL_HANDLE)
+    {
+        const VkResult res = vkGetQueryPoolResults(device, pQueries->statisticsPool, 0, 1, sizeof(invocations), &invocations, sizeof(invocations),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        if (res != VK_SUCCESS) {
+            fprintf(stderr, "vkGetQueryPoolResults for pipeline statistics failed: %d\n", res);
         }
-        int* dstMem = hostBuffer;
-        for (int i = 1; i < (int)elemCount; i++)
+    }
+    if (pQueries->timestampPool != VK_NULL_HANDLE)
+    {
+        uint64_t timestamps[2] = { 0 };
+        const VkResult res = vkGetQueryPoolResults(device, pQueries->timestampPool, 0, 2, sizeof(timestamps), timestamps, sizeof(timestamps[0]),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        if (res == VK_SUCCESS)
         {
-            if (dstMem[i] != i * 2)
-            {
-                fprintf(stderr, "Result error @ %d, result is: %d\n", i, dstMem[i]);
-                break;
-            }
+            const uint64_t ticks = ((timestamps[1] & pQueries->timestampMask) - (timestamps[0] & pQueries->timestampMask)) & pQueries->timestampMask;
+            dispatchMilliseconds = (double)ticks * deviceContext->properties.limits.timestampPeriod / 1000000.0;
         }
-        printf("The first 5 elements sum = %d\n", dstMem[1] + dstMem[2] + dstMem[3] + dstMem[4] + dstMem[5]);
+        else {
+            fprintf(stderr, "vkGetQueryPoolResults for timestamps failed: %d\n", res);
+        }
+    }
+    if (pQueries->performancePool != VK_NULL_HANDLE)
+    {
+        const size_t resultSize = deviceContext->performanceCounterCount * sizeof(performanceResults[0]);
+        const VkResult res = vkGetQueryPoolResults(device, pQueries->performancePool, 0, 1, resultSize, performanceResults, resultSize,
+            VK_QUERY_RESULT_WAIT_BIT);
+        if (res != VK_SUCCESS) {
+            fprintf(stderr, "vkGetQueryPoolResults for performance counters failed: %d\n", res);
+        }
+        // Ready for the next submission of the command buffer
+        deviceContext->resetQueryPool(device, pQueries->performancePool, 0, 1);
+    }
+
+    struct DeviceCounters* counters = &s_instrumentation.counters.devices[deviceContext - s_deviceContexts];
+    mtx_lock(&s_instrumentation.mutex);
+    counters->profiledDispatchCount++;
+    counters->computeShaderInvocations += invocations;
+    counters->dispatchMilliseconds += dispatchMilliseconds;
+    for (uint32_t i = 0; i < deviceContext->performanceCounterCount; i++) {
+        counters->performanceCounterTotals[i] += GetPerformanceCounterValue(deviceContext->performanceCounterStorages[i], &performanceResults[i]);
+    }
+    mtx_unlock(&s_instrumentation.mutex);
+}
+
+// All the resources one job needs while it is in flight on a queue
+struct ComputeJobContext
+{
+    struct DeviceContext* deviceContext;
+    const struct ComputeJob* job;
+    struct ComputeJobResult* jobResult;
+    uint32_t queueIndex;
+    bool verbose;
+    // The recorded command buffer may be submitted again for another job of the same element count
+    bool reusable;
+
+    // deviceBuffers[0] as host temporal buffer, deviceBuffers[1] as device dst buffer, deviceBuffers[2] as device src buffer,
+    // deviceBuffer[3] as address wrapper buffer
+    VkDeviceMemory deviceMemories[3];
+    VkBuffer deviceBuffers[4];
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    // Released to `pipelineCache` when the context is destroyed
+    struct ComputePipelineCache* pipelineCache;
+    const struct ComputePipelineState* pipelineState;
+    // Pushed by the recorded command buffer, so a rebound job must be the same chunk
+    struct TestKernelChunk chunk;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    // Only recorded into the primary command buffer of CreateComputeJobContext
+    struct DispatchQueries queries;
+    // Timeline value the job signals when a SubmissionBatcher submitted it, 0 while it is pending or submitted with `fence`
+    uint64_t timelineValue;
+
+    uint32_t iteration;
+    uint64_t setupBeginTime;
+    uint64_t submitTime;
+};
+
+static void DestroyComputeJobContext(struct ComputeJobContext* context)
+{
+    const struct DeviceContext* deviceContext = context->deviceContext;
+    if (deviceContext == NULL) {
+        return;
+    }
+
+    if (context->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(deviceContext->device, context->fence, NULL);
+    }
+    if (context->commandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(deviceContext->device, deviceContext->commandPools[context->queueIndex], 1, &context->commandBuffer);
+    }
+    DestroyDispatchQueries(deviceContext->device, &context->queries);
+    if (context->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(deviceContext->device, context->descriptorPool, NULL);
+    }
+    if (context->pipelineState != NULL) {
+        ReleaseComputePipeline(context->pipelineCache, context->pipelineState);
+    }
+
+    for (size_t i = 0; i < sizeof(context->deviceBuffers) / sizeof(context->deviceBuffers[0]); i++)
+    {
+        if (context->deviceBuffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(deviceContext->device, context->deviceBuffers[i], NULL);
+        }
+    }
+    for (size_t i = 0; i < sizeof(context->deviceMemories) / sizeof(context->deviceMemories[0]); i++)
+    {
+        if (context->deviceMemories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(deviceContext->device, context->deviceMemories[i], NULL);
+        }
+    }
+
+    memset(context, 0, sizeof(*context));
+}
+
+// Creates the buffers, the pipeline and the descriptor set of a job, but no command buffer
+static VkResult PrepareComputeJobContext(struct DeviceContext* deviceContext, const struct ComputeJob* job, struct ComputeJobResult* pJobResult,
+    uint32_t queueIndex, struct ComputePipelineCache* pPipelineCache, bool verbose, bool reusable, struct ComputeJobContext* context)
+{
+    memset(context, 0, sizeof(*context));
+    context->deviceContext = deviceContext;
+    context->job = job;
+    context->jobResult = pJobResult;
+    context->queueIndex = queueIndex;
+    context->verbose = verbose;
+    context->reusable = reusable;
+    context->chunk = GetTestKernelChunk(job);
+    context->setupBeginTime = GetCurrentTimeNanoseconds();
+
+    const uint32_t elemCount = job->elemCount;
+    const VkDeviceSize bufferSize = elemCount * sizeof(int);
+
+    VkResult result = AllocateMemoryAndBuffers(deviceContext->device, &deviceContext->memoryProperties, context->deviceMemories, context->deviceBuffers,
+        bufferSize, job->firstElement, deviceContext->queueFamilyIndex);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "AllocateMemoryAndBuffers failed!\n");
+        return result;
+    }
+
+    context->pipelineCache = pPipelineCache;
+    result = AcquireComputePipeline(pPipelineCache, elemCount, &context->pipelineState);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    // There's no need to destroy `descriptorSet`, since VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT flag is not set
+    // in `flags` in `VkDescriptorPoolCreateInfo`
+    result = CreateDescriptorSets(deviceContext->device, context->deviceBuffers[3], ADDITIONAL_ADDRESS_BUFFER_SIZE,
+        context->pipelineState->descriptorSetLayout, &context->descriptorPool, &context->descriptorSet);
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "CreateDescriptorSets failed!\n");
+    }
+
+    return result;
+}
+
+// Records upload, dispatch and read back of a prepared job into `commandBuffer`, which may be a primary or a secondary one
+static void RecordComputeJobCommands(const struct ComputeJobContext* context, VkCommandBuffer commandBuffer)
+{
+    const uint32_t queueFamilyIndex = context->deviceContext->queueFamilyIndex;
+    const uint32_t elemCount = context->job->elemCount;
+    const VkDeviceSize bufferSize = elemCount * sizeof(int);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipelineState->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipelineState->pipelineLayout, 0, 1, &context->descriptorSet, 0, NULL);
+    PushTestKernelChunk(commandBuffer, context->pipelineState->pipelineLayout, context->chunk);
+
+    WriteBufferAndSync(commandBuffer, queueFamilyIndex, context->deviceBuffers[2], context->deviceBuffers[3], context->deviceBuffers[0], bufferSize);
+
+    RecordDispatchQueriesBegin(&context->queries, commandBuffer);
+    vkCmdDispatch(commandBuffer, elemCount / COMPUTE_WORKGROUP_SIZE, 1, 1);
+    RecordDispatchQueriesEnd(&context->queries, commandBuffer);
+
+    SyncAndReadBuffer(commandBuffer, queueFamilyIndex, context->deviceBuffers[0], context->deviceBuffers[1], bufferSize);
+}
+
+// Host counters of one submission of the commands recorded by RecordComputeJobCommands
+static void CountComputeJobCommands(const struct ComputeJobContext* context)
+{
+    const uint64_t bufferSize = (uint64_t)context->job->elemCount * sizeof(int);
+    AddHostCounter(HOST_COUNTER_COMMAND_BUFFERS, 1);
+    AddHostCounter(HOST_COUNTER_UPLOADED_BYTES, bufferSize + ADDITIONAL_ADDRESS_BUFFER_SIZE);
+    AddHostCounter(HOST_COUNTER_DOWNLOADED_BYTES, bufferSize);
+    AddHostCounter(HOST_COUNTER_DISPATCHES, 1);
+}
+
+static VkResult CreateComputeJobContext(struct DeviceContext* deviceContext, const struct ComputeJob* job, struct ComputeJobResult* pJobResult,
+    uint32_t queueIndex, struct ComputePipelineCache* pPipelineCache, bool verbose, bool reusable, struct ComputeJobContext* context)
+{
+    VkResult result = PrepareComputeJobContext(deviceContext, job, pJobResult, queueIndex, pPipelineCache, verbose, reusable, context);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = CreateDispatchQueries(deviceContext, &context->queries);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = AllocateCommandBuffers(deviceContext->device, deviceContext->commandPools[queueIndex], VK_COMMAND_BUFFER_LEVEL_PRIMARY, &context->commandBuffer, 1);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "AllocateCommandBuffers failed: %d\n", result);
+        return result;
+    }
+
+    // The command buffer is submitted once per iteration, so it cannot be a one-time-submit one
+    const VkCommandBufferBeginInfo cmdBufBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = job->iterations > 1 || reusable ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL
+    };
+    result = vkBeginCommandBuffer(context->commandBuffer, &cmdBufBeginInfo);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkBeginCommandBuffer failed: %d\n", result);
+        return result;
+    }
+
+    RecordComputeJobCommands(context, context->commandBuffer);
+
+    result = vkEndCommandBuffer(context->commandBuffer);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkEndCommandBuffer failed: %d\n", result);
+        return result;
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    result = vkCreateFence(deviceContext->device, &fenceCreateInfo, NULL, &context->fence);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateFence failed: %d\n", result);
+        return result;
+    }
+
+    pJobResult->setupMilliseconds = (double)(GetCurrentTimeNanoseconds() - context->setupBeginTime) / 1000000.0;
+
+    return result;
+}
+
+// Writes the source sequence of the job into the host temporal buffer again, since it holds the read back result of the previous run
+static VkResult RefillComputeJobSource(const struct ComputeJobContext* context)
+{
+    const struct DeviceContext* deviceContext = context->deviceContext;
+    const VkDeviceSize bufferSize = context->job->elemCount * sizeof(int);
+    void* hostBuffer = NULL;
+    VkResult result = vkMapMemory(deviceContext->device, context->deviceMemories[0], 0, bufferSize, 0, &hostBuffer);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", result);
+        return result;
+    }
+    AddHostCounter(HOST_COUNTER_MAP_CALLS, 1);
+    InitializeSourceData(hostBuffer, (int)context->job->elemCount, (int)context->job->firstElement);
+    vkUnmapMemory(deviceContext->device, context->deviceMemories[0]);
+    return VK_SUCCESS;
+}
+
+static VkResult SubmitComputeJobIteration(struct ComputeJobContext* context)
+{
+    const struct DeviceContext* deviceContext = context->deviceContext;
+    VkResult result = VK_SUCCESS;
+    if (context->iteration > 0)
+    {
+        result = RefillComputeJobSource(context);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+
+        result = vkResetFences(deviceContext->device, 1, &context->fence);
+        if (result != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkResetFences failed: %d\n", result);
+            return result;
+        }
+    }
+
+    const VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &context->commandBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL
+    };
+
+    context->submitTime = GetCurrentTimeNanoseconds();
+
+    result = vkQueueSubmit(deviceContext->queues[context->queueIndex], 1, &submit_info, context->fence);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkQueueSubmit failed: %d\n", result);
+        return result;
+    }
+    AddHostCounter(HOST_COUNTER_SUBMITS, 1);
+    CountComputeJobCommands(context);
+
+    return result;
+}
+
+// Called after the fence of the current iteration is signaled. Returns true if there are more iterations to submit.
+static bool CompleteComputeJobIteration(struct ComputeJobContext* context)
+{
+    const struct DeviceContext* deviceContext = context->deviceContext;
+    struct ComputeJobResult* pJobResult = context->jobResult;
+    const uint32_t elemCount = context->job->elemCount;
+    const int firstElement = (int)context->job->firstElement;
+
+    const double iterationMilliseconds = (double)(GetCurrentTimeNanoseconds() - context->submitTime) / 1000000.0;
+    pJobResult->totalMilliseconds += iterationMilliseconds;
+    if (context->iteration == 0 || iterationMilliseconds < pJobResult->minMilliseconds) {
+        pJobResult->minMilliseconds = iterationMilliseconds;
+    }
+    if (iterationMilliseconds > pJobResult->maxMilliseconds) {
+        pJobResult->maxMilliseconds = iterationMilliseconds;
+    }
+    if (s_instrumentation.enabled) {
+        CollectDispatchQueries(deviceContext, &context->queries);
+    }
+
+    // Verify the result
+    void* hostBuffer = NULL;
+    VkResult result = vkMapMemory(deviceContext->device, context->deviceMemories[0], 0, elemCount * sizeof(int), 0, &hostBuffer);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", result);
+        pJobResult->result = result;
+        pJobResult->passed = false;
+        return false;
+    }
+    AddHostCounter(HOST_COUNTER_MAP_CALLS, 1);
+
+    int* dstMem = hostBuffer;
+    const bool passed = VerifyTestKernelOutput(dstMem, elemCount, firstElement, context->job->totalElemCount);
+
+    pJobResult->completedIterations++;
+    context->iteration++;
+
+    if (context->job->outputData != NULL && context->iteration == context->job->iterations) {
+        memcpy(context->job->outputData, dstMem, elemCount * sizeof(int));
+    }
 
+    if (context->verbose && context->iteration == 1 && context->job->totalElemCount == 0)
+    {
+        printf("The first 5 elements sum = %d\n", dstMem[1] + dstMem[2] + dstMem[3] + dstMem[4] + dstMem[5]);
         if (dstMem[0] == (int)elemCount) {
             puts("total_data_elem_count is the same as elemCount!");
         }
+    }
 
-        vkUnmapMemory(s_specDevice, deviceMemories[0]);
+    vkUnmapMemory(deviceContext->device, context->deviceMemories[0]);
 
-    } while (false);
+    pJobResult->result = VK_SUCCESS;
+    pJobResult->passed = passed && pJobResult->completedIterations == context->job->iterations;
+    return passed && context->iteration < context->job->iterations;
+}
 
-    if (fence != VK_NULL_HANDLE) {
-        vkDestroyFence(s_specDevice, fence, NULL);
+// Binds a retired reusable context to a new job of the same element count and chunk. Only the source data has to be refilled,
+// since the recorded command buffer uploads it from the host temporal buffer on every submission.
+static VkResult RebindComputeJobContext(struct ComputeJobContext* context, const struct ComputeJob* job, struct ComputeJobResult* pJobResult)
+{
+    const struct DeviceContext* deviceContext = context->deviceContext;
+    if (!IsSameTestKernelChunk(context->chunk, GetTestKernelChunk(job)))
+    {
+        fprintf(stderr, "Job %s is not the chunk the context was recorded for!\n", job->name);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    context->setupBeginTime = GetCurrentTimeNanoseconds();
+    context->job = job;
+    context->jobResult = pJobResult;
+    context->iteration = 0;
+
+    VkResult result = RefillComputeJobSource(context);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    result = vkResetFences(deviceContext->device, 1, &context->fence);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkResetFences failed: %d\n", result);
+        return result;
+    }
+
+    pJobResult->setupMilliseconds = (double)(GetCurrentTimeNanoseconds() - context->setupBeginTime) / 1000000.0;
+
+    return result;
+}
+
+// What a completion wait waits for: any of `fences`, or `semaphore` reaching `value` if there are no fences
+struct CompletionTarget
+{
+    const VkFence* fences;
+    uint32_t fenceCount;
+    VkSemaphore semaphore;
+    uint64_t value;
+};
+
+// Waits poll with exponential backoff for up to a spin window, then block. Polling avoids the wake-up latency of a blocking
+// wait for jobs that complete within the window, at the cost of a busy core. The adaptive window is derived from smoothed
+// durations of the recent waits of the same waiter, measured from the submission.
+struct CompletionWaiter
+{
+    const struct DeviceContext* deviceContext;
+    enum WAIT_STRATEGY strategy;
+    uint64_t maxSpinNanoseconds;
+    // Exponentially weighted mean and mean deviation of the durations, valid once `durationCount` > 0
+    uint64_t averageNanoseconds;
+    uint64_t deviationNanoseconds;
+    uint32_t durationCount;
+    // Waits that completed while polling and waits that ended up blocking
+    uint32_t spinCompletions;
+    uint32_t blockingWaits;
+};
+
+static void InitializeCompletionWaiter(struct CompletionWaiter* waiter, const struct DeviceContext* deviceContext, enum WAIT_STRATEGY strategy,
+    uint32_t maxSpinMicroseconds)
+{
+    memset(waiter, 0, sizeof(*waiter));
+    waiter->deviceContext = deviceContext;
+    waiter->strategy = strategy;
+    waiter->maxSpinNanoseconds = (uint64_t)(maxSpinMicroseconds > 0 ? maxSpinMicroseconds : DEFAULT_MAX_SPIN_MICROSECONDS) * 1000;
+}
+
+// Returns VK_SUCCESS if the target has completed and VK_NOT_READY if not
+static VkResult PollCompletion(const struct DeviceContext* deviceContext, const struct CompletionTarget* target)
+{
+    if (target->fenceCount == 0)
+    {
+        uint64_t value = 0;
+        const VkResult result = deviceContext->getSemaphoreCounterValue(deviceContext->device, target->semaphore, &value);
+        if (result != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkGetSemaphoreCounterValue failed: %d\n", result);
+            return result;
+        }
+        return value >= target->value ? VK_SUCCESS : VK_NOT_READY;
+    }
+
+    for (uint32_t i = 0; i < target->fenceCount; i++)
+    {
+        const VkResult status = vkGetFenceStatus(deviceContext->device, target->fences[i]);
+        if (status != VK_NOT_READY)
+        {
+            if (status != VK_SUCCESS) {
+                fprintf(stderr, "vkGetFenceStatus failed: %d\n", status);
+            }
+            return status;
+        }
+    }
+    return VK_NOT_READY;
+}
+
+static VkResult BlockOnCompletion(const struct DeviceContext* deviceContext, const struct CompletionTarget* target)
+{
+    VkResult result = VK_SUCCESS;
+    if (target->fenceCount == 0)
+    {
+        const VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .semaphoreCount = 1,
+            .pSemaphores = &target->semaphore,
+            .pValues = &target->value
+        };
+        result = deviceContext->waitSemaphores(deviceContext->device, &waitInfo, UINT64_MAX);
+        if (result != VK_SUCCESS) {
+            fprintf(stderr, "vkWaitSemaphores failed: %d\n", result);
+        }
     }
-    if (commandPool != VK_NULL_HANDLE)
+    else
     {
-        vkFreeCommandBuffers(s_specDevice, commandPool, commandBufferCount, commandBuffers);
-        vkDestroyCommandPool(s_specDevice, commandPool, NULL);
+        result = vkWaitForFences(deviceContext->device, target->fenceCount, target->fences, VK_FALSE, UINT64_MAX);
+        if (result != VK_SUCCESS) {
+            fprintf(stderr, "vkWaitForFences failed: %d\n", result);
+        }
     }
-    if (descriptorPool != VK_NULL_HANDLE) {
-        vkDestroyDescriptorPool(s_specDevice, descriptorPool, NULL);
+    return result;
+}
+
+// Polls until the expected completion, the smoothed duration plus four mean deviations, if it is within the maximum window.
+// Jobs expected later, or already overdue, are left to the blocking wait.
+static uint64_t GetAdaptiveSpinNanoseconds(const struct CompletionWaiter* waiter, uint64_t elapsedNanoseconds)
+{
+    if (waiter->durationCount == 0) {
+        return waiter->maxSpinNanoseconds;
     }
-    if (descriptorSetLayout != VK_NULL_HANDLE) {
-        vkDestroyDescriptorSetLayout(s_specDevice, descriptorSetLayout, NULL);
+    const uint64_t expectedNanoseconds = waiter->averageNanoseconds + 4 * waiter->deviationNanoseconds;
+    if (expectedNanoseconds <= elapsedNanoseconds || expectedNanoseconds - elapsedNanoseconds > waiter->maxSpinNanoseconds) {
+        return 0;
     }
-    if (pipelineLayout != VK_NULL_HANDLE) {
-        vkDestroyPipelineLayout(s_specDevice, pipelineLayout, NULL);
+    return expectedNanoseconds - elapsedNanoseconds;
+}
+
+// Smooths like the round-trip time estimate of TCP, with gains of 1/8 for the mean and 1/4 for the deviation
+static void RecordCompletionDuration(struct CompletionWaiter* waiter, uint64_t durationNanoseconds)
+{
+    if (waiter->durationCount++ == 0)
+    {
+        waiter->averageNanoseconds = durationNanoseconds;
+        waiter->deviationNanoseconds = durationNanoseconds / 2;
+        return;
     }
-    if (computePipeline != VK_NULL_HANDLE) {
-        vkDestroyPipeline(s_specDevice, computePipeline, NULL);
+    const int64_t error = (int64_t)durationNanoseconds - (int64_t)waiter->averageNanoseconds;
+    const int64_t deviationError = (error < 0 ? -error : error) - (int64_t)waiter->deviationNanoseconds;
+    waiter->averageNanoseconds = (uint64_t)((int64_t)waiter->averageNanoseconds + error / 8);
+    waiter->deviationNanoseconds = (uint64_t)((int64_t)waiter->deviationNanoseconds + deviationError / 4);
+}
+
+// Waits for `target` with the strategy of the waiter. `submitTime` is when the awaited work was submitted.
+static VkResult WaitForCompletion(struct CompletionWaiter* waiter, const struct CompletionTarget* target, uint64_t submitTime)
+{
+    uint64_t currentTime = GetCurrentTimeNanoseconds();
+    uint64_t spinNanoseconds = 0;
+    if (waiter->strategy == WAIT_STRATEGY_SPIN) {
+        spinNanoseconds = waiter->maxSpinNanoseconds;
     }
-    if (computeShaderModule != VK_NULL_HANDLE) {
-        vkDestroyShaderModule(s_specDevice, computeShaderModule, NULL);
+    else if (waiter->strategy == WAIT_STRATEGY_ADAPTIVE) {
+        spinNanoseconds = GetAdaptiveSpinNanoseconds(waiter, currentTime > submitTime ? currentTime - submitTime : 0);
     }
 
-    for (size_t i = 0; i < sizeof(deviceBuffers) / sizeof(deviceBuffers[0]); i++)
+    VkResult result = VK_NOT_READY;
+    const uint64_t spinEndTime = currentTime + spinNanoseconds;
+    uint32_t pauseCount = 1;
+    while (spinNanoseconds > 0)
     {
-        if (deviceBuffers[i] != VK_NULL_HANDLE) {
-            vkDestroyBuffer(s_specDevice, deviceBuffers[i], NULL);
+        result = PollCompletion(waiter->deviceContext, target);
+        currentTime = GetCurrentTimeNanoseconds();
+        if (result != VK_NOT_READY || currentTime >= spinEndTime) {
+            break;
+        }
+        for (uint32_t i = 0; i < pauseCount; i++) {
+            PauseProcessor();
         }
+        pauseCount = min(pauseCount * 2, (uint32_t)MAX_SPIN_BACKOFF_PAUSES);
     }
-    for (size_t i = 0; i < sizeof(deviceMemories) / sizeof(deviceMemories[0]); i++)
+
+    if (result == VK_SUCCESS) {
+        waiter->spinCompletions++;
+    }
+    else if (result == VK_NOT_READY)
     {
-        if (deviceMemories[i] != VK_NULL_HANDLE) {
-            vkFreeMemory(s_specDevice, deviceMemories[i], NULL);
-        }
+        waiter->blockingWaits++;
+        result = BlockOnCompletion(waiter->deviceContext, target);
     }
 
-    puts("\n================ Complete the compute test ================\n");
+    if (result == VK_SUCCESS)
+    {
+        currentTime = GetCurrentTimeNanoseconds();
+        RecordCompletionDuration(waiter, currentTime > submitTime ? currentTime - submitTime : 0);
+    }
+    return result;
 }
 
-int main(int argc, const char* argv[])
+// Distributes job indices over device contexts. Each device owns a contiguous range of jobs, takes jobs from the front
+// of its own range, and steals from the back of the largest remaining range once its own range is exhausted.
+struct WorkStealingScheduler
+{
+    mtx_t mutex;
+    uint32_t deviceCount;
+    uint32_t rangeBegins[MAX_DEVICE_CONTEXT_COUNT];
+    uint32_t rangeEnds[MAX_DEVICE_CONTEXT_COUNT];
+    uint32_t executedCounts[MAX_DEVICE_CONTEXT_COUNT];
+    uint32_t stolenCounts[MAX_DEVICE_CONTEXT_COUNT];
+    // Set when a device fails badly enough that nothing else should be scheduled
+    bool aborted;
+};
+
+// The initial partition is proportional to `weights` (e.g. queue counts)
+static bool InitializeWorkStealingScheduler(struct WorkStealingScheduler* pScheduler, uint32_t jobCount, const uint32_t weights[], uint32_t deviceCount)
 {
-    if (InitializeInstanceAndeDevice() == VK_SUCCESS) {
-        RunComputeTest();
+    memset(pScheduler, 0, sizeof(*pScheduler));
+    if (mtx_init(&pScheduler->mutex, mtx_plain) != thrd_success)
+    {
+        fprintf(stderr, "mtx_init failed!\n");
+        return false;
     }
+    pScheduler->deviceCount = deviceCount;
 
-    DestroyInstanceAndDevice();
+    uint64_t totalWeight = 0;
+    for (uint32_t i = 0; i < deviceCount; i++) {
+        totalWeight += weights[i];
+    }
+
+    uint64_t accumulatedWeight = 0;
+    uint32_t begin = 0;
+    for (uint32_t i = 0; i < deviceCount; i++)
+    {
+        accumulatedWeight += weights[i];
+        const uint32_t end = i + 1 == deviceCount ? jobCount : (uint32_t)(jobCount * accumulatedWeight / totalWeight);
+        pScheduler->rangeBegins[i] = begin;
+        pScheduler->rangeEnds[i] = end;
+        begin = end;
+    }
+
+    return true;
+}
+
+static void DestroyWorkStealingScheduler(struct WorkStealingScheduler* pScheduler)
+{
+    mtx_destroy(&pScheduler->mutex);
+}
+
+// Returns the next job index for `deviceIndex`, or UINT32_MAX if there are no jobs left
+static uint32_t AcquireScheduledJob(struct WorkStealingScheduler* pScheduler, uint32_t deviceIndex)
+{
+    uint32_t jobIndex = UINT32_MAX;
+
+    mtx_lock(&pScheduler->mutex);
+
+    if (!pScheduler->aborted)
+    {
+        if (pScheduler->rangeBegins[deviceIndex] < pScheduler->rangeEnds[deviceIndex]) {
+            jobIndex = pScheduler->rangeBegins[deviceIndex]++;
+        }
+        else
+        {
+            uint32_t victim = UINT32_MAX;
+            uint32_t victimRemaining = 0;
+            for (uint32_t i = 0; i < pScheduler->deviceCount; i++)
+            {
+                const uint32_t remaining = pScheduler->rangeEnds[i] - pScheduler->rangeBegins[i];
+                if (remaining > victimRemaining)
+                {
+                    victim = i;
+                    victimRemaining = remaining;
+                }
+            }
+            if (victim != UINT32_MAX)
+            {
+                jobIndex = --pScheduler->rangeEnds[victim];
+                pScheduler->stolenCounts[deviceIndex]++;
+            }
+        }
+
+        if (jobIndex != UINT32_MAX) {
+            pScheduler->executedCounts[deviceIndex]++;
+        }
+    }
+
+    mtx_unlock(&pScheduler->mutex);
+
+    return jobIndex;
+}
+
+static void AbortScheduledJobs(struct WorkStealingScheduler* pScheduler)
+{
+    mtx_lock(&pScheduler->mutex);
+    pScheduler->aborted = true;
+    mtx_unlock(&pScheduler->mutex);
+}
+
+// Runs the jobs handed out by `pScheduler` on the first `queueCount` queues of one device. Each queue runs one job at a time,
+// and a queue picks up the next job as soon as its current job completes.
+static void RunDeviceJobs(uint32_t deviceIndex, struct WorkStealingScheduler* pScheduler, const struct ComputeJob jobs[], struct ComputeJobResult results[],
+    uint32_t queueCount, bool verbose)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[deviceIndex];
+    if (queueCount == 0 || queueCount > deviceContext->queueCount) {
+        queueCount = deviceContext->queueCount;
+    }
+
+    struct ComputePipelineCache pipelineCache = { .device = deviceContext->device };
+    VkResult result = AcquireShaderModule(deviceContext, "test", NULL, &pipelineCache.shaderModule);
+    if (result != VK_SUCCESS)
+    {
+        // Leave the jobs to the other devices
+        fprintf(stderr, "AcquireShaderModule failed on device context %u!\n", deviceIndex);
+        return;
+    }
+
+    struct ComputeJobContext contexts[MAX_COMPUTE_QUEUE_COUNT];
+    bool busy[MAX_COMPUTE_QUEUE_COUNT] = { false };
+    uint32_t activeCount = 0;
+    bool hasPendingJobs = true;
+
+    struct CompletionWaiter waiter;
+    InitializeCompletionWaiter(&waiter, deviceContext, s_options.waitStrategy, s_options.maxSpinMicroseconds);
+
+    while (true)
+    {
+        // Hand pending jobs to idle queues
+        for (uint32_t q = 0; q < queueCount && hasPendingJobs; q++)
+        {
+            while (!busy[q])
+            {
+                const uint32_t jobIndex = AcquireScheduledJob(pScheduler, deviceIndex);
+                if (jobIndex == UINT32_MAX)
+                {
+                    hasPendingJobs = false;
+                    break;
+                }
+
+                results[jobIndex].deviceIndex = deviceIndex;
+                results[jobIndex].queueIndex = q;
+                if (verbose) {
+                    printf("Job `%s` is scheduled to device context %u queue[%u]\n", jobs[jobIndex].name, deviceIndex, q);
+                }
+
+                result = CreateComputeJobContext(deviceContext, &jobs[jobIndex], &results[jobIndex], q, &pipelineCache, verbose, false, &contexts[q]);
+                if (result == VK_SUCCESS) {
+                    result = SubmitComputeJobIteration(&contexts[q]);
+                }
+                if (result != VK_SUCCESS)
+                {
+                    results[jobIndex].result = result;
+                    DestroyComputeJobContext(&contexts[q]);
+                    continue;
+                }
+
+                busy[q] = true;
+                activeCount++;
+            }
+        }
+
+        if (activeCount == 0) {
+            break;
+        }
+
+        VkFence fences[MAX_COMPUTE_QUEUE_COUNT];
+        uint32_t fenceCount = 0;
+        uint64_t firstSubmitTime = UINT64_MAX;
+        for (uint32_t q = 0; q < queueCount; q++)
+        {
+            if (busy[q])
+            {
+                fences[fenceCount++] = contexts[q].fence;
+                firstSubmitTime = min(firstSubmitTime, contexts[q].submitTime);
+            }
+        }
+
+        // Wake up as soon as any queue completes its current submission
+        const struct CompletionTarget target = {
+            .fences = fences,
+            .fenceCount = fenceCount,
+            .semaphore = VK_NULL_HANDLE,
+            .value = 0
+        };
+        result = WaitForCompletion(&waiter, &target, firstSubmitTime);
+
+        for (uint32_t q = 0; q < queueCount; q++)
+        {
+            if (!busy[q]) {
+                continue;
+            }
+
+            struct ComputeJobContext* context = &contexts[q];
+            VkResult status = result == VK_SUCCESS ? vkGetFenceStatus(deviceContext->device, context->fence) : result;
+            if (status == VK_NOT_READY) {
+                continue;
+            }
+
+            bool hasMore = false;
+            if (status == VK_SUCCESS)
+            {
+                hasMore = CompleteComputeJobIteration(context);
+                if (hasMore)
+                {
+                    status = SubmitComputeJobIteration(context);
+                    hasMore = status == VK_SUCCESS;
+                }
+            }
+
+            if (!hasMore)
+            {
+                struct ComputeJobResult* pJobResult = context->jobResult;
+                if (status != VK_SUCCESS)
+                {
+                    pJobResult->result = status;
+                    pJobResult->passed = false;
+                }
+                if (verbose && pJobResult->completedIterations > 0)
+                {
+                    printf("Job `%s` on device context %u queue[%u] %s: %u iteration(s), avg %.3fms, min %.3fms, max %.3fms\n", context->job->name,
+                        deviceIndex, q, pJobResult->passed ? "passed" : "failed", pJobResult->completedIterations,
+                        pJobResult->totalMilliseconds / pJobResult->completedIterations, pJobResult->minMilliseconds, pJobResult->maxMilliseconds);
+                }
+
+                DestroyComputeJobContext(context);
+                busy[q] = false;
+                activeCount--;
+            }
+        }
+
+        if (result != VK_SUCCESS)
+        {
+            // The device may be lost, don't schedule anything else
+            AbortScheduledJobs(pScheduler);
+            hasPendingJobs = false;
+        }
+    }
+
+    DestroyComputePipelineCache(&pipelineCache);
+}
+
+static void ResetJobResults(struct ComputeJobResult results[], uint32_t jobCount)
+{
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        memset(&results[i], 0, sizeof(results[i]));
+        results[i].result = VK_NOT_READY;
+    }
+}
+
+typedef void (*PFN_CpuKernel)(const VkDeviceAddress* addressTable, struct TestKernelChunk chunk, uint32_t elemCount, uint32_t beginIndex,
+    uint32_t endIndex);
+
+// Worker threads that run the chunks of one dispatch at a time. Dispatches are issued from one thread only.
+struct CpuBackend
+{
+    bool initialized;
+    uint32_t threadCount;
+    thrd_t threads[MAX_CPU_BACKEND_THREAD_COUNT];
+    mtx_t mutex;
+    cnd_t workCondition;
+    cnd_t doneCondition;
+    // The current dispatch, protected by the mutex
+    PFN_CpuKernel kernel;
+    const VkDeviceAddress* addressTable;
+    struct TestKernelChunk pushConstants;
+    uint32_t elemCount;
+    uint32_t chunkCount;
+    uint32_t nextChunk;
+    uint32_t completedChunkCount;
+    bool stopRequested;
+};
+
+static struct CpuBackend s_cpuBackend;
+
+// The CPU version of test.comp.glsl. Host addresses stand in for the device addresses of the address table.
+static void CpuTestKernel(const VkDeviceAddress* addressTable, struct TestKernelChunk chunk, uint32_t elemCount, uint32_t beginIndex,
+    uint32_t endIndex)
+{
+    // Unsigned arithmetic wraps like the GPU's int addition instead of overflowing
+    uint32_t* restrict dstMem = (uint32_t*)(uintptr_t)addressTable[0];
+    const uint32_t* restrict srcMem = (const uint32_t*)(uintptr_t)addressTable[1];
+    if (dstMem == NULL || srcMem == NULL || addressTable[2] != 0) {
+        return;
+    }
+
+    // Independent iterations over non-aliasing regions, which the compiler vectorizes
+    for (uint32_t i = beginIndex; i < endIndex; i++) {
+        dstMem[i] = srcMem[i] + srcMem[i];
+    }
+
+    // Only the first element of the whole array holds its element count
+    if (beginIndex == 0 && endIndex > 0 && chunk.offset == 0) {
+        dstMem[0] = chunk.totalElemCount == 0 ? elemCount : chunk.totalElemCount;
+    }
+}
+
+static int CpuBackendWorkerThreadProc(void* arg)
+{
+    struct CpuBackend* backend = arg;
+
+    mtx_lock(&backend->mutex);
+    while (true)
+    {
+        while (!backend->stopRequested && backend->nextChunk == backend->chunkCount) {
+            cnd_wait(&backend->workCondition, &backend->mutex);
+        }
+        if (backend->stopRequested) {
+            break;
+        }
+
+        const uint32_t chunk = backend->nextChunk++;
+        const PFN_CpuKernel kernel = backend->kernel;
+        const VkDeviceAddress* addressTable = backend->addressTable;
+        const struct TestKernelChunk pushConstants = backend->pushConstants;
+        const uint32_t elemCount = backend->elemCount;
+        mtx_unlock(&backend->mutex);
+
+        const uint32_t beginIndex = chunk * CPU_BACKEND_CHUNK_ELEMENT_COUNT;
+        kernel(addressTable, pushConstants, elemCount, beginIndex, min(beginIndex + CPU_BACKEND_CHUNK_ELEMENT_COUNT, elemCount));
+
+        mtx_lock(&backend->mutex);
+        if (++backend->completedChunkCount == backend->chunkCount) {
+            cnd_signal(&backend->doneCondition);
+        }
+    }
+    mtx_unlock(&backend->mutex);
+
+    return 0;
+}
+
+static void DestroyCpuBackend(struct CpuBackend* backend)
+{
+    if (!backend->initialized) {
+        return;
+    }
+
+    mtx_lock(&backend->mutex);
+    backend->stopRequested = true;
+    cnd_broadcast(&backend->workCondition);
+    mtx_unlock(&backend->mutex);
+
+    for (uint32_t i = 0; i < backend->threadCount; i++) {
+        thrd_join(backend->threads[i], NULL);
+    }
+
+    cnd_destroy(&backend->doneCondition);
+    cnd_destroy(&backend->workCondition);
+    mtx_destroy(&backend->mutex);
+    memset(backend, 0, sizeof(*backend));
+}
+
+static bool InitializeCpuBackend(struct CpuBackend* backend, uint32_t threadCount)
+{
+    memset(backend, 0, sizeof(*backend));
+    if (mtx_init(&backend->mutex, mtx_plain) != thrd_success || cnd_init(&backend->workCondition) != thrd_success ||
+        cnd_init(&backend->doneCondition) != thrd_success)
+    {
+        fprintf(stderr, "Failed to initialize the synchronization of the CPU backend!\n");
+        return false;
+    }
+    backend->initialized = true;
+
+    for (uint32_t i = 0; i < min(threadCount, (uint32_t)MAX_CPU_BACKEND_THREAD_COUNT); i++)
+    {
+        if (thrd_create(&backend->threads[i], CpuBackendWorkerThreadProc, backend) != thrd_success)
+        {
+            fprintf(stderr, "thrd_create failed for CPU backend worker %u!\n", i);
+            break;
+        }
+        backend->threadCount++;
+    }
+    if (backend->threadCount == 0)
+    {
+        DestroyCpuBackend(backend);
+        return false;
+    }
+
+    return true;
+}
+
+// Starts the worker threads on first use; `--cpu-threads` or one thread per processor. Returns NULL if no thread can be started.
+static struct CpuBackend* AcquireCpuBackend(void)
+{
+    if (!s_cpuBackend.initialized)
+    {
+        const uint32_t threadCount = s_options.cpuThreadCount > 0 ? s_options.cpuThreadCount : GetProcessorCount();
+        if (!InitializeCpuBackend(&s_cpuBackend, threadCount)) {
+            return NULL;
+        }
+        printf("CPU backend: %u worker thread(s)\n", s_cpuBackend.threadCount);
+    }
+    return &s_cpuBackend;
+}
+
+// Splits [0, elemCount) into chunks that the workers run in parallel and waits for all of them
+static void DispatchCpuKernel(struct CpuBackend* backend, PFN_CpuKernel kernel, const VkDeviceAddress* addressTable,
+    struct TestKernelChunk pushConstants, uint32_t elemCount)
+{
+    mtx_lock(&backend->mutex);
+    backend->kernel = kernel;
+    backend->addressTable = addressTable;
+    backend->pushConstants = pushConstants;
+    backend->elemCount = elemCount;
+    backend->chunkCount = (elemCount + CPU_BACKEND_CHUNK_ELEMENT_COUNT - 1) / CPU_BACKEND_CHUNK_ELEMENT_COUNT;
+    backend->nextChunk = 0;
+    backend->completedChunkCount = 0;
+    cnd_broadcast(&backend->workCondition);
+
+    while (backend->completedChunkCount < backend->chunkCount) {
+        cnd_wait(&backend->doneCondition, &backend->mutex);
+    }
+    mtx_unlock(&backend->mutex);
+}
+
+// Runs one job with the same results as the Vulkan backend: per iteration times, verification and the optional output copy
+static void RunCpuComputeJob(struct CpuBackend* backend, const struct ComputeJob* job, struct ComputeJobResult* pJobResult, bool verbose)
+{
+    memset(pJobResult, 0, sizeof(*pJobResult));
+    pJobResult->result = VK_NOT_READY;
+    pJobResult->backend = COMPUTE_BACKEND_CPU;
+    if (backend == NULL)
+    {
+        pJobResult->result = VK_ERROR_INITIALIZATION_FAILED;
+        return;
+    }
+
+    const uint64_t setupBeginTime = GetCurrentTimeNanoseconds();
+    const size_t bufferSize = (size_t)job->elemCount * sizeof(int);
+    int* srcMem = malloc(bufferSize);
+    int* dstMem = malloc(bufferSize);
+    if (srcMem == NULL || dstMem == NULL)
+    {
+        fprintf(stderr, "Failed to allocate the host memory of job `%s`!\n", job->name);
+        pJobResult->result = VK_ERROR_OUT_OF_HOST_MEMORY;
+        free(srcMem);
+        free(dstMem);
+        return;
+    }
+    InitializeSourceData(srcMem, (int)job->elemCount, (int)job->firstElement);
+
+    // Laid out like the address table of the Vulkan backend: dst, src and a null terminator
+    const VkDeviceAddress addressTable[ADDITIONAL_ADDRESS_BUFFER_SIZE / sizeof(VkDeviceAddress)] = {
+        (VkDeviceAddress)(uintptr_t)dstMem,
+        (VkDeviceAddress)(uintptr_t)srcMem,
+        0
+    };
+    pJobResult->setupMilliseconds = (double)(GetCurrentTimeNanoseconds() - setupBeginTime) / 1000000.0;
+
+    bool passed = true;
+    for (uint32_t iteration = 0; iteration < job->iterations && passed; iteration++)
+    {
+        const uint64_t beginTime = GetCurrentTimeNanoseconds();
+        DispatchCpuKernel(backend, CpuTestKernel, addressTable, GetTestKernelChunk(job), job->elemCount);
+        const double iterationMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+        pJobResult->totalMilliseconds += iterationMilliseconds;
+        if (iteration == 0 || iterationMilliseconds < pJobResult->minMilliseconds) {
+            pJobResult->minMilliseconds = iterationMilliseconds;
+        }
+        if (iterationMilliseconds > pJobResult->maxMilliseconds) {
+            pJobResult->maxMilliseconds = iterationMilliseconds;
+        }
+
+        passed = VerifyTestKernelOutput(dstMem, job->elemCount, (int)job->firstElement, job->totalElemCount);
+        pJobResult->completedIterations++;
+    }
+
+    if (passed && job->outputData != NULL) {
+        memcpy(job->outputData, dstMem, bufferSize);
+    }
+
+    pJobResult->result = VK_SUCCESS;
+    pJobResult->passed = passed && pJobResult->completedIterations == job->iterations;
+    if (verbose && pJobResult->completedIterations > 0)
+    {
+        printf("Job `%s` on the CPU backend (%u threads) %s: %u iteration(s), avg %.3fms, min %.3fms, max %.3fms\n", job->name,
+            backend->threadCount, pJobResult->passed ? "passed" : "failed", pJobResult->completedIterations,
+            pJobResult->totalMilliseconds / pJobResult->completedIterations, pJobResult->minMilliseconds, pJobResult->maxMilliseconds);
+    }
+
+    free(srcMem);
+    free(dstMem);
+}
+
+// Jobs run one after another, each dispatch spread over all worker threads
+static void RunCpuComputeJobs(const struct ComputeJob jobs[], struct ComputeJobResult results[], uint32_t jobCount, bool verbose)
+{
+    struct CpuBackend* backend = AcquireCpuBackend();
+    for (uint32_t i = 0; i < jobCount; i++) {
+        RunCpuComputeJob(backend, &jobs[i], &results[i], verbose);
+    }
+}
+
+// Reruns the jobs the device could not run on the CPU backend, unless `--backend=vulkan` was given.
+// Jobs that ran but produced wrong results are not rerun.
+static void FailOverComputeJobs(const struct ComputeJob jobs[], struct ComputeJobResult results[], uint32_t jobCount, bool verbose)
+{
+    if (s_options.backendSelection != BACKEND_SELECTION_AUTO) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        if (results[i].passed || results[i].result == VK_SUCCESS) {
+            continue;
+        }
+        fprintf(stderr, "Job `%s` failed on the Vulkan backend (%d), failing over to the CPU backend\n", jobs[i].name, results[i].result);
+        RunCpuComputeJob(AcquireCpuBackend(), &jobs[i], &results[i], verbose);
+    }
+}
+
+// Schedules independent jobs over the first `queueCount` queues of the primary device
+static void RunComputeJobs(const struct ComputeJob jobs[], struct ComputeJobResult results[], uint32_t jobCount, uint32_t queueCount, bool verbose)
+{
+    ResetJobResults(results, jobCount);
+
+    // Without a Vulkan device, the CPU backend runs the jobs
+    if (s_deviceContextCount == 0)
+    {
+        RunCpuComputeJobs(jobs, results, jobCount, verbose);
+        return;
+    }
+
+    struct WorkStealingScheduler scheduler;
+    const uint32_t weight = 1;
+    if (!InitializeWorkStealingScheduler(&scheduler, jobCount, &weight, 1)) {
+        return;
+    }
+
+    RunDeviceJobs(0, &scheduler, jobs, results, queueCount, verbose);
+
+    DestroyWorkStealingScheduler(&scheduler);
+
+    FailOverComputeJobs(jobs, results, jobCount, verbose);
+}
+
+struct DeviceWorkerArgs
+{
+    uint32_t deviceIndex;
+    struct WorkStealingScheduler* scheduler;
+    const struct ComputeJob* jobs;
+    struct ComputeJobResult* results;
+    bool verbose;
+};
+
+static int DeviceWorkerThreadProc(void* arg)
+{
+    const struct DeviceWorkerArgs* args = arg;
+    RunDeviceJobs(args->deviceIndex, args->scheduler, args->jobs, args->results, 0, args->verbose);
+    return 0;
+}
+
+// Schedules independent jobs over all queues of all device contexts, one worker thread per device context.
+// Results are stored by job index, so they are always gathered in job order.
+static void RunMultiDeviceJobs(const struct ComputeJob jobs[], struct ComputeJobResult results[], uint32_t jobCount, bool verbose)
+{
+    ResetJobResults(results, jobCount);
+
+    uint32_t weights[MAX_DEVICE_CONTEXT_COUNT];
+    for (uint32_t i = 0; i < s_deviceContextCount; i++) {
+        weights[i] = s_deviceContexts[i].queueCount;
+    }
+
+    struct WorkStealingScheduler scheduler;
+    if (!InitializeWorkStealingScheduler(&scheduler, jobCount, weights, s_deviceContextCount)) {
+        return;
+    }
+
+    thrd_t threads[MAX_DEVICE_CONTEXT_COUNT];
+    bool threadCreated[MAX_DEVICE_CONTEXT_COUNT] = { false };
+    struct DeviceWorkerArgs args[MAX_DEVICE_CONTEXT_COUNT];
+    for (uint32_t i = 0; i < s_deviceContextCount; i++)
+    {
+        args[i] = (struct DeviceWorkerArgs){
+            .deviceIndex = i,
+            .scheduler = &scheduler,
+            .jobs = jobs,
+            .results = results,
+            .verbose = verbose
+        };
+        // Device contexts without a worker leave their range to be stolen by the others
+        threadCreated[i] = thrd_create(&threads[i], DeviceWorkerThreadProc, &args[i]) == thrd_success;
+        if (!threadCreated[i]) {
+            fprintf(stderr, "thrd_create failed for device context %u!\n", i);
+        }
+    }
+
+    for (uint32_t i = 0; i < s_deviceContextCount; i++)
+    {
+        if (threadCreated[i]) {
+            thrd_join(threads[i], NULL);
+        }
+    }
+
+    for (uint32_t i = 0; i < s_deviceContextCount; i++)
+    {
+        printf("Device context %u (%s): executed %u job(s), %u stolen\n", i, s_deviceContexts[i].properties.deviceName,
+            scheduler.executedCounts[i], scheduler.stolenCounts[i]);
+    }
+
+    DestroyWorkStealingScheduler(&scheduler);
+
+    FailOverComputeJobs(jobs, results, jobCount, verbose);
+}
+
+typedef void (*PFN_ComputeJobCompleted)(const struct ComputeJob* job, const struct ComputeJobResult* pJobResult, void* userData);
+
+// Handle of one asynchronously submitted job. The storage belongs to the caller and must outlive the job.
+struct ComputeJobFuture
+{
+    const struct ComputeJob* job;
+    struct ComputeJobResult* jobResult;
+    PFN_ComputeJobCompleted callback;
+    void* userData;
+    // Protected by the mutex of the engine the job was submitted to
+    bool completed;
+};
+
+enum ASYNC_QUEUE_SLOT_STATE
+{
+    ASYNC_QUEUE_SLOT_IDLE,
+    // A producer is preparing a job for the queue
+    ASYNC_QUEUE_SLOT_RESERVED,
+    // Owned by the completion thread until the job retires
+    ASYNC_QUEUE_SLOT_IN_FLIGHT
+};
+
+struct AsyncComputeEngine;
+
+struct AsyncQueueSlot
+{
+    struct AsyncComputeEngine* engine;
+    enum ASYNC_QUEUE_SLOT_STATE state;
+    // Idle slots keep the context of their last job, so that the next job of the same element count and chunk can reuse it
+    bool hasContext;
+    struct ComputeJobContext context;
+    // Element count the kept context was created for; `context.job` of an idle slot belongs to a retired job and may be gone
+    uint32_t contextElemCount;
+    struct ComputeJobFuture* future;
+    // Waits for the fence of this queue only, so a job submitted to another queue never waits behind it
+    thrd_t completionThread;
+    bool completionThreadStarted;
+};
+
+static bool CanRecycleAsyncQueueSlot(const struct AsyncQueueSlot* slot, const struct ComputeJob* job)
+{
+    return slot->hasContext && slot->contextElemCount == job->elemCount && IsSameTestKernelChunk(slot->context.chunk, GetTestKernelChunk(job));
+}
+
+// Runs jobs on all queues of one device without blocking the producers on fences. A completion thread per queue retires
+// the jobs, submits their remaining iterations, keeps their resources for reuse and fires the callbacks.
+// Command pools are only touched by the producer holding a reserved slot, so they need no additional locking.
+struct AsyncComputeEngine
+{
+    struct DeviceContext* deviceContext;
+    // Serializes producers, which share the pipeline cache; contexts release their pipeline when destroyed under it too
+    mtx_t producerMutex;
+    struct ComputePipelineCache pipelineCache;
+    // Serializes the callbacks, so that they may share state without locking
+    mtx_t callbackMutex;
+
+    mtx_t mutex;
+    // Signaled when a job is submitted or retired
+    cnd_t condition;
+    bool stopRequested;
+    struct AsyncQueueSlot slots[MAX_COMPUTE_QUEUE_COUNT];
+    uint32_t slotCount;
+
+    uint32_t submittedJobCount;
+    uint32_t recycledContextCount;
+};
+
+static void CallComputeJobCallback(struct AsyncComputeEngine* engine, const struct ComputeJobFuture* future)
+{
+    if (future->callback != NULL)
+    {
+        mtx_lock(&engine->callbackMutex);
+        future->callback(future->job, future->jobResult, future->userData);
+        mtx_unlock(&engine->callbackMutex);
+    }
+}
+
+static int AsyncCompletionThreadProc(void* arg)
+{
+    struct AsyncQueueSlot* slot = arg;
+    struct AsyncComputeEngine* engine = slot->engine;
+
+    // Adapts to the jobs of this queue only
+    struct CompletionWaiter waiter;
+    InitializeCompletionWaiter(&waiter, engine->deviceContext, s_options.waitStrategy, s_options.maxSpinMicroseconds);
+
+    mtx_lock(&engine->mutex);
+
+    while (true)
+    {
+        // Submitting to the slot wakes the thread right away
+        if (slot->state != ASYNC_QUEUE_SLOT_IN_FLIGHT)
+        {
+            if (engine->stopRequested) {
+                break;
+            }
+            cnd_wait(&engine->condition, &engine->mutex);
+            continue;
+        }
+
+        // An in-flight slot is owned by its completion thread, so it can be processed without holding the lock
+        mtx_unlock(&engine->mutex);
+
+        const struct CompletionTarget target = {
+            .fences = &slot->context.fence,
+            .fenceCount = 1,
+            .semaphore = VK_NULL_HANDLE,
+            .value = 0
+        };
+        VkResult status = WaitForCompletion(&waiter, &target, slot->context.submitTime);
+
+        bool hasMore = false;
+        if (status == VK_SUCCESS)
+        {
+            hasMore = CompleteComputeJobIteration(&slot->context);
+            if (hasMore)
+            {
+                status = SubmitComputeJobIteration(&slot->context);
+                hasMore = status == VK_SUCCESS;
+            }
+        }
+
+        struct ComputeJobFuture* future = slot->future;
+        if (!hasMore)
+        {
+            if (status != VK_SUCCESS)
+            {
+                future->jobResult->result = status;
+                future->jobResult->passed = false;
+            }
+            // The callback runs before the future is marked as completed, so waiters observe its effects
+            CallComputeJobCallback(engine, future);
+        }
+
+        mtx_lock(&engine->mutex);
+
+        if (!hasMore)
+        {
+            slot->state = ASYNC_QUEUE_SLOT_IDLE;
+            slot->future = NULL;
+            future->completed = true;
+            cnd_broadcast(&engine->condition);
+        }
+    }
+
+    mtx_unlock(&engine->mutex);
+
+    return 0;
+}
+
+// Stops the completion threads once the jobs in flight have retired
+static void StopAsyncCompletionThreads(struct AsyncComputeEngine* engine)
+{
+    mtx_lock(&engine->mutex);
+    engine->stopRequested = true;
+    cnd_broadcast(&engine->condition);
+    mtx_unlock(&engine->mutex);
+
+    for (uint32_t i = 0; i < engine->slotCount; i++)
+    {
+        if (engine->slots[i].completionThreadStarted) {
+            thrd_join(engine->slots[i].completionThread, NULL);
+        }
+    }
+}
+
+static VkResult CreateAsyncComputeEngine(struct DeviceContext* deviceContext, struct AsyncComputeEngine* engine)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->deviceContext = deviceContext;
+    engine->pipelineCache.device = deviceContext->device;
+    engine->slotCount = deviceContext->queueCount;
+
+    VkResult result = AcquireShaderModule(deviceContext, "test", NULL, &engine->pipelineCache.shaderModule);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return result;
+    }
+
+    if (mtx_init(&engine->producerMutex, mtx_plain) != thrd_success || mtx_init(&engine->callbackMutex, mtx_plain) != thrd_success ||
+        mtx_init(&engine->mutex, mtx_plain) != thrd_success || cnd_init(&engine->condition) != thrd_success)
+    {
+        fprintf(stderr, "Failed to initialize the synchronization of the engine!\n");
+        DestroyComputePipelineCache(&engine->pipelineCache);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    for (uint32_t i = 0; i < engine->slotCount; i++)
+    {
+        struct AsyncQueueSlot* slot = &engine->slots[i];
+        slot->engine = engine;
+        slot->completionThreadStarted = thrd_create(&slot->completionThread, AsyncCompletionThreadProc, slot) == thrd_success;
+        if (!slot->completionThreadStarted)
+        {
+            fprintf(stderr, "Failed to start the completion thread of queue[%u]!\n", i);
+            StopAsyncCompletionThreads(engine);
+            DestroyComputePipelineCache(&engine->pipelineCache);
+            cnd_destroy(&engine->condition);
+            mtx_destroy(&engine->mutex);
+            mtx_destroy(&engine->callbackMutex);
+            mtx_destroy(&engine->producerMutex);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+    }
+
+    return VK_SUCCESS;
+}
+
+// Waits for all submitted jobs, then stops the completion threads and releases the kept contexts
+static void DestroyAsyncComputeEngine(struct AsyncComputeEngine* engine)
+{
+    StopAsyncCompletionThreads(engine);
+
+    for (uint32_t i = 0; i < engine->slotCount; i++)
+    {
+        if (engine->slots[i].hasContext) {
+            DestroyComputeJobContext(&engine->slots[i].context);
+        }
+    }
+
+    DestroyComputePipelineCache(&engine->pipelineCache);
+    cnd_destroy(&engine->condition);
+    mtx_destroy(&engine->mutex);
+    mtx_destroy(&engine->callbackMutex);
+    mtx_destroy(&engine->producerMutex);
+}
+
+// Submits a job and returns as soon as it is on a queue. Only blocks while every queue is busy.
+// `callback` is called once the job has retired, on a completion thread, or on the calling thread if the job could not be
+// submitted; callbacks never run concurrently. `future` can be waited on with WaitComputeJobFuture.
+static VkResult SubmitComputeJobAsync(struct AsyncComputeEngine* engine, const struct ComputeJob* job, struct ComputeJobResult* pJobResult,
+    PFN_ComputeJobCompleted callback, void* userData, struct ComputeJobFuture* future)
+{
+    memset(pJobResult, 0, sizeof(*pJobResult));
+    pJobResult->result = VK_NOT_READY;
+    *future = (struct ComputeJobFuture){
+        .job = job,
+        .jobResult = pJobResult,
+        .callback = callback,
+        .userData = userData,
+        .completed = false
+    };
+
+    mtx_lock(&engine->mutex);
+
+    // Prefer an idle queue whose kept context matches the element count
+    uint32_t slotIndex = UINT32_MAX;
+    while (slotIndex == UINT32_MAX)
+    {
+        for (uint32_t i = 0; i < engine->slotCount; i++)
+        {
+            const struct AsyncQueueSlot* slot = &engine->slots[i];
+            if (slot->state != ASYNC_QUEUE_SLOT_IDLE) {
+                continue;
+            }
+            if (slotIndex == UINT32_MAX || CanRecycleAsyncQueueSlot(slot, job)) {
+                slotIndex = i;
+            }
+        }
+        if (slotIndex == UINT32_MAX) {
+            cnd_wait(&engine->condition, &engine->mutex);
+        }
+    }
+
+    struct AsyncQueueSlot* slot = &engine->slots[slotIndex];
+    slot->state = ASYNC_QUEUE_SLOT_RESERVED;
+    slot->future = future;
+
+    mtx_unlock(&engine->mutex);
+
+    pJobResult->deviceIndex = (uint32_t)(engine->deviceContext - s_deviceContexts);
+    pJobResult->queueIndex = slotIndex;
+
+    VkResult result = VK_SUCCESS;
+    const bool recycled = CanRecycleAsyncQueueSlot(slot, job);
+    if (recycled) {
+        result = RebindComputeJobContext(&slot->context, job, pJobResult);
+    }
+    else
+    {
+        mtx_lock(&engine->producerMutex);
+        if (slot->hasContext)
+        {
+            DestroyComputeJobContext(&slot->context);
+            slot->hasContext = false;
+        }
+
+        result = CreateComputeJobContext(engine->deviceContext, job, pJobResult, slotIndex, &engine->pipelineCache, false, true, &slot->context);
+        if (result != VK_SUCCESS) {
+            DestroyComputeJobContext(&slot->context);
+        }
+        mtx_unlock(&engine->producerMutex);
+
+        slot->hasContext = result == VK_SUCCESS;
+        slot->contextElemCount = job->elemCount;
+    }
+
+    if (result == VK_SUCCESS) {
+        result = SubmitComputeJobIteration(&slot->context);
+    }
+
+    if (result == VK_SUCCESS)
+    {
+        mtx_lock(&engine->mutex);
+        slot->state = ASYNC_QUEUE_SLOT_IN_FLIGHT;
+        engine->submittedJobCount++;
+        if (recycled) {
+            engine->recycledContextCount++;
+        }
+        cnd_broadcast(&engine->condition);
+        mtx_unlock(&engine->mutex);
+        return result;
+    }
+
+    // The job never reached the queue, so there is nothing for the completion thread to retire
+    pJobResult->result = result;
+    CallComputeJobCallback(engine, future);
+
+    mtx_lock(&engine->mutex);
+    slot->state = ASYNC_QUEUE_SLOT_IDLE;
+    slot->future = NULL;
+    future->completed = true;
+    cnd_broadcast(&engine->condition);
+    mtx_unlock(&engine->mutex);
+
+    return result;
+}
+
+static void WaitComputeJobFuture(struct AsyncComputeEngine* engine, const struct ComputeJobFuture* future)
+{
+    mtx_lock(&engine->mutex);
+    while (!future->completed) {
+        cnd_wait(&engine->condition, &engine->mutex);
+    }
+    mtx_unlock(&engine->mutex);
+}
+
+static void RunComputeJob(const struct ComputeJob* job, struct ComputeJobResult* pJobResult)
+{
+    printf("\n================ Begin the compute job `%s` ================\n\n", job->name);
+
+    RunComputeJobs(job, pJobResult, 1, 1, true);
+
+    printf("\n================ Complete the compute job `%s` ================\n\n", job->name);
+}
+
+static bool RunComputeTest(void)
+{
+    const struct ComputeJob job = {
+        .name = "default",
+        .elemCount = DEFAULT_ELEMENT_COUNT,
+        .iterations = 1
+    };
+    struct ComputeJobResult jobResult;
+    RunComputeJob(&job, &jobResult);
+    return jobResult.passed;
+}
+
+// Partitions one large input into chunks, runs the chunks across all device contexts and gathers the output in order
+static bool RunMultiDeviceTest(uint32_t totalElemCount)
+{
+    static struct ComputeJob jobs[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobResult results[MAX_BATCH_JOB_COUNT];
+
+    uint32_t chunkElemCount = MULTI_DEVICE_CHUNK_ELEMENT_COUNT;
+    uint32_t jobCount = (totalElemCount + chunkElemCount - 1) / chunkElemCount;
+    if (jobCount > MAX_BATCH_JOB_COUNT)
+    {
+        jobCount = MAX_BATCH_JOB_COUNT;
+        chunkElemCount = (totalElemCount + jobCount - 1) / jobCount;
+        chunkElemCount = (chunkElemCount + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE * COMPUTE_WORKGROUP_SIZE;
+    }
+
+    int* output = malloc((size_t)totalElemCount * sizeof(int));
+    if (output == NULL)
+    {
+        fprintf(stderr, "Failed to allocate the output of %u elements!\n", totalElemCount);
+        return false;
+    }
+
+    printf("\n================ Begin the multi-device test: %u elements in %u chunk(s) over %u device context(s) ================\n\n",
+        totalElemCount, jobCount, s_deviceContextCount);
+
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        const uint32_t firstElement = i * chunkElemCount;
+        snprintf(jobs[i].name, sizeof(jobs[i].name), "chunk%u", i);
+        jobs[i].elemCount = min(chunkElemCount, totalElemCount - firstElement);
+        jobs[i].iterations = 1;
+        jobs[i].firstElement = firstElement;
+        jobs[i].totalElemCount = totalElemCount;
+        jobs[i].outputData = output + firstElement;
+    }
+
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    RunMultiDeviceJobs(jobs, results, jobCount, false);
+    const double wallMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+    bool passed = true;
+    for (uint32_t i = 0; i < jobCount && passed; i++)
+    {
+        if (!results[i].passed)
+        {
+            fprintf(stderr, "Chunk %u failed on device context %u: %d\n", i, results[i].deviceIndex, results[i].result);
+            passed = false;
+        }
+    }
+
+    // The gathered output must be the output of a single run: the element count of the whole input, then 2 * i
+    if (passed && output[0] != (int)totalElemCount)
+    {
+        fprintf(stderr, "The gathered output has a wrong header: %d\n", output[0]);
+        passed = false;
+    }
+    for (uint32_t e = 1; e < totalElemCount && passed; e++)
+    {
+        if (output[e] != (int)(e * 2))
+        {
+            fprintf(stderr, "Gathered result error @ %u, result is: %d\n", e, output[e]);
+            passed = false;
+        }
+    }
+
+    printf("Multi-device test %s in %.3fms (%.2f Melem/s)\n", passed ? "passed" : "failed", wallMilliseconds, totalElemCount / (wallMilliseconds * 1000.0));
+    printf("\n================ Complete the multi-device test ================\n\n");
+
+    free(output);
+    return passed;
+}
+
+// Runs the same set of independent jobs with 1..N queues and reports the aggregate throughput
+static bool RunQueueScalingBenchmark(uint32_t jobCount)
+{
+    static struct ComputeJob jobs[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobResult results[MAX_BATCH_JOB_COUNT];
+
+    if (jobCount > MAX_BATCH_JOB_COUNT) {
+        jobCount = MAX_BATCH_JOB_COUNT;
+    }
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        snprintf(jobs[i].name, sizeof(jobs[i].name), "bench%u", i);
+        jobs[i].elemCount = QUEUE_BENCHMARK_ELEMENT_COUNT;
+        jobs[i].iterations = QUEUE_BENCHMARK_ITERATIONS;
+    }
+
+    printf("\n================ Queue scaling benchmark: %u job(s) x %d iteration(s) x %d elements ================\n\n",
+        jobCount, QUEUE_BENCHMARK_ITERATIONS, QUEUE_BENCHMARK_ELEMENT_COUNT);
+    puts("queues  wall(ms)    jobs/s      Melem/s     speedup");
+
+    bool allPassed = true;
+    double baseMilliseconds = 0.0;
+    for (uint32_t queueCount = 1; queueCount <= s_deviceContexts[0].queueCount; queueCount++)
+    {
+        const uint64_t beginTime = GetCurrentTimeNanoseconds();
+        RunComputeJobs(jobs, results, jobCount, queueCount, false);
+        const double wallMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+        for (uint32_t i = 0; i < jobCount; i++)
+        {
+            if (!results[i].passed)
+            {
+                fprintf(stderr, "Job `%s` failed with %u queue(s): %d\n", jobs[i].name, queueCount, results[i].result);
+                allPassed = false;
+            }
+        }
+
+        if (queueCount == 1) {
+            baseMilliseconds = wallMilliseconds;
+        }
+        const double totalElements = (double)jobCount * QUEUE_BENCHMARK_ITERATIONS * QUEUE_BENCHMARK_ELEMENT_COUNT;
+        printf("%6u  %10.3f  %10.2f  %10.2f  %7.2fx\n", queueCount, wallMilliseconds, jobCount * 1000.0 / wallMilliseconds,
+            totalElements / (wallMilliseconds * 1000.0), baseMilliseconds / wallMilliseconds);
+    }
+
+    return allPassed;
+}
+
+struct AsyncSubmissionStats
+{
+    uint32_t completedCount;
+    uint32_t failedCount;
+};
+
+// The engine serializes the callbacks, so the statistics need no locking
+static void OnAsyncComputeJobCompleted(const struct ComputeJob* job, const struct ComputeJobResult* pJobResult, void* userData)
+{
+    struct AsyncSubmissionStats* stats = userData;
+    stats->completedCount++;
+    if (!pJobResult->passed)
+    {
+        stats->failedCount++;
+        fprintf(stderr, "Job `%s` failed on queue[%u]: %d\n", job->name, pJobResult->queueIndex, pJobResult->result);
+    }
+}
+
+// Submits independent jobs of two alternating sizes from a single producer thread and waits on their futures at the end
+static bool RunAsyncSubmissionTest(uint32_t jobCount)
+{
+    static struct ComputeJob jobs[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobResult results[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobFuture futures[MAX_BATCH_JOB_COUNT];
+
+    if (jobCount > MAX_BATCH_JOB_COUNT) {
+        jobCount = MAX_BATCH_JOB_COUNT;
+    }
+
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        snprintf(jobs[i].name, sizeof(jobs[i].name), "async%u", i);
+        jobs[i].elemCount = QUEUE_BENCHMARK_ELEMENT_COUNT * (1 + i % 2);
+        jobs[i].iterations = 1;
+        jobs[i].firstElement = i;
+        jobs[i].outputData = NULL;
+    }
+
+    struct AsyncComputeEngine engine;
+    if (CreateAsyncComputeEngine(&s_deviceContexts[0], &engine) != VK_SUCCESS) {
+        return false;
+    }
+
+    printf("\n================ Begin the async submission test: %u jobs on %u queue(s) ================\n\n", jobCount, engine.slotCount);
+
+    struct AsyncSubmissionStats stats = { 0 };
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    uint64_t producerNanoseconds = 0;
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        const uint64_t submitBeginTime = GetCurrentTimeNanoseconds();
+        SubmitComputeJobAsync(&engine, &jobs[i], &results[i], OnAsyncComputeJobCompleted, &stats, &futures[i]);
+        producerNanoseconds += GetCurrentTimeNanoseconds() - submitBeginTime;
+    }
+    for (uint32_t i = 0; i < jobCount; i++) {
+        WaitComputeJobFuture(&engine, &futures[i]);
+    }
+    const double wallMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+    bool passed = stats.completedCount == jobCount && stats.failedCount == 0;
+    printf("%u job(s) completed, %u failed, %u of %u submission(s) reused a retired context\n", stats.completedCount, stats.failedCount,
+        engine.recycledContextCount, engine.submittedJobCount);
+    printf("Producer time %.3fms (%.3fms per job), wall time %.3fms\n", producerNanoseconds / 1000000.0,
+        jobCount > 0 ? producerNanoseconds / 1000000.0 / jobCount : 0.0, wallMilliseconds);
+
+    DestroyAsyncComputeEngine(&engine);
+
+    printf("\n================ Complete the async submission test ================\n\n");
+
+    return passed;
+}
+
+static int CompareDoubles(const void* a, const void* b)
+{
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// `values` must be sorted in ascending order
+static double GetPercentile(const double values[], uint32_t count, double percentile)
+{
+    if (count == 0) {
+        return 0.0;
+    }
+    const uint32_t index = (uint32_t)(percentile / 100.0 * (double)(count - 1) + 0.5);
+    return values[min(index, count - 1)];
+}
+
+// Gathers ready jobs and submits them with a single vkQueueSubmit, one VkSubmitInfo per job. Every job signals its own value
+// of one timeline semaphore, so jobs still complete one by one without a fence per job.
+struct SubmissionBatcher
+{
+    struct DeviceContext* deviceContext;
+    uint32_t queueIndex;
+    VkSemaphore timelineSemaphore;
+    // Value signaled by the last submitted job
+    uint64_t lastSubmittedValue;
+    // A batch is submitted as soon as it holds `maxBatchSize` jobs or its first job has waited `windowNanoseconds`
+    uint32_t maxBatchSize;
+    uint64_t windowNanoseconds;
+    struct ComputeJobContext* pendingContexts[MAX_COALESCED_BATCH_SIZE];
+    uint32_t pendingCount;
+    uint64_t firstPendingTime;
+    uint32_t submitCount;
+};
+
+static VkResult CreateSubmissionBatcher(struct DeviceContext* deviceContext, uint32_t queueIndex, struct SubmissionBatcher* batcher)
+{
+    memset(batcher, 0, sizeof(*batcher));
+    batcher->deviceContext = deviceContext;
+    batcher->queueIndex = queueIndex;
+    batcher->maxBatchSize = 1;
+
+    if (deviceContext->getSemaphoreCounterValue == NULL)
+    {
+        fprintf(stderr, "The current device does not support timeline semaphores!\n");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    const VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .pNext = NULL,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0
+    };
+    const VkSemaphoreCreateInfo semaphoreCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &semaphoreTypeCreateInfo,
+        .flags = 0
+    };
+    const VkResult result = vkCreateSemaphore(deviceContext->device, &semaphoreCreateInfo, NULL, &batcher->timelineSemaphore);
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateSemaphore failed: %d\n", result);
+    }
+    return result;
+}
+
+static void DestroySubmissionBatcher(struct SubmissionBatcher* batcher)
+{
+    if (batcher->timelineSemaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(batcher->deviceContext->device, batcher->timelineSemaphore, NULL);
+    }
+    memset(batcher, 0, sizeof(*batcher));
+}
+
+// Submits all pending jobs at once. The job at position i of the batch signals `lastSubmittedValue + 1 + i`.
+static VkResult FlushSubmissionBatch(struct SubmissionBatcher* batcher)
+{
+    if (batcher->pendingCount == 0) {
+        return VK_SUCCESS;
+    }
+
+    VkSubmitInfo submitInfos[MAX_COALESCED_BATCH_SIZE];
+    VkTimelineSemaphoreSubmitInfo timelineInfos[MAX_COALESCED_BATCH_SIZE];
+    uint64_t signalValues[MAX_COALESCED_BATCH_SIZE];
+    for (uint32_t i = 0; i < batcher->pendingCount; i++)
+    {
+        signalValues[i] = batcher->lastSubmittedValue + 1 + i;
+        timelineInfos[i] = (VkTimelineSemaphoreSubmitInfo){
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .pNext = NULL,
+            .waitSemaphoreValueCount = 0,
+            .pWaitSemaphoreValues = NULL,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &signalValues[i]
+        };
+        submitInfos[i] = (VkSubmitInfo){
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timelineInfos[i],
+            .waitSemaphoreCount = 0,
+            .pWaitSemaphores = NULL,
+            .pWaitDstStageMask = NULL,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &batcher->pendingContexts[i]->commandBuffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &batcher->timelineSemaphore
+        };
+    }
+
+    const uint64_t submitTime = GetCurrentTimeNanoseconds();
+    const VkResult result = vkQueueSubmit(batcher->deviceContext->queues[batcher->queueIndex], batcher->pendingCount, submitInfos, VK_NULL_HANDLE);
+    if (result != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkQueueSubmit failed: %d\n", result);
+        return result;
+    }
+
+    AddHostCounter(HOST_COUNTER_SUBMITS, 1);
+    for (uint32_t i = 0; i < batcher->pendingCount; i++)
+    {
+        batcher->pendingContexts[i]->submitTime = submitTime;
+        batcher->pendingContexts[i]->timelineValue = signalValues[i];
+        CountComputeJobCommands(batcher->pendingContexts[i]);
+    }
+    batcher->lastSubmittedValue += batcher->pendingCount;
+    batcher->pendingCount = 0;
+    batcher->submitCount++;
+
+    return VK_SUCCESS;
+}
+
+// Queues a job whose command buffer is recorded; the batch is submitted right away once it is full
+static VkResult AddBatchedJob(struct SubmissionBatcher* batcher, struct ComputeJobContext* context)
+{
+    context->timelineValue = 0;
+    if (batcher->pendingCount == 0) {
+        batcher->firstPendingTime = GetCurrentTimeNanoseconds();
+    }
+    batcher->pendingContexts[batcher->pendingCount++] = context;
+
+    return batcher->pendingCount >= batcher->maxBatchSize ? FlushSubmissionBatch(batcher) : VK_SUCCESS;
+}
+
+// Submits the pending batch once its window has expired; to be called regularly by the owner of the batcher
+static VkResult PollSubmissionBatcher(struct SubmissionBatcher* batcher, uint64_t currentTime)
+{
+    if (batcher->pendingCount > 0 && currentTime - batcher->firstPendingTime >= batcher->windowNanoseconds) {
+        return FlushSubmissionBatch(batcher);
+    }
+    return VK_SUCCESS;
+}
+
+// Jobs whose timeline value is not above the returned value have completed
+static VkResult GetCompletedBatchValue(const struct SubmissionBatcher* batcher, uint64_t* pValue)
+{
+    const VkResult result = batcher->deviceContext->getSemaphoreCounterValue(batcher->deviceContext->device, batcher->timelineSemaphore, pValue);
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "vkGetSemaphoreCounterValue failed: %d\n", result);
+    }
+    return result;
+}
+
+struct CoalescingConfig
+{
+    // 0 submits every job on arrival with its own vkQueueSubmit and fence, bypassing the batcher
+    uint32_t maxBatchSize;
+    uint32_t windowMicroseconds;
+};
+
+struct CoalescingMeasurement
+{
+    uint32_t submitCount;
+    double wallMilliseconds;
+    // From the arrival of a job until the host observes its completion
+    double meanLatencyMilliseconds;
+    double p50LatencyMilliseconds;
+    double p99LatencyMilliseconds;
+};
+
+// Jobs arrive every COALESCING_JOB_INTERVAL_MICROSECONDS. They are submitted according to `config` while the same thread
+// polls for completions, so the latency includes the time a job waits in the batcher.
+static bool MeasureSubmissionCoalescing(struct SubmissionBatcher* batcher, struct ComputeJobContext contexts[], const struct ComputeJob jobs[],
+    struct ComputeJobResult results[], uint32_t jobCount, const struct CoalescingConfig* config, struct CoalescingMeasurement* pMeasurement)
+{
+    static uint64_t arrivalTimes[MAX_BATCH_JOB_COUNT];
+    static double latencies[MAX_BATCH_JOB_COUNT];
+    const VkDevice device = batcher->deviceContext->device;
+    memset(pMeasurement, 0, sizeof(*pMeasurement));
+
+    ResetJobResults(results, jobCount);
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        if (RebindComputeJobContext(&contexts[i], &jobs[i], &results[i]) != VK_SUCCESS) {
+            return false;
+        }
+    }
+
+    batcher->maxBatchSize = config->maxBatchSize;
+    batcher->windowNanoseconds = (uint64_t)config->windowMicroseconds * 1000;
+    const uint32_t initialSubmitCount = batcher->submitCount;
+
+    bool passed = true;
+    uint32_t arrivedCount = 0;
+    uint32_t completedCount = 0;
+    uint32_t fenceSubmitCount = 0;
+    bool completed[MAX_BATCH_JOB_COUNT] = { false };
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    while (completedCount < jobCount && passed)
+    {
+        uint64_t currentTime = GetCurrentTimeNanoseconds();
+        while (arrivedCount < jobCount && currentTime - beginTime >= (uint64_t)arrivedCount * COALESCING_JOB_INTERVAL_MICROSECONDS * 1000)
+        {
+            struct ComputeJobContext* context = &contexts[arrivedCount];
+            arrivalTimes[arrivedCount++] = currentTime;
+            if (config->maxBatchSize == 0)
+            {
+                passed = SubmitComputeJobIteration(context) == VK_SUCCESS;
+                fenceSubmitCount++;
+            }
+            else {
+                passed = AddBatchedJob(batcher, context) == VK_SUCCESS;
+            }
+            if (!passed) {
+                break;
+            }
+        }
+        if (passed && config->maxBatchSize > 0) {
+            passed = PollSubmissionBatcher(batcher, currentTime) == VK_SUCCESS;
+        }
+
+        uint64_t completedValue = 0;
+        if (passed && config->maxBatchSize > 0) {
+            passed = GetCompletedBatchValue(batcher, &completedValue) == VK_SUCCESS;
+        }
+
+        currentTime = GetCurrentTimeNanoseconds();
+        for (uint32_t i = 0; i < arrivedCount && passed; i++)
+        {
+            if (completed[i]) {
+                continue;
+            }
+            bool done = false;
+            if (config->maxBatchSize == 0)
+            {
+                const VkResult status = vkGetFenceStatus(device, contexts[i].fence);
+                passed = status == VK_SUCCESS || status == VK_NOT_READY;
+                done = status == VK_SUCCESS;
+            }
+            else {
+                done = contexts[i].timelineValue != 0 && contexts[i].timelineValue <= completedValue;
+            }
+            if (done)
+            {
+                latencies[completedCount++] = (double)(currentTime - arrivalTimes[i]) / 1000000.0;
+                completed[i] = true;
+                CompleteComputeJobIteration(&contexts[i]);
+                if (!results[i].passed)
+                {
+                    fprintf(stderr, "Job `%s` failed: %d\n", jobs[i].name, results[i].result);
+                    passed = false;
+                }
+            }
+        }
+    }
+    pMeasurement->wallMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+    if (!passed)
+    {
+        // Nothing may be in flight when the contexts are reused or destroyed
+        vkQueueWaitIdle(batcher->deviceContext->queues[batcher->queueIndex]);
+        batcher->pendingCount = 0;
+        return false;
+    }
+
+    double totalLatency = 0.0;
+    for (uint32_t i = 0; i < completedCount; i++) {
+        totalLatency += latencies[i];
+    }
+    qsort(latencies, completedCount, sizeof(latencies[0]), CompareDoubles);
+    pMeasurement->submitCount = config->maxBatchSize == 0 ? fenceSubmitCount : batcher->submitCount - initialSubmitCount;
+    pMeasurement->meanLatencyMilliseconds = completedCount > 0 ? totalLatency / completedCount : 0.0;
+    pMeasurement->p50LatencyMilliseconds = GetPercentile(latencies, completedCount, 50.0);
+    pMeasurement->p99LatencyMilliseconds = GetPercentile(latencies, completedCount, 99.0);
+
+    return true;
+}
+
+// Compares a submission and a fence per job with coalesced submissions under a steady arrival rate of small jobs,
+// for the default set of batch sizes and windows or for the one given with `--coalesce`
+static bool RunSubmissionCoalescingBenchmark(uint32_t jobCount, uint32_t maxBatchSize, uint32_t windowMicroseconds)
+{
+    static struct ComputeJob jobs[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobResult results[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobContext contexts[MAX_BATCH_JOB_COUNT];
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+
+    static const struct CoalescingConfig defaultConfigs[] = {
+        { .maxBatchSize = 0, .windowMicroseconds = 0 },
+        { .maxBatchSize = 1, .windowMicroseconds = 0 },
+        { .maxBatchSize = 8, .windowMicroseconds = 50 },
+        { .maxBatchSize = 32, .windowMicroseconds = 200 },
+        { .maxBatchSize = MAX_COALESCED_BATCH_SIZE, .windowMicroseconds = 1000 }
+    };
+    const struct CoalescingConfig customConfigs[] = {
+        { .maxBatchSize = 0, .windowMicroseconds = 0 },
+        { .maxBatchSize = maxBatchSize, .windowMicroseconds = windowMicroseconds }
+    };
+    const struct CoalescingConfig* configs = maxBatchSize > 0 ? customConfigs : defaultConfigs;
+    const uint32_t configCount = maxBatchSize > 0 ? 2 : (uint32_t)(sizeof(defaultConfigs) / sizeof(defaultConfigs[0]));
+
+    if (jobCount > MAX_BATCH_JOB_COUNT) {
+        jobCount = MAX_BATCH_JOB_COUNT;
+    }
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        snprintf(jobs[i].name, sizeof(jobs[i].name), "small%u", i);
+        jobs[i].elemCount = COALESCING_BENCHMARK_ELEMENT_COUNT;
+        jobs[i].iterations = 1;
+        jobs[i].firstElement = i;
+        jobs[i].outputData = NULL;
+    }
+
+    printf("\n================ Submission coalescing benchmark: %u job(s) of %d elements, one every %dus ================\n\n",
+        jobCount, COALESCING_BENCHMARK_ELEMENT_COUNT, COALESCING_JOB_INTERVAL_MICROSECONDS);
+
+    struct ComputePipelineCache pipelineCache = { .device = deviceContext->device };
+    struct SubmissionBatcher batcher = { 0 };
+    uint32_t contextCount = 0;
+    bool passed = AcquireShaderModule(deviceContext, "test", NULL, &pipelineCache.shaderModule) == VK_SUCCESS &&
+        CreateSubmissionBatcher(deviceContext, 0, &batcher) == VK_SUCCESS;
+
+    // All jobs are recorded up front, so the measurement only covers submission and completion
+    for (; contextCount < jobCount && passed; contextCount++) {
+        passed = CreateComputeJobContext(deviceContext, &jobs[contextCount], &results[contextCount], 0, &pipelineCache, false, true,
+            &contexts[contextCount]) == VK_SUCCESS;
+    }
+
+    if (passed) {
+        puts("batch  window(us)  submits  wall(ms)    jobs/s      mean(ms)  p50(ms)   p99(ms)");
+    }
+    for (uint32_t c = 0; c < configCount && passed; c++)
+    {
+        struct CoalescingMeasurement measurement;
+        passed = MeasureSubmissionCoalescing(&batcher, contexts, jobs, results, jobCount, &configs[c], &measurement);
+        if (!passed) {
+            break;
+        }
+
+        char batchLabel[16];
+        if (configs[c].maxBatchSize == 0) {
+            snprintf(batchLabel, sizeof(batchLabel), "fence");
+        }
+        else {
+            snprintf(batchLabel, sizeof(batchLabel), "%u", configs[c].maxBatchSize);
+        }
+        printf("%-5s  %10u  %7u  %8.3f  %10.2f  %8.3f  %8.3f  %8.3f\n", batchLabel, configs[c].windowMicroseconds, measurement.submitCount,
+            measurement.wallMilliseconds, jobCount * 1000.0 / measurement.wallMilliseconds, measurement.meanLatencyMilliseconds,
+            measurement.p50LatencyMilliseconds, measurement.p99LatencyMilliseconds);
+    }
+
+    for (uint32_t i = 0; i < contextCount; i++) {
+        DestroyComputeJobContext(&contexts[i]);
+    }
+    DestroySubmissionBatcher(&batcher);
+    DestroyComputePipelineCache(&pipelineCache);
+
+    printf("\n================ Complete the submission coalescing benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+struct WaitMeasurement
+{
+    // From the submission until the wait returns
+    double p50LatencyMicroseconds;
+    double p99LatencyMicroseconds;
+    // Thread CPU time spent in the waits
+    double cpuMicrosecondsPerJob;
+    double cpuPercent;
+    double spinCompletionPercent;
+};
+
+// Runs the iterations of `context` one at a time and waits for each with `strategy`, on its fence or, with `batcher`, on the
+// timeline value its submission signals
+static bool MeasureCompletionWaits(struct ComputeJobContext* context, struct SubmissionBatcher* batcher, enum WAIT_STRATEGY strategy,
+    double latencies[], struct WaitMeasurement* pMeasurement)
+{
+    const uint32_t jobCount = context->job->iterations;
+    struct CompletionWaiter waiter;
+    InitializeCompletionWaiter(&waiter, context->deviceContext, strategy, s_options.maxSpinMicroseconds);
+
+    ResetJobResults(context->jobResult, 1);
+    bool passed = RebindComputeJobContext(context, context->job, context->jobResult) == VK_SUCCESS;
+
+    uint64_t waitCpuNanoseconds = 0;
+    uint64_t waitNanoseconds = 0;
+    for (uint32_t i = 0; i < jobCount && passed; i++)
+    {
+        struct CompletionTarget target = {
+            .fences = &context->fence,
+            .fenceCount = 1,
+            .semaphore = VK_NULL_HANDLE,
+            .value = 0
+        };
+        VkResult result = VK_SUCCESS;
+        if (batcher != NULL)
+        {
+            if (context->iteration > 0) {
+                result = RefillComputeJobSource(context);
+            }
+            if (result == VK_SUCCESS) {
+                result = AddBatchedJob(batcher, context);
+            }
+            target = (struct CompletionTarget){
+                .fences = NULL,
+                .fenceCount = 0,
+                .semaphore = batcher->timelineSemaphore,
+                .value = context->timelineValue
+            };
+        }
+        else {
+            result = SubmitComputeJobIteration(context);
+        }
+        if (result != VK_SUCCESS) {
+            break;
+        }
+
+        const uint64_t cpuBeginTime = GetThreadCpuTimeNanoseconds();
+        const uint64_t beginTime = GetCurrentTimeNanoseconds();
+        result = WaitForCompletion(&waiter, &target, context->submitTime);
+        const uint64_t endTime = GetCurrentTimeNanoseconds();
+        waitCpuNanoseconds += GetThreadCpuTimeNanoseconds() - cpuBeginTime;
+        waitNanoseconds += endTime - beginTime;
+        latencies[i] = (double)(endTime - context->submitTime) / 1000.0;
+
+        passed = result == VK_SUCCESS;
+        if (passed) {
+            passed = CompleteComputeJobIteration(context) || context->jobResult->passed;
+        }
+    }
+
+    if (!passed)
+    {
+        // Nothing may be in flight when the context is reused or destroyed
+        vkQueueWaitIdle(context->deviceContext->queues[context->queueIndex]);
+        fprintf(stderr, "Waiting with %s failed!\n", s_waitStrategyNames[strategy]);
+        return false;
+    }
+
+    qsort(latencies, jobCount, sizeof(latencies[0]), CompareDoubles);
+    pMeasurement->p50LatencyMicroseconds = GetPercentile(latencies, jobCount, 50.0);
+    pMeasurement->p99LatencyMicroseconds = GetPercentile(latencies, jobCount, 99.0);
+    pMeasurement->cpuMicrosecondsPerJob = (double)waitCpuNanoseconds / 1000.0 / jobCount;
+    pMeasurement->cpuPercent = waitNanoseconds > 0 ? 100.0 * (double)waitCpuNanoseconds / (double)waitNanoseconds : 0.0;
+    pMeasurement->spinCompletionPercent = 100.0 * waiter.spinCompletions / jobCount;
+
+    return true;
+}
+
+// Compares the wait strategies on jobs shorter and longer than the spin window, waiting on fences and on timeline semaphores
+static bool RunCompletionWaitBenchmark(uint32_t jobCount)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    static const uint32_t elemCounts[] = { WAIT_BENCHMARK_SMALL_ELEMENT_COUNT, WAIT_BENCHMARK_LARGE_ELEMENT_COUNT };
+    const uint32_t maxSpinMicroseconds = s_options.maxSpinMicroseconds > 0 ? s_options.maxSpinMicroseconds : DEFAULT_MAX_SPIN_MICROSECONDS;
+
+    printf("\n================ Begin the completion wait benchmark: %u job(s) per strategy, spin window up to %uus ================\n\n",
+        jobCount, maxSpinMicroseconds);
+
+    struct ComputePipelineCache pipelineCache = { .device = deviceContext->device };
+    struct SubmissionBatcher batcher = { 0 };
+    double* latencies = malloc(jobCount * sizeof(double));
+    bool passed = latencies != NULL && AcquireShaderModule(deviceContext, "test", NULL, &pipelineCache.shaderModule) == VK_SUCCESS;
+
+    // Timeline semaphores are optional; the batcher submits every job on arrival, as its batches hold a single job
+    const bool useTimeline = passed && deviceContext->getSemaphoreCounterValue != NULL && deviceContext->waitSemaphores != NULL &&
+        CreateSubmissionBatcher(deviceContext, 0, &batcher) == VK_SUCCESS;
+    if (passed && !useTimeline) {
+        puts("Timeline semaphores are not available, only fences are measured.");
+    }
+
+    for (uint32_t e = 0; e < sizeof(elemCounts) / sizeof(elemCounts[0]) && passed; e++)
+    {
+        struct ComputeJob job = {
+            .elemCount = elemCounts[e],
+            .iterations = jobCount,
+            .firstElement = 0,
+            .outputData = NULL
+        };
+        snprintf(job.name, sizeof(job.name), "wait%u", elemCounts[e]);
+        struct ComputeJobResult jobResult;
+        struct ComputeJobContext context;
+        passed = CreateComputeJobContext(deviceContext, &job, &jobResult, 0, &pipelineCache, false, true, &context) == VK_SUCCESS;
+        if (!passed)
+        {
+            DestroyComputeJobContext(&context);
+            break;
+        }
+
+        printf("Jobs of %u elements:\n", elemCounts[e]);
+        puts("target    strategy   p50(us)    p99(us)    cpu/job(us)  cpu(%)   spun(%)");
+        for (uint32_t target = 0; target < (useTimeline ? 2U : 1U) && passed; target++)
+        {
+            for (int strategy = 0; strategy < WAIT_STRATEGY_COUNT && passed; strategy++)
+            {
+                struct WaitMeasurement measurement;
+                passed = MeasureCompletionWaits(&context, target == 0 ? NULL : &batcher, (enum WAIT_STRATEGY)strategy, latencies, &measurement);
+                if (passed)
+                {
+                    printf("%-8s  %-8s  %9.1f  %9.1f  %11.1f  %6.1f  %7.1f\n", target == 0 ? "fence" : "timeline", s_waitStrategyNames[strategy],
+                        measurement.p50LatencyMicroseconds, measurement.p99LatencyMicroseconds, measurement.cpuMicrosecondsPerJob,
+                        measurement.cpuPercent, measurement.spinCompletionPercent);
+                }
+            }
+        }
+        puts("");
+
+        DestroyComputeJobContext(&context);
+    }
+
+    if (useTimeline) {
+        DestroySubmissionBatcher(&batcher);
+    }
+    DestroyComputePipelineCache(&pipelineCache);
+    free(latencies);
+
+    printf("================ Complete the completion wait benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Each recording thread owns a command pool and records the secondary command buffers of a contiguous range of jobs
+struct RecordingThreadArgs
+{
+    const struct ComputeJobContext* contexts;
+    // Shared by all threads, indexed by job
+    VkCommandBuffer* secondaryCommandBuffers;
+    uint32_t firstJob;
+    uint32_t jobCount;
+
+    VkCommandPool commandPool;
+    VkResult result;
+    // Creating the command pool and allocating the command buffers
+    uint64_t setupNanoseconds;
+    uint64_t recordNanoseconds;
+};
+
+static int RecordingThreadProc(void* arg)
+{
+    struct RecordingThreadArgs* args = arg;
+    const struct DeviceContext* deviceContext = args->contexts[args->firstJob].deviceContext;
+    VkCommandBuffer* commandBuffers = &args->secondaryCommandBuffers[args->firstJob];
+
+    const uint64_t setupBeginTime = GetCurrentTimeNanoseconds();
+    args->result = InitializeCommandPools(deviceContext->queueFamilyIndex, deviceContext->device, &args->commandPool, 1);
+    if (args->result != VK_SUCCESS) {
+        return 0;
+    }
+
+    args->result = AllocateCommandBuffers(deviceContext->device, args->commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, commandBuffers, args->jobCount);
+    if (args->result != VK_SUCCESS)
+    {
+        fprintf(stderr, "AllocateCommandBuffers failed: %d\n", args->result);
+        return 0;
+    }
+    args->setupNanoseconds = GetCurrentTimeNanoseconds() - setupBeginTime;
+
+    // Compute work is recorded outside of any render pass, so nothing has to be inherited
+    const VkCommandBufferInheritanceInfo inheritanceInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = NULL,
+        .renderPass = VK_NULL_HANDLE,
+        .subpass = 0,
+        .framebuffer = VK_NULL_HANDLE,
+        .occlusionQueryEnable = VK_FALSE,
+        .queryFlags = 0,
+        .pipelineStatistics = 0
+    };
+    const VkCommandBufferBeginInfo cmdBufBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = &inheritanceInfo
+    };
+
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    for (uint32_t i = 0; i < args->jobCount && args->result == VK_SUCCESS; i++)
+    {
+        args->result = vkBeginCommandBuffer(commandBuffers[i], &cmdBufBeginInfo);
+        if (args->result != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkBeginCommandBuffer failed: %d\n", args->result);
+            break;
+        }
+
+        RecordComputeJobCommands(&args->contexts[args->firstJob + i], commandBuffers[i]);
+
+        args->result = vkEndCommandBuffer(commandBuffers[i]);
+        if (args->result != VK_SUCCESS) {
+            fprintf(stderr, "vkEndCommandBuffer failed: %d\n", args->result);
+        }
+    }
+    args->recordNanoseconds = GetCurrentTimeNanoseconds() - beginTime;
+
+    return 0;
+}
+
+// Records the secondary command buffers of all jobs on `threadCount` threads, executes them from one primary command buffer
+// with a single vkQueueSubmit and verifies every job. Returns the recording time of the slowest thread in `pRecordMilliseconds`,
+// and the longest command pool creation and command buffer allocation of a thread in `pSetupMilliseconds`.
+static VkResult RunRecordingRound(struct ComputeJobContext contexts[], uint32_t jobCount, uint32_t threadCount,
+    double* pSetupMilliseconds, double* pRecordMilliseconds, double* pExecuteMilliseconds, bool* pPassed)
+{
+    static VkCommandBuffer secondaryCommandBuffers[MAX_BATCH_JOB_COUNT];
+
+    struct DeviceContext* deviceContext = contexts[0].deviceContext;
+    const VkDevice device = deviceContext->device;
+
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        VkResult result = RefillComputeJobSource(&contexts[i]);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+        memset(contexts[i].jobResult, 0, sizeof(*contexts[i].jobResult));
+        contexts[i].iteration = 0;
+    }
+
+    struct RecordingThreadArgs args[MAX_RECORDING_THREAD_COUNT];
+    thrd_t threads[MAX_RECORDING_THREAD_COUNT];
+    bool threadCreated[MAX_RECORDING_THREAD_COUNT] = { false };
+
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        const uint32_t firstJob = jobCount * t / threadCount;
+        args[t] = (struct RecordingThreadArgs){
+            .contexts = contexts,
+            .secondaryCommandBuffers = secondaryCommandBuffers,
+            .firstJob = firstJob,
+            .jobCount = jobCount * (t + 1) / threadCount - firstJob,
+            .commandPool = VK_NULL_HANDLE,
+            .result = VK_NOT_READY,
+            .setupNanoseconds = 0,
+            .recordNanoseconds = 0
+        };
+        threadCreated[t] = thrd_create(&threads[t], RecordingThreadProc, &args[t]) == thrd_success;
+        if (!threadCreated[t]) {
+            fprintf(stderr, "thrd_create failed for recording thread %u!\n", t);
+        }
+    }
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        if (threadCreated[t]) {
+            thrd_join(threads[t], NULL);
+        }
+    }
+
+    // Thread start-up, pool creation and allocation are left out of the recording time
+    VkResult result = VK_SUCCESS;
+    uint64_t setupNanoseconds = 0;
+    uint64_t recordNanoseconds = 0;
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        if (result == VK_SUCCESS) {
+            result = threadCreated[t] ? args[t].result : VK_ERROR_INITIALIZATION_FAILED;
+        }
+        setupNanoseconds = max(setupNanoseconds, args[t].setupNanoseconds);
+        recordNanoseconds = max(recordNanoseconds, args[t].recordNanoseconds);
+    }
+    *pSetupMilliseconds = (double)setupNanoseconds / 1000000.0;
+    *pRecordMilliseconds = (double)recordNanoseconds / 1000000.0;
+
+    VkCommandBuffer primaryCommandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    do
+    {
+        if (result != VK_SUCCESS) {
+            break;
+        }
+
+        result = AllocateCommandBuffers(device, deviceContext->commandPools[0], VK_COMMAND_BUFFER_LEVEL_PRIMARY, &primaryCommandBuffer, 1);
+        if (result != VK_SUCCESS)
+        {
+            fprintf(stderr, "AllocateCommandBuffers failed: %d\n", result);
+            break;
+        }
+
+        const VkCommandBufferBeginInfo cmdBufBeginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = NULL,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = NULL
+        };
+        result = vkBeginCommandBuffer(primaryCommandBuffer, &cmdBufBeginInfo);
+        if (result != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkBeginCommandBuffer failed: %d\n", result);
+            break;
+        }
+        vkCmdExecuteCommands(primaryCommandBuffer, jobCount, secondaryCommandBuffers);
+        result = vkEndCommandBuffer(primaryCommandBuffer);
+        if (result != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkEndCommandBuffer failed: %d\n", result);
+            break;
+        }
+
+        const VkFenceCreateInfo fenceCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0
+        };
+        result = vkCreateFence(device, &fenceCreateInfo, NULL, &fence);
+        if (result != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateFence failed: %d\n", result);
+            break;
+        }
+
+        const VkSubmitInfo submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = NULL,
+            .waitSemaphoreCount = 0,
+            .pWaitSemaphores = NULL,
+            .pWaitDstStageMask = NULL,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &primaryCommandBuffer,
+            .signalSemaphoreCount = 0,
+            .pSignalSemaphores = NULL
+        };
+
+        const uint64_t submitTime = GetCurrentTimeNanoseconds();
+        result = vkQueueSubmit(deviceContext->queues[0], 1, &submit_info, fence);
+        if (result != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkQueueSubmit failed: %d\n", result);
+            break;
+        }
+
+        result = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+        if (result != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkWaitForFences failed: %d\n", result);
+            break;
+        }
+        *pExecuteMilliseconds = (double)(GetCurrentTimeNanoseconds() - submitTime) / 1000000.0;
+
+        *pPassed = true;
+        for (uint32_t i = 0; i < jobCount; i++)
+        {
+            contexts[i].submitTime = submitTime;
+            CompleteComputeJobIteration(&contexts[i]);
+            *pPassed = *pPassed && contexts[i].jobResult->passed;
+        }
+    }
+    while (false);
+
+    if (fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, fence, NULL);
+    }
+    if (primaryCommandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(device, deviceContext->commandPools[0], 1, &primaryCommandBuffer);
+    }
+    // Destroying the pools also frees the secondary command buffers
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        if (threadCreated[t] && args[t].commandPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device, args[t].commandPool, NULL);
+        }
+    }
+
+    return result;
+}
+
+// Records the same group of jobs with 1, 2, 4, ... threads and reports the recording throughput of each configuration
+static bool RunRecordingScalingBenchmark(uint32_t jobCount)
+{
+    static struct ComputeJob jobs[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobResult results[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobContext contexts[MAX_BATCH_JOB_COUNT];
+
+    if (jobCount > MAX_BATCH_JOB_COUNT) {
+        jobCount = MAX_BATCH_JOB_COUNT;
+    }
+
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    struct ComputePipelineCache pipelineCache = { .device = deviceContext->device };
+    if (AcquireShaderModule(deviceContext, "test", NULL, &pipelineCache.shaderModule) != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return false;
+    }
+
+    printf("\n================ Begin the recording scaling benchmark: %u jobs of %u elements ================\n\n",
+        jobCount, RECORDING_BENCHMARK_ELEMENT_COUNT);
+
+    bool passed = true;
+    uint32_t preparedCount = 0;
+    for (; preparedCount < jobCount; preparedCount++)
+    {
+        const uint32_t i = preparedCount;
+        snprintf(jobs[i].name, sizeof(jobs[i].name), "record%u", i);
+        jobs[i].elemCount = RECORDING_BENCHMARK_ELEMENT_COUNT;
+        jobs[i].iterations = 1;
+        jobs[i].firstElement = i;
+        jobs[i].outputData = NULL;
+
+        if (PrepareComputeJobContext(deviceContext, &jobs[i], &results[i], 0, &pipelineCache, false, false, &contexts[i]) != VK_SUCCESS)
+        {
+            DestroyComputeJobContext(&contexts[i]);
+            passed = false;
+            break;
+        }
+    }
+
+    double baselineJobsPerMillisecond = 0.0;
+    for (uint32_t threadCount = 1; passed && threadCount <= MAX_RECORDING_THREAD_COUNT && threadCount <= jobCount; threadCount *= 2)
+    {
+        double setupMilliseconds = 0.0;
+        double recordMilliseconds = 0.0;
+        double executeMilliseconds = 0.0;
+        bool roundPassed = false;
+        const VkResult result = RunRecordingRound(contexts, jobCount, threadCount, &setupMilliseconds, &recordMilliseconds, &executeMilliseconds,
+            &roundPassed);
+        if (result != VK_SUCCESS || !roundPassed)
+        {
+            fprintf(stderr, "Recording round with %u thread(s) failed: %d\n", threadCount, result);
+            passed = false;
+            break;
+        }
+
+        const double jobsPerMillisecond = jobCount / recordMilliseconds;
+        if (threadCount == 1) {
+            baselineJobsPerMillisecond = jobsPerMillisecond;
+        }
+        printf("%u thread(s): recorded in %.3fms (%.1f jobs/ms, %.2fx), pool setup %.3fms, executed in %.3fms with one submission\n",
+            threadCount, recordMilliseconds, jobsPerMillisecond, jobsPerMillisecond / baselineJobsPerMillisecond, setupMilliseconds,
+            executeMilliseconds);
+    }
+
+    for (uint32_t i = 0; i < preparedCount; i++) {
+        DestroyComputeJobContext(&contexts[i]);
+    }
+    DestroyComputePipelineCache(&pipelineCache);
+
+    printf("\n================ Complete the recording scaling benchmark ================\n\n");
+
+    return passed;
+}
+
+// A pass of a compute graph either copies between buffers or dispatches the test kernel. Passes only declare which
+// graph resources they read or write; the barriers between them are derived when the graph is recorded.
+enum COMPUTE_GRAPH_PASS_TYPE
+{
+    COMPUTE_GRAPH_PASS_COPY,
+    COMPUTE_GRAPH_PASS_DISPATCH
+};
+
+struct ComputeGraphUsage
+{
+    uint32_t resource;
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+    bool write;
+};
+
+// Stages that read a buffer since its last write
+struct ComputeGraphRead
+{
+    VkPipelineStageFlags2 stages;
+    // A barrier already orders the reads before later commands of these stages, so a write there needn't wait for them again
+    VkPipelineStageFlags2 orderedBeforeStages;
+};
+
+// Synchronization state of one buffer while the graph is being recorded
+struct ComputeGraphResource
+{
+    VkBuffer buffer;
+    // The last write that may still be unavailable to later passes
+    VkPipelineStageFlags2 writeStage;
+    VkAccessFlags2 writeAccess;
+    // Where the last write has already been made visible
+    VkPipelineStageFlags2 visibleStages;
+    VkAccessFlags2 visibleAccess;
+    // Reads since the last write, a later write has to wait for the ones not yet ordered before its stage
+    uint32_t readCount;
+    struct ComputeGraphRead reads[MAX_COMPUTE_GRAPH_READ_STAGES];
+};
+
+static void AddComputeGraphRead(struct ComputeGraphResource* resource, VkPipelineStageFlags2 stage)
+{
+    uint32_t i = 0;
+    while (i < resource->readCount && resource->reads[i].stages != stage) {
+        i++;
+    }
+    if (i == MAX_COMPUTE_GRAPH_READ_STAGES) {
+        i--;
+    }
+    else if (i == resource->readCount) {
+        resource->reads[resource->readCount++] = (struct ComputeGraphRead){ 0 };
+    }
+    // No barrier has ordered the new read yet
+    resource->reads[i].stages |= stage;
+    resource->reads[i].orderedBeforeStages = 0;
+}
+
+struct ComputeGraphPass
+{
+    enum COMPUTE_GRAPH_PASS_TYPE type;
+    // COMPUTE_GRAPH_PASS_COPY
+    VkBuffer srcBuffer;
+    VkBuffer dstBuffer;
+    uint32_t regionCount;
+    VkBufferCopy regions[2];
+    // COMPUTE_GRAPH_PASS_DISPATCH
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSet descriptorSet;
+    uint32_t groupCount;
+
+    uint32_t usageCount;
+    struct ComputeGraphUsage usages[MAX_COMPUTE_GRAPH_PASS_USAGES];
+    // Passes of the same level don't depend on each other
+    uint32_t level;
+};
+
+struct ComputeGraph
+{
+    uint32_t resourceCount;
+    struct ComputeGraphResource resources[MAX_COMPUTE_GRAPH_RESOURCES];
+    uint32_t passCount;
+    struct ComputeGraphPass passes[MAX_COMPUTE_GRAPH_PASSES];
+};
+
+struct ComputeGraphStats
+{
+    uint32_t barrierCount;
+    uint32_t bufferBarrierCount;
+    uint32_t levelCount;
+};
+
+static uint32_t AddComputeGraphResource(struct ComputeGraph* graph, VkBuffer buffer)
+{
+    if (graph->resourceCount == MAX_COMPUTE_GRAPH_RESOURCES) {
+        return UINT32_MAX;
+    }
+    graph->resources[graph->resourceCount] = (struct ComputeGraphResource){ .buffer = buffer };
+    return graph->resourceCount++;
+}
+
+// Host buffers are synchronized with the fence of the submission, so they are not graph resources; pass UINT32_MAX for them
+static bool AddComputeGraphCopyPass(struct ComputeGraph* graph, VkBuffer srcBuffer, uint32_t srcResource, VkBuffer dstBuffer, uint32_t dstResource,
+    const VkBufferCopy regions[], uint32_t regionCount)
+{
+    if (graph->passCount == MAX_COMPUTE_GRAPH_PASSES || regionCount > 2) {
+        return false;
+    }
+
+    struct ComputeGraphPass* pass = &graph->passes[graph->passCount++];
+    memset(pass, 0, sizeof(*pass));
+    pass->type = COMPUTE_GRAPH_PASS_COPY;
+    pass->srcBuffer = srcBuffer;
+    pass->dstBuffer = dstBuffer;
+    pass->regionCount = regionCount;
+    memcpy(pass->regions, regions, regionCount * sizeof(regions[0]));
+
+    if (srcResource != UINT32_MAX)
+    {
+        pass->usages[pass->usageCount++] = (struct ComputeGraphUsage){
+            .resource = srcResource, .stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT, .access = VK_ACCESS_2_TRANSFER_READ_BIT, .write = false
+        };
+    }
+    if (dstResource != UINT32_MAX)
+    {
+        pass->usages[pass->usageCount++] = (struct ComputeGraphUsage){
+            .resource = dstResource, .stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT, .access = VK_ACCESS_2_TRANSFER_WRITE_BIT, .write = true
+        };
+    }
+    return true;
+}
+
+// `reads` and `writes` are the resources the kernel accesses, including the ones only reached through device addresses
+static bool AddComputeGraphDispatchPass(struct ComputeGraph* graph, VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet,
+    uint32_t groupCount, const uint32_t reads[], uint32_t readCount, const uint32_t writes[], uint32_t writeCount)
+{
+    if (graph->passCount == MAX_COMPUTE_GRAPH_PASSES || readCount + writeCount > MAX_COMPUTE_GRAPH_PASS_USAGES) {
+        return false;
+    }
+
+    struct ComputeGraphPass* pass = &graph->passes[graph->passCount++];
+    memset(pass, 0, sizeof(*pass));
+    pass->type = COMPUTE_GRAPH_PASS_DISPATCH;
+    pass->pipeline = pipeline;
+    pass->pipelineLayout = pipelineLayout;
+    pass->descriptorSet = descriptorSet;
+    pass->groupCount = groupCount;
+
+    for (uint32_t i = 0; i < readCount; i++)
+    {
+        pass->usages[pass->usageCount++] = (struct ComputeGraphUsage){
+            .resource = reads[i], .stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, .access = VK_ACCESS_2_SHADER_READ_BIT, .write = false
+        };
+    }
+    for (uint32_t i = 0; i < writeCount; i++)
+    {
+        pass->usages[pass->usageCount++] = (struct ComputeGraphUsage){
+            .resource = writes[i], .stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, .access = VK_ACCESS_2_SHADER_WRITE_BIT, .write = true
+        };
+    }
+    return true;
+}
+
+// Two passes conflict if they share a resource and at least one of them writes it
+static bool ComputeGraphPassesConflict(const struct ComputeGraphPass* a, const struct ComputeGraphPass* b)
+{
+    for (uint32_t i = 0; i < a->usageCount; i++)
+    {
+        for (uint32_t j = 0; j < b->usageCount; j++)
+        {
+            if (a->usages[i].resource == b->usages[j].resource && (a->usages[i].write || b->usages[j].write)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Assigns every pass the earliest level after all the earlier declared passes it conflicts with.
+// Recording level by level moves independent passes next to each other, so they share the barriers in between.
+static uint32_t ScheduleComputeGraph(struct ComputeGraph* graph)
+{
+    uint32_t levelCount = 0;
+    for (uint32_t p = 0; p < graph->passCount; p++)
+    {
+        uint32_t level = 0;
+        for (uint32_t q = 0; q < p; q++)
+        {
+            if (graph->passes[q].level + 1 > level && ComputeGraphPassesConflict(&graph->passes[q], &graph->passes[p])) {
+                level = graph->passes[q].level + 1;
+            }
+        }
+        graph->passes[p].level = level;
+        levelCount = max(levelCount, level + 1);
+    }
+    return levelCount;
+}
+
+static void RecordComputeGraphBarriers(const struct DeviceContext* deviceContext, VkCommandBuffer commandBuffer, const VkMemoryBarrier2* pMemoryBarrier,
+    const VkBufferMemoryBarrier2 bufferBarriers[], uint32_t bufferBarrierCount)
+{
+    if (deviceContext->cmdPipelineBarrier2 != NULL)
+    {
+        const VkDependencyInfo dependencyInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .pNext = NULL,
+            .dependencyFlags = 0,
+            .memoryBarrierCount = pMemoryBarrier != NULL ? 1 : 0,
+            .pMemoryBarriers = pMemoryBarrier,
+            .bufferMemoryBarrierCount = bufferBarrierCount,
+            .pBufferMemoryBarriers = bufferBarriers,
+            .imageMemoryBarrierCount = 0,
+            .pImageMemoryBarriers = NULL
+        };
+        deviceContext->cmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+        return;
+    }
+
+    // The stage and access bits the graph uses have the same values in both APIs, so the masks are merged into one legacy barrier
+    VkPipelineStageFlags srcStageMask = 0;
+    VkPipelineStageFlags dstStageMask = 0;
+    VkMemoryBarrier memoryBarrier = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    VkBufferMemoryBarrier legacyBufferBarriers[MAX_COMPUTE_GRAPH_RESOURCES];
+    if (pMemoryBarrier != NULL)
+    {
+        srcStageMask |= (VkPipelineStageFlags)pMemoryBarrier->srcStageMask;
+        dstStageMask |= (VkPipelineStageFlags)pMemoryBarrier->dstStageMask;
+        memoryBarrier.srcAccessMask = (VkAccessFlags)pMemoryBarrier->srcAccessMask;
+        memoryBarrier.dstAccessMask = (VkAccessFlags)pMemoryBarrier->dstAccessMask;
+    }
+    for (uint32_t i = 0; i < bufferBarrierCount; i++)
+    {
+        srcStageMask |= (VkPipelineStageFlags)bufferBarriers[i].srcStageMask;
+        dstStageMask |= (VkPipelineStageFlags)bufferBarriers[i].dstStageMask;
+        legacyBufferBarriers[i] = (VkBufferMemoryBarrier){
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .pNext = NULL,
+            .srcAccessMask = (VkAccessFlags)bufferBarriers[i].srcAccessMask,
+            .dstAccessMask = (VkAccessFlags)bufferBarriers[i].dstAccessMask,
+            .srcQueueFamilyIndex = bufferBarriers[i].srcQueueFamilyIndex,
+            .dstQueueFamilyIndex = bufferBarriers[i].dstQueueFamilyIndex,
+            .buffer = bufferBarriers[i].buffer,
+            .offset = bufferBarriers[i].offset,
+            .size = bufferBarriers[i].size
+        };
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, srcStageMask != 0 ? srcStageMask : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStageMask, 0,
+        pMemoryBarrier != NULL ? 1 : 0, &memoryBarrier, bufferBarrierCount, legacyBufferBarriers, 0, NULL);
+}
+
+static void RecordComputeGraphPass(VkCommandBuffer commandBuffer, const struct ComputeGraphPass* pass)
+{
+    if (pass->type == COMPUTE_GRAPH_PASS_COPY) {
+        vkCmdCopyBuffer(commandBuffer, pass->srcBuffer, pass->dstBuffer, pass->regionCount, pass->regions);
+    }
+    else
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pass->pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pass->pipelineLayout, 0, 1, &pass->descriptorSet, 0, NULL);
+        PushTestKernelChunk(commandBuffer, pass->pipelineLayout, (struct TestKernelChunk){ 0 });
+        vkCmdDispatch(commandBuffer, pass->groupCount, 1, 1);
+    }
+}
+
+// Records the graph level by level with one batched barrier between levels that only covers the resources with a hazard.
+// If `planBarriers` is false, the passes are recorded in declaration order with a full memory barrier after every pass instead.
+static void RecordComputeGraph(const struct DeviceContext* deviceContext, struct ComputeGraph* graph, VkCommandBuffer commandBuffer, bool planBarriers,
+    struct ComputeGraphStats* pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+
+    if (!planBarriers)
+    {
+        const VkMemoryBarrier2 fullBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .pNext = NULL,
+            .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT
+        };
+        for (uint32_t p = 0; p < graph->passCount; p++)
+        {
+            if (p > 0)
+            {
+                RecordComputeGraphBarriers(deviceContext, commandBuffer, &fullBarrier, NULL, 0);
+                pStats->barrierCount++;
+            }
+            RecordComputeGraphPass(commandBuffer, &graph->passes[p]);
+        }
+        pStats->levelCount = graph->passCount;
+        return;
+    }
+
+    for (uint32_t r = 0; r < graph->resourceCount; r++)
+    {
+        const VkBuffer buffer = graph->resources[r].buffer;
+        graph->resources[r] = (struct ComputeGraphResource){ .buffer = buffer };
+    }
+
+    pStats->levelCount = ScheduleComputeGraph(graph);
+    for (uint32_t level = 0; level < pStats->levelCount; level++)
+    {
+        // At most one barrier per resource, merging the hazards of all passes in the level
+        VkBufferMemoryBarrier2 bufferBarriers[MAX_COMPUTE_GRAPH_RESOURCES];
+        uint32_t barrierIndices[MAX_COMPUTE_GRAPH_RESOURCES];
+        uint32_t bufferBarrierCount = 0;
+        for (uint32_t r = 0; r < graph->resourceCount; r++) {
+            barrierIndices[r] = UINT32_MAX;
+        }
+
+        for (uint32_t p = 0; p < graph->passCount; p++)
+        {
+            const struct ComputeGraphPass* pass = &graph->passes[p];
+            if (pass->level != level) {
+                continue;
+            }
+
+            for (uint32_t u = 0; u < pass->usageCount; u++)
+            {
+                const struct ComputeGraphUsage* usage = &pass->usages[u];
+                const struct ComputeGraphResource* resource = &graph->resources[usage->resource];
+
+                VkPipelineStageFlags2 srcStage = 0;
+                VkAccessFlags2 srcAccess = 0;
+                if (resource->writeAccess != 0 &&
+                    (usage->write || (resource->visibleStages & usage->stage) == 0 || (resource->visibleAccess & usage->access) == 0))
+                {
+                    // Read after write, or write after write
+                    srcStage |= resource->writeStage;
+                    srcAccess |= resource->writeAccess;
+                }
+                for (uint32_t i = 0; i < resource->readCount && usage->write; i++)
+                {
+                    // Write after read only needs an execution dependency
+                    if ((resource->reads[i].orderedBeforeStages & usage->stage) != usage->stage) {
+                        srcStage |= resource->reads[i].stages;
+                    }
+                }
+                if (srcStage == 0) {
+                    continue;
+                }
+
+                if (barrierIndices[usage->resource] == UINT32_MAX)
+                {
+                    barrierIndices[usage->resource] = bufferBarrierCount;
+                    bufferBarriers[bufferBarrierCount++] = (VkBufferMemoryBarrier2){
+                        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                        .pNext = NULL,
+                        .srcQueueFamilyIndex = deviceContext->queueFamilyIndex,
+                        .dstQueueFamilyIndex = deviceContext->queueFamilyIndex,
+                        .buffer = resource->buffer,
+                        .offset = 0,
+                        .size = VK_WHOLE_SIZE
+                    };
+                }
+                VkBufferMemoryBarrier2* barrier = &bufferBarriers[barrierIndices[usage->resource]];
+                barrier->srcStageMask |= srcStage;
+                barrier->srcAccessMask |= srcAccess;
+                barrier->dstStageMask |= usage->stage;
+                if (srcAccess != 0) {
+                    barrier->dstAccessMask |= usage->access;
+                }
+            }
+        }
+
+        if (bufferBarrierCount > 0)
+        {
+            RecordComputeGraphBarriers(deviceContext, commandBuffer, NULL, bufferBarriers, bufferBarrierCount);
+            pStats->barrierCount++;
+            pStats->bufferBarrierCount += bufferBarrierCount;
+
+            // The execution dependency of a barrier orders all earlier commands of its source stages, whatever buffer they read,
+            // but only before later commands of its destination stages
+            for (uint32_t r = 0; r < graph->resourceCount; r++)
+            {
+                struct ComputeGraphResource* resource = &graph->resources[r];
+                for (uint32_t i = 0; i < resource->readCount; i++)
+                {
+                    struct ComputeGraphRead* read = &resource->reads[i];
+                    for (uint32_t b = 0; b < bufferBarrierCount; b++)
+                    {
+                        if ((bufferBarriers[b].srcStageMask & read->stages) == read->stages) {
+                            read->orderedBeforeStages |= bufferBarriers[b].dstStageMask;
+                        }
+                    }
+                }
+                if (barrierIndices[r] == UINT32_MAX) {
+                    continue;
+                }
+                const VkBufferMemoryBarrier2* barrier = &bufferBarriers[barrierIndices[r]];
+                if (barrier->srcAccessMask != 0)
+                {
+                    resource->visibleStages |= barrier->dstStageMask;
+                    resource->visibleAccess |= barrier->dstAccessMask;
+                }
+            }
+        }
+
+        for (uint32_t p = 0; p < graph->passCount; p++)
+        {
+            const struct ComputeGraphPass* pass = &graph->passes[p];
+            if (pass->level != level) {
+                continue;
+            }
+
+            RecordComputeGraphPass(commandBuffer, pass);
+
+            for (uint32_t u = 0; u < pass->usageCount; u++)
+            {
+                const struct ComputeGraphUsage* usage = &pass->usages[u];
+                struct ComputeGraphResource* resource = &graph->resources[usage->resource];
+                if (usage->write)
+                {
+                    resource->writeStage = usage->stage;
+                    resource->writeAccess = usage->access;
+                    resource->visibleStages = 0;
+                    resource->visibleAccess = 0;
+                    resource->readCount = 0;
+                }
+                else {
+                    AddComputeGraphRead(resource, usage->stage);
+                }
+            }
+        }
+    }
+}
+
+// Buffers of the graph benchmark. Every chain uploads its input, doubles it GRAPH_BENCHMARK_CHAIN_DEPTH times and reads the
+// result back. The chains are independent of each other.
+struct GraphBenchmarkResources
+{
+    VkDevice device;
+    VkDeviceMemory hostMemory;
+    // Inputs and address blocks of all chains, followed by the read back results of all chains
+    VkBuffer hostBuffer;
+    VkDeviceMemory deviceMemory;
+    // dataBuffers[c][k] is the input of pass k of chain c, dataBuffers[c][depth] is the output of the chain
+    VkBuffer dataBuffers[GRAPH_BENCHMARK_CHAIN_COUNT][GRAPH_BENCHMARK_CHAIN_DEPTH + 1];
+    // Holds the dst and src addresses of one pass
+    VkBuffer addressBuffers[GRAPH_BENCHMARK_CHAIN_COUNT][GRAPH_BENCHMARK_CHAIN_DEPTH];
+    VkDescriptorPool descriptorPools[GRAPH_BENCHMARK_CHAIN_COUNT][GRAPH_BENCHMARK_CHAIN_DEPTH];
+    VkDescriptorSet descriptorSets[GRAPH_BENCHMARK_CHAIN_COUNT][GRAPH_BENCHMARK_CHAIN_DEPTH];
+};
+
+static void DestroyGraphBenchmarkResources(struct GraphBenchmarkResources* pResources)
+{
+    const VkDevice device = pResources->device;
+    for (uint32_t c = 0; c < GRAPH_BENCHMARK_CHAIN_COUNT; c++)
+    {
+        for (uint32_t k = 0; k <= GRAPH_BENCHMARK_CHAIN_DEPTH; k++)
+        {
+            if (pResources->dataBuffers[c][k] != VK_NULL_HANDLE) {
+                vkDestroyBuffer(device, pResources->dataBuffers[c][k], NULL);
+            }
+            if (k == GRAPH_BENCHMARK_CHAIN_DEPTH) {
+                continue;
+            }
+            if (pResources->addressBuffers[c][k] != VK_NULL_HANDLE) {
+                vkDestroyBuffer(device, pResources->addressBuffers[c][k], NULL);
+            }
+            if (pResources->descriptorPools[c][k] != VK_NULL_HANDLE) {
+                vkDestroyDescriptorPool(device, pResources->descriptorPools[c][k], NULL);
+            }
+        }
+    }
+    if (pResources->deviceMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, pResources->deviceMemory, NULL);
+    }
+    if (pResources->hostBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, pResources->hostBuffer, NULL);
+    }
+    if (pResources->hostMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, pResources->hostMemory, NULL);
+    }
+    memset(pResources, 0, sizeof(*pResources));
+}
+
+static VkResult CreateGraphBenchmarkResources(const struct DeviceContext* deviceContext, VkDescriptorSetLayout descLayout,
+    struct GraphBenchmarkResources* pResources)
+{
+    const VkDevice device = deviceContext->device;
+    const VkDeviceSize bufferSize = GRAPH_BENCHMARK_ELEMENT_COUNT * sizeof(int);
+    const VkDeviceSize uploadStride = bufferSize + GRAPH_BENCHMARK_CHAIN_DEPTH * ADDITIONAL_ADDRESS_BUFFER_SIZE;
+    const VkDeviceSize hostBufferSize = GRAPH_BENCHMARK_CHAIN_COUNT * (uploadStride + bufferSize);
+
+    memset(pResources, 0, sizeof(*pResources));
+    pResources->device = device;
+
+    // All device buffers are placed in one allocation
+    VkBufferCreateInfo bufCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .size = bufferSize,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &deviceContext->queueFamilyIndex
+    };
+
+    VkDeviceSize dataOffsets[GRAPH_BENCHMARK_CHAIN_COUNT][GRAPH_BENCHMARK_CHAIN_DEPTH + 1];
+    VkDeviceSize addressOffsets[GRAPH_BENCHMARK_CHAIN_COUNT][GRAPH_BENCHMARK_CHAIN_DEPTH];
+    VkDeviceSize deviceMemSize = 0;
+    uint32_t memoryTypeBits = UINT32_MAX;
+
+    VkResult res = VK_SUCCESS;
+    for (uint32_t c = 0; c < GRAPH_BENCHMARK_CHAIN_COUNT && res == VK_SUCCESS; c++)
+    {
+        for (uint32_t k = 0; k <= GRAPH_BENCHMARK_CHAIN_DEPTH * 2; k++)
+        {
+            // Data buffers first, then the address buffers of the chain
+            const bool isData = k <= GRAPH_BENCHMARK_CHAIN_DEPTH;
+            VkBuffer* pBuffer = isData ? &pResources->dataBuffers[c][k] : &pResources->addressBuffers[c][k - GRAPH_BENCHMARK_CHAIN_DEPTH - 1];
+            bufCreateInfo.size = isData ? bufferSize : ADDITIONAL_ADDRESS_BUFFER_SIZE;
+
+            res = vkCreateBuffer(device, &bufCreateInfo, NULL, pBuffer);
+            if (res != VK_SUCCESS)
+            {
+                fprintf(stderr, "vkCreateBuffer failed: %d\n", res);
+                break;
+            }
+
+            VkMemoryRequirements memRequirements = { 0 };
+            vkGetBufferMemoryRequirements(device, *pBuffer, &memRequirements);
+            deviceMemSize = (deviceMemSize + memRequirements.alignment - 1) / memRequirements.alignment * memRequirements.alignment;
+            if (isData) {
+                dataOffsets[c][k] = deviceMemSize;
+            }
+            else {
+                addressOffsets[c][k - GRAPH_BENCHMARK_CHAIN_DEPTH - 1] = deviceMemSize;
+            }
+            deviceMemSize += memRequirements.size;
+            memoryTypeBits &= memRequirements.memoryTypeBits;
+        }
+    }
+
+    do
+    {
+        if (res != VK_SUCCESS) {
+            break;
+        }
+
+        const uint32_t deviceMemoryTypeIndex = FindMemoryTypeIndex(&deviceContext->memoryProperties, memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceMemSize);
+        if (deviceMemoryTypeIndex == UINT32_MAX)
+        {
+            fprintf(stderr, "No device local memory type for %zuMB!\n", (size_t)(deviceMemSize / (1024 * 1024)));
+            res = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+            break;
+        }
+
+        const VkMemoryAllocateFlagsInfo memAllocFlagsInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+            .pNext = NULL,
+            .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+        };
+        const VkMemoryAllocateInfo deviceMemAllocInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = &memAllocFlagsInfo,
+            .allocationSize = deviceMemSize,
+            .memoryTypeIndex = deviceMemoryTypeIndex
+        };
+        res = vkAllocateMemory(device, &deviceMemAllocInfo, NULL, &pResources->deviceMemory);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkAllocateMemory failed: %d\n", res);
+            break;
+        }
+
+        for (uint32_t c = 0; c < GRAPH_BENCHMARK_CHAIN_COUNT && res == VK_SUCCESS; c++)
+        {
+            for (uint32_t k = 0; k <= GRAPH_BENCHMARK_CHAIN_DEPTH && res == VK_SUCCESS; k++)
+            {
+                res = vkBindBufferMemory(device, pResources->dataBuffers[c][k], pResources->deviceMemory, dataOffsets[c][k]);
+                if (res == VK_SUCCESS && k < GRAPH_BENCHMARK_CHAIN_DEPTH) {
+                    res = vkBindBufferMemory(device, pResources->addressBuffers[c][k], pResources->deviceMemory, addressOffsets[c][k]);
+                }
+            }
+        }
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkBindBufferMemory failed: %d\n", res);
+            break;
+        }
+
+        bufCreateInfo.size = hostBufferSize;
+        bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        res = vkCreateBuffer(device, &bufCreateInfo, NULL, &pResources->hostBuffer);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateBuffer failed: %d\n", res);
+            break;
+        }
+
+        VkMemoryRequirements hostMemRequirements = { 0 };
+        vkGetBufferMemoryRequirements(device, pResources->hostBuffer, &hostMemRequirements);
+        const uint32_t hostMemoryTypeIndex = FindMemoryTypeIndex(&deviceContext->memoryProperties, hostMemRequirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, hostMemRequirements.size);
+        if (hostMemoryTypeIndex == UINT32_MAX)
+        {
+            fprintf(stderr, "No host visible memory type for %zuMB!\n", (size_t)(hostMemRequirements.size / (1024 * 1024)));
+            res = VK_ERROR_OUT_OF_HOST_MEMORY;
+            break;
+        }
+
+        const VkMemoryAllocateInfo hostMemAllocInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = NULL,
+            .allocationSize = hostMemRequirements.size,
+            .memoryTypeIndex = hostMemoryTypeIndex
+        };
+        res = vkAllocateMemory(device, &hostMemAllocInfo, NULL, &pResources->hostMemory);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkAllocateMemory failed: %d\n", res);
+            break;
+        }
+        res = vkBindBufferMemory(device, pResources->hostBuffer, pResources->hostMemory, 0);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkBindBufferMemory failed: %d\n", res);
+            break;
+        }
+
+        void* hostData = NULL;
+        res = vkMapMemory(device, pResources->hostMemory, 0, hostBufferSize, 0, &hostData);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkMapMemory failed: %d\n", res);
+            break;
+        }
+        for (uint32_t c = 0; c < GRAPH_BENCHMARK_CHAIN_COUNT; c++)
+        {
+            uint8_t* upload = (uint8_t*)hostData + c * uploadStride;
+            InitializeSourceData((int*)upload, GRAPH_BENCHMARK_ELEMENT_COUNT, (int)(c * GRAPH_BENCHMARK_ELEMENT_COUNT));
+
+            // Pass k reads dataBuffers[c][k] and writes dataBuffers[c][k + 1]
+            for (uint32_t k = 0; k < GRAPH_BENCHMARK_CHAIN_DEPTH; k++)
+            {
+                VkDeviceAddress* addrMem = (VkDeviceAddress*)(upload + bufferSize + k * ADDITIONAL_ADDRESS_BUFFER_SIZE);
+                memset(addrMem, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
+                addrMem[0] = GetBufferDeviceAddress(device, pResources->dataBuffers[c][k + 1]);
+                addrMem[1] = GetBufferDeviceAddress(device, pResources->dataBuffers[c][k]);
+            }
+        }
+        vkUnmapMemory(device, pResources->hostMemory);
+
+        for (uint32_t c = 0; c < GRAPH_BENCHMARK_CHAIN_COUNT && res == VK_SUCCESS; c++)
+        {
+            for (uint32_t k = 0; k < GRAPH_BENCHMARK_CHAIN_DEPTH && res == VK_SUCCESS; k++)
+            {
+                res = CreateDescriptorSets(device, pResources->addressBuffers[c][k], ADDITIONAL_ADDRESS_BUFFER_SIZE, descLayout,
+                    &pResources->descriptorPools[c][k], &pResources->descriptorSets[c][k]);
+            }
+        }
+        if (res != VK_SUCCESS) {
+            fprintf(stderr, "CreateDescriptorSets failed!\n");
+        }
+    }
+    while (false);
+
+    return res;
+}
+
+// Declares the chains one after another, the way they would naturally be written
+static bool BuildGraphBenchmark(struct ComputeGraph* graph, const struct GraphBenchmarkResources* pResources, const struct ComputePipelineState* pipelineState)
+{
+    const VkDeviceSize bufferSize = GRAPH_BENCHMARK_ELEMENT_COUNT * sizeof(int);
+    const VkDeviceSize uploadStride = bufferSize + GRAPH_BENCHMARK_CHAIN_DEPTH * ADDITIONAL_ADDRESS_BUFFER_SIZE;
+
+    memset(graph, 0, sizeof(*graph));
+    bool succeeded = true;
+    for (uint32_t c = 0; c < GRAPH_BENCHMARK_CHAIN_COUNT && succeeded; c++)
+    {
+        uint32_t dataResources[GRAPH_BENCHMARK_CHAIN_DEPTH + 1];
+        for (uint32_t k = 0; k <= GRAPH_BENCHMARK_CHAIN_DEPTH; k++) {
+            dataResources[k] = AddComputeGraphResource(graph, pResources->dataBuffers[c][k]);
+        }
+
+        for (uint32_t k = 0; k < GRAPH_BENCHMARK_CHAIN_DEPTH; k++)
+        {
+            // The address block of every pass is uploaded by a pass of its own
+            const uint32_t addressResource = AddComputeGraphResource(graph, pResources->addressBuffers[c][k]);
+            const VkBufferCopy addressRegion = {
+                .srcOffset = c * uploadStride + bufferSize + k * ADDITIONAL_ADDRESS_BUFFER_SIZE,
+                .dstOffset = 0,
+                .size = ADDITIONAL_ADDRESS_BUFFER_SIZE
+            };
+            succeeded = succeeded && addressResource != UINT32_MAX &&
+                AddComputeGraphCopyPass(graph, pResources->hostBuffer, UINT32_MAX, pResources->addressBuffers[c][k], addressResource, &addressRegion, 1);
+
+            if (k == 0)
+            {
+                const VkBufferCopy dataRegion = { .srcOffset = c * uploadStride, .dstOffset = 0, .size = bufferSize };
+                succeeded = succeeded && dataResources[0] != UINT32_MAX &&
+                    AddComputeGraphCopyPass(graph, pResources->hostBuffer, UINT32_MAX, pResources->dataBuffers[c][0], dataResources[0], &dataRegion, 1);
+            }
+
+            // The kernel reaches both data buffers through the addresses in the address block
+            const uint32_t reads[] = { addressResource, dataResources[k] };
+            const uint32_t writes[] = { dataResources[k + 1] };
+            succeeded = succeeded && dataResources[k + 1] != UINT32_MAX &&
+                AddComputeGraphDispatchPass(graph, pipelineState->pipeline, pipelineState->pipelineLayout, pResources->descriptorSets[c][k],
+                    GRAPH_BENCHMARK_ELEMENT_COUNT / COMPUTE_WORKGROUP_SIZE, reads, 2, writes, 1);
+        }
+
+        const VkBufferCopy readbackRegion = {
+            .srcOffset = 0,
+            .dstOffset = GRAPH_BENCHMARK_CHAIN_COUNT * uploadStride + c * bufferSize,
+            .size = bufferSize
+        };
+        succeeded = succeeded && AddComputeGraphCopyPass(graph, pResources->dataBuffers[c][GRAPH_BENCHMARK_CHAIN_DEPTH],
+            dataResources[GRAPH_BENCHMARK_CHAIN_DEPTH], pResources->hostBuffer, UINT32_MAX, &readbackRegion, 1);
+    }
+
+    if (!succeeded) {
+        fprintf(stderr, "The benchmark graph exceeds %d resources or %d passes!\n", MAX_COMPUTE_GRAPH_RESOURCES, MAX_COMPUTE_GRAPH_PASSES);
+    }
+    return succeeded;
+}
+
+static bool VerifyGraphBenchmarkResults(const struct GraphBenchmarkResources* pResources)
+{
+    const VkDeviceSize bufferSize = GRAPH_BENCHMARK_ELEMENT_COUNT * sizeof(int);
+    const VkDeviceSize readbackOffset = GRAPH_BENCHMARK_CHAIN_COUNT * (bufferSize + GRAPH_BENCHMARK_CHAIN_DEPTH * ADDITIONAL_ADDRESS_BUFFER_SIZE);
+
+    void* hostData = NULL;
+    VkResult res = vkMapMemory(pResources->device, pResources->hostMemory, readbackOffset, GRAPH_BENCHMARK_CHAIN_COUNT * bufferSize, 0, &hostData);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return false;
+    }
+
+    bool passed = true;
+    for (uint32_t c = 0; c < GRAPH_BENCHMARK_CHAIN_COUNT && passed; c++)
+    {
+        const int* dstMem = (const int*)hostData + c * GRAPH_BENCHMARK_ELEMENT_COUNT;
+        const int firstElement = (int)(c * GRAPH_BENCHMARK_ELEMENT_COUNT);
+        // Every pass doubles the elements, except the first one which always holds the element count
+        for (int i = 1; i < GRAPH_BENCHMARK_ELEMENT_COUNT; i++)
+        {
+            if (dstMem[i] != (firstElement + i) << GRAPH_BENCHMARK_CHAIN_DEPTH)
+            {
+                fprintf(stderr, "Chain %u result error @ %d, result is: %d\n", c, i, dstMem[i]);
+                passed = false;
+                break;
+            }
+        }
+        if (dstMem[0] != GRAPH_BENCHMARK_ELEMENT_COUNT)
+        {
+            fprintf(stderr, "Chain %u total_data_elem_count is %d!\n", c, dstMem[0]);
+            passed = false;
+        }
+    }
+
+    vkUnmapMemory(pResources->device, pResources->hostMemory);
+    return passed;
+}
+
+// Records the benchmark graph once with planned barriers and once with a barrier after every pass, then compares barrier
+// counts and GPU time. The GPU time comes from timestamps if the queue family supports them.
+static bool RunGraphBarrierBenchmark(void)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    const VkDevice device = deviceContext->device;
+    const uint64_t timestampMask = GetQueueTimestampMask(deviceContext);
+
+    printf("\n================ Begin the graph barrier benchmark: %d chain(s) of %d pass(es), %s ================\n\n",
+        GRAPH_BENCHMARK_CHAIN_COUNT, GRAPH_BENCHMARK_CHAIN_DEPTH, deviceContext->cmdPipelineBarrier2 != NULL ? "synchronization2" : "legacy barriers");
+
+    struct ComputePipelineCache pipelineCache = { .device = device };
+    static struct ComputeGraph graph;
+    struct GraphBenchmarkResources resources = { .device = device };
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    bool passed = false;
+
+    do
+    {
+        VkResult res = AcquireShaderModule(deviceContext, "test", NULL, &pipelineCache.shaderModule);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "AcquireShaderModule failed!\n");
+            break;
+        }
+
+        const struct ComputePipelineState* pipelineState = NULL;
+        res = AcquireComputePipeline(&pipelineCache, GRAPH_BENCHMARK_ELEMENT_COUNT, &pipelineState);
+        if (res != VK_SUCCESS) {
+            break;
+        }
+
+        res = CreateGraphBenchmarkResources(deviceContext, pipelineState->descriptorSetLayout, &resources);
+        if (res != VK_SUCCESS) {
+            break;
+        }
+
+        if (!BuildGraphBenchmark(&graph, &resources, pipelineState)) {
+            break;
+        }
+
+        if (timestampMask != 0)
+        {
+            const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .pNext = NULL,
+                .flags = 0,
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = 2,
+                .pipelineStatistics = 0
+            };
+            res = vkCreateQueryPool(device, &queryPoolCreateInfo, NULL, &queryPool);
+            if (res != VK_SUCCESS)
+            {
+                fprintf(stderr, "vkCreateQueryPool failed: %d\n", res);
+                break;
+            }
+        }
+
+        const VkFenceCreateInfo fenceCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0
+        };
+        res = vkCreateFence(device, &fenceCreateInfo, NULL, &fence);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateFence failed: %d\n", res);
+            break;
+        }
+
+        passed = true;
+        for (int mode = 0; mode < 2 && passed; mode++)
+        {
+            const bool planBarriers = mode == 1;
+
+            res = AllocateCommandBuffers(device, deviceContext->commandPools[0], VK_COMMAND_BUFFER_LEVEL_PRIMARY, &commandBuffer, 1);
+            if (res != VK_SUCCESS)
+            {
+                fprintf(stderr, "AllocateCommandBuffers failed: %d\n", res);
+                passed = false;
+                break;
+            }
+
+            // The same command buffer is submitted for every iteration
+            const VkCommandBufferBeginInfo cmdBufBeginInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .pNext = NULL,
+                .flags = 0,
+                .pInheritanceInfo = NULL
+            };
+            res = vkBeginCommandBuffer(commandBuffer, &cmdBufBeginInfo);
+            if (res != VK_SUCCESS)
+            {
+                fprintf(stderr, "vkBeginCommandBuffer failed: %d\n", res);
+                passed = false;
+                break;
+            }
+
+            if (queryPool != VK_NULL_HANDLE)
+            {
+                vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+            }
+
+            struct ComputeGraphStats stats;
+            RecordComputeGraph(deviceContext, &graph, commandBuffer, planBarriers, &stats);
+
+            if (queryPool != VK_NULL_HANDLE) {
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+            }
+
+            res = vkEndCommandBuffer(commandBuffer);
+            if (res != VK_SUCCESS)
+            {
+                fprintf(stderr, "vkEndCommandBuffer failed: %d\n", res);
+                passed = false;
+                break;
+            }
+
+            const VkSubmitInfo submit_info = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext = NULL,
+                .waitSemaphoreCount = 0,
+                .pWaitSemaphores = NULL,
+                .pWaitDstStageMask = NULL,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &commandBuffer,
+                .signalSemaphoreCount = 0,
+                .pSignalSemaphores = NULL
+            };
+
+            double totalGpuMilliseconds = 0.0;
+            double totalHostMilliseconds = 0.0;
+            for (int iteration = 0; iteration < GRAPH_BENCHMARK_ITERATIONS && passed; iteration++)
+            {
+                const uint64_t submitTime = GetCurrentTimeNanoseconds();
+                res = vkQueueSubmit(deviceContext->queues[0], 1, &submit_info, fence);
+                if (res == VK_SUCCESS) {
+                    res = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+                }
+                if (res == VK_SUCCESS) {
+                    res = vkResetFences(device, 1, &fence);
+                }
+                if (res != VK_SUCCESS)
+                {
+                    fprintf(stderr, "Submitting the graph failed: %d\n", res);
+                    passed = false;
+                    break;
+                }
+                totalHostMilliseconds += (double)(GetCurrentTimeNanoseconds() - submitTime) / 1000000.0;
+
+                if (queryPool != VK_NULL_HANDLE)
+                {
+                    uint64_t timestamps[2] = { 0 };
+                    res = vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(timestamps[0]),
+                        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+                    if (res == VK_SUCCESS)
+                    {
+                        const uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+                        totalGpuMilliseconds += (double)ticks * deviceContext->properties.limits.timestampPeriod / 1000000.0;
+                    }
+                }
+
+                passed = VerifyGraphBenchmarkResults(&resources);
+            }
+
+            printf("%s: %u pass(es) in %u step(s), %u pipeline barrier(s), %u buffer barrier(s), GPU %.3fms, host %.3fms per run\n",
+                planBarriers ? "Planned barriers" : "Barrier per pass", graph.passCount, stats.levelCount, stats.barrierCount,
+                stats.bufferBarrierCount, queryPool != VK_NULL_HANDLE ? totalGpuMilliseconds / GRAPH_BENCHMARK_ITERATIONS : 0.0,
+                totalHostMilliseconds / GRAPH_BENCHMARK_ITERATIONS);
+
+            vkFreeCommandBuffers(device, deviceContext->commandPools[0], 1, &commandBuffer);
+            commandBuffer = VK_NULL_HANDLE;
+        }
+    }
+    while (false);
+
+    if (commandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(device, deviceContext->commandPools[0], 1, &commandBuffer);
+    }
+    if (fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, fence, NULL);
+    }
+    if (queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, queryPool, NULL);
+    }
+    DestroyGraphBenchmarkResources(&resources);
+    DestroyComputePipelineCache(&pipelineCache);
+
+    printf("\n================ Complete the graph barrier benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Mirrors `StepState` of reduce_step.comp.glsl
+struct IndirectStepState
+{
+    VkDispatchIndirectCommand dispatch;
+    uint32_t elemCount;
+    uint32_t value;
+    uint32_t reserved[3];
+};
+
+// Creates a pipeline whose only descriptor is the address table in binding 0, with `pushConstantSize` bytes of push constants
+static VkResult CreatePushConstantComputePipeline(VkDevice device, VkShaderModule computeShaderModule, uint32_t pushConstantSize,
+    VkPipeline* pComputePipeline, VkPipelineLayout* pPipelineLayout, VkDescriptorSetLayout* pDescLayout)
+{
+    const VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[1] = {
+        {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
+    };
+    const uint32_t bindingCount = (uint32_t)(sizeof(descriptorSetLayoutBindings) / sizeof(descriptorSetLayoutBindings[0]));
+    const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        NULL, 0, bindingCount, descriptorSetLayoutBindings
+    };
+
+    VkResult res = vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, NULL, pDescLayout);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateDescriptorSetLayout failed: %d\n", res);
+        return res;
+    }
+
+    const VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = pushConstantSize
+    };
+
+    const VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = pDescLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+
+    res = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, pPipelineLayout);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreatePipelineLayout failed: %d\n", res);
+        return res;
+    }
+
+    const VkComputePipelineCreateInfo computePipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = computeShaderModule,
+            .pName = "main",
+            .pSpecializationInfo = NULL
+        },
+        .layout = *pPipelineLayout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = 0
+    };
+    res = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, NULL, pComputePipeline);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateComputePipelines failed: %d\n", res);
+    }
+
+    return res;
+}
+
+struct IndirectReductionContext
+{
+    struct DeviceContext* deviceContext;
+    uint32_t elemCount;
+
+    VkShaderModule shaderModule;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+
+    // Ping-pong buffers of the reduction
+    VkBuffer dataBuffers[2];
+    VkDeviceMemory dataMemories[2];
+    // Host visible, holds MAX_INDIRECT_STEP_COUNT + 1 `struct IndirectStepState` entries
+    VkBuffer stateBuffer;
+    VkDeviceMemory stateMemory;
+    struct IndirectStepState* states;
+    // Host visible, holds the addresses of both data buffers and of the state buffer
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+    // Host visible, holds the input sequence
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+
+    VkFence fence;
+};
+
+static void DestroyIndirectReductionContext(struct IndirectReductionContext* context)
+{
+    if (context->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = context->deviceContext->device;
+
+    if (context->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, context->fence, NULL);
+    }
+    if (context->states != NULL) {
+        vkUnmapMemory(device, context->stateMemory);
+    }
+
+    const VkBuffer buffers[] = { context->dataBuffers[0], context->dataBuffers[1], context->stateBuffer, context->addressTableBuffer, context->stagingBuffer };
+    const VkDeviceMemory memories[] = { context->dataMemories[0], context->dataMemories[1], context->stateMemory, context->addressTableMemory, context->stagingMemory };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+    {
+        if (buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers[i], NULL);
+        }
+        if (memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, memories[i], NULL);
+        }
+    }
+
+    if (context->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, context->descriptorPool, NULL);
+    }
+    if (context->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, context->pipeline, NULL);
+    }
+    if (context->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, context->pipelineLayout, NULL);
+    }
+    if (context->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, context->descriptorSetLayout, NULL);
+    }
+
+    memset(context, 0, sizeof(*context));
+}
+
+static VkResult CreateIndirectReductionContext(struct DeviceContext* deviceContext, uint32_t elemCount, struct IndirectReductionContext* context)
+{
+    memset(context, 0, sizeof(*context));
+    context->deviceContext = deviceContext;
+    context->elemCount = elemCount;
+
+    const VkDevice device = deviceContext->device;
+    const VkDeviceSize bufferSize = (VkDeviceSize)elemCount * sizeof(uint32_t);
+    const VkMemoryPropertyFlags hostMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkResult res = AcquireShaderModule(deviceContext, "reduce_step", NULL, &context->shaderModule);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return res;
+    }
+
+    // The step index selects the state entry and the direction of the ping-pong buffers
+    res = CreatePushConstantComputePipeline(device, context->shaderModule, sizeof(uint32_t), &context->pipeline, &context->pipelineLayout,
+        &context->descriptorSetLayout);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        res = CreateBufferWithMemory(deviceContext, bufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &context->dataBuffers[i], &context->dataMemories[i]);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+    }
+
+    // The state buffer is written by the kernels, read as indirect arguments and polled by the host
+    const VkDeviceSize stateBufferSize = (MAX_INDIRECT_STEP_COUNT + 1) * sizeof(struct IndirectStepState);
+    res = CreateBufferWithMemory(deviceContext, stateBufferSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, hostMemoryFlags, &context->stateBuffer, &context->stateMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    res = vkMapMemory(device, context->stateMemory, 0, stateBufferSize, 0, (void**)&context->states);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+
+    res = CreateBufferWithMemory(deviceContext, ADDITIONAL_ADDRESS_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemoryFlags,
+        &context->addressTableBuffer, &context->addressTableMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    VkDeviceAddress* addrMem = NULL;
+    res = vkMapMemory(device, context->addressTableMemory, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE, 0, (void**)&addrMem);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    memset(addrMem, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
+    addrMem[0] = GetBufferDeviceAddress(device, context->dataBuffers[0]);
+    addrMem[1] = GetBufferDeviceAddress(device, context->dataBuffers[1]);
+    addrMem[2] = GetBufferDeviceAddress(device, context->stateBuffer);
+    vkUnmapMemory(device, context->addressTableMemory);
+
+    res = CreateBufferWithMemory(deviceContext, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostMemoryFlags, &context->stagingBuffer, &context->stagingMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    void* hostBuffer = NULL;
+    res = vkMapMemory(device, context->stagingMemory, 0, bufferSize, 0, &hostBuffer);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    InitializeSourceData(hostBuffer, (int)elemCount, 0);
+    vkUnmapMemory(device, context->stagingMemory);
+
+    res = CreateDescriptorSets(device, context->addressTableBuffer, ADDITIONAL_ADDRESS_BUFFER_SIZE, context->descriptorSetLayout,
+        &context->descriptorPool, &context->descriptorSet);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "CreateDescriptorSets failed!\n");
+        return res;
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &context->fence);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+    }
+
+    return res;
+}
+
+static uint32_t GetReductionStepGroupCount(uint32_t elemCount)
+{
+    const uint32_t nextCount = (elemCount + 1) / 2;
+    return max((nextCount + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE, 1U);
+}
+
+static void RecordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask,
+    VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+    // The kernels reach their buffers through device addresses, so a global memory barrier is used
+    const VkMemoryBarrier memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = srcAccessMask,
+        .dstAccessMask = dstAccessMask
+    };
+    vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+}
+
+// Allocates a primary command buffer from the first pool, lets `record` fill it, submits it and waits for `fence`
+static VkResult SubmitOneTimeCommands(struct DeviceContext* deviceContext, VkFence fence,
+    void (*record)(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg), const void* userData, uint32_t arg)
+{
+    const VkDevice device = deviceContext->device;
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkResult res = AllocateCommandBuffers(device, deviceContext->commandPools[0], VK_COMMAND_BUFFER_LEVEL_PRIMARY, &commandBuffer, 1);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AllocateCommandBuffers failed: %d\n", res);
+        return res;
+    }
+
+    do
+    {
+        const VkCommandBufferBeginInfo cmdBufBeginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = NULL,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = NULL
+        };
+        res = vkBeginCommandBuffer(commandBuffer, &cmdBufBeginInfo);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkBeginCommandBuffer failed: %d\n", res);
+            break;
+        }
+
+        record(userData, commandBuffer, arg);
+
+        res = vkEndCommandBuffer(commandBuffer);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkEndCommandBuffer failed: %d\n", res);
+            break;
+        }
+
+        const VkSubmitInfo submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = NULL,
+            .waitSemaphoreCount = 0,
+            .pWaitSemaphores = NULL,
+            .pWaitDstStageMask = NULL,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &commandBuffer,
+            .signalSemaphoreCount = 0,
+            .pSignalSemaphores = NULL
+        };
+        res = vkQueueSubmit(deviceContext->queues[0], 1, &submit_info, fence);
+        if (res == VK_SUCCESS)
+        {
+            AddHostCounter(HOST_COUNTER_SUBMITS, 1);
+            AddHostCounter(HOST_COUNTER_COMMAND_BUFFERS, 1);
+            res = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+        }
+        if (res == VK_SUCCESS) {
+            res = vkResetFences(device, 1, &fence);
+        }
+        if (res != VK_SUCCESS) {
+            fprintf(stderr, "Submitting the one-time commands failed: %d\n", res);
+        }
+    }
+    while (false);
+
+    vkFreeCommandBuffers(device, deviceContext->commandPools[0], 1, &commandBuffer);
+
+    return res;
+}
+
+static VkResult SubmitIndirectReductionCommands(struct IndirectReductionContext* context,
+    void (*record)(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg), uint32_t arg)
+{
+    return SubmitOneTimeCommands(context->deviceContext, context->fence, record, context, arg);
+}
+
+static void RecordReductionUpload(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg)
+{
+    const struct IndirectReductionContext* context = userData;
+    const VkBufferCopy copyRegion = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = (VkDeviceSize)context->elemCount * sizeof(uint32_t)
+    };
+    vkCmdCopyBuffer(commandBuffer, context->stagingBuffer, context->dataBuffers[0], 1, &copyRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+// One step with the dispatch size computed on the host, as a CPU driven loop has to do
+static void RecordHostDrivenReductionStep(const void* userData, VkCommandBuffer commandBuffer, uint32_t step)
+{
+    const struct IndirectReductionContext* context = userData;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipelineLayout, 0, 1, &context->descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, context->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(step), &step);
+    vkCmdDispatch(commandBuffer, GetReductionStepGroupCount(context->states[step].elemCount), 1, 1);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// `stepCount` steps whose sizes come from the previous steps, followed by moving the last state back to the first entry,
+// so that the same commands can be submitted again until the reduction converges. `stepCount` must be even, which leaves
+// the data in dataBuffers[0].
+static void RecordGpuDrivenReductionSteps(const void* userData, VkCommandBuffer commandBuffer, uint32_t stepCount)
+{
+    const struct IndirectReductionContext* context = userData;
+    // Covers the upload and the state written back by the previous submission
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipelineLayout, 0, 1, &context->descriptorSet, 0, NULL);
+
+    for (uint32_t step = 0; step < stepCount; step++)
+    {
+        vkCmdPushConstants(commandBuffer, context->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(step), &step);
+        vkCmdDispatchIndirect(commandBuffer, context->stateBuffer, step * sizeof(struct IndirectStepState));
+
+        // The next step reads both the data and its dispatch arguments written by this step
+        if (step + 1 < stepCount)
+        {
+            RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        }
+    }
+
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    const VkBufferCopy stateRegion = {
+        .srcOffset = stepCount * sizeof(struct IndirectStepState),
+        .dstOffset = 0,
+        .size = offsetof(struct IndirectStepState, value)
+    };
+    vkCmdCopyBuffer(commandBuffer, context->stateBuffer, context->stateBuffer, 1, &stateRegion);
+
+    // The partial sum in front of the data, which is the result once the reduction has converged
+    const VkBufferCopy valueRegion = {
+        .srcOffset = 0,
+        .dstOffset = offsetof(struct IndirectStepState, value),
+        .size = sizeof(uint32_t)
+    };
+    vkCmdCopyBuffer(commandBuffer, context->dataBuffers[0], context->stateBuffer, 1, &valueRegion);
+
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+static void RecordReductionReadback(const void* userData, VkCommandBuffer commandBuffer, uint32_t step)
+{
+    const struct IndirectReductionContext* context = userData;
+    const VkBufferCopy valueRegion = {
+        .srcOffset = 0,
+        .dstOffset = step * sizeof(struct IndirectStepState) + offsetof(struct IndirectStepState, value),
+        .size = sizeof(uint32_t)
+    };
+    vkCmdCopyBuffer(commandBuffer, context->dataBuffers[step & 1], context->stateBuffer, 1, &valueRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+static VkResult ResetIndirectReduction(struct IndirectReductionContext* context)
+{
+    memset(context->states, 0, (MAX_INDIRECT_STEP_COUNT + 1) * sizeof(struct IndirectStepState));
+    context->states[0] = (struct IndirectStepState){
+        .dispatch = { GetReductionStepGroupCount(context->elemCount), 1, 1 },
+        .elemCount = context->elemCount
+    };
+    return SubmitIndirectReductionCommands(context, RecordReductionUpload, 0);
+}
+
+// Sums 0..elemCount-1 (modulo 2^32) with a pairwise reduction, once with a host round trip per step and once with
+// INDIRECT_STEPS_PER_SUBMISSION GPU driven steps per submission
+static bool RunIndirectReductionTest(uint32_t elemCount)
+{
+    struct IndirectReductionContext context;
+    bool passed = false;
+
+    // The first step dispatches the most workgroups, one per pair of workgroup sizes
+    const uint64_t maxElemCount = (uint64_t)s_deviceContexts[0].properties.limits.maxComputeWorkGroupCount[0] * COMPUTE_WORKGROUP_SIZE * 2;
+    if (elemCount > maxElemCount)
+    {
+        printf("Clamping %u elements to %llu, the maximum workgroup count of the device\n", elemCount, (unsigned long long)maxElemCount);
+        elemCount = (uint32_t)maxElemCount;
+    }
+
+    uint32_t expected = 0;
+    for (uint32_t i = 0; i < elemCount; i++) {
+        expected += i;
+    }
+
+    printf("\n================ Begin the indirect dispatch test: sum of %u elements ================\n\n", elemCount);
+
+    do
+    {
+        if (CreateIndirectReductionContext(&s_deviceContexts[0], elemCount, &context) != VK_SUCCESS) {
+            break;
+        }
+
+        // CPU driven: read the size of every step back before recording the next one
+        if (ResetIndirectReduction(&context) != VK_SUCCESS) {
+            break;
+        }
+        uint64_t beginTime = GetCurrentTimeNanoseconds();
+        uint32_t step = 0;
+        VkResult res = VK_SUCCESS;
+        while (context.states[step].elemCount > 1 && step < MAX_INDIRECT_STEP_COUNT && res == VK_SUCCESS)
+        {
+            res = SubmitIndirectReductionCommands(&context, RecordHostDrivenReductionStep, step);
+            step++;
+        }
+        if (res == VK_SUCCESS) {
+            res = SubmitIndirectReductionCommands(&context, RecordReductionReadback, step);
+        }
+        if (res != VK_SUCCESS) {
+            break;
+        }
+        const double hostDrivenMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+        const uint32_t hostDrivenResult = context.states[step].value;
+        printf("Host driven: %u step(s), %u round trip(s), %.3fms, sum = %u\n", step, step + 1, hostDrivenMilliseconds, hostDrivenResult);
+
+        // GPU driven: the host only checks for convergence after every INDIRECT_STEPS_PER_SUBMISSION steps
+        if (ResetIndirectReduction(&context) != VK_SUCCESS) {
+            break;
+        }
+        beginTime = GetCurrentTimeNanoseconds();
+        uint32_t submissionCount = 0;
+        while (context.states[0].elemCount > 1 && submissionCount * INDIRECT_STEPS_PER_SUBMISSION < MAX_INDIRECT_STEP_COUNT && res == VK_SUCCESS)
+        {
+            res = SubmitIndirectReductionCommands(&context, RecordGpuDrivenReductionSteps, INDIRECT_STEPS_PER_SUBMISSION);
+            submissionCount++;
+        }
+        if (res != VK_SUCCESS) {
+            break;
+        }
+        const double gpuDrivenMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+        const uint32_t gpuDrivenResult = context.states[0].value;
+        printf("GPU driven: %u step(s) per submission, %u round trip(s), %.3fms, sum = %u\n", INDIRECT_STEPS_PER_SUBMISSION, submissionCount,
+            gpuDrivenMilliseconds, gpuDrivenResult);
+
+        passed = hostDrivenResult == expected && gpuDrivenResult == expected && context.states[0].elemCount == 1;
+        if (!passed) {
+            fprintf(stderr, "The expected sum is %u!\n", expected);
+        }
+    }
+    while (false);
+
+    DestroyIndirectReductionContext(&context);
+
+    printf("\n================ Complete the indirect dispatch test: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Mirrors the header of `DeviceHeapType` in device_heap_filter.comp.glsl; `top` and `listHead` are byte offsets into the heap
+struct DeviceHeapHeader
+{
+    uint32_t top;
+    uint32_t capacity;
+    uint32_t listHead;
+    uint32_t failedCount;
+};
+
+// Mirrors the header of `OutputBlockType` in device_heap_filter.comp.glsl, the kept elements follow it
+struct DeviceHeapBlockHeader
+{
+    VkDeviceAddress next;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+// Mirrors `FilterParams` of device_heap_filter.comp.glsl
+struct DeviceHeapFilterParams
+{
+    uint32_t elemCount;
+    uint32_t selectivity;
+};
+
+struct DeviceHeapFilterContext
+{
+    struct DeviceContext* deviceContext;
+    uint32_t elemCount;
+
+    VkShaderModule shaderModule;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+
+    VkBuffer srcBuffer;
+    VkDeviceMemory srcMemory;
+    // DEVICE_HEAP_CAPACITY bytes of device local memory, reached by the kernels only through its device address
+    VkBuffer heapBuffer;
+    VkDeviceMemory heapMemory;
+    VkDeviceAddress heapAddress;
+    // Host visible, holds the addresses of the source buffer and of the heap
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+    // Host visible, holds the input sequence
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    // Host visible, receives the heap header after every filter run
+    VkBuffer headerBuffer;
+    VkDeviceMemory headerMemory;
+    struct DeviceHeapHeader* header;
+    // Host visible, sized to the used extent of the heap of the current run
+    VkBuffer readbackBuffer;
+    VkDeviceSize readbackSize;
+
+    VkFence fence;
+};
+
+static void DestroyDeviceHeapFilterContext(struct DeviceHeapFilterContext* context)
+{
+    if (context->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = context->deviceContext->device;
+
+    if (context->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, context->fence, NULL);
+    }
+    if (context->header != NULL) {
+        vkUnmapMemory(device, context->headerMemory);
+    }
+
+    const VkBuffer buffers[] = { context->srcBuffer, context->heapBuffer, context->addressTableBuffer, context->stagingBuffer, context->headerBuffer };
+    const VkDeviceMemory memories[] = { context->srcMemory, context->heapMemory, context->addressTableMemory, context->stagingMemory, context->headerMemory };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+    {
+        if (buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers[i], NULL);
+        }
+        if (memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, memories[i], NULL);
+        }
+    }
+
+    if (context->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, context->descriptorPool, NULL);
+    }
+    if (context->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, context->pipeline, NULL);
+    }
+    if (context->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, context->pipelineLayout, NULL);
+    }
+    if (context->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, context->descriptorSetLayout, NULL);
+    }
+
+    memset(context, 0, sizeof(*context));
+}
+
+static VkResult CreateDeviceHeapFilterContext(struct DeviceContext* deviceContext, uint32_t elemCount, struct DeviceHeapFilterContext* context)
+{
+    memset(context, 0, sizeof(*context));
+    context->deviceContext = deviceContext;
+    context->elemCount = elemCount;
+
+    const VkDevice device = deviceContext->device;
+    const VkDeviceSize bufferSize = (VkDeviceSize)elemCount * sizeof(uint32_t);
+    const VkMemoryPropertyFlags hostMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkResult res = AcquireShaderModule(deviceContext, "device_heap_filter", NULL, &context->shaderModule);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return res;
+    }
+
+    res = CreatePushConstantComputePipeline(device, context->shaderModule, sizeof(struct DeviceHeapFilterParams), &context->pipeline,
+        &context->pipelineLayout, &context->descriptorSetLayout);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    res = CreateBufferWithMemory(deviceContext, bufferSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &context->srcBuffer, &context->srcMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    res = CreateBufferWithMemory(deviceContext, DEVICE_HEAP_CAPACITY,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &context->heapBuffer, &context->heapMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    context->heapAddress = GetBufferDeviceAddress(device, context->heapBuffer);
+
+    res = CreateBufferWithMemory(deviceContext, ADDITIONAL_ADDRESS_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemoryFlags,
+        &context->addressTableBuffer, &context->addressTableMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    VkDeviceAddress* addrMem = NULL;
+    res = vkMapMemory(device, context->addressTableMemory, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE, 0, (void**)&addrMem);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    memset(addrMem, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
+    addrMem[0] = GetBufferDeviceAddress(device, context->srcBuffer);
+    addrMem[1] = context->heapAddress;
+    vkUnmapMemory(device, context->addressTableMemory);
+
+    res = CreateBufferWithMemory(deviceContext, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostMemoryFlags, &context->stagingBuffer, &context->stagingMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    void* hostBuffer = NULL;
+    res = vkMapMemory(device, context->stagingMemory, 0, bufferSize, 0, &hostBuffer);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    InitializeSourceData(hostBuffer, (int)elemCount, 0);
+    vkUnmapMemory(device, context->stagingMemory);
+
+    res = CreateBufferWithMemory(deviceContext, sizeof(struct DeviceHeapHeader), VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemoryFlags,
+        &context->headerBuffer, &context->headerMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    res = vkMapMemory(device, context->headerMemory, 0, sizeof(struct DeviceHeapHeader), 0, (void**)&context->header);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+
+    res = CreateDescriptorSets(device, context->addressTableBuffer, ADDITIONAL_ADDRESS_BUFFER_SIZE, context->descriptorSetLayout,
+        &context->descriptorPool, &context->descriptorSet);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "CreateDescriptorSets failed!\n");
+        return res;
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &context->fence);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+    }
+
+    return res;
+}
+
+// Same predicate as `Keep` of device_heap_filter.comp.glsl
+static bool KeepFilteredElement(uint32_t value, uint32_t selectivity)
+{
+    return ((value * 2654435761U) >> 16) % 100U < selectivity;
+}
+
+static void RecordDeviceHeapUpload(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg)
+{
+    const struct DeviceHeapFilterContext* context = userData;
+    const VkBufferCopy copyRegion = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = (VkDeviceSize)context->elemCount * sizeof(uint32_t)
+    };
+    vkCmdCopyBuffer(commandBuffer, context->stagingBuffer, context->srcBuffer, 1, &copyRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+// Resets the heap, runs the filter and reads the heap header back. Freeing all blocks at once is just resetting `top`.
+static void RecordDeviceHeapFilter(const void* userData, VkCommandBuffer commandBuffer, uint32_t selectivity)
+{
+    const struct DeviceHeapFilterContext* context = userData;
+
+    const struct DeviceHeapHeader emptyHeader = {
+        .top = sizeof(struct DeviceHeapHeader),
+        .capacity = DEVICE_HEAP_CAPACITY,
+        .listHead = 0,
+        .failedCount = 0
+    };
+    vkCmdUpdateBuffer(commandBuffer, context->heapBuffer, 0, sizeof(emptyHeader), &emptyHeader);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    const struct DeviceHeapFilterParams params = {
+        .elemCount = context->elemCount,
+        .selectivity = selectivity
+    };
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipelineLayout, 0, 1, &context->descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, context->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(commandBuffer, (context->elemCount + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE, 1, 1);
+
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    const VkBufferCopy headerRegion = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = sizeof(struct DeviceHeapHeader)
+    };
+    vkCmdCopyBuffer(commandBuffer, context->heapBuffer, context->headerBuffer, 1, &headerRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// Copies the used extent of the heap, which the previous submission has already made visible to transfers
+static void RecordDeviceHeapReadback(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg)
+{
+    const struct DeviceHeapFilterContext* context = userData;
+    const VkBufferCopy usedRegion = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = context->readbackSize
+    };
+    vkCmdCopyBuffer(commandBuffer, context->heapBuffer, context->readbackBuffer, 1, &usedRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// Walks the block list of the read back heap and checks that it holds exactly the elements kept by the CPU filter
+static bool VerifyDeviceHeapBlocks(const struct DeviceHeapFilterContext* context, const uint8_t* heapData, VkDeviceSize usedSize,
+    uint32_t selectivity, uint32_t* pBlockCount, uint32_t* pKeptCount)
+{
+    uint32_t expectedCount = 0;
+    uint64_t expectedSum = 0;
+    for (uint32_t i = 0; i < context->elemCount; i++)
+    {
+        if (KeepFilteredElement(i, selectivity))
+        {
+            expectedCount++;
+            expectedSum += i;
+        }
+    }
+
+    const uint32_t maxBlockCount = (context->elemCount + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE;
+    const struct DeviceHeapHeader* header = (const struct DeviceHeapHeader*)heapData;
+    uint32_t blockCount = 0;
+    uint32_t keptCount = 0;
+    uint64_t keptSum = 0;
+    uint32_t offset = header->listHead;
+    while (offset != 0)
+    {
+        const struct DeviceHeapBlockHeader* block = (const struct DeviceHeapBlockHeader*)(heapData + offset);
+        if (offset < sizeof(*header) || offset + sizeof(*block) > usedSize || block->count > COMPUTE_WORKGROUP_SIZE ||
+            offset + sizeof(*block) + block->count * sizeof(uint32_t) > usedSize || ++blockCount > maxBlockCount)
+        {
+            fprintf(stderr, "Corrupted block at heap offset %u!\n", offset);
+            return false;
+        }
+
+        const uint32_t* values = (const uint32_t*)(block + 1);
+        for (uint32_t i = 0; i < block->count; i++)
+        {
+            if (values[i] >= context->elemCount || !KeepFilteredElement(values[i], selectivity))
+            {
+                fprintf(stderr, "Unexpected element %u in the block at heap offset %u!\n", values[i], offset);
+                return false;
+            }
+            keptSum += values[i];
+        }
+        keptCount += block->count;
+
+        offset = block->next != 0 ? (uint32_t)(block->next - context->heapAddress) : 0;
+    }
+
+    *pBlockCount = blockCount;
+    *pKeptCount = keptCount;
+    if (keptCount != expectedCount || keptSum != expectedSum)
+    {
+        fprintf(stderr, "Expected %u elements with the sum %llu, got %u elements with the sum %llu!\n", expectedCount,
+            (unsigned long long)expectedSum, keptCount, (unsigned long long)keptSum);
+        return false;
+    }
+    return true;
+}
+
+// Runs one filter and reads back only the used extent of the heap
+static bool RunDeviceHeapFilter(struct DeviceHeapFilterContext* context, uint32_t selectivity, VkDeviceSize* pUsedSize)
+{
+    struct DeviceContext* deviceContext = context->deviceContext;
+    const VkDevice device = deviceContext->device;
+
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    if (SubmitOneTimeCommands(deviceContext, context->fence, RecordDeviceHeapFilter, context, selectivity) != VK_SUCCESS) {
+        return false;
+    }
+    const double filterMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+    const struct DeviceHeapHeader header = *context->header;
+    if (header.failedCount > 0)
+    {
+        fprintf(stderr, "The device heap is exhausted, %u element(s) were dropped!\n", header.failedCount);
+        return false;
+    }
+
+    VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+    uint8_t* heapData = NULL;
+    bool passed = false;
+    uint32_t blockCount = 0;
+    uint32_t keptCount = 0;
+
+    context->readbackSize = header.top;
+    do
+    {
+        if (CreateBufferWithMemory(deviceContext, context->readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &context->readbackBuffer, &readbackMemory) != VK_SUCCESS) {
+            break;
+        }
+        if (SubmitOneTimeCommands(deviceContext, context->fence, RecordDeviceHeapReadback, context, 0) != VK_SUCCESS) {
+            break;
+        }
+
+        const VkResult res = vkMapMemory(device, readbackMemory, 0, context->readbackSize, 0, (void**)&heapData);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkMapMemory failed: %d\n", res);
+            break;
+        }
+        passed = VerifyDeviceHeapBlocks(context, heapData, context->readbackSize, selectivity, &blockCount, &keptCount);
+        vkUnmapMemory(device, readbackMemory);
+    }
+    while (false);
+
+    if (context->readbackBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, context->readbackBuffer, NULL);
+    }
+    if (readbackMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, readbackMemory, NULL);
+    }
+    context->readbackBuffer = VK_NULL_HANDLE;
+
+    const VkDeviceSize overAllocatedSize = (VkDeviceSize)context->elemCount * sizeof(uint32_t);
+    printf("Selectivity %3u%%: %u element(s) in %u block(s), %.3fms, used %llu bytes (%.1f%% of the %llu bytes of an over-allocated output)\n",
+        selectivity, keptCount, blockCount, filterMilliseconds, (unsigned long long)header.top,
+        (double)header.top * 100.0 / (double)overAllocatedSize, (unsigned long long)overAllocatedSize);
+
+    *pUsedSize = header.top;
+    return passed;
+}
+
+// Filters the input at several selectivities with output blocks allocated on the device, and compares the used heap extent
+// with the worst case output size the host would have to allocate up front
+static bool RunDeviceHeapTest(uint32_t elemCount)
+{
+    static const uint32_t selectivities[] = { 1, 10, 50 };
+    const uint32_t selectivityCount = (uint32_t)(sizeof(selectivities) / sizeof(selectivities[0]));
+
+    struct DeviceHeapFilterContext context;
+    bool passed = false;
+    VkDeviceSize peakUsedSize = 0;
+
+    printf("\n================ Begin the device heap test: filter %u elements with a %u byte heap ================\n\n", elemCount, DEVICE_HEAP_CAPACITY);
+
+    do
+    {
+        if (CreateDeviceHeapFilterContext(&s_deviceContexts[0], elemCount, &context) != VK_SUCCESS) {
+            break;
+        }
+        if (SubmitOneTimeCommands(context.deviceContext, context.fence, RecordDeviceHeapUpload, &context, 0) != VK_SUCCESS) {
+            break;
+        }
+
+        uint32_t i = 0;
+        for (; i < selectivityCount; i++)
+        {
+            VkDeviceSize usedSize = 0;
+            if (!RunDeviceHeapFilter(&context, selectivities[i], &usedSize)) {
+                break;
+            }
+            peakUsedSize = max(peakUsedSize, usedSize);
+        }
+        passed = i == selectivityCount;
+    }
+    while (false);
+
+    DestroyDeviceHeapFilterContext(&context);
+
+    if (passed)
+    {
+        const VkDeviceSize overAllocatedSize = (VkDeviceSize)elemCount * sizeof(uint32_t);
+        printf("\nPeak heap usage: %llu bytes, over-allocating every output: %llu bytes per filter, %llu bytes for all %u filters\n",
+            (unsigned long long)peakUsedSize, (unsigned long long)overAllocatedSize, (unsigned long long)(overAllocatedSize * selectivityCount),
+            selectivityCount);
+    }
+
+    printf("\n================ Complete the device heap test: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Mirrors the OP_ constants of persistent_queue.comp.glsl
+enum PERSISTENT_JOB_OP
+{
+    // dst[i] = 2 * src[i]
+    PERSISTENT_JOB_OP_DOUBLE = 1,
+    // Completes and stops the kernel
+    PERSISTENT_JOB_OP_SHUTDOWN = 2
+};
+
+// Mirrors the STATE_ constants of persistent_queue.comp.glsl
+enum PERSISTENT_QUEUE_STATE
+{
+    PERSISTENT_QUEUE_STATE_STOPPED,
+    PERSISTENT_QUEUE_STATE_RUNNING,
+    // Left after PERSISTENT_QUEUE_MAX_IDLE_POLLS polls without a job
+    PERSISTENT_QUEUE_STATE_IDLE_EXIT,
+    PERSISTENT_QUEUE_STATE_SHUT_DOWN
+};
+
+// Mirrors `JobSlot` of persistent_queue.comp.glsl
+struct PersistentJobSlot
+{
+    VkDeviceAddress srcAddress;
+    VkDeviceAddress dstAddress;
+    uint32_t elemCount;
+    uint32_t op;
+    uint32_t sequence;
+    uint32_t completion;
+};
+
+// Mirrors `RingType` of persistent_queue.comp.glsl
+struct PersistentQueueRing
+{
+    uint32_t completedCount;
+    uint32_t state;
+    uint32_t reserved[2];
+    struct PersistentJobSlot slots[PERSISTENT_QUEUE_CAPACITY];
+};
+
+// Mirrors `QueueParams` of persistent_queue.comp.glsl
+struct PersistentQueueParams
+{
+    uint32_t capacity;
+    uint32_t maxIdlePolls;
+};
+
+// A kernel that stays resident on one queue and runs the jobs published in a ring of host visible memory.
+// The ring is accessed through volatile pointers, so every poll reads the memory again. A release fence orders the
+// descriptor before its sequence number, and an acquire fence orders a completion before the reads of the output.
+struct PersistentQueue
+{
+    struct DeviceContext* deviceContext;
+    uint32_t queueIndex;
+
+    VkShaderModule shaderModule;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+
+    VkBuffer ringBuffer;
+    VkDeviceMemory ringMemory;
+    volatile struct PersistentQueueRing* ring;
+    // Holds the address of the ring
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+
+    // Records the single workgroup dispatch, submitted again on every launch
+    VkCommandBuffer commandBuffer;
+    // Signaled when the kernel has left
+    VkFence fence;
+    bool running;
+    uint32_t launchCount;
+    uint32_t publishedCount;
+};
+
+static void DestroyPersistentQueueObjects(struct PersistentQueue* queue)
+{
+    if (queue->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = queue->deviceContext->device;
+
+    if (queue->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, queue->fence, NULL);
+    }
+    if (queue->commandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(device, queue->deviceContext->commandPools[queue->queueIndex], 1, &queue->commandBuffer);
+    }
+    if (queue->ring != NULL) {
+        vkUnmapMemory(device, queue->ringMemory);
+    }
+
+    const VkBuffer buffers[] = { queue->ringBuffer, queue->addressTableBuffer };
+    const VkDeviceMemory memories[] = { queue->ringMemory, queue->addressTableMemory };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+    {
+        if (buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers[i], NULL);
+        }
+        if (memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, memories[i], NULL);
+        }
+    }
+
+    if (queue->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, queue->descriptorPool, NULL);
+    }
+    if (queue->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, queue->pipeline, NULL);
+    }
+    if (queue->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, queue->pipelineLayout, NULL);
+    }
+    if (queue->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, queue->descriptorSetLayout, NULL);
+    }
+
+    memset(queue, 0, sizeof(*queue));
+}
+
+// Creates the ring and records the kernel launch; the kernel itself is launched by the first job
+static VkResult CreatePersistentQueue(struct DeviceContext* deviceContext, uint32_t queueIndex, struct PersistentQueue* queue)
+{
+    memset(queue, 0, sizeof(*queue));
+    queue->deviceContext = deviceContext;
+    queue->queueIndex = queueIndex;
+
+    const VkDevice device = deviceContext->device;
+    const VkMemoryPropertyFlags hostMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkResult res = AcquireShaderModule(deviceContext, "persistent_queue", NULL, &queue->shaderModule);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return res;
+    }
+
+    res = CreatePushConstantComputePipeline(device, queue->shaderModule, sizeof(struct PersistentQueueParams), &queue->pipeline,
+        &queue->pipelineLayout, &queue->descriptorSetLayout);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    res = CreateBufferWithMemory(deviceContext, sizeof(struct PersistentQueueRing), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        hostMemoryFlags, &queue->ringBuffer, &queue->ringMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    void* ringMem = NULL;
+    res = vkMapMemory(device, queue->ringMemory, 0, sizeof(struct PersistentQueueRing), 0, &ringMem);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    memset(ringMem, 0, sizeof(struct PersistentQueueRing));
+    queue->ring = ringMem;
+
+    res = CreateBufferWithMemory(deviceContext, ADDITIONAL_ADDRESS_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemoryFlags,
+        &queue->addressTableBuffer, &queue->addressTableMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    VkDeviceAddress* addrMem = NULL;
+    res = vkMapMemory(device, queue->addressTableMemory, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE, 0, (void**)&addrMem);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    memset(addrMem, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
+    addrMem[0] = GetBufferDeviceAddress(device, queue->ringBuffer);
+    vkUnmapMemory(device, queue->addressTableMemory);
+
+    res = CreateDescriptorSets(device, queue->addressTableBuffer, ADDITIONAL_ADDRESS_BUFFER_SIZE, queue->descriptorSetLayout,
+        &queue->descriptorPool, &queue->descriptorSet);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "CreateDescriptorSets failed!\n");
+        return res;
+    }
+
+    res = AllocateCommandBuffers(device, deviceContext->commandPools[queueIndex], VK_COMMAND_BUFFER_LEVEL_PRIMARY, &queue->commandBuffer, 1);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AllocateCommandBuffers failed: %d\n", res);
+        return res;
+    }
+
+    const VkCommandBufferBeginInfo cmdBufBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .pInheritanceInfo = NULL
+    };
+    res = vkBeginCommandBuffer(queue->commandBuffer, &cmdBufBeginInfo);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkBeginCommandBuffer failed: %d\n", res);
+        return res;
+    }
+
+    const struct PersistentQueueParams params = {
+        .capacity = PERSISTENT_QUEUE_CAPACITY,
+        .maxIdlePolls = PERSISTENT_QUEUE_MAX_IDLE_POLLS
+    };
+    vkCmdBindPipeline(queue->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, queue->pipeline);
+    vkCmdBindDescriptorSets(queue->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, queue->pipelineLayout, 0, 1, &queue->descriptorSet, 0, NULL);
+    vkCmdPushConstants(queue->commandBuffer, queue->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(queue->commandBuffer, 1, 1, 1);
+
+    res = vkEndCommandBuffer(queue->commandBuffer);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkEndCommandBuffer failed: %d\n", res);
+        return res;
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &queue->fence);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+    }
+
+    return res;
+}
+
+// Launches the kernel if it is not running and jobs are pending. A kernel that has left after idling is detected
+// through its fence and launched again; it resumes at the first job it has not completed.
+static VkResult KeepPersistentQueueRunning(struct PersistentQueue* queue)
+{
+    const VkDevice device = queue->deviceContext->device;
+    VkResult res = VK_SUCCESS;
+    if (queue->running)
+    {
+        res = vkGetFenceStatus(device, queue->fence);
+        if (res == VK_NOT_READY) {
+            return VK_SUCCESS;
+        }
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkGetFenceStatus failed: %d\n", res);
+            return res;
+        }
+
+        queue->running = false;
+        res = vkResetFences(device, 1, &queue->fence);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkResetFences failed: %d\n", res);
+            return res;
+        }
+    }
+
+    if (queue->ring->completedCount == queue->publishedCount) {
+        return VK_SUCCESS;
+    }
+
+    const VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &queue->commandBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL
+    };
+    res = vkQueueSubmit(queue->deviceContext->queues[queue->queueIndex], 1, &submit_info, queue->fence);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkQueueSubmit failed: %d\n", res);
+        return res;
+    }
+    queue->running = true;
+    queue->launchCount++;
+    return VK_SUCCESS;
+}
+
+// Publishes a job without any vkQueueSubmit while the kernel is running. `*pTicket` receives the ticket to wait for.
+static VkResult EnqueuePersistentJob(struct PersistentQueue* queue, VkDeviceAddress srcAddress, VkDeviceAddress dstAddress,
+    uint32_t elemCount, enum PERSISTENT_JOB_OP op, uint32_t* pTicket)
+{
+    // A slot is free again once the job published PERSISTENT_QUEUE_CAPACITY jobs earlier has completed
+    while (queue->publishedCount - queue->ring->completedCount >= PERSISTENT_QUEUE_CAPACITY)
+    {
+        const VkResult res = KeepPersistentQueueRunning(queue);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+    }
+    // The slot is not rewritten before the kernel is seen to be done with it
+    atomic_thread_fence(memory_order_acquire);
+
+    volatile struct PersistentJobSlot* slot = &queue->ring->slots[queue->publishedCount % PERSISTENT_QUEUE_CAPACITY];
+    slot->srcAddress = srcAddress;
+    slot->dstAddress = dstAddress;
+    slot->elemCount = elemCount;
+    slot->op = op;
+    slot->completion = 0;
+    // Written last, hands the slot over to the kernel
+    atomic_thread_fence(memory_order_release);
+    slot->sequence = queue->publishedCount + 1;
+
+    *pTicket = ++queue->publishedCount;
+    return KeepPersistentQueueRunning(queue);
+}
+
+// Spins on the completion flag of the job
+static VkResult WaitPersistentJob(struct PersistentQueue* queue, uint32_t ticket)
+{
+    volatile const struct PersistentJobSlot* slot = &queue->ring->slots[(ticket - 1) % PERSISTENT_QUEUE_CAPACITY];
+    // The slot may already have been reused by a later job if the caller waits late
+    while (slot->completion != ticket && (int32_t)(queue->ring->completedCount - ticket) < 0)
+    {
+        const VkResult res = KeepPersistentQueueRunning(queue);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+    }
+    // The output of the job is read after its completion
+    atomic_thread_fence(memory_order_acquire);
+    return VK_SUCCESS;
+}
+
+// Shuts the kernel down through the ring, waits for it to leave and destroys the queue.
+// Returns whether the kernel has acknowledged the shutdown.
+static bool DestroyPersistentQueue(struct PersistentQueue* queue)
+{
+    bool shutDown = false;
+    if (queue->deviceContext == NULL) {
+        return shutDown;
+    }
+
+    uint32_t ticket = 0;
+    if (queue->commandBuffer != VK_NULL_HANDLE && queue->fence != VK_NULL_HANDLE &&
+        EnqueuePersistentJob(queue, 0, 0, 0, PERSISTENT_JOB_OP_SHUTDOWN, &ticket) == VK_SUCCESS &&
+        WaitPersistentJob(queue, ticket) == VK_SUCCESS)
+    {
+        shutDown = queue->ring->state == PERSISTENT_QUEUE_STATE_SHUT_DOWN;
+    }
+
+    if (queue->running)
+    {
+        // Either shut down or left after idling; in both cases it is about to finish
+        const VkResult res = vkWaitForFences(queue->deviceContext->device, 1, &queue->fence, VK_TRUE, UINT64_MAX);
+        if (res != VK_SUCCESS) {
+            fprintf(stderr, "vkWaitForFences failed: %d\n", res);
+        }
+        queue->running = false;
+    }
+
+    DestroyPersistentQueueObjects(queue);
+    return shutDown;
+}
+
+// Compares the latency of tiny jobs submitted one by one with jobs published to the persistent kernel
+static bool RunPersistentQueueBenchmark(uint32_t jobCount)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    const VkDevice device = deviceContext->device;
+    const uint32_t elemCount = PERSISTENT_QUEUE_JOB_ELEMENT_COUNT;
+    const VkDeviceSize bufferSize = elemCount * sizeof(uint32_t);
+
+    printf("\n================ Begin the persistent queue benchmark: %u jobs of %u elements ================\n\n", jobCount, elemCount);
+
+    // Submit per job: one vkQueueSubmit and one fence wait for every job
+    const struct ComputeJob submitJob = {
+        .name = "submit-per-job",
+        .elemCount = elemCount,
+        .iterations = jobCount
+    };
+    struct ComputeJobResult submitResult;
+    RunComputeJobs(&submitJob, &submitResult, 1, 1, false);
+    bool passed = submitResult.passed && submitResult.completedIterations == jobCount;
+    if (passed)
+    {
+        printf("Submit per job:   average %8.1fus, min %8.1fus, max %8.1fus\n", submitResult.totalMilliseconds * 1000.0 / jobCount,
+            submitResult.minMilliseconds * 1000.0, submitResult.maxMilliseconds * 1000.0);
+    }
+
+    struct PersistentQueue queue;
+    VkBuffer buffers[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    VkDeviceMemory memories[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    uint32_t* hostData[2] = { NULL, NULL };
+    bool persistentPassed = false;
+    bool shutDown = false;
+
+    do
+    {
+        if (!passed || CreatePersistentQueue(deviceContext, 0, &queue) != VK_SUCCESS) {
+            break;
+        }
+
+        // The kernel reads and writes the job data in place, so it is kept in host visible memory
+        VkResult res = VK_SUCCESS;
+        for (int i = 0; i < 2 && res == VK_SUCCESS; i++)
+        {
+            res = CreateBufferWithMemory(deviceContext, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers[i], &memories[i]);
+            if (res == VK_SUCCESS)
+            {
+                res = vkMapMemory(device, memories[i], 0, bufferSize, 0, (void**)&hostData[i]);
+                if (res != VK_SUCCESS) {
+                    fprintf(stderr, "vkMapMemory failed: %d\n", res);
+                }
+            }
+        }
+        if (res != VK_SUCCESS) {
+            break;
+        }
+        InitializeSourceData((int*)hostData[0], (int)elemCount, 0);
+        const VkDeviceAddress srcAddress = GetBufferDeviceAddress(device, buffers[0]);
+        const VkDeviceAddress dstAddress = GetBufferDeviceAddress(device, buffers[1]);
+
+        // The first job launches the kernel and is not measured
+        double totalMicroseconds = 0.0;
+        double minMicroseconds = 0.0;
+        double maxMicroseconds = 0.0;
+        uint32_t job = 0;
+        for (; job <= jobCount; job++)
+        {
+            memset(hostData[1], 0, bufferSize);
+
+            uint32_t ticket = 0;
+            const uint64_t beginTime = GetCurrentTimeNanoseconds();
+            res = EnqueuePersistentJob(&queue, srcAddress, dstAddress, elemCount, PERSISTENT_JOB_OP_DOUBLE, &ticket);
+            if (res == VK_SUCCESS) {
+                res = WaitPersistentJob(&queue, ticket);
+            }
+            if (res != VK_SUCCESS) {
+                break;
+            }
+            const double microseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000.0;
+
+            uint32_t i = 0;
+            while (i < elemCount && hostData[1][i] == hostData[0][i] * 2U) {
+                i++;
+            }
+            if (i < elemCount)
+            {
+                fprintf(stderr, "Persistent job %u: element %u is %u, expected %u!\n", job, i, hostData[1][i], hostData[0][i] * 2U);
+                break;
+            }
+
+            if (job == 0) {
+                continue;
+            }
+            totalMicroseconds += microseconds;
+            if (job == 1 || microseconds < minMicroseconds) {
+                minMicroseconds = microseconds;
+            }
+            if (microseconds > maxMicroseconds) {
+                maxMicroseconds = microseconds;
+            }
+        }
+        if (job <= jobCount) {
+            break;
+        }
+
+        printf("Persistent queue: average %8.1fus, min %8.1fus, max %8.1fus, %u kernel launch(es)\n", totalMicroseconds / jobCount,
+            minMicroseconds, maxMicroseconds, queue.launchCount);
+        persistentPassed = true;
+    }
+    while (false);
+
+    if (passed)
+    {
+        shutDown = DestroyPersistentQueue(&queue);
+        printf("Persistent kernel %s\n", shutDown ? "shut down cleanly" : "did not acknowledge the shutdown");
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (hostData[i] != NULL) {
+            vkUnmapMemory(device, memories[i]);
+        }
+        if (buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers[i], NULL);
+        }
+        if (memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, memories[i], NULL);
+        }
+    }
+
+    passed = passed && persistentPassed && shutDown;
+
+    printf("\n================ Complete the persistent queue benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// A buffer whose address range is reserved at creation and backed by memory on demand. With sparse residency, memory is
+// bound with vkQueueBindSparse as the data grows and the device address never changes; the device only accesses the
+// bound range of the partially resident buffer. Without it, the buffer falls back to a dense one that is fully backed at creation.
+struct VirtualBuffer
+{
+    struct DeviceContext* deviceContext;
+    VkBuffer buffer;
+    VkDeviceAddress address;
+    VkDeviceSize reservedSize;
+    VkDeviceSize committedSize;
+    // A multiple of the sparse block size
+    VkDeviceSize commitGranularity;
+    uint32_t memoryTypeIndex;
+    bool sparse;
+    // One allocation per commit, bound back to back from offset 0
+    uint32_t memoryCount;
+    VkDeviceMemory memories[MAX_VIRTUAL_BUFFER_COMMIT_COUNT];
+    VkFence fence;
+};
+
+static void DestroyVirtualBuffer(struct VirtualBuffer* virtualBuffer)
+{
+    if (virtualBuffer->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = virtualBuffer->deviceContext->device;
+
+    if (virtualBuffer->buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, virtualBuffer->buffer, NULL);
+    }
+    for (uint32_t i = 0; i < virtualBuffer->memoryCount; i++) {
+        vkFreeMemory(device, virtualBuffer->memories[i], NULL);
+    }
+    if (virtualBuffer->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, virtualBuffer->fence, NULL);
+    }
+
+    memset(virtualBuffer, 0, sizeof(*virtualBuffer));
+}
+
+static VkResult CreateVirtualBuffer(struct DeviceContext* deviceContext, VkDeviceSize reservedSize, VkBufferUsageFlags usage,
+    struct VirtualBuffer* virtualBuffer)
+{
+    memset(virtualBuffer, 0, sizeof(*virtualBuffer));
+    virtualBuffer->deviceContext = deviceContext;
+    usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+    const VkDevice device = deviceContext->device;
+    VkResult res = VK_SUCCESS;
+    if (!deviceContext->supportSparseResidencyBuffer)
+    {
+        res = CreateBufferWithMemory(deviceContext, reservedSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &virtualBuffer->buffer, &virtualBuffer->memories[0]);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+        virtualBuffer->memoryCount = 1;
+        virtualBuffer->reservedSize = reservedSize;
+        virtualBuffer->committedSize = reservedSize;
+        virtualBuffer->commitGranularity = reservedSize;
+        virtualBuffer->address = GetBufferDeviceAddress(device, virtualBuffer->buffer);
+        return VK_SUCCESS;
+    }
+
+    const VkBufferCreateInfo bufCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_BUFFER_CREATE_SPARSE_BINDING_BIT | VK_BUFFER_CREATE_SPARSE_RESIDENCY_BIT,
+        .size = reservedSize,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &deviceContext->queueFamilyIndex
+    };
+    res = vkCreateBuffer(device, &bufCreateInfo, NULL, &virtualBuffer->buffer);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateBuffer failed: %d\n", res);
+        return res;
+    }
+    virtualBuffer->sparse = true;
+
+    // For sparse buffers the alignment is the sparse block size
+    VkMemoryRequirements memRequirements = { 0 };
+    vkGetBufferMemoryRequirements(device, virtualBuffer->buffer, &memRequirements);
+    virtualBuffer->reservedSize = memRequirements.size;
+    virtualBuffer->commitGranularity = (VIRTUAL_BUFFER_COMMIT_GRANULARITY + memRequirements.alignment - 1) / memRequirements.alignment * memRequirements.alignment;
+    virtualBuffer->memoryTypeIndex = FindMemoryTypeIndex(&deviceContext->memoryProperties, memRequirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, virtualBuffer->reservedSize);
+    if (virtualBuffer->memoryTypeIndex == UINT32_MAX)
+    {
+        fprintf(stderr, "No device local memory type for %zu bytes!\n", (size_t)virtualBuffer->reservedSize);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    // The address of a sparse buffer is valid before any memory is bound
+    virtualBuffer->address = GetBufferDeviceAddress(device, virtualBuffer->buffer);
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &virtualBuffer->fence);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+    }
+
+    return res;
+}
+
+// Makes sure that the first `size` bytes are backed by memory. New memory is bound behind the committed range, so data
+// already in the buffer and addresses handed out stay valid. The range being bound must not be in use on the device.
+static VkResult CommitVirtualBuffer(struct VirtualBuffer* virtualBuffer, VkDeviceSize size)
+{
+    if (size <= virtualBuffer->committedSize) {
+        return VK_SUCCESS;
+    }
+    if (size > virtualBuffer->reservedSize)
+    {
+        fprintf(stderr, "%zu bytes exceed the %zu bytes reserved for the virtual buffer!\n", (size_t)size, (size_t)virtualBuffer->reservedSize);
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    if (virtualBuffer->memoryCount == MAX_VIRTUAL_BUFFER_COMMIT_COUNT)
+    {
+        fprintf(stderr, "The virtual buffer has been grown too many times, at most %d commits are supported!\n", MAX_VIRTUAL_BUFFER_COMMIT_COUNT);
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    struct DeviceContext* deviceContext = virtualBuffer->deviceContext;
+    const VkDevice device = deviceContext->device;
+    const VkDeviceSize granularity = virtualBuffer->commitGranularity;
+    const VkDeviceSize committedSize = min((size + granularity - 1) / granularity * granularity, virtualBuffer->reservedSize);
+
+    const VkMemoryAllocateFlagsInfo memAllocFlagsInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+        .pNext = NULL,
+        .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+    };
+    const VkMemoryAllocateInfo memAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &memAllocFlagsInfo,
+        .allocationSize = committedSize - virtualBuffer->committedSize,
+        .memoryTypeIndex = virtualBuffer->memoryTypeIndex
+    };
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkResult res = vkAllocateMemory(device, &memAllocInfo, NULL, &memory);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkAllocateMemory failed: %d\n", res);
+        return res;
+    }
+
+    const VkSparseMemoryBind memoryBind = {
+        .resourceOffset = virtualBuffer->committedSize,
+        .size = memAllocInfo.allocationSize,
+        .memory = memory,
+        .memoryOffset = 0,
+        .flags = 0
+    };
+    const VkSparseBufferMemoryBindInfo bufferBindInfo = {
+        .buffer = virtualBuffer->buffer,
+        .bindCount = 1,
+        .pBinds = &memoryBind
+    };
+    const VkBindSparseInfo bindSparseInfo = {
+        .sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .bufferBindCount = 1,
+        .pBufferBinds = &bufferBindInfo,
+        .imageOpaqueBindCount = 0,
+        .pImageOpaqueBinds = NULL,
+        .imageBindCount = 0,
+        .pImageBinds = NULL,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL
+    };
+    res = vkQueueBindSparse(deviceContext->queues[0], 1, &bindSparseInfo, virtualBuffer->fence);
+    if (res == VK_SUCCESS) {
+        res = vkWaitForFences(device, 1, &virtualBuffer->fence, VK_TRUE, UINT64_MAX);
+    }
+    if (res == VK_SUCCESS) {
+        res = vkResetFences(device, 1, &virtualBuffer->fence);
+    }
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "Binding sparse memory failed: %d\n", res);
+        vkFreeMemory(device, memory, NULL);
+        return res;
+    }
+
+    virtualBuffer->memories[virtualBuffer->memoryCount++] = memory;
+    virtualBuffer->committedSize = committedSize;
+    return VK_SUCCESS;
+}
+
+struct SparseGrowthStep
+{
+    const struct VirtualBuffer* srcBuffer;
+    const struct VirtualBuffer* dstBuffer;
+    VkBuffer stagingBuffer;
+    VkDeviceSize size;
+    const struct ComputePipelineState* pipelineState;
+    VkDescriptorSet descriptorSet;
+};
+
+// Uploads the source, doubles it with test.comp.glsl and reads the result back into the staging buffer
+static void RecordSparseGrowthStep(const void* userData, VkCommandBuffer commandBuffer, uint32_t elemCount)
+{
+    const struct SparseGrowthStep* step = userData;
+    const VkBufferCopy copyRegion = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = step->size
+    };
+    vkCmdCopyBuffer(commandBuffer, step->stagingBuffer, step->srcBuffer->buffer, 1, &copyRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, step->pipelineState->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, step->pipelineState->pipelineLayout, 0, 1, &step->descriptorSet, 0, NULL);
+    PushTestKernelChunk(commandBuffer, step->pipelineState->pipelineLayout, (struct TestKernelChunk){ 0 });
+    vkCmdDispatch(commandBuffer, elemCount / COMPUTE_WORKGROUP_SIZE, 1, 1);
+
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdCopyBuffer(commandBuffer, step->dstBuffer->buffer, step->stagingBuffer, 1, &copyRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// Grows the data of the test kernel from maxElemCount / 2^(SPARSE_GROWTH_STEP_COUNT - 1) to maxElemCount elements in
+// virtual buffers reserved for maxElemCount elements. The address table is written once and stays valid throughout.
+static bool RunSparseGrowthTest(uint32_t maxElemCount)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    const VkDevice device = deviceContext->device;
+    const VkDeviceSize reservedSize = (VkDeviceSize)maxElemCount * sizeof(int);
+
+    struct ComputePipelineCache pipelineCache = { .device = device };
+    struct VirtualBuffer srcBuffer = { 0 };
+    struct VirtualBuffer dstBuffer = { 0 };
+    VkBuffer addressTableBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory addressTableMemory = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    bool passed = false;
+
+    printf("\n================ Begin the sparse growth test: up to %u elements ================\n\n", maxElemCount);
+
+    do
+    {
+        if (AcquireShaderModule(deviceContext, "test", NULL, &pipelineCache.shaderModule) != VK_SUCCESS)
+        {
+            fprintf(stderr, "AcquireShaderModule failed!\n");
+            break;
+        }
+
+        const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (CreateVirtualBuffer(deviceContext, reservedSize, usage, &srcBuffer) != VK_SUCCESS ||
+            CreateVirtualBuffer(deviceContext, reservedSize, usage, &dstBuffer) != VK_SUCCESS) {
+            break;
+        }
+        printf("%s virtual buffers, %zu bytes reserved each\n", srcBuffer.sparse ? "Sparse" : "Dense (sparse residency is not supported)",
+            (size_t)srcBuffer.reservedSize);
+
+        if (CreateBufferWithMemory(deviceContext, ADDITIONAL_ADDRESS_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &addressTableBuffer, &addressTableMemory) != VK_SUCCESS) {
+            break;
+        }
+        VkDeviceAddress* addrMem = NULL;
+        VkResult res = vkMapMemory(device, addressTableMemory, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE, 0, (void**)&addrMem);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkMapMemory failed: %d\n", res);
+            break;
+        }
+        memset(addrMem, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
+        addrMem[0] = dstBuffer.address;
+        addrMem[1] = srcBuffer.address;
+        vkUnmapMemory(device, addressTableMemory);
+
+        const VkFenceCreateInfo fenceCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0
+        };
+        res = vkCreateFence(device, &fenceCreateInfo, NULL, &fence);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateFence failed: %d\n", res);
+            break;
+        }
+
+        uint32_t stepIndex = 0;
+        for (; stepIndex < SPARSE_GROWTH_STEP_COUNT; stepIndex++)
+        {
+            // The test kernel has no bounds check, so every step is a multiple of the workgroup size
+            const uint32_t shiftedCount = maxElemCount >> (SPARSE_GROWTH_STEP_COUNT - 1 - stepIndex);
+            const uint32_t elemCount = min((shiftedCount + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE * COMPUTE_WORKGROUP_SIZE, maxElemCount);
+            struct SparseGrowthStep step = {
+                .srcBuffer = &srcBuffer,
+                .dstBuffer = &dstBuffer,
+                .size = (VkDeviceSize)elemCount * sizeof(int)
+            };
+
+            if (CommitVirtualBuffer(&srcBuffer, step.size) != VK_SUCCESS || CommitVirtualBuffer(&dstBuffer, step.size) != VK_SUCCESS ||
+                AcquireComputePipeline(&pipelineCache, elemCount, &step.pipelineState) != VK_SUCCESS) {
+                break;
+            }
+
+            VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+            VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+            int* hostData = NULL;
+            bool stepPassed = false;
+            do
+            {
+                if (CreateDescriptorSets(device, addressTableBuffer, ADDITIONAL_ADDRESS_BUFFER_SIZE, step.pipelineState->descriptorSetLayout,
+                    &descriptorPool, &step.descriptorSet) != VK_SUCCESS)
+                {
+                    fprintf(stderr, "CreateDescriptorSets failed!\n");
+                    break;
+                }
+                if (CreateBufferWithMemory(deviceContext, step.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &step.stagingBuffer, &stagingMemory) != VK_SUCCESS) {
+                    break;
+                }
+                res = vkMapMemory(device, stagingMemory, 0, step.size, 0, (void**)&hostData);
+                if (res != VK_SUCCESS)
+                {
+                    fprintf(stderr, "vkMapMemory failed: %d\n", res);
+                    break;
+                }
+                InitializeSourceData(hostData, (int)elemCount, 0);
+
+                if (SubmitOneTimeCommands(deviceContext, fence, RecordSparseGrowthStep, &step, elemCount) != VK_SUCCESS) {
+                    break;
+                }
+
+                stepPassed = hostData[0] == (int)elemCount;
+                for (uint32_t i = 1; i < elemCount && stepPassed; i++) {
+                    stepPassed = hostData[i] == (int)i * 2;
+                }
+                if (!stepPassed) {
+                    fprintf(stderr, "Wrong result with %u elements!\n", elemCount);
+                }
+            }
+            while (false);
+
+            if (hostData != NULL) {
+                vkUnmapMemory(device, stagingMemory);
+            }
+            if (step.stagingBuffer != VK_NULL_HANDLE) {
+                vkDestroyBuffer(device, step.stagingBuffer, NULL);
+            }
+            if (stagingMemory != VK_NULL_HANDLE) {
+                vkFreeMemory(device, stagingMemory, NULL);
+            }
+            if (descriptorPool != VK_NULL_HANDLE) {
+                vkDestroyDescriptorPool(device, descriptorPool, NULL);
+            }
+            ReleaseComputePipeline(&pipelineCache, step.pipelineState);
+            if (!stepPassed) {
+                break;
+            }
+
+            printf("%9u elements: %zu of %zu bytes committed per buffer, source address 0x%llx, destination address 0x%llx\n", elemCount,
+                (size_t)srcBuffer.committedSize, (size_t)srcBuffer.reservedSize, (unsigned long long)srcBuffer.address, (unsigned long long)dstBuffer.address);
+        }
+
+        // Growing must not have moved the buffers
+        passed = stepIndex == SPARSE_GROWTH_STEP_COUNT && GetBufferDeviceAddress(device, srcBuffer.buffer) == srcBuffer.address &&
+            GetBufferDeviceAddress(device, dstBuffer.buffer) == dstBuffer.address;
+    }
+    while (false);
+
+    if (fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, fence, NULL);
+    }
+    if (addressTableBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, addressTableBuffer, NULL);
+    }
+    if (addressTableMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, addressTableMemory, NULL);
+    }
+    DestroyVirtualBuffer(&srcBuffer);
+    DestroyVirtualBuffer(&dstBuffer);
+    DestroyComputePipelineCache(&pipelineCache);
+
+    printf("\n================ Complete the sparse growth test: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+enum ELEMENT_TYPE
+{
+    ELEMENT_TYPE_INT8,
+    ELEMENT_TYPE_FP16,
+    ELEMENT_TYPE_INT32,
+    ELEMENT_TYPE_FP32,
+    ELEMENT_TYPE_INT64,
+    ELEMENT_TYPE_FP64,
+    ELEMENT_TYPE_COUNT
+};
+
+struct ElementTypeInfo
+{
+    // Also the variant of typed_double.comp.glsl compiled for the type
+    const char* name;
+    uint32_t size;
+    // Source values are taken modulo this, so that doubling them is exact in the type
+    uint32_t valueRange;
+};
+
+static const struct ElementTypeInfo s_elementTypes[ELEMENT_TYPE_COUNT] = {
+    { "int8", 1, 1U << 6 },
+    { "fp16", 2, 1U << 10 },
+    { "int32", 4, 1U << 30 },
+    { "fp32", 4, 1U << 23 },
+    { "int64", 8, 1U << 30 },
+    { "fp64", 8, 1U << 30 }
+};
+
+// Returns the name of the missing device features, or NULL if the device supports the type
+static const char* GetMissingElementTypeFeatures(const struct DeviceContext* deviceContext, enum ELEMENT_TYPE type)
+{
+    if (type == ELEMENT_TYPE_INT8 && !deviceContext->supportInt8) {
+        return "shaderInt8 and storageBuffer8BitAccess";
+    }
+    if (type == ELEMENT_TYPE_FP16 && !deviceContext->supportFloat16) {
+        return "shaderFloat16 and storageBuffer16BitAccess";
+    }
+    if (type == ELEMENT_TYPE_FP64 && !deviceContext->supportFloat64) {
+        return "shaderFloat64";
+    }
+    return NULL;
+}
+
+// Exact for integers below 2048
+static uint16_t IntegerToHalf(uint32_t value)
+{
+    if (value == 0) {
+        return 0;
+    }
+    uint32_t exponent = 0;
+    while ((value >> (exponent + 1)) != 0) {
+        exponent++;
+    }
+    return (uint16_t)(((exponent + 15) << 10) | ((value << (10 - exponent)) & 0x3FF));
+}
+
+// Wide types scale the value up to use their range. The scaling is linear, so the expected result is the doubled value
+// written the same way.
+static void WriteTypedElement(enum ELEMENT_TYPE type, void* data, uint32_t index, uint32_t value)
+{
+    switch (type)
+    {
+    case ELEMENT_TYPE_INT8:
+        ((int8_t*)data)[index] = (int8_t)value;
+        break;
+    case ELEMENT_TYPE_FP16:
+        ((uint16_t*)data)[index] = IntegerToHalf(value);
+        break;
+    case ELEMENT_TYPE_INT32:
+        ((int32_t*)data)[index] = (int32_t)value;
+        break;
+    case ELEMENT_TYPE_FP32:
+        ((float*)data)[index] = (float)value;
+        break;
+    case ELEMENT_TYPE_INT64:
+        ((int64_t*)data)[index] = (int64_t)value << 24;
+        break;
+    case ELEMENT_TYPE_FP64:
+        ((double*)data)[index] = (double)value * 4294967296.0;
+        break;
+    default:
+        break;
+    }
+}
+
+static void FillTypedSource(enum ELEMENT_TYPE type, void* data, uint32_t elemCount)
+{
+    for (uint32_t i = 0; i < elemCount; i++) {
+        WriteTypedElement(type, data, i, i % s_elementTypes[type].valueRange);
+    }
+}
+
+static bool VerifyTypedResult(enum ELEMENT_TYPE type, const void* data, uint32_t elemCount)
+{
+    const struct ElementTypeInfo* info = &s_elementTypes[type];
+    for (uint32_t i = 0; i < elemCount; i++)
+    {
+        uint64_t expected = 0;
+        WriteTypedElement(type, &expected, 0, i % info->valueRange * 2);
+        if (memcmp((const uint8_t*)data + (size_t)i * info->size, &expected, info->size) != 0)
+        {
+            fprintf(stderr, "%s element %u is wrong!\n", info->name, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Everything one typed kernel run needs
+struct ElementTypeKernel
+{
+    struct DeviceContext* deviceContext;
+    enum ELEMENT_TYPE type;
+    uint32_t elemCount;
+    VkDeviceSize bufferSize;
+
+    VkShaderModule shaderModule;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+
+    // [0] is the source, [1] the destination
+    VkBuffer dataBuffers[2];
+    VkDeviceMemory dataMemories[2];
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+    // Host visible, holds the source before the run and the result after it
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    void* hostData;
+    // VK_NULL_HANDLE if the queue family has no timestamps
+    VkQueryPool queryPool;
+
+    VkFence fence;
+};
+
+static void DestroyElementTypeKernel(struct ElementTypeKernel* kernel)
+{
+    if (kernel->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = kernel->deviceContext->device;
+
+    if (kernel->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, kernel->fence, NULL);
+    }
+    if (kernel->queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, kernel->queryPool, NULL);
+    }
+    if (kernel->hostData != NULL) {
+        vkUnmapMemory(device, kernel->stagingMemory);
+    }
+
+    const VkBuffer buffers[] = { kernel->dataBuffers[0], kernel->dataBuffers[1], kernel->addressTableBuffer, kernel->stagingBuffer };
+    const VkDeviceMemory memories[] = { kernel->dataMemories[0], kernel->dataMemories[1], kernel->addressTableMemory, kernel->stagingMemory };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+    {
+        if (buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers[i], NULL);
+        }
+        if (memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, memories[i], NULL);
+        }
+    }
+
+    if (kernel->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, kernel->descriptorPool, NULL);
+    }
+    if (kernel->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, kernel->pipeline, NULL);
+    }
+    if (kernel->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, kernel->pipelineLayout, NULL);
+    }
+    if (kernel->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, kernel->descriptorSetLayout, NULL);
+    }
+
+    memset(kernel, 0, sizeof(*kernel));
+}
+
+// Selects the variant of the type and specializes it for `elemCount` when the pipeline is created
+static VkResult CreateElementTypeKernel(struct DeviceContext* deviceContext, enum ELEMENT_TYPE type, uint32_t elemCount, bool useTimestamps,
+    struct ElementTypeKernel* kernel)
+{
+    memset(kernel, 0, sizeof(*kernel));
+    kernel->deviceContext = deviceContext;
+    kernel->type = type;
+    kernel->elemCount = elemCount;
+    kernel->bufferSize = (VkDeviceSize)elemCount * s_elementTypes[type].size;
+
+    const VkDevice device = deviceContext->device;
+    const VkMemoryPropertyFlags hostMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkResult res = AcquireShaderModule(deviceContext, "typed_double", s_elementTypes[type].name, &kernel->shaderModule);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return res;
+    }
+
+    res = CreateComputePipeline(device, kernel->shaderModule, &kernel->pipeline, &kernel->pipelineLayout, &kernel->descriptorSetLayout, elemCount);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "CreateComputePipeline failed!\n");
+        return res;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        res = CreateBufferWithMemory(deviceContext, kernel->bufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &kernel->dataBuffers[i], &kernel->dataMemories[i]);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+    }
+
+    res = CreateBufferWithMemory(deviceContext, ADDITIONAL_ADDRESS_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemoryFlags,
+        &kernel->addressTableBuffer, &kernel->addressTableMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    VkDeviceAddress* addrMem = NULL;
+    res = vkMapMemory(device, kernel->addressTableMemory, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE, 0, (void**)&addrMem);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    memset(addrMem, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
+    addrMem[0] = GetBufferDeviceAddress(device, kernel->dataBuffers[1]);
+    addrMem[1] = GetBufferDeviceAddress(device, kernel->dataBuffers[0]);
+    vkUnmapMemory(device, kernel->addressTableMemory);
+
+    res = CreateBufferWithMemory(deviceContext, kernel->bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemoryFlags,
+        &kernel->stagingBuffer, &kernel->stagingMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    res = vkMapMemory(device, kernel->stagingMemory, 0, kernel->bufferSize, 0, &kernel->hostData);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    FillTypedSource(type, kernel->hostData, elemCount);
+
+    res = CreateDescriptorSets(device, kernel->addressTableBuffer, ADDITIONAL_ADDRESS_BUFFER_SIZE, kernel->descriptorSetLayout,
+        &kernel->descriptorPool, &kernel->descriptorSet);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "CreateDescriptorSets failed!\n");
+        return res;
+    }
+
+    if (useTimestamps)
+    {
+        const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+            .pipelineStatistics = 0
+        };
+        res = vkCreateQueryPool(device, &queryPoolCreateInfo, NULL, &kernel->queryPool);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateQueryPool failed: %d\n", res);
+            return res;
+        }
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &kernel->fence);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+    }
+
+    return res;
+}
+
+// Uploads the source, runs `iterations` dispatches between two timestamps and reads the result back
+static void RecordElementTypeKernel(const void* userData, VkCommandBuffer commandBuffer, uint32_t iterations)
+{
+    const struct ElementTypeKernel* kernel = userData;
+    const VkBufferCopy copyRegion = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = kernel->bufferSize
+    };
+    vkCmdCopyBuffer(commandBuffer, kernel->stagingBuffer, kernel->dataBuffers[0], 1, &copyRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0, 1, &kernel->descriptorSet, 0, NULL);
+
+    if (kernel->queryPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, kernel->queryPool, 0, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, kernel->queryPool, 0);
+    }
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        vkCmdDispatch(commandBuffer, (kernel->elemCount + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE, 1, 1);
+        // Every dispatch writes the same destination
+        RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+    }
+    if (kernel->queryPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, kernel->queryPool, 1);
+    }
+
+    vkCmdCopyBuffer(commandBuffer, kernel->dataBuffers[1], kernel->stagingBuffer, 1, &copyRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// Runs the same kernel for every element type the device supports and reports bytes/s and elements/s per type.
+// Each element is read once and written once per dispatch.
+static bool RunElementTypeBenchmark(uint32_t elemCount)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    const uint64_t timestampMask = GetQueueTimestampMask(deviceContext);
+    bool passed = true;
+
+    printf("\n================ Begin the element type benchmark: %u elements, %d dispatch(es) per type, %s ================\n\n",
+        elemCount, ELEMENT_TYPE_BENCHMARK_ITERATIONS, timestampMask != 0 ? "GPU timestamps" : "host time");
+
+    for (int type = 0; type < ELEMENT_TYPE_COUNT && passed; type++)
+    {
+        const struct ElementTypeInfo* info = &s_elementTypes[type];
+        const char* missingFeatures = GetMissingElementTypeFeatures(deviceContext, (enum ELEMENT_TYPE)type);
+        if (missingFeatures != NULL)
+        {
+            printf("%-6s skipped, the device does not support %s\n", info->name, missingFeatures);
+            continue;
+        }
+
+        struct ElementTypeKernel kernel;
+        passed = false;
+        do
+        {
+            if (CreateElementTypeKernel(deviceContext, (enum ELEMENT_TYPE)type, elemCount, timestampMask != 0, &kernel) != VK_SUCCESS) {
+                break;
+            }
+
+            const uint64_t beginTime = GetCurrentTimeNanoseconds();
+            if (SubmitOneTimeCommands(deviceContext, kernel.fence, RecordElementTypeKernel, &kernel, ELEMENT_TYPE_BENCHMARK_ITERATIONS) != VK_SUCCESS) {
+                break;
+            }
+            double milliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+            if (kernel.queryPool != VK_NULL_HANDLE)
+            {
+                uint64_t timestamps[2] = { 0 };
+                const VkResult res = vkGetQueryPoolResults(deviceContext->device, kernel.queryPool, 0, 2, sizeof(timestamps), timestamps,
+                    sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+                if (res != VK_SUCCESS)
+                {
+                    fprintf(stderr, "vkGetQueryPoolResults failed: %d\n", res);
+                    break;
+                }
+                const uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+                milliseconds = (double)ticks * deviceContext->properties.limits.timestampPeriod / 1000000.0;
+            }
+
+            if (!VerifyTypedResult((enum ELEMENT_TYPE)type, kernel.hostData, elemCount)) {
+                break;
+            }
+
+            const double seconds = milliseconds / 1000.0 / ELEMENT_TYPE_BENCHMARK_ITERATIONS;
+            printf("%-6s %.3fms per dispatch, %8.2f GB/s, %8.2f Gelements/s\n", info->name, seconds * 1000.0,
+                seconds > 0.0 ? (double)kernel.bufferSize * 2.0 / seconds / 1e9 : 0.0, seconds > 0.0 ? (double)elemCount / seconds / 1e9 : 0.0);
+            passed = true;
+        }
+        while (false);
+
+        DestroyElementTypeKernel(&kernel);
+    }
+
+    printf("\n================ Complete the element type benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// How the kernel of the access pattern benchmark reaches its data buffers; the names are the variants of access_pattern.comp.glsl
+enum ACCESS_METHOD
+{
+    ACCESS_METHOD_BDA_RELOAD,
+    ACCESS_METHOD_BDA_HOISTED,
+    ACCESS_METHOD_DESCRIPTOR_ARRAY,
+    ACCESS_METHOD_FIXED_BINDINGS,
+    ACCESS_METHOD_COUNT
+};
+
+static const char* const s_accessMethodNames[ACCESS_METHOD_COUNT] = { "bda_reload", "bda_hoisted", "descriptor_array", "fixed_bindings" };
+
+struct AccessBenchmarkResources
+{
+    struct DeviceContext* deviceContext;
+    // Data buffer b is filled with b + 1
+    VkBuffer dataBuffers[ACCESS_BENCHMARK_MAX_BUFFER_COUNT];
+    VkDeviceMemory dataMemories[ACCESS_BENCHMARK_MAX_BUFFER_COUNT];
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+    // One sum per invocation
+    VkBuffer resultBuffer;
+    VkDeviceMemory resultMemory;
+    VkBuffer readbackBuffer;
+    VkDeviceMemory readbackMemory;
+    const uint32_t* readbackData;
+    // VK_NULL_HANDLE if the queue family has no timestamps
+    VkQueryPool queryPool;
+    VkFence fence;
+};
+
+// One pipeline of the sweep with its descriptor set
+struct AccessPatternPipeline
+{
+    const struct AccessBenchmarkResources* resources;
+    enum ACCESS_METHOD method;
+    uint32_t bufferCount;
+    uint32_t accessStride;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+};
+
+static void DestroyAccessBenchmarkResources(struct AccessBenchmarkResources* resources)
+{
+    if (resources->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = resources->deviceContext->device;
+
+    if (resources->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, resources->fence, NULL);
+    }
+    if (resources->queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, resources->queryPool, NULL);
+    }
+    if (resources->readbackData != NULL) {
+        vkUnmapMemory(device, resources->readbackMemory);
+    }
+
+    for (uint32_t i = 0; i < ACCESS_BENCHMARK_MAX_BUFFER_COUNT; i++)
+    {
+        if (resources->dataBuffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, resources->dataBuffers[i], NULL);
+        }
+        if (resources->dataMemories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, resources->dataMemories[i], NULL);
+        }
+    }
+
+    const VkBuffer buffers[] = { resources->addressTableBuffer, resources->resultBuffer, resources->readbackBuffer };
+    const VkDeviceMemory memories[] = { resources->addressTableMemory, resources->resultMemory, resources->readbackMemory };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+    {
+        if (buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers[i], NULL);
+        }
+        if (memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, memories[i], NULL);
+        }
+    }
+
+    memset(resources, 0, sizeof(*resources));
+}
+
+static void RecordAccessDataFill(const void* userData, VkCommandBuffer commandBuffer, uint32_t bufferCount)
+{
+    const struct AccessBenchmarkResources* resources = userData;
+    for (uint32_t i = 0; i < bufferCount; i++) {
+        vkCmdFillBuffer(commandBuffer, resources->dataBuffers[i], 0, VK_WHOLE_SIZE, i + 1);
+    }
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+static VkResult CreateAccessBenchmarkResources(struct DeviceContext* deviceContext, bool useTimestamps, struct AccessBenchmarkResources* resources)
+{
+    memset(resources, 0, sizeof(*resources));
+    resources->deviceContext = deviceContext;
+
+    const VkDevice device = deviceContext->device;
+    const VkMemoryPropertyFlags hostMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkDeviceSize dataBufferSize = ACCESS_BENCHMARK_ELEMENT_COUNT * sizeof(uint32_t);
+    const VkDeviceSize resultBufferSize = ACCESS_BENCHMARK_INVOCATION_COUNT * sizeof(uint32_t);
+    const VkDeviceSize addressTableSize = ACCESS_BENCHMARK_MAX_BUFFER_COUNT * sizeof(VkDeviceAddress);
+
+    VkResult res = VK_SUCCESS;
+    for (uint32_t i = 0; i < ACCESS_BENCHMARK_MAX_BUFFER_COUNT && res == VK_SUCCESS; i++)
+    {
+        res = CreateBufferWithMemory(deviceContext, dataBufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &resources->dataBuffers[i], &resources->dataMemories[i]);
+    }
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    res = CreateBufferWithMemory(deviceContext, addressTableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemoryFlags,
+        &resources->addressTableBuffer, &resources->addressTableMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    VkDeviceAddress* addrMem = NULL;
+    res = vkMapMemory(device, resources->addressTableMemory, 0, addressTableSize, 0, (void**)&addrMem);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    for (uint32_t i = 0; i < ACCESS_BENCHMARK_MAX_BUFFER_COUNT; i++) {
+        addrMem[i] = GetBufferDeviceAddress(device, resources->dataBuffers[i]);
+    }
+    vkUnmapMemory(device, resources->addressTableMemory);
+
+    res = CreateBufferWithMemory(deviceContext, resultBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &resources->resultBuffer, &resources->resultMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    res = CreateBufferWithMemory(deviceContext, resultBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemoryFlags,
+        &resources->readbackBuffer, &resources->readbackMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    res = vkMapMemory(device, resources->readbackMemory, 0, resultBufferSize, 0, (void**)&resources->readbackData);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+
+    if (useTimestamps)
+    {
+        const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+            .pipelineStatistics = 0
+        };
+        res = vkCreateQueryPool(device, &queryPoolCreateInfo, NULL, &resources->queryPool);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateQueryPool failed: %d\n", res);
+            return res;
+        }
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &resources->fence);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+        return res;
+    }
+
+    return SubmitOneTimeCommands(deviceContext, resources->fence, RecordAccessDataFill, resources, ACCESS_BENCHMARK_MAX_BUFFER_COUNT);
+}
+
+static void DestroyAccessPatternPipeline(VkDevice device, struct AccessPatternPipeline* pipeline)
+{
+    if (pipeline->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, pipeline->descriptorPool, NULL);
+    }
+    if (pipeline->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, pipeline->pipeline, NULL);
+    }
+    if (pipeline->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, pipeline->pipelineLayout, NULL);
+    }
+    if (pipeline->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, pipeline->descriptorSetLayout, NULL);
+    }
+    memset(pipeline, 0, sizeof(*pipeline));
+}
+
+// Binding 0 is the result. The data buffers follow as an address table at binding 1, as an array of descriptors at binding 1
+// of which the kernel reads the first `bufferCount`, or as one descriptor per binding from binding 1 on.
+static VkResult CreateAccessPatternPipeline(const struct AccessBenchmarkResources* resources, enum ACCESS_METHOD method, uint32_t bufferCount,
+    uint32_t accessStride, struct AccessPatternPipeline* pipeline)
+{
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->resources = resources;
+    pipeline->method = method;
+    pipeline->bufferCount = bufferCount;
+    pipeline->accessStride = accessStride;
+
+    struct DeviceContext* deviceContext = resources->deviceContext;
+    const VkDevice device = deviceContext->device;
+
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    VkResult res = AcquireShaderModule(deviceContext, "access_pattern", s_accessMethodNames[method], &shaderModule);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return res;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[1 + ACCESS_BENCHMARK_FIXED_BINDING_COUNT];
+    uint32_t bindingCount = 0;
+    uint32_t descriptorCount = 0;
+    const uint32_t dataBindingCount = method == ACCESS_METHOD_FIXED_BINDINGS ? ACCESS_BENCHMARK_FIXED_BINDING_COUNT : 1;
+    for (uint32_t i = 0; i <= dataBindingCount; i++)
+    {
+        bindings[bindingCount++] = (VkDescriptorSetLayoutBinding){
+            .binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = i == 1 && method == ACCESS_METHOD_DESCRIPTOR_ARRAY ? ACCESS_BENCHMARK_MAX_BUFFER_COUNT : 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL
+        };
+        descriptorCount += bindings[i].descriptorCount;
+    }
+
+    const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .bindingCount = bindingCount,
+        .pBindings = bindings
+    };
+    res = vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, NULL, &pipeline->descriptorSetLayout);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateDescriptorSetLayout failed: %d\n", res);
+        return res;
+    }
+
+    const VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = &pipeline->descriptorSetLayout,
+        .pushConstantRangeCount = 0,
+        .pPushConstantRanges = NULL
+    };
+    res = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, &pipeline->pipelineLayout);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreatePipelineLayout failed: %d\n", res);
+        return res;
+    }
+
+    // elem_count, buffer_count, access_stride and reads_per_buffer
+    const uint32_t specConsts[4] = { ACCESS_BENCHMARK_ELEMENT_COUNT, bufferCount, accessStride, ACCESS_BENCHMARK_READS_PER_BUFFER };
+    VkSpecializationMapEntry mapEntries[4];
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        mapEntries[i] = (VkSpecializationMapEntry){
+            .constantID = i,
+            .offset = i * (uint32_t)sizeof(uint32_t),
+            .size = sizeof(uint32_t)
+        };
+    }
+    const VkSpecializationInfo specializationInfo = {
+        .mapEntryCount = 4,
+        .pMapEntries = mapEntries,
+        .dataSize = sizeof(specConsts),
+        .pData = specConsts
+    };
+
+    const VkComputePipelineCreateInfo computePipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shaderModule,
+            .pName = "main",
+            .pSpecializationInfo = &specializationInfo
+        },
+        .layout = pipeline->pipelineLayout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = 0
+    };
+    res = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, NULL, &pipeline->pipeline);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateComputePipelines failed: %d\n", res);
+        return res;
+    }
+
+    const VkDescriptorPoolCreateInfo descriptorPoolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = (VkDescriptorPoolSize[]) {
+            {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = descriptorCount}
+        }
+    };
+    res = vkCreateDescriptorPool(device, &descriptorPoolInfo, NULL, &pipeline->descriptorPool);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateDescriptorPool failed: %d\n", res);
+        return res;
+    }
+
+    const VkDescriptorSetAllocateInfo descAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = pipeline->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &pipeline->descriptorSetLayout
+    };
+    res = vkAllocateDescriptorSets(device, &descAllocInfo, &pipeline->descriptorSet);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkAllocateDescriptorSets failed: %d\n", res);
+        return res;
+    }
+
+    // [0] is the result, the data buffers follow in the order of the bindings. Fixed bindings beyond bufferCount are never
+    // read, they just reuse the first data buffer. The whole descriptor array is written, as every element must be valid.
+    VkDescriptorBufferInfo bufferInfos[1 + ACCESS_BENCHMARK_MAX_BUFFER_COUNT];
+    bufferInfos[0] = (VkDescriptorBufferInfo){ resources->resultBuffer, 0, VK_WHOLE_SIZE };
+    if (method == ACCESS_METHOD_BDA_RELOAD || method == ACCESS_METHOD_BDA_HOISTED) {
+        bufferInfos[1] = (VkDescriptorBufferInfo){ resources->addressTableBuffer, 0, VK_WHOLE_SIZE };
+    }
+    else
+    {
+        for (uint32_t i = 0; i < descriptorCount - 1; i++) {
+            const uint32_t dataIndex = method == ACCESS_METHOD_DESCRIPTOR_ARRAY || i < bufferCount ? i : 0;
+            bufferInfos[1 + i] = (VkDescriptorBufferInfo){ resources->dataBuffers[dataIndex], 0, VK_WHOLE_SIZE };
+        }
+    }
+
+    VkWriteDescriptorSet writes[1 + ACCESS_BENCHMARK_FIXED_BINDING_COUNT];
+    uint32_t bufferInfoIndex = 0;
+    for (uint32_t i = 0; i < bindingCount; i++)
+    {
+        writes[i] = (VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = NULL,
+            .dstSet = pipeline->descriptorSet,
+            .dstBinding = bindings[i].binding,
+            .dstArrayElement = 0,
+            .descriptorCount = bindings[i].descriptorCount,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = NULL,
+            .pBufferInfo = &bufferInfos[bufferInfoIndex],
+            .pTexelBufferView = NULL
+        };
+        bufferInfoIndex += bindings[i].descriptorCount;
+    }
+    vkUpdateDescriptorSets(device, bindingCount, writes, 0, NULL);
+
+    return VK_SUCCESS;
+}
+
+// Runs the kernel `iterations` times between two timestamps and reads the sums of the last run back
+static void RecordAccessPattern(const void* userData, VkCommandBuffer commandBuffer, uint32_t iterations)
+{
+    const struct AccessPatternPipeline* pipeline = userData;
+    const struct AccessBenchmarkResources* resources = pipeline->resources;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipelineLayout, 0, 1, &pipeline->descriptorSet, 0, NULL);
+
+    if (resources->queryPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, resources->queryPool, 0, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, resources->queryPool, 0);
+    }
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        vkCmdDispatch(commandBuffer, ACCESS_BENCHMARK_INVOCATION_COUNT / COMPUTE_WORKGROUP_SIZE, 1, 1);
+        // Every run writes the same sums
+        RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+    }
+    if (resources->queryPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, resources->queryPool, 1);
+    }
+
+    const VkBufferCopy copyRegion = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = ACCESS_BENCHMARK_INVOCATION_COUNT * sizeof(uint32_t)
+    };
+    vkCmdCopyBuffer(commandBuffer, resources->resultBuffer, resources->readbackBuffer, 1, &copyRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// Measures one configuration of the sweep and returns the time per data access in nanoseconds, or a negative value on failure
+static double MeasureAccessPattern(struct AccessBenchmarkResources* resources, enum ACCESS_METHOD method, uint32_t bufferCount, uint32_t accessStride,
+    uint64_t timestampMask)
+{
+    struct DeviceContext* deviceContext = resources->deviceContext;
+    struct AccessPatternPipeline pipeline;
+    double nanosecondsPerAccess = -1.0;
+
+    do
+    {
+        if (CreateAccessPatternPipeline(resources, method, bufferCount, accessStride, &pipeline) != VK_SUCCESS) {
+            break;
+        }
+
+        const uint64_t beginTime = GetCurrentTimeNanoseconds();
+        if (SubmitOneTimeCommands(deviceContext, resources->fence, RecordAccessPattern, &pipeline, ACCESS_BENCHMARK_ITERATIONS) != VK_SUCCESS) {
+            break;
+        }
+        double nanoseconds = (double)(GetCurrentTimeNanoseconds() - beginTime);
+
+        if (resources->queryPool != VK_NULL_HANDLE)
+        {
+            uint64_t timestamps[2] = { 0 };
+            const VkResult res = vkGetQueryPoolResults(deviceContext->device, resources->queryPool, 0, 2, sizeof(timestamps), timestamps,
+                sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            if (res != VK_SUCCESS)
+            {
+                fprintf(stderr, "vkGetQueryPoolResults failed: %d\n", res);
+                break;
+            }
+            const uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+            nanoseconds = (double)ticks * deviceContext->properties.limits.timestampPeriod;
+        }
+
+        // Every read of buffer b returns b + 1
+        const uint32_t expectedSum = ACCESS_BENCHMARK_READS_PER_BUFFER * bufferCount * (bufferCount + 1) / 2;
+        uint32_t mismatchCount = 0;
+        for (uint32_t i = 0; i < ACCESS_BENCHMARK_INVOCATION_COUNT; i++)
+        {
+            if (resources->readbackData[i] != expectedSum) {
+                mismatchCount++;
+            }
+        }
+        if (mismatchCount > 0)
+        {
+            fprintf(stderr, "%s with %u buffer(s): %u wrong sum(s), expected %u!\n", s_accessMethodNames[method], bufferCount, mismatchCount, expectedSum);
+            break;
+        }
+
+        const double accessCount = (double)ACCESS_BENCHMARK_ITERATIONS * ACCESS_BENCHMARK_INVOCATION_COUNT * bufferCount * ACCESS_BENCHMARK_READS_PER_BUFFER;
+        nanosecondsPerAccess = nanoseconds / accessCount;
+    }
+    while (false);
+
+    DestroyAccessPatternPipeline(deviceContext->device, &pipeline);
+
+    return nanosecondsPerAccess;
+}
+
+// Sweeps the number of buffers and the access stride, and compares reaching the buffers through buffer device addresses
+// (with and without hoisting the pointers) with descriptor arrays and fixed bindings.
+static bool RunAccessPatternBenchmark(void)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    const uint64_t timestampMask = GetQueueTimestampMask(deviceContext);
+    const VkPhysicalDeviceLimits* limits = &deviceContext->properties.limits;
+    const uint32_t maxStorageBuffers = min(limits->maxPerStageDescriptorStorageBuffers, limits->maxDescriptorSetStorageBuffers);
+
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(deviceContext->physicalDevice, &features);
+    const bool supportDescriptorArrays = features.shaderStorageBufferArrayDynamicIndexing != VK_FALSE;
+
+    static const uint32_t bufferCounts[] = { 1, 2, 4, 8, 16, 32, ACCESS_BENCHMARK_MAX_BUFFER_COUNT };
+    static const uint32_t accessStrides[] = { 1, 32 };
+
+    printf("\n================ Begin the access pattern benchmark: %d invocations, %d read(s) per buffer, %s ================\n\n",
+        ACCESS_BENCHMARK_INVOCATION_COUNT, ACCESS_BENCHMARK_READS_PER_BUFFER, timestampMask != 0 ? "GPU timestamps" : "host time");
+    if (!supportDescriptorArrays) {
+        puts("shaderStorageBufferArrayDynamicIndexing is not supported, descriptor arrays are skipped.");
+    }
+
+    struct AccessBenchmarkResources resources;
+    bool passed = CreateAccessBenchmarkResources(deviceContext, timestampMask != 0, &resources) == VK_SUCCESS;
+
+    for (size_t s = 0; s < sizeof(accessStrides) / sizeof(accessStrides[0]) && passed; s++)
+    {
+        printf("Access stride %u (ns per access, BDA overhead relative to the descriptor array):\n", accessStrides[s]);
+        printf("%8s", "buffers");
+        for (int method = 0; method < ACCESS_METHOD_COUNT; method++) {
+            printf(" %17s", s_accessMethodNames[method]);
+        }
+        printf(" %17s %17s\n", "reload overhead", "hoisted overhead");
+
+        for (size_t b = 0; b < sizeof(bufferCounts) / sizeof(bufferCounts[0]) && passed; b++)
+        {
+            const uint32_t bufferCount = bufferCounts[b];
+            double nanosecondsPerAccess[ACCESS_METHOD_COUNT];
+            printf("%8u", bufferCount);
+
+            for (int method = 0; method < ACCESS_METHOD_COUNT && passed; method++)
+            {
+                // The result takes one storage buffer descriptor as well
+                const bool supported = method == ACCESS_METHOD_DESCRIPTOR_ARRAY ? supportDescriptorArrays && ACCESS_BENCHMARK_MAX_BUFFER_COUNT + 1 <= maxStorageBuffers :
+                    method == ACCESS_METHOD_FIXED_BINDINGS ? bufferCount <= ACCESS_BENCHMARK_FIXED_BINDING_COUNT &&
+                        ACCESS_BENCHMARK_FIXED_BINDING_COUNT + 1 <= maxStorageBuffers : true;
+                nanosecondsPerAccess[method] = -1.0;
+                if (!supported)
+                {
+                    printf(" %17s", "-");
+                    continue;
+                }
+
+                nanosecondsPerAccess[method] = MeasureAccessPattern(&resources, (enum ACCESS_METHOD)method, bufferCount, accessStrides[s], timestampMask);
+                passed = nanosecondsPerAccess[method] >= 0.0;
+                printf(" %17.4f", nanosecondsPerAccess[method]);
+            }
+
+            const double reference = nanosecondsPerAccess[ACCESS_METHOD_DESCRIPTOR_ARRAY];
+            if (passed && reference >= 0.0)
+            {
+                printf(" %+17.4f %+17.4f\n", nanosecondsPerAccess[ACCESS_METHOD_BDA_RELOAD] - reference,
+                    nanosecondsPerAccess[ACCESS_METHOD_BDA_HOISTED] - reference);
+            }
+            else {
+                printf(" %17s %17s\n", "-", "-");
+            }
+        }
+        puts("");
+    }
+
+    DestroyAccessBenchmarkResources(&resources);
+
+    printf("================ Complete the access pattern benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Operations of the gather/scatter benchmark; the names are the variants of gather_scatter.comp.glsl
+enum GATHER_SCATTER_OP
+{
+    GATHER_SCATTER_OP_GATHER,
+    GATHER_SCATTER_OP_SCATTER_ADD,
+    GATHER_SCATTER_OP_SCATTER_MIN,
+    GATHER_SCATTER_OP_SCATTER_MAX,
+    GATHER_SCATTER_OP_COUNT
+};
+
+static const char* const s_gatherScatterOpNames[GATHER_SCATTER_OP_COUNT] = { "gather", "scatter_add", "scatter_min", "scatter_max" };
+
+// One entry of an index stream, an uvec2 in the kernel
+struct GatherScatterIndex
+{
+    uint32_t slot;
+    uint32_t offset;
+};
+
+struct GatherScatterResources
+{
+    struct DeviceContext* deviceContext;
+    VkBuffer dataBuffers[GATHER_SCATTER_MAX_BUFFER_COUNT];
+    VkDeviceMemory dataMemories[GATHER_SCATTER_MAX_BUFFER_COUNT];
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+    // The index stream, the values gathered into or scattered from, and the unsorted positions of a sorted stream
+    VkBuffer indexBuffer;
+    VkDeviceMemory indexMemory;
+    VkBuffer valueBuffer;
+    VkDeviceMemory valueMemory;
+    VkBuffer orderBuffer;
+    VkDeviceMemory orderMemory;
+    // Holds the index stream, its order and its values, or the contents of all data buffers
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    void* stagingData;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    // [op][0] reads the values in stream order, [op][1] through the order of a sorted stream
+    VkPipeline pipelines[GATHER_SCATTER_OP_COUNT][2];
+    // VK_NULL_HANDLE if the queue family has no timestamps
+    VkQueryPool queryPool;
+    VkFence fence;
+};
+
+// Host copies of the stream under measurement
+struct GatherScatterStreams
+{
+    struct GatherScatterIndex* entries;
+    struct GatherScatterIndex* sortedEntries;
+    // order[i] is the position in `entries` of sorted entry i
+    uint32_t* order;
+    uint32_t* scratch;
+    uint32_t* values;
+    // Expected contents of the data buffers after a scatter
+    uint32_t* expected;
+};
+
+struct GatherScatterRun
+{
+    const struct GatherScatterResources* resources;
+    enum GATHER_SCATTER_OP op;
+    bool sorted;
+    uint32_t bufferCount;
+};
+
+static inline uint32_t GetGatherScatterKey(struct GatherScatterIndex entry)
+{
+    return entry.slot * GATHER_SCATTER_BUFFER_ELEMENT_COUNT + entry.offset;
+}
+
+static void DestroyGatherScatterResources(struct GatherScatterResources* resources)
+{
+    if (resources->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = resources->deviceContext->device;
+
+    if (resources->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, resources->fence, NULL);
+    }
+    if (resources->queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, resources->queryPool, NULL);
+    }
+    for (uint32_t op = 0; op < GATHER_SCATTER_OP_COUNT; op++)
+    {
+        for (uint32_t sorted = 0; sorted < 2; sorted++)
+        {
+            if (resources->pipelines[op][sorted] != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, resources->pipelines[op][sorted], NULL);
+            }
+        }
+    }
+    if (resources->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, resources->descriptorPool, NULL);
+    }
+    if (resources->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, resources->pipelineLayout, NULL);
+    }
+    if (resources->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, resources->descriptorSetLayout, NULL);
+    }
+    if (resources->stagingData != NULL) {
+        vkUnmapMemory(device, resources->stagingMemory);
+    }
+
+    for (uint32_t i = 0; i < GATHER_SCATTER_MAX_BUFFER_COUNT; i++)
+    {
+        if (resources->dataBuffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, resources->dataBuffers[i], NULL);
+        }
+        if (resources->dataMemories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, resources->dataMemories[i], NULL);
+        }
+    }
+
+    const VkBuffer buffers[] = { resources->addressTableBuffer, resources->indexBuffer, resources->valueBuffer, resources->orderBuffer,
+        resources->stagingBuffer };
+    const VkDeviceMemory memories[] = { resources->addressTableMemory, resources->indexMemory, resources->valueMemory, resources->orderMemory,
+        resources->stagingMemory };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+    {
+        if (buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers[i], NULL);
+        }
+        if (memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, memories[i], NULL);
+        }
+    }
+
+    memset(resources, 0, sizeof(*resources));
+}
+
+// Binding 0 is the index stream, 1 the address table, 2 the values and 3 the order. All pipelines share the descriptor set.
+static VkResult CreateGatherScatterPipelines(struct GatherScatterResources* resources)
+{
+    struct DeviceContext* deviceContext = resources->deviceContext;
+    const VkDevice device = deviceContext->device;
+
+    VkDescriptorSetLayoutBinding bindings[4];
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        bindings[i] = (VkDescriptorSetLayoutBinding){
+            .binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL
+        };
+    }
+    const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .bindingCount = 4,
+        .pBindings = bindings
+    };
+    VkResult res = vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, NULL, &resources->descriptorSetLayout);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateDescriptorSetLayout failed: %d\n", res);
+        return res;
+    }
+
+    const VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = &resources->descriptorSetLayout,
+        .pushConstantRangeCount = 0,
+        .pPushConstantRanges = NULL
+    };
+    res = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, &resources->pipelineLayout);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreatePipelineLayout failed: %d\n", res);
+        return res;
+    }
+
+    for (uint32_t op = 0; op < GATHER_SCATTER_OP_COUNT; op++)
+    {
+        VkShaderModule shaderModule = VK_NULL_HANDLE;
+        res = AcquireShaderModule(deviceContext, "gather_scatter", s_gatherScatterOpNames[op], &shaderModule);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "AcquireShaderModule failed!\n");
+            return res;
+        }
+
+        for (uint32_t sorted = 0; sorted < 2; sorted++)
+        {
+            // use_order
+            const VkBool32 useOrder = sorted != 0 ? VK_TRUE : VK_FALSE;
+            const VkSpecializationMapEntry mapEntry = {
+                .constantID = 0,
+                .offset = 0,
+                .size = sizeof(useOrder)
+            };
+            const VkSpecializationInfo specializationInfo = {
+                .mapEntryCount = 1,
+                .pMapEntries = &mapEntry,
+                .dataSize = sizeof(useOrder),
+                .pData = &useOrder
+            };
+            const VkComputePipelineCreateInfo computePipelineCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                .pNext = NULL,
+                .flags = 0,
+                .stage = {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .pNext = NULL,
+                    .flags = 0,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = shaderModule,
+                    .pName = "main",
+                    .pSpecializationInfo = &specializationInfo
+                },
+                .layout = resources->pipelineLayout,
+                .basePipelineHandle = VK_NULL_HANDLE,
+                .basePipelineIndex = 0
+            };
+            res = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, NULL, &resources->pipelines[op][sorted]);
+            if (res != VK_SUCCESS)
+            {
+                fprintf(stderr, "vkCreateComputePipelines failed: %d\n", res);
+                return res;
+            }
+        }
+    }
+
+    const VkDescriptorPoolCreateInfo descriptorPoolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = (VkDescriptorPoolSize[]) {
+            {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 4}
+        }
+    };
+    res = vkCreateDescriptorPool(device, &descriptorPoolInfo, NULL, &resources->descriptorPool);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateDescriptorPool failed: %d\n", res);
+        return res;
+    }
+
+    const VkDescriptorSetAllocateInfo descAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = resources->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &resources->descriptorSetLayout
+    };
+    res = vkAllocateDescriptorSets(device, &descAllocInfo, &resources->descriptorSet);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkAllocateDescriptorSets failed: %d\n", res);
+        return res;
+    }
+
+    const VkDescriptorBufferInfo bufferInfos[4] = {
+        { resources->indexBuffer, 0, VK_WHOLE_SIZE },
+        { resources->addressTableBuffer, 0, VK_WHOLE_SIZE },
+        { resources->valueBuffer, 0, VK_WHOLE_SIZE },
+        { resources->orderBuffer, 0, VK_WHOLE_SIZE }
+    };
+    VkWriteDescriptorSet writes[4];
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        writes[i] = (VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = NULL,
+            .dstSet = resources->descriptorSet,
+            .dstBinding = i,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = NULL,
+            .pBufferInfo = &bufferInfos[i],
+            .pTexelBufferView = NULL
+        };
+    }
+    vkUpdateDescriptorSets(device, 4, writes, 0, NULL);
+
+    return VK_SUCCESS;
+}
+
+static VkResult CreateGatherScatterResources(struct DeviceContext* deviceContext, bool useTimestamps, struct GatherScatterResources* resources)
+{
+    memset(resources, 0, sizeof(*resources));
+    resources->deviceContext = deviceContext;
+
+    const VkDevice device = deviceContext->device;
+    const VkMemoryPropertyFlags hostMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkDeviceSize dataBufferSize = GATHER_SCATTER_BUFFER_ELEMENT_COUNT * sizeof(uint32_t);
+    const VkDeviceSize indexStreamSize = GATHER_SCATTER_INDEX_COUNT * sizeof(struct GatherScatterIndex);
+    const VkDeviceSize valueStreamSize = GATHER_SCATTER_INDEX_COUNT * sizeof(uint32_t);
+    const VkDeviceSize addressTableSize = GATHER_SCATTER_MAX_BUFFER_COUNT * sizeof(VkDeviceAddress);
+    const VkDeviceSize stagingSize = max(indexStreamSize + 2 * valueStreamSize, GATHER_SCATTER_MAX_BUFFER_COUNT * dataBufferSize);
+
+    VkResult res = VK_SUCCESS;
+    for (uint32_t i = 0; i < GATHER_SCATTER_MAX_BUFFER_COUNT && res == VK_SUCCESS; i++)
+    {
+        res = CreateBufferWithMemory(deviceContext, dataBufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &resources->dataBuffers[i], &resources->dataMemories[i]);
+    }
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    res = CreateBufferWithMemory(deviceContext, addressTableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemoryFlags,
+        &resources->addressTableBuffer, &resources->addressTableMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    VkDeviceAddress* addrMem = NULL;
+    res = vkMapMemory(device, resources->addressTableMemory, 0, addressTableSize, 0, (void**)&addrMem);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    for (uint32_t i = 0; i < GATHER_SCATTER_MAX_BUFFER_COUNT; i++) {
+        addrMem[i] = GetBufferDeviceAddress(device, resources->dataBuffers[i]);
+    }
+    vkUnmapMemory(device, resources->addressTableMemory);
+
+    const VkBufferUsageFlags streamUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    res = CreateBufferWithMemory(deviceContext, indexStreamSize, streamUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &resources->indexBuffer, &resources->indexMemory);
+    if (res == VK_SUCCESS)
+    {
+        res = CreateBufferWithMemory(deviceContext, valueStreamSize, streamUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &resources->valueBuffer, &resources->valueMemory);
+    }
+    if (res == VK_SUCCESS)
+    {
+        res = CreateBufferWithMemory(deviceContext, valueStreamSize, streamUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &resources->orderBuffer, &resources->orderMemory);
+    }
+    if (res == VK_SUCCESS)
+    {
+        res = CreateBufferWithMemory(deviceContext, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            hostMemoryFlags, &resources->stagingBuffer, &resources->stagingMemory);
+    }
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    res = vkMapMemory(device, resources->stagingMemory, 0, stagingSize, 0, &resources->stagingData);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+
+    if (useTimestamps)
+    {
+        const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2,
+            .pipelineStatistics = 0
+        };
+        res = vkCreateQueryPool(device, &queryPoolCreateInfo, NULL, &resources->queryPool);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateQueryPool failed: %d\n", res);
+            return res;
+        }
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &resources->fence);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+        return res;
+    }
+
+    return CreateGatherScatterPipelines(resources);
+}
+
+// Sequential entries walk all elements of the first `bufferCount` buffers in order; `randomPercent` of the entries are
+// replaced by uniformly random ones
+static void GenerateIndexStream(struct GatherScatterIndex* entries, uint32_t bufferCount, uint32_t randomPercent, uint32_t seed)
+{
+    const uint32_t elementCount = bufferCount * GATHER_SCATTER_BUFFER_ELEMENT_COUNT;
+    for (uint32_t i = 0; i < GATHER_SCATTER_INDEX_COUNT; i++)
+    {
+        seed = seed * 1664525U + 1013904223U;
+        uint32_t key = i % elementCount;
+        if ((seed >> 8) % 100 < randomPercent)
+        {
+            seed = seed * 1664525U + 1013904223U;
+            key = (seed >> 8) % elementCount;
+        }
+        entries[i] = (struct GatherScatterIndex){ key / GATHER_SCATTER_BUFFER_ELEMENT_COUNT, key % GATHER_SCATTER_BUFFER_ELEMENT_COUNT };
+    }
+}
+
+// The sorting pre-pass: an LSD radix sort of the entry positions by (slot, offset), so that neighbouring invocations access
+// neighbouring elements of the same buffer. The values are not moved; the kernel finds them through `order`.
+static void SortIndexStream(struct GatherScatterStreams* streams)
+{
+    const uint32_t digitMask = (1U << GATHER_SCATTER_SORT_DIGIT_BITS) - 1;
+    uint32_t* passInput = streams->order;
+    uint32_t* passOutput = streams->scratch;
+    for (uint32_t i = 0; i < GATHER_SCATTER_INDEX_COUNT; i++) {
+        passInput[i] = i;
+    }
+
+    // Two passes leave the sorted positions in `order`
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        const uint32_t shift = pass * GATHER_SCATTER_SORT_DIGIT_BITS;
+        uint32_t offsets[1U << GATHER_SCATTER_SORT_DIGIT_BITS] = { 0 };
+        for (uint32_t i = 0; i < GATHER_SCATTER_INDEX_COUNT; i++) {
+            offsets[(GetGatherScatterKey(streams->entries[passInput[i]]) >> shift) & digitMask]++;
+        }
+        uint32_t sum = 0;
+        for (uint32_t d = 0; d <= digitMask; d++)
+        {
+            const uint32_t count = offsets[d];
+            offsets[d] = sum;
+            sum += count;
+        }
+        for (uint32_t i = 0; i < GATHER_SCATTER_INDEX_COUNT; i++)
+        {
+            const uint32_t position = passInput[i];
+            passOutput[offsets[(GetGatherScatterKey(streams->entries[position]) >> shift) & digitMask]++] = position;
+        }
+
+        uint32_t* const swap = passInput;
+        passInput = passOutput;
+        passOutput = swap;
+    }
+
+    for (uint32_t i = 0; i < GATHER_SCATTER_INDEX_COUNT; i++) {
+        streams->sortedEntries[i] = streams->entries[streams->order[i]];
+    }
+}
+
+// Copies the index stream, its values and its order (arg 0) or the contents of all data buffers (arg 1) from the staging buffer
+static void RecordGatherScatterUpload(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg)
+{
+    const struct GatherScatterResources* resources = userData;
+    const VkDeviceSize indexStreamSize = GATHER_SCATTER_INDEX_COUNT * sizeof(struct GatherScatterIndex);
+    const VkDeviceSize valueStreamSize = GATHER_SCATTER_INDEX_COUNT * sizeof(uint32_t);
+    const VkDeviceSize dataBufferSize = GATHER_SCATTER_BUFFER_ELEMENT_COUNT * sizeof(uint32_t);
+
+    if (arg == 0)
+    {
+        VkBufferCopy copyRegion = { .srcOffset = 0, .dstOffset = 0, .size = indexStreamSize };
+        vkCmdCopyBuffer(commandBuffer, resources->stagingBuffer, resources->indexBuffer, 1, &copyRegion);
+        copyRegion = (VkBufferCopy){ .srcOffset = indexStreamSize, .dstOffset = 0, .size = valueStreamSize };
+        vkCmdCopyBuffer(commandBuffer, resources->stagingBuffer, resources->valueBuffer, 1, &copyRegion);
+        copyRegion.srcOffset = indexStreamSize + valueStreamSize;
+        vkCmdCopyBuffer(commandBuffer, resources->stagingBuffer, resources->orderBuffer, 1, &copyRegion);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < GATHER_SCATTER_MAX_BUFFER_COUNT; i++)
+        {
+            const VkBufferCopy copyRegion = { .srcOffset = i * dataBufferSize, .dstOffset = 0, .size = dataBufferSize };
+            vkCmdCopyBuffer(commandBuffer, resources->stagingBuffer, resources->dataBuffers[i], 1, &copyRegion);
+        }
+    }
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+// Runs the kernel `iterations` times between two timestamps and copies the gathered values or the scattered buffers to the
+// staging buffer. Scatters start from the identity of their combine operation.
+static void RecordGatherScatterRun(const void* userData, VkCommandBuffer commandBuffer, uint32_t iterations)
+{
+    const struct GatherScatterRun* run = userData;
+    const struct GatherScatterResources* resources = run->resources;
+    const VkDeviceSize dataBufferSize = GATHER_SCATTER_BUFFER_ELEMENT_COUNT * sizeof(uint32_t);
+
+    if (run->op != GATHER_SCATTER_OP_GATHER)
+    {
+        const uint32_t identity = run->op == GATHER_SCATTER_OP_SCATTER_MIN ? UINT32_MAX : 0;
+        for (uint32_t i = 0; i < run->bufferCount; i++) {
+            vkCmdFillBuffer(commandBuffer, resources->dataBuffers[i], 0, VK_WHOLE_SIZE, identity);
+        }
+        RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources->pipelines[run->op][run->sorted ? 1 : 0]);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources->pipelineLayout, 0, 1, &resources->descriptorSet, 0, NULL);
+
+    if (resources->queryPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, resources->queryPool, 0, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, resources->queryPool, 0);
+    }
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        vkCmdDispatch(commandBuffer, GATHER_SCATTER_INDEX_COUNT / COMPUTE_WORKGROUP_SIZE, 1, 1);
+        RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+    }
+    if (resources->queryPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, resources->queryPool, 1);
+    }
+
+    if (run->op == GATHER_SCATTER_OP_GATHER)
+    {
+        const VkBufferCopy copyRegion = { .srcOffset = 0, .dstOffset = 0, .size = GATHER_SCATTER_INDEX_COUNT * sizeof(uint32_t) };
+        vkCmdCopyBuffer(commandBuffer, resources->valueBuffer, resources->stagingBuffer, 1, &copyRegion);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < run->bufferCount; i++)
+        {
+            const VkBufferCopy copyRegion = { .srcOffset = 0, .dstOffset = i * dataBufferSize, .size = dataBufferSize };
+            vkCmdCopyBuffer(commandBuffer, resources->dataBuffers[i], resources->stagingBuffer, 1, &copyRegion);
+        }
+    }
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+static inline uint32_t CombineScatterValue(enum GATHER_SCATTER_OP op, uint32_t current, uint32_t value)
+{
+    switch (op)
+    {
+    case GATHER_SCATTER_OP_SCATTER_ADD:
+        return current + value;
+    case GATHER_SCATTER_OP_SCATTER_MIN:
+        return min(current, value);
+    default:
+        return max(current, value);
+    }
+}
+
+// Checks the staging buffer against the unsorted stream; sorting must not change any result
+static bool VerifyGatherScatterRun(const struct GatherScatterResources* resources, struct GatherScatterStreams* streams,
+    enum GATHER_SCATTER_OP op, uint32_t bufferCount)
+{
+    const uint32_t* results = resources->stagingData;
+    if (op == GATHER_SCATTER_OP_GATHER)
+    {
+        // Element o of buffer b holds b * GATHER_SCATTER_BUFFER_ELEMENT_COUNT + o
+        for (uint32_t i = 0; i < GATHER_SCATTER_INDEX_COUNT; i++)
+        {
+            const uint32_t expected = GetGatherScatterKey(streams->entries[i]);
+            if (results[i] != expected)
+            {
+                fprintf(stderr, "gather: value %u is %u, expected %u!\n", i, results[i], expected);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const uint32_t elementCount = bufferCount * GATHER_SCATTER_BUFFER_ELEMENT_COUNT;
+    const uint32_t identity = op == GATHER_SCATTER_OP_SCATTER_MIN ? UINT32_MAX : 0;
+    for (uint32_t i = 0; i < elementCount; i++) {
+        streams->expected[i] = identity;
+    }
+    for (uint32_t iteration = 0; iteration < GATHER_SCATTER_ITERATIONS; iteration++)
+    {
+        for (uint32_t i = 0; i < GATHER_SCATTER_INDEX_COUNT; i++)
+        {
+            const uint32_t key = GetGatherScatterKey(streams->entries[i]);
+            streams->expected[key] = CombineScatterValue(op, streams->expected[key], streams->values[i]);
+        }
+    }
+    for (uint32_t i = 0; i < elementCount; i++)
+    {
+        if (results[i] != streams->expected[i])
+        {
+            fprintf(stderr, "%s: element %u of buffer %u is %u, expected %u!\n", s_gatherScatterOpNames[op], i % GATHER_SCATTER_BUFFER_ELEMENT_COUNT,
+                i / GATHER_SCATTER_BUFFER_ELEMENT_COUNT, results[i], streams->expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes the stream, sorted or not, into the staging buffer and uploads it
+static VkResult UploadGatherScatterStream(struct GatherScatterResources* resources, const struct GatherScatterStreams* streams, bool sorted)
+{
+    uint8_t* staging = resources->stagingData;
+    const size_t indexStreamSize = GATHER_SCATTER_INDEX_COUNT * sizeof(struct GatherScatterIndex);
+    const size_t valueStreamSize = GATHER_SCATTER_INDEX_COUNT * sizeof(uint32_t);
+    memcpy(staging, sorted ? streams->sortedEntries : streams->entries, indexStreamSize);
+    memcpy(staging + indexStreamSize, streams->values, valueStreamSize);
+    memcpy(staging + indexStreamSize + valueStreamSize, streams->order, valueStreamSize);
+    return SubmitOneTimeCommands(resources->deviceContext, resources->fence, RecordGatherScatterUpload, resources, 0);
+}
+
+// Restores the pattern the gather verifies, since scatters overwrite the data buffers
+static VkResult UploadGatherScatterData(struct GatherScatterResources* resources)
+{
+    uint32_t* staging = resources->stagingData;
+    for (uint32_t i = 0; i < GATHER_SCATTER_MAX_BUFFER_COUNT * GATHER_SCATTER_BUFFER_ELEMENT_COUNT; i++) {
+        staging[i] = i;
+    }
+    return SubmitOneTimeCommands(resources->deviceContext, resources->fence, RecordGatherScatterUpload, resources, 1);
+}
+
+// Runs and verifies one operation over the uploaded stream. Returns million entries per second, or a negative value on failure.
+static double MeasureGatherScatter(struct GatherScatterResources* resources, struct GatherScatterStreams* streams, enum GATHER_SCATTER_OP op,
+    bool sorted, uint32_t bufferCount, uint64_t timestampMask)
+{
+    struct DeviceContext* deviceContext = resources->deviceContext;
+    const struct GatherScatterRun run = {
+        .resources = resources,
+        .op = op,
+        .sorted = sorted,
+        .bufferCount = bufferCount
+    };
+
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    if (SubmitOneTimeCommands(deviceContext, resources->fence, RecordGatherScatterRun, &run, GATHER_SCATTER_ITERATIONS) != VK_SUCCESS) {
+        return -1.0;
+    }
+    double nanoseconds = (double)(GetCurrentTimeNanoseconds() - beginTime);
+
+    if (resources->queryPool != VK_NULL_HANDLE)
+    {
+        uint64_t timestamps[2] = { 0 };
+        const VkResult res = vkGetQueryPoolResults(deviceContext->device, resources->queryPool, 0, 2, sizeof(timestamps), timestamps,
+            sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkGetQueryPoolResults failed: %d\n", res);
+            return -1.0;
+        }
+        const uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+        nanoseconds = (double)ticks * deviceContext->properties.limits.timestampPeriod;
+    }
+
+    if (!VerifyGatherScatterRun(resources, streams, op, bufferCount)) {
+        return -1.0;
+    }
+
+    return (double)GATHER_SCATTER_ITERATIONS * GATHER_SCATTER_INDEX_COUNT * 1000.0 / max(nanoseconds, 1.0);
+}
+
+// Gathers and scatters (atomic add, min and max) along index streams of (buffer slot, offset) pairs resolved through the
+// address table. Sweeps the share of random entries and the number of buffers, with and without the sorting pre-pass.
+static bool RunGatherScatterBenchmark(void)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    const uint64_t timestampMask = GetQueueTimestampMask(deviceContext);
+
+    static const uint32_t randomPercents[] = { 0, 10, 50, 100 };
+    static const uint32_t bufferCounts[] = { 1, 4, 16, GATHER_SCATTER_MAX_BUFFER_COUNT };
+    enum
+    {
+        RANDOMNESS_COUNT = sizeof(randomPercents) / sizeof(randomPercents[0]),
+        BUFFER_COUNT_COUNT = sizeof(bufferCounts) / sizeof(bufferCounts[0])
+    };
+
+    printf("\n================ Begin the gather/scatter benchmark: %d entries, %d elements per buffer, %s ================\n\n",
+        GATHER_SCATTER_INDEX_COUNT, GATHER_SCATTER_BUFFER_ELEMENT_COUNT, timestampMask != 0 ? "GPU timestamps" : "host time");
+
+    struct GatherScatterStreams streams = {
+        .entries = malloc(GATHER_SCATTER_INDEX_COUNT * sizeof(struct GatherScatterIndex)),
+        .sortedEntries = malloc(GATHER_SCATTER_INDEX_COUNT * sizeof(struct GatherScatterIndex)),
+        .order = malloc(GATHER_SCATTER_INDEX_COUNT * sizeof(uint32_t)),
+        .scratch = malloc(GATHER_SCATTER_INDEX_COUNT * sizeof(uint32_t)),
+        .values = malloc(GATHER_SCATTER_INDEX_COUNT * sizeof(uint32_t)),
+        .expected = malloc(GATHER_SCATTER_MAX_BUFFER_COUNT * GATHER_SCATTER_BUFFER_ELEMENT_COUNT * sizeof(uint32_t))
+    };
+    bool passed = streams.entries != NULL && streams.sortedEntries != NULL && streams.order != NULL && streams.scratch != NULL &&
+        streams.values != NULL && streams.expected != NULL;
+    if (!passed) {
+        fprintf(stderr, "Out of host memory for the index streams!\n");
+    }
+
+    // Small enough that scatter_add cannot overflow
+    for (uint32_t i = 0; i < GATHER_SCATTER_INDEX_COUNT && passed; i++) {
+        streams.values[i] = 1 + ((i * 2654435761U) >> 24);
+    }
+
+    struct GatherScatterResources resources = { 0 };
+    passed = passed && CreateGatherScatterResources(deviceContext, timestampMask != 0, &resources) == VK_SUCCESS;
+
+    // Million entries per second, [op][randomness][sorted][buffer count]
+    static double throughputs[GATHER_SCATTER_OP_COUNT][RANDOMNESS_COUNT][2][BUFFER_COUNT_COUNT];
+    double sortMilliseconds[RANDOMNESS_COUNT][BUFFER_COUNT_COUNT];
+
+    for (uint32_t r = 0; r < RANDOMNESS_COUNT && passed; r++)
+    {
+        for (uint32_t b = 0; b < BUFFER_COUNT_COUNT && passed; b++)
+        {
+            GenerateIndexStream(streams.entries, bufferCounts[b], randomPercents[r], r * BUFFER_COUNT_COUNT + b + 1);
+            const uint64_t sortBeginTime = GetCurrentTimeNanoseconds();
+            SortIndexStream(&streams);
+            sortMilliseconds[r][b] = (double)(GetCurrentTimeNanoseconds() - sortBeginTime) / 1000000.0;
+
+            for (uint32_t sorted = 0; sorted < 2 && passed; sorted++)
+            {
+                // The gather overwrites the values, so it runs after the scatters
+                passed = UploadGatherScatterStream(&resources, &streams, sorted != 0) == VK_SUCCESS;
+                for (uint32_t op = GATHER_SCATTER_OP_SCATTER_ADD; op < GATHER_SCATTER_OP_COUNT && passed; op++)
+                {
+                    throughputs[op][r][sorted][b] = MeasureGatherScatter(&resources, &streams, (enum GATHER_SCATTER_OP)op, sorted != 0,
+                        bufferCounts[b], timestampMask);
+                    passed = throughputs[op][r][sorted][b] >= 0.0;
+                }
+                if (passed)
+                {
+                    passed = UploadGatherScatterData(&resources) == VK_SUCCESS;
+                    throughputs[GATHER_SCATTER_OP_GATHER][r][sorted][b] = passed ? MeasureGatherScatter(&resources, &streams,
+                        GATHER_SCATTER_OP_GATHER, sorted != 0, bufferCounts[b], timestampMask) : -1.0;
+                    passed = throughputs[GATHER_SCATTER_OP_GATHER][r][sorted][b] >= 0.0;
+                }
+            }
+        }
+    }
+
+    for (uint32_t op = 0; op < GATHER_SCATTER_OP_COUNT && passed; op++)
+    {
+        printf("%s (M entries/s):\n%8s %7s", s_gatherScatterOpNames[op], "random", "sorted");
+        for (uint32_t b = 0; b < BUFFER_COUNT_COUNT; b++) {
+            printf(" %8u buf", bufferCounts[b]);
+        }
+        puts("");
+        for (uint32_t r = 0; r < RANDOMNESS_COUNT; r++)
+        {
+            for (uint32_t sorted = 0; sorted < 2; sorted++)
+            {
+                printf("%7u%% %7s", randomPercents[r], sorted != 0 ? "yes" : "no");
+                for (uint32_t b = 0; b < BUFFER_COUNT_COUNT; b++) {
+                    printf(" %12.1f", throughputs[op][r][sorted][b]);
+                }
+                puts("");
+            }
+        }
+        puts("");
+    }
+
+    if (passed)
+    {
+        printf("Host sorting pre-pass (ms):\n%8s", "random");
+        for (uint32_t b = 0; b < BUFFER_COUNT_COUNT; b++) {
+            printf(" %8u buf", bufferCounts[b]);
+        }
+        puts("");
+        for (uint32_t r = 0; r < RANDOMNESS_COUNT; r++)
+        {
+            printf("%7u%%", randomPercents[r]);
+            for (uint32_t b = 0; b < BUFFER_COUNT_COUNT; b++) {
+                printf(" %12.3f", sortMilliseconds[r][b]);
+            }
+            puts("");
+        }
+        puts("");
+    }
+
+    DestroyGatherScatterResources(&resources);
+    free(streams.entries);
+    free(streams.sortedEntries);
+    free(streams.order);
+    free(streams.scratch);
+    free(streams.values);
+    free(streams.expected);
+
+    printf("================ Complete the gather/scatter benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Must match decode_blocks.comp.glsl
+enum BLOCK_ENCODING
+{
+    BLOCK_ENCODING_FRAME_OF_REFERENCE,
+    BLOCK_ENCODING_DELTA
+};
+
+// Matches BlockHeader of decode_blocks.comp.glsl. wordOffset indexes the packed words, which follow all headers.
+struct CompressedBlockHeader
+{
+    uint32_t modeAndWidth;
+    uint32_t base;
+    uint32_t reference;
+    uint32_t wordOffset;
+};
+
+enum COMPRESSION_DATASET
+{
+    COMPRESSION_DATASET_SEQUENCE,
+    COMPRESSION_DATASET_SMALL_RANGE,
+    COMPRESSION_DATASET_SORTED,
+    COMPRESSION_DATASET_RANDOM,
+    COMPRESSION_DATASET_COUNT
+};
+
+static const char* const s_compressionDatasetNames[COMPRESSION_DATASET_COUNT] = { "sequence", "small_range", "sorted", "random" };
+
+// Each encoder thread handles a contiguous range of blocks
+struct EncoderThreadArgs
+{
+    const uint32_t* values;
+    uint32_t elemCount;
+    struct CompressedBlockHeader* headers;
+    // NULL while the headers are chosen, then the packed words of all blocks
+    uint32_t* words;
+    uint32_t firstBlock;
+    uint32_t blockCount;
+};
+
+struct CompressedUploadResources
+{
+    // The main kernel; the decoder writes the source buffer of its int32 variant
+    struct ElementTypeKernel kernel;
+    uint32_t blockCount;
+    VkDeviceSize encodedCapacity;
+    VkDeviceSize encodedSize;
+    // Host copy of the headers, which the encoder reads back while it assigns the word offsets
+    struct CompressedBlockHeader* headers;
+
+    VkBuffer encodedBuffer;
+    VkDeviceMemory encodedMemory;
+    VkBuffer encodedStagingBuffer;
+    VkDeviceMemory encodedStagingMemory;
+    void* encodedStagingData;
+    // Host visible, receives the result of the main kernel so that the source in the kernel staging buffer is kept
+    VkBuffer resultBuffer;
+    VkDeviceMemory resultMemory;
+    void* resultData;
+
+    VkShaderModule shaderModule;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+    // Before the upload, after the upload (and decoding) and after the main kernel; VK_NULL_HANDLE without timestamps
+    VkQueryPool queryPool;
+};
+
+static void FillCompressionDataset(enum COMPRESSION_DATASET dataset, uint32_t* values, uint32_t elemCount)
+{
+    uint32_t seed = 1;
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < elemCount; i++)
+    {
+        seed = seed * 1664525U + 1013904223U;
+        switch (dataset)
+        {
+        case COMPRESSION_DATASET_SEQUENCE:
+            // Like InitializeSourceData
+            values[i] = i;
+            break;
+        case COMPRESSION_DATASET_SMALL_RANGE:
+            values[i] = 1000 + (seed >> 24);
+            break;
+        case COMPRESSION_DATASET_SORTED:
+            value += seed >> 28;
+            values[i] = value;
+            break;
+        default:
+            values[i] = seed;
+            break;
+        }
+    }
+}
+
+static inline uint32_t GetBitWidth(uint32_t value)
+{
+    uint32_t bitWidth = 0;
+    while (value != 0)
+    {
+        bitWidth++;
+        value >>= 1;
+    }
+    return bitWidth;
+}
+
+// Chooses the mode with the narrower packed values. A partial block is padded with its last element, a delta of 0.
+static struct CompressedBlockHeader ChooseBlockEncoding(const uint32_t* values, uint32_t count)
+{
+    uint32_t minValue = values[0];
+    uint32_t maxValue = values[0];
+    int64_t minDelta = count < COMPRESSED_BLOCK_ELEMENT_COUNT ? 0 : INT64_MAX;
+    int64_t maxDelta = count < COMPRESSED_BLOCK_ELEMENT_COUNT ? 0 : INT64_MIN;
+    for (uint32_t i = 1; i < count; i++)
+    {
+        minValue = min(minValue, values[i]);
+        maxValue = max(maxValue, values[i]);
+        const int64_t delta = (int32_t)(values[i] - values[i - 1]);
+        minDelta = min(minDelta, delta);
+        maxDelta = max(maxDelta, delta);
+    }
+
+    const uint32_t referenceWidth = GetBitWidth(maxValue - minValue);
+    const uint32_t deltaWidth = GetBitWidth((uint32_t)(maxDelta - minDelta));
+    if (deltaWidth < referenceWidth) {
+        return (struct CompressedBlockHeader){ (BLOCK_ENCODING_DELTA << 8) | deltaWidth, values[0], (uint32_t)minDelta, 0 };
+    }
+    return (struct CompressedBlockHeader){ (BLOCK_ENCODING_FRAME_OF_REFERENCE << 8) | referenceWidth, minValue, 0, 0 };
+}
+
+// Writes the words strictly in order, since `words` is usually write-combined staging memory
+static void PackBlock(const uint32_t* values, uint32_t count, const struct CompressedBlockHeader* header, uint32_t* words)
+{
+    const uint32_t bitWidth = header->modeAndWidth & 0xFFU;
+    const bool delta = (header->modeAndWidth >> 8) == BLOCK_ENCODING_DELTA;
+    if (bitWidth == 0) {
+        return;
+    }
+
+    uint64_t bits = 0;
+    uint32_t bitCount = 0;
+    uint32_t previous = values[0];
+    for (uint32_t i = 0; i < COMPRESSED_BLOCK_ELEMENT_COUNT; i++)
+    {
+        const uint32_t value = values[min(i, count - 1)];
+        uint32_t packed = value - header->base;
+        if (delta)
+        {
+            packed = i == 0 ? 0 : value - previous - header->reference;
+            previous = value;
+        }
+
+        bits |= (uint64_t)packed << bitCount;
+        bitCount += bitWidth;
+        if (bitCount >= 32)
+        {
+            *words++ = (uint32_t)bits;
+            bits >>= 32;
+            bitCount -= 32;
+        }
+    }
+}
+
+static int EncoderThreadProc(void* arg)
+{
+    const struct EncoderThreadArgs* args = arg;
+    for (uint32_t block = args->firstBlock; block < args->firstBlock + args->blockCount; block++)
+    {
+        const uint32_t firstElement = block * COMPRESSED_BLOCK_ELEMENT_COUNT;
+        const uint32_t count = min(args->elemCount - firstElement, (uint32_t)COMPRESSED_BLOCK_ELEMENT_COUNT);
+        if (args->words == NULL) {
+            args->headers[block] = ChooseBlockEncoding(&args->values[firstElement], count);
+        }
+        else {
+            PackBlock(&args->values[firstElement], count, &args->headers[block], &args->words[args->headers[block].wordOffset]);
+        }
+    }
+    return 0;
+}
+
+// Runs one phase of the encoder on `threadCount` threads. A range whose thread cannot be created is encoded on this thread.
+static void RunEncoderPhase(struct EncoderThreadArgs args[], uint32_t threadCount)
+{
+    thrd_t threads[MAX_ENCODER_THREAD_COUNT];
+    bool threadCreated[MAX_ENCODER_THREAD_COUNT] = { false };
+    for (uint32_t t = 0; t < threadCount; t++) {
+        threadCreated[t] = thrd_create(&threads[t], EncoderThreadProc, &args[t]) == thrd_success;
+    }
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        if (threadCreated[t]) {
+            thrd_join(threads[t], NULL);
+        }
+        else {
+            EncoderThreadProc(&args[t]);
+        }
+    }
+}
+
+// Encodes `values` into the encoded staging buffer: the block headers, then the packed words. The headers are chosen in
+// parallel, their word offsets are assigned in order, and the blocks are packed in parallel.
+static void EncodeCompressedUpload(struct CompressedUploadResources* resources, const uint32_t* values, uint32_t threadCount)
+{
+    const uint32_t elemCount = resources->kernel.elemCount;
+    const uint32_t blockCount = resources->blockCount;
+    threadCount = min(threadCount, blockCount);
+
+    struct EncoderThreadArgs args[MAX_ENCODER_THREAD_COUNT];
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        const uint32_t firstBlock = blockCount * t / threadCount;
+        args[t] = (struct EncoderThreadArgs){
+            .values = values,
+            .elemCount = elemCount,
+            .headers = resources->headers,
+            .words = NULL,
+            .firstBlock = firstBlock,
+            .blockCount = blockCount * (t + 1) / threadCount - firstBlock
+        };
+    }
+    RunEncoderPhase(args, threadCount);
+
+    uint32_t wordCount = 0;
+    for (uint32_t i = 0; i < blockCount; i++)
+    {
+        resources->headers[i].wordOffset = wordCount;
+        wordCount += (resources->headers[i].modeAndWidth & 0xFFU) * (COMPRESSED_BLOCK_ELEMENT_COUNT / 32);
+    }
+
+    const size_t headerSize = blockCount * sizeof(struct CompressedBlockHeader);
+    uint8_t* staging = resources->encodedStagingData;
+    for (uint32_t t = 0; t < threadCount; t++) {
+        args[t].words = (uint32_t*)(staging + headerSize);
+    }
+    RunEncoderPhase(args, threadCount);
+
+    memcpy(staging, resources->headers, headerSize);
+    resources->encodedSize = headerSize + (VkDeviceSize)wordCount * sizeof(uint32_t);
+}
+
+static void DestroyCompressedUploadResources(struct CompressedUploadResources* resources)
+{
+    if (resources->kernel.deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = resources->kernel.deviceContext->device;
+
+    if (resources->queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, resources->queryPool, NULL);
+    }
+    if (resources->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, resources->descriptorPool, NULL);
+    }
+    if (resources->pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, resources->pipeline, NULL);
+    }
+    if (resources->pipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, resources->pipelineLayout, NULL);
+    }
+    if (resources->descriptorSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, resources->descriptorSetLayout, NULL);
+    }
+    if (resources->encodedStagingData != NULL) {
+        vkUnmapMemory(device, resources->encodedStagingMemory);
+    }
+    if (resources->resultData != NULL) {
+        vkUnmapMemory(device, resources->resultMemory);
+    }
+
+    const VkBuffer buffers[] = { resources->encodedBuffer, resources->encodedStagingBuffer, resources->resultBuffer, resources->addressTableBuffer };
+    const VkDeviceMemory memories[] = { resources->encodedMemory, resources->encodedStagingMemory, resources->resultMemory, resources->addressTableMemory };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+    {
+        if (buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffers[i], NULL);
+        }
+        if (memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, memories[i], NULL);
+        }
+    }
+
+    free(resources->headers);
+    DestroyElementTypeKernel(&resources->kernel);
+    memset(resources, 0, sizeof(*resources));
+}
+
+// The encoded buffers are sized for the worst case, where every block is packed at 32 bits
+static VkResult CreateCompressedUploadResources(struct DeviceContext* deviceContext, uint32_t elemCount, bool useTimestamps,
+    struct CompressedUploadResources* resources)
+{
+    memset(resources, 0, sizeof(*resources));
+
+    VkResult res = CreateElementTypeKernel(deviceContext, ELEMENT_TYPE_INT32, elemCount, false, &resources->kernel);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    const VkDevice device = deviceContext->device;
+    const VkMemoryPropertyFlags hostMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    resources->blockCount = (elemCount + COMPRESSED_BLOCK_ELEMENT_COUNT - 1) / COMPRESSED_BLOCK_ELEMENT_COUNT;
+    const VkDeviceSize headerSize = resources->blockCount * sizeof(struct CompressedBlockHeader);
+    resources->encodedCapacity = headerSize + (VkDeviceSize)resources->blockCount * COMPRESSED_BLOCK_ELEMENT_COUNT * sizeof(uint32_t);
+
+    resources->headers = malloc(headerSize);
+    if (resources->headers == NULL)
+    {
+        fprintf(stderr, "Out of host memory for %u block headers!\n", resources->blockCount);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    res = CreateBufferWithMemory(deviceContext, resources->encodedCapacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &resources->encodedBuffer, &resources->encodedMemory);
+    if (res == VK_SUCCESS)
+    {
+        res = CreateBufferWithMemory(deviceContext, resources->encodedCapacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostMemoryFlags,
+            &resources->encodedStagingBuffer, &resources->encodedStagingMemory);
+    }
+    if (res == VK_SUCCESS)
+    {
+        res = CreateBufferWithMemory(deviceContext, resources->kernel.bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemoryFlags,
+            &resources->resultBuffer, &resources->resultMemory);
+    }
+    if (res == VK_SUCCESS)
+    {
+        res = CreateBufferWithMemory(deviceContext, ADDITIONAL_ADDRESS_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemoryFlags,
+            &resources->addressTableBuffer, &resources->addressTableMemory);
+    }
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    res = vkMapMemory(device, resources->encodedStagingMemory, 0, resources->encodedCapacity, 0, &resources->encodedStagingData);
+    if (res == VK_SUCCESS) {
+        res = vkMapMemory(device, resources->resultMemory, 0, resources->kernel.bufferSize, 0, &resources->resultData);
+    }
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+
+    // The destination, the headers and the packed words, like the address table of decode_blocks.comp.glsl
+    VkDeviceAddress* addrMem = NULL;
+    res = vkMapMemory(device, resources->addressTableMemory, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE, 0, (void**)&addrMem);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    memset(addrMem, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
+    addrMem[0] = GetBufferDeviceAddress(device, resources->kernel.dataBuffers[0]);
+    addrMem[1] = GetBufferDeviceAddress(device, resources->encodedBuffer);
+    addrMem[2] = addrMem[1] + headerSize;
+    vkUnmapMemory(device, resources->addressTableMemory);
+
+    res = AcquireShaderModule(deviceContext, "decode_blocks", NULL, &resources->shaderModule);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return res;
+    }
+
+    res = CreateComputePipeline(device, resources->shaderModule, &resources->pipeline, &resources->pipelineLayout, &resources->descriptorSetLayout, elemCount);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "CreateComputePipeline failed!\n");
+        return res;
+    }
+
+    res = CreateDescriptorSets(device, resources->addressTableBuffer, ADDITIONAL_ADDRESS_BUFFER_SIZE, resources->descriptorSetLayout,
+        &resources->descriptorPool, &resources->descriptorSet);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "CreateDescriptorSets failed!\n");
+        return res;
+    }
+
+    if (useTimestamps)
+    {
+        const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 3,
+            .pipelineStatistics = 0
+        };
+        res = vkCreateQueryPool(device, &queryPoolCreateInfo, NULL, &resources->queryPool);
+        if (res != VK_SUCCESS) {
+            fprintf(stderr, "vkCreateQueryPool failed: %d\n", res);
+        }
+    }
+
+    return res;
+}
+
+// Uploads the raw source from the kernel staging buffer (arg 0) or the encoded one, which is decoded into the kernel source
+// buffer (arg 1), then runs the main kernel and reads its result back. The source buffer is cleared first, so that an upload
+// that wrote nothing cannot pass.
+static void RecordCompressedUpload(const void* userData, VkCommandBuffer commandBuffer, uint32_t compressed)
+{
+    const struct CompressedUploadResources* resources = userData;
+    const struct ElementTypeKernel* kernel = &resources->kernel;
+
+    vkCmdFillBuffer(commandBuffer, kernel->dataBuffers[0], 0, VK_WHOLE_SIZE, 0);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    if (resources->queryPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, resources->queryPool, 0, 3);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, resources->queryPool, 0);
+    }
+
+    if (compressed != 0)
+    {
+        const VkBufferCopy copyRegion = { .srcOffset = 0, .dstOffset = 0, .size = resources->encodedSize };
+        vkCmdCopyBuffer(commandBuffer, resources->encodedStagingBuffer, resources->encodedBuffer, 1, &copyRegion);
+        RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources->pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources->pipelineLayout, 0, 1, &resources->descriptorSet, 0, NULL);
+        vkCmdDispatch(commandBuffer, resources->blockCount, 1, 1);
+        RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+    else
+    {
+        const VkBufferCopy copyRegion = { .srcOffset = 0, .dstOffset = 0, .size = kernel->bufferSize };
+        vkCmdCopyBuffer(commandBuffer, kernel->stagingBuffer, kernel->dataBuffers[0], 1, &copyRegion);
+        RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+    if (resources->queryPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, resources->queryPool, 1);
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0, 1, &kernel->descriptorSet, 0, NULL);
+    vkCmdDispatch(commandBuffer, (kernel->elemCount + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE, 1, 1);
+    if (resources->queryPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, resources->queryPool, 2);
+    }
+
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    const VkBufferCopy readbackRegion = { .srcOffset = 0, .dstOffset = 0, .size = kernel->bufferSize };
+    vkCmdCopyBuffer(commandBuffer, kernel->dataBuffers[1], resources->resultBuffer, 1, &readbackRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// Runs one upload path and verifies the doubled result. Returns the upload (and decoding) time and the time up to the end of
+// the main kernel in milliseconds. Without timestamps both are the host time of the whole submission.
+static bool MeasureCompressedUpload(struct CompressedUploadResources* resources, const uint32_t* values, bool compressed, uint64_t timestampMask,
+    double* pUploadMilliseconds, double* pTotalMilliseconds)
+{
+    struct DeviceContext* deviceContext = resources->kernel.deviceContext;
+
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    if (SubmitOneTimeCommands(deviceContext, resources->kernel.fence, RecordCompressedUpload, resources, compressed ? 1 : 0) != VK_SUCCESS) {
+        return false;
+    }
+    *pUploadMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+    *pTotalMilliseconds = *pUploadMilliseconds;
+
+    if (resources->queryPool != VK_NULL_HANDLE)
+    {
+        uint64_t timestamps[3] = { 0 };
+        const VkResult res = vkGetQueryPoolResults(deviceContext->device, resources->queryPool, 0, 3, sizeof(timestamps), timestamps,
+            sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkGetQueryPoolResults failed: %d\n", res);
+            return false;
+        }
+        const double period = deviceContext->properties.limits.timestampPeriod;
+        *pUploadMilliseconds = (double)(((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask) * period / 1000000.0;
+        *pTotalMilliseconds = (double)(((timestamps[2] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask) * period / 1000000.0;
+    }
+
+    const uint32_t* results = resources->resultData;
+    for (uint32_t i = 0; i < resources->kernel.elemCount; i++)
+    {
+        if (results[i] != values[i] * 2)
+        {
+            fprintf(stderr, "%s upload: result %u is %u, expected %u!\n", compressed ? "Compressed" : "Raw", i, results[i], values[i] * 2);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Uploads datasets of different compressibility raw and compressed, with every block encoded by frame of reference or delta and
+// bit-packed on the host, then decoded on the device right before the main kernel. Reports the compression ratio, the encoding
+// time on 1 and N threads, and the effective upload GB/s of both paths in bytes of raw data. The end-to-end GB/s of the
+// compressed path also counts the encoding on N threads.
+static bool RunCompressedUploadBenchmark(uint32_t elemCount)
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    const uint64_t timestampMask = GetQueueTimestampMask(deviceContext);
+    const uint32_t threadCount = min(GetProcessorCount(), (uint32_t)MAX_ENCODER_THREAD_COUNT);
+
+    // Both the decoder and the main kernel dispatch one workgroup per 1024 elements
+    const uint64_t maxElemCount = (uint64_t)deviceContext->properties.limits.maxComputeWorkGroupCount[0] * COMPRESSED_BLOCK_ELEMENT_COUNT;
+    if (elemCount > maxElemCount)
+    {
+        printf("Clamping %u elements to %llu, the maximum workgroup count of the device\n", elemCount, (unsigned long long)maxElemCount);
+        elemCount = (uint32_t)maxElemCount;
+    }
+    const double rawBytes = (double)elemCount * sizeof(uint32_t);
+
+    printf("\n================ Begin the compressed upload benchmark: %u elements, %u encoder threads, best of %d, %s ================\n\n",
+        elemCount, threadCount, COMPRESSED_UPLOAD_ITERATIONS, timestampMask != 0 ? "GPU timestamps" : "host time");
+
+    struct CompressedUploadResources resources;
+    bool passed = CreateCompressedUploadResources(deviceContext, elemCount, timestampMask != 0, &resources) == VK_SUCCESS;
+
+    // Encoded and verified from host memory, since the staging buffers may be uncached
+    uint32_t* values = malloc(resources.kernel.bufferSize);
+    if (passed && values == NULL)
+    {
+        fprintf(stderr, "Out of host memory for %u elements!\n", elemCount);
+        passed = false;
+    }
+
+    if (passed)
+    {
+        printf("%-12s %8s %12s %12s %12s %12s %12s %12s %12s\n", "dataset", "ratio", "encode1 ms", "encodeN ms",
+            "raw GB/s", "comp GB/s", "e2e GB/s", "raw ms", "comp ms");
+    }
+    for (int dataset = 0; dataset < COMPRESSION_DATASET_COUNT && passed; dataset++)
+    {
+        // The raw path uploads straight from the kernel staging buffer
+        FillCompressionDataset((enum COMPRESSION_DATASET)dataset, values, elemCount);
+        memcpy(resources.kernel.hostData, values, resources.kernel.bufferSize);
+
+        uint64_t beginTime = GetCurrentTimeNanoseconds();
+        EncodeCompressedUpload(&resources, values, 1);
+        const double singleThreadMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+        beginTime = GetCurrentTimeNanoseconds();
+        EncodeCompressedUpload(&resources, values, threadCount);
+        const double multiThreadMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+        double bestUpload[2] = { DBL_MAX, DBL_MAX };
+        double bestTotal[2] = { DBL_MAX, DBL_MAX };
+        for (uint32_t i = 0; i < COMPRESSED_UPLOAD_ITERATIONS && passed; i++)
+        {
+            for (uint32_t compressed = 0; compressed < 2 && passed; compressed++)
+            {
+                double uploadMilliseconds = 0.0;
+                double totalMilliseconds = 0.0;
+                passed = MeasureCompressedUpload(&resources, values, compressed != 0, timestampMask, &uploadMilliseconds, &totalMilliseconds);
+                bestUpload[compressed] = min(bestUpload[compressed], uploadMilliseconds);
+                bestTotal[compressed] = min(bestTotal[compressed], totalMilliseconds);
+            }
+        }
+        if (!passed) {
+            break;
+        }
+
+        printf("%-12s %8.2f %12.3f %12.3f %12.2f %12.2f %12.2f %12.3f %12.3f\n", s_compressionDatasetNames[dataset],
+            rawBytes / (double)resources.encodedSize, singleThreadMilliseconds, multiThreadMilliseconds,
+            rawBytes / (max(bestUpload[0], 0.001) * 1000000.0), rawBytes / (max(bestUpload[1], 0.001) * 1000000.0),
+            rawBytes / (max(multiThreadMilliseconds + bestUpload[1], 0.001) * 1000000.0), bestTotal[0], bestTotal[1]);
+    }
+
+    free(values);
+    DestroyCompressedUploadResources(&resources);
+
+    printf("\n================ Complete the compressed upload benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Compiles every registered shader from the GLSL directory, bypassing the cache, then loads it again through the cache
+static bool RunShaderCompileBenchmark(void)
+{
+    if (s_options.glslDirectory == NULL)
+    {
+        fprintf(stderr, "--bench-shader-compile needs --glsl-dir!\n");
+        return false;
+    }
+
+    printf("\n================ Begin the shader compile benchmark: GLSL from %s, cache in %s ================\n\n",
+        s_options.glslDirectory, s_options.shaderCacheDirectory);
+
+    bool passed = true;
+    double totalColdMilliseconds = 0.0;
+    double totalWarmMilliseconds = 0.0;
+    for (uint32_t i = 0; i < EMBEDDED_SHADER_COUNT && passed; i++)
+    {
+        const struct EmbeddedShader* shader = &s_embeddedShaders[i];
+        uint32_t* coldCode = NULL;
+        uint32_t* warmCode = NULL;
+        size_t coldCodeSize = 0;
+        size_t warmCodeSize = 0;
+        bool cacheHit = false;
+
+        uint64_t beginTime = GetCurrentTimeNanoseconds();
+        passed = LoadOrCompileShader(shader, true, &coldCode, &coldCodeSize, &cacheHit);
+        const double coldMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+        if (passed)
+        {
+            beginTime = GetCurrentTimeNanoseconds();
+            passed = LoadOrCompileShader(shader, false, &warmCode, &warmCodeSize, &cacheHit);
+            const double warmMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+            if (passed && (!cacheHit || warmCodeSize != coldCodeSize || memcmp(warmCode, coldCode, coldCodeSize) != 0))
+            {
+                fprintf(stderr, "The cached SPIR-V of %s does not match the compiled one!\n", shader->sourceFileName);
+                passed = false;
+            }
+            if (passed)
+            {
+                printf("%-20s %-6s cold %8.3fms, warm %8.3fms, %zu bytes of SPIR-V\n", shader->name, shader->variant != NULL ? shader->variant : "",
+                    coldMilliseconds, warmMilliseconds, coldCodeSize);
+                totalColdMilliseconds += coldMilliseconds;
+                totalWarmMilliseconds += warmMilliseconds;
+            }
+        }
+
+        free(coldCode);
+        free(warmCode);
+    }
+
+    if (passed)
+    {
+        printf("\nAll %d shaders: cold %.3fms, warm %.3fms (%.1fx)\n", EMBEDDED_SHADER_COUNT, totalColdMilliseconds, totalWarmMilliseconds,
+            totalWarmMilliseconds > 0.0 ? totalColdMilliseconds / totalWarmMilliseconds : 0.0);
+    }
+
+    printf("\n================ Complete the shader compile benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+#ifdef __linux__
+
+// Seals a payload memfd must carry; F_SEAL_WRITE is not required, since the service writes the results in place
+#define SERVICE_REQUIRED_PAYLOAD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW)
+
+enum SERVICE_MESSAGE_TYPE
+{
+    // Client to service; a SUBMIT request carries the memfd of its payload as SCM_RIGHTS
+    SERVICE_MESSAGE_SUBMIT = 1,
+    SERVICE_MESSAGE_QUERY_STATS,
+    SERVICE_MESSAGE_SHUTDOWN,
+    // Service to client
+    SERVICE_MESSAGE_RESULT,
+    SERVICE_MESSAGE_STATS
+};
+
+// The payload of a SUBMIT request holds `elemCount` int32 elements, which the service doubles in place. The memfd must be
+// created with MFD_ALLOW_SEALING and carry SERVICE_REQUIRED_PAYLOAD_SEALS, so that its client cannot truncate it while the
+// service accesses the mapping.
+struct ServiceRequest
+{
+    uint32_t type;
+    uint32_t requestId;
+    uint32_t elemCount;
+    uint32_t reserved;
+};
+
+struct ServiceClientStats
+{
+    uint64_t completedJobCount;
+    uint64_t failedJobCount;
+    uint64_t processedBytes;
+    // Jobs whose payload was imported as device memory instead of being copied through a staging buffer
+    uint64_t importedJobCount;
+    // Sum of the sizes of the batches the jobs ran in
+    uint64_t batchedJobCount;
+    // From receiving a request to replying to it
+    double totalLatencyMilliseconds;
+};
+
+struct ServiceReply
+{
+    uint32_t type;
+    uint32_t requestId;
+    int32_t result;
+    uint32_t batchSize;
+    struct ServiceClientStats stats;
+};
+
+struct ServiceClient
+{
+    // -1 if the entry is free
+    int socketFd;
+    // Closed after the current batch, so that its jobs in the batch are still counted
+    bool disconnected;
+    struct ServiceClientStats stats;
+    // Replies its socket had no room for, sent in order once it becomes writable. No requests are read from the client
+    // until they are, which bounds them to the replies of one round.
+    struct ServiceReply pendingReplies[SERVICE_MAX_REQUESTS_PER_CLIENT];
+    uint32_t pendingReplyCount;
+};
+
+// One position of a batch. The device buffers only grow, so a warm service allocates nothing for most jobs.
+struct ServiceJobSlot
+{
+    VkDeviceSize capacity;
+    // [0] source, [1] destination
+    VkBuffer dataBuffers[2];
+    VkDeviceMemory dataMemories[2];
+    // Only used when the payload cannot be imported
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    void* stagingData;
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+    VkDeviceAddress* addresses;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+
+    // The job currently in the slot
+    uint32_t clientIndex;
+    uint32_t requestId;
+    uint32_t elemCount;
+    uint64_t receiveTime;
+    void* payload;
+    size_t payloadSize;
+    VkBuffer importedBuffer;
+    VkDeviceMemory importedMemory;
+    const struct ComputePipelineState* pipelineState;
+    VkResult result;
+};
+
+struct ComputeService
+{
+    struct DeviceContext* deviceContext;
+    struct ComputePipelineCache pipelineCache;
+    VkFence fence;
+    int listenFd;
+    char socketPath[MAX_SERVICE_SOCKET_PATH_LENGTH];
+    struct ServiceClient clients[SERVICE_MAX_CLIENT_COUNT];
+    uint32_t nextClientIndex;
+    struct ServiceJobSlot slots[SERVICE_MAX_BATCH_SIZE];
+    uint32_t slotCount;
+    uint64_t batchCount;
+    uint64_t jobCount;
+    bool stopRequested;
+};
+
+// Sends one message; `payloadFd` is passed along with it unless it is -1
+static bool SendServiceMessage(int socketFd, const void* message, size_t messageSize, int payloadFd, int flags)
+{
+    union
+    {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { .iov_base = (void*)message, .iov_len = messageSize };
+    struct msghdr msg = {
+        .msg_name = NULL,
+        .msg_namelen = 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = NULL,
+        .msg_controllen = 0,
+        .msg_flags = 0
+    };
+    if (payloadFd >= 0)
+    {
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &payloadFd, sizeof(int));
+    }
+
+    // A client that went away must not kill the service with SIGPIPE
+    return sendmsg(socketFd, &msg, flags | MSG_NOSIGNAL) == (ssize_t)messageSize;
+}
+
+// Receives one message and the descriptor passed along with it, -1 in `*pPayloadFd` if there is none
+static ssize_t ReceiveServiceMessage(int socketFd, void* message, size_t messageSize, int flags, int* pPayloadFd)
+{
+    union
+    {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct iovec iov = { .iov_base = message, .iov_len = messageSize };
+    struct msghdr msg = {
+        .msg_name = NULL,
+        .msg_namelen = 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+        .msg_flags = 0
+    };
+
+    *pPayloadFd = -1;
+    const ssize_t received = recvmsg(socketFd, &msg, flags | MSG_CMSG_CLOEXEC);
+    if (received < 0) {
+        return received;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(pPayloadFd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    return received;
+}
+
+// Sends the pending replies of the client without blocking; returns false if the client has to be disconnected
+static bool FlushServiceReplies(struct ServiceClient* client)
+{
+    uint32_t sentCount = 0;
+    while (sentCount < client->pendingReplyCount &&
+        SendServiceMessage(client->socketFd, &client->pendingReplies[sentCount], sizeof(client->pendingReplies[0]), -1, MSG_DONTWAIT)) {
+        sentCount++;
+    }
+    const bool wouldBlock = sentCount < client->pendingReplyCount && (errno == EAGAIN || errno == EWOULDBLOCK);
+
+    client->pendingReplyCount -= sentCount;
+    memmove(client->pendingReplies, client->pendingReplies + sentCount, client->pendingReplyCount * sizeof(client->pendingReplies[0]));
+    return client->pendingReplyCount == 0 || wouldBlock;
+}
+
+// Replies without blocking, so that a client that stops reading cannot stall the others. A reply that does not fit into
+// the socket is queued; a client that falls further behind is disconnected.
+static void SendServiceReply(struct ServiceClient* client, const struct ServiceReply* reply)
+{
+    if (client->disconnected) {
+        return;
+    }
+    if (client->pendingReplyCount == SERVICE_MAX_REQUESTS_PER_CLIENT)
+    {
+        fprintf(stderr, "A client does not read its replies, disconnecting it!\n");
+        client->disconnected = true;
+        return;
+    }
+    client->pendingReplies[client->pendingReplyCount++] = *reply;
+    client->disconnected = !FlushServiceReplies(client);
+}
+
+static int ConnectServiceSocket(const char* socketPath)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath);
+
+    const int socketFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (socketFd >= 0 && connect(socketFd, (const struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(socketFd);
+        return -1;
+    }
+    return socketFd;
+}
+
+// Job sizes are rounded up to powers of 2, so that at most one pipeline per power of 2 is created
+static uint32_t GetServiceBucketElementCount(uint32_t elemCount)
+{
+    uint32_t bucketElemCount = COMPUTE_WORKGROUP_SIZE;
+    while (bucketElemCount < elemCount) {
+        bucketElemCount <<= 1;
+    }
+    return bucketElemCount;
+}
+
+static void PrintServiceClientStats(uint32_t clientIndex, const struct ServiceClientStats* stats)
+{
+    const uint64_t jobCount = stats->completedJobCount + stats->failedJobCount;
+    printf("Client %u: %llu job(s) completed, %llu failed, %.1fMB, %llu imported, average batch size %.2f, average latency %.3fms\n",
+        clientIndex, (unsigned long long)stats->completedJobCount, (unsigned long long)stats->failedJobCount,
+        (double)stats->processedBytes / (1024.0 * 1024.0), (unsigned long long)stats->importedJobCount,
+        jobCount > 0 ? (double)stats->batchedJobCount / (double)jobCount : 0.0,
+        jobCount > 0 ? stats->totalLatencyMilliseconds / (double)jobCount : 0.0);
+}
+
+static void ReleaseServiceJobSlotBuffers(VkDevice device, struct ServiceJobSlot* slot)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (slot->dataBuffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, slot->dataBuffers[i], NULL);
+        }
+        if (slot->dataMemories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, slot->dataMemories[i], NULL);
+        }
+        slot->dataBuffers[i] = VK_NULL_HANDLE;
+        slot->dataMemories[i] = VK_NULL_HANDLE;
+    }
+    if (slot->stagingBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, slot->stagingBuffer, NULL);
+    }
+    if (slot->stagingMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, slot->stagingMemory, NULL);
+    }
+    slot->stagingBuffer = VK_NULL_HANDLE;
+    slot->stagingMemory = VK_NULL_HANDLE;
+    slot->stagingData = NULL;
+    slot->capacity = 0;
+}
+
+static void DestroyServiceJobSlot(VkDevice device, struct ServiceJobSlot* slot)
+{
+    ReleaseServiceJobSlotBuffers(device, slot);
+    if (slot->addressTableBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, slot->addressTableBuffer, NULL);
+    }
+    if (slot->addressTableMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, slot->addressTableMemory, NULL);
+    }
+    if (slot->descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, slot->descriptorPool, NULL);
+    }
+    memset(slot, 0, sizeof(*slot));
+}
+
+// Grows the buffers of the slot to at least `size` bytes. The address table and the descriptor set are created on first use
+// and only their addresses change afterwards.
+static VkResult PrepareServiceJobSlot(const struct DeviceContext* deviceContext, VkDescriptorSetLayout descriptorSetLayout, VkDeviceSize size,
+    struct ServiceJobSlot* slot)
+{
+    const VkDevice device = deviceContext->device;
+    const VkMemoryPropertyFlags hostMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkResult res = VK_SUCCESS;
+
+    if (slot->addressTableBuffer == VK_NULL_HANDLE)
+    {
+        res = CreateBufferWithMemory(deviceContext, ADDITIONAL_ADDRESS_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemoryFlags,
+            &slot->addressTableBuffer, &slot->addressTableMemory);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+        res = vkMapMemory(device, slot->addressTableMemory, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE, 0, (void**)&slot->addresses);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkMapMemory failed: %d\n", res);
+            return res;
+        }
+        memset(slot->addresses, 0, ADDITIONAL_ADDRESS_BUFFER_SIZE);
+
+        // All pipelines of the cache have identically defined layouts, so the set is compatible with each of them
+        res = CreateDescriptorSets(device, slot->addressTableBuffer, ADDITIONAL_ADDRESS_BUFFER_SIZE, descriptorSetLayout,
+            &slot->descriptorPool, &slot->descriptorSet);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "CreateDescriptorSets failed!\n");
+            return res;
+        }
+    }
+
+    if (slot->capacity >= size) {
+        return VK_SUCCESS;
+    }
+
+    ReleaseServiceJobSlotBuffers(device, slot);
+    for (int i = 0; i < 2; i++)
+    {
+        res = CreateBufferWithMemory(deviceContext, size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &slot->dataBuffers[i], &slot->dataMemories[i]);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+    }
+    res = CreateBufferWithMemory(deviceContext, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostMemoryFlags,
+        &slot->stagingBuffer, &slot->stagingMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    res = vkMapMemory(device, slot->stagingMemory, 0, size, 0, &slot->stagingData);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+
+    slot->addresses[0] = GetBufferDeviceAddress(device, slot->dataBuffers[1]);
+    slot->addresses[1] = GetBufferDeviceAddress(device, slot->dataBuffers[0]);
+    slot->capacity = size;
+
+    return VK_SUCCESS;
+}
+
+// Imports the mapped payload of the slot with VK_EXT_external_memory_host, so that the transfers read and write the memfd
+// of the client directly. Returns false if the payload has to be copied through the staging buffer instead.
+static bool ImportServicePayload(const struct DeviceContext* deviceContext, struct ServiceJobSlot* slot)
+{
+    const VkDevice device = deviceContext->device;
+    const VkDeviceSize alignment = deviceContext->minImportedHostPointerAlignment;
+    if (deviceContext->getMemoryHostPointerProperties == NULL || alignment == 0 || slot->payloadSize % alignment != 0 ||
+        (uintptr_t)slot->payload % alignment != 0) {
+        return false;
+    }
+
+    VkMemoryHostPointerPropertiesEXT hostPointerProps = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+        .pNext = NULL,
+        .memoryTypeBits = 0
+    };
+    if (deviceContext->getMemoryHostPointerProperties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, slot->payload,
+        &hostPointerProps) != VK_SUCCESS) {
+        return false;
+    }
+
+    const VkExternalMemoryBufferCreateInfo externalBufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT
+    };
+    const VkBufferCreateInfo bufCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = &externalBufferCreateInfo,
+        .flags = 0,
+        .size = slot->payloadSize,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &deviceContext->queueFamilyIndex
+    };
+    if (vkCreateBuffer(device, &bufCreateInfo, NULL, &slot->importedBuffer) != VK_SUCCESS)
+    {
+        slot->importedBuffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, slot->importedBuffer, &memRequirements);
+    const uint32_t memoryTypeIndex = FindMemoryTypeIndex(&deviceContext->memoryProperties,
+        memRequirements.memoryTypeBits & hostPointerProps.memoryTypeBits, 0, slot->payloadSize);
+
+    const VkImportMemoryHostPointerInfoEXT importInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+        .pNext = NULL,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+        .pHostPointer = slot->payload
+    };
+    const VkMemoryAllocateInfo memAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &importInfo,
+        .allocationSize = slot->payloadSize,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+    if (memoryTypeIndex == UINT32_MAX || vkAllocateMemory(device, &memAllocInfo, NULL, &slot->importedMemory) != VK_SUCCESS ||
+        vkBindBufferMemory(device, slot->importedBuffer, slot->importedMemory, 0) != VK_SUCCESS)
+    {
+        if (slot->importedMemory != VK_NULL_HANDLE) {
+            vkFreeMemory(device, slot->importedMemory, NULL);
+        }
+        vkDestroyBuffer(device, slot->importedBuffer, NULL);
+        slot->importedBuffer = VK_NULL_HANDLE;
+        slot->importedMemory = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return true;
+}
+
+// Copies every payload of the batch in, runs all kernels and copies the results back, with one barrier between the phases
+static void RecordServiceBatch(const void* userData, VkCommandBuffer commandBuffer, uint32_t slotCount)
+{
+    const struct ComputeService* service = userData;
+
+    for (uint32_t i = 0; i < slotCount; i++)
+    {
+        const struct ServiceJobSlot* slot = &service->slots[i];
+        if (slot->result != VK_SUCCESS) {
+            continue;
+        }
+        const VkBufferCopy copyRegion = {
+            .srcOffset = 0,
+            .dstOffset = 0,
+            .size = (VkDeviceSize)slot->elemCount * sizeof(int32_t)
+        };
+        vkCmdCopyBuffer(commandBuffer, slot->importedBuffer != VK_NULL_HANDLE ? slot->importedBuffer : slot->stagingBuffer,
+            slot->dataBuffers[0], 1, &copyRegion);
+    }
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    for (uint32_t i = 0; i < slotCount; i++)
+    {
+        const struct ServiceJobSlot* slot = &service->slots[i];
+        if (slot->result != VK_SUCCESS) {
+            continue;
+        }
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, slot->pipelineState->pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, slot->pipelineState->pipelineLayout, 0, 1, &slot->descriptorSet, 0, NULL);
+        PushTestKernelChunk(commandBuffer, slot->pipelineState->pipelineLayout, (struct TestKernelChunk){ 0 });
+        vkCmdDispatch(commandBuffer, slot->pipelineState->elemCount / COMPUTE_WORKGROUP_SIZE, 1, 1);
+    }
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+    for (uint32_t i = 0; i < slotCount; i++)
+    {
+        const struct ServiceJobSlot* slot = &service->slots[i];
+        if (slot->result != VK_SUCCESS) {
+            continue;
+        }
+        const VkBufferCopy copyRegion = {
+            .srcOffset = 0,
+            .dstOffset = 0,
+            .size = (VkDeviceSize)slot->elemCount * sizeof(int32_t)
+        };
+        vkCmdCopyBuffer(commandBuffer, slot->dataBuffers[1],
+            slot->importedBuffer != VK_NULL_HANDLE ? slot->importedBuffer : slot->stagingBuffer, 1, &copyRegion);
+    }
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// Runs the jobs of the current batch in one submission, then replies to their clients and unmaps the payloads
+static void RunServiceBatch(struct ComputeService* service)
+{
+    struct DeviceContext* deviceContext = service->deviceContext;
+    const VkDevice device = deviceContext->device;
+    uint32_t runnableCount = 0;
+
+    for (uint32_t i = 0; i < service->slotCount; i++)
+    {
+        struct ServiceJobSlot* slot = &service->slots[i];
+        slot->result = AcquireComputePipeline(&service->pipelineCache, GetServiceBucketElementCount(slot->elemCount), &slot->pipelineState);
+        if (slot->result == VK_SUCCESS)
+        {
+            slot->result = PrepareServiceJobSlot(deviceContext, slot->pipelineState->descriptorSetLayout,
+                (VkDeviceSize)slot->pipelineState->elemCount * sizeof(int32_t), slot);
+        }
+        if (slot->result != VK_SUCCESS) {
+            continue;
+        }
+        if (!ImportServicePayload(deviceContext, slot)) {
+            memcpy(slot->stagingData, slot->payload, (size_t)slot->elemCount * sizeof(int32_t));
+        }
+        runnableCount++;
+    }
+
+    VkResult res = VK_SUCCESS;
+    if (runnableCount > 0) {
+        res = SubmitOneTimeCommands(deviceContext, service->fence, RecordServiceBatch, service, service->slotCount);
+    }
+
+    const uint64_t completeTime = GetCurrentTimeNanoseconds();
+    for (uint32_t i = 0; i < service->slotCount; i++)
+    {
+        struct ServiceJobSlot* slot = &service->slots[i];
+        const bool imported = slot->importedBuffer != VK_NULL_HANDLE;
+        const size_t payloadBytes = (size_t)slot->elemCount * sizeof(int32_t);
+        if (slot->result == VK_SUCCESS) {
+            slot->result = res;
+        }
+        if (slot->result == VK_SUCCESS && !imported) {
+            memcpy(slot->payload, slot->stagingData, payloadBytes);
+        }
+        if (imported)
+        {
+            vkDestroyBuffer(device, slot->importedBuffer, NULL);
+            vkFreeMemory(device, slot->importedMemory, NULL);
+            slot->importedBuffer = VK_NULL_HANDLE;
+            slot->importedMemory = VK_NULL_HANDLE;
+        }
+        munmap(slot->payload, slot->payloadSize);
+        slot->payload = NULL;
+        if (slot->pipelineState != NULL)
+        {
+            ReleaseComputePipeline(&service->pipelineCache, slot->pipelineState);
+            slot->pipelineState = NULL;
+        }
+
+        struct ServiceClient* client = &service->clients[slot->clientIndex];
+        if (slot->result == VK_SUCCESS)
+        {
+            client->stats.completedJobCount++;
+            client->stats.processedBytes += payloadBytes;
+            client->stats.importedJobCount += imported ? 1 : 0;
+        }
+        else {
+            client->stats.failedJobCount++;
+        }
+        client->stats.batchedJobCount += service->slotCount;
+        client->stats.totalLatencyMilliseconds += (double)(completeTime - slot->receiveTime) / 1000000.0;
+
+        const struct ServiceReply reply = {
+            .type = SERVICE_MESSAGE_RESULT,
+            .requestId = slot->requestId,
+            .result = slot->result,
+            .batchSize = service->slotCount,
+            .stats = client->stats
+        };
+        SendServiceReply(client, &reply);
+    }
+
+    service->batchCount++;
+    service->jobCount += service->slotCount;
+    service->slotCount = 0;
+}
+
+// Maps the payload of a SUBMIT request into the next slot of the batch; invalid requests are answered right away
+static void AddServiceJob(struct ComputeService* service, uint32_t clientIndex, const struct ServiceRequest* request, int payloadFd)
+{
+    struct ServiceClient* client = &service->clients[clientIndex];
+    const size_t payloadBytes = (size_t)request->elemCount * sizeof(int32_t);
+
+    // Accessing a mapping whose file has been truncated raises SIGBUS, which would take down the whole service
+    // Descriptors that cannot be sealed, such as regular files, fail F_GET_SEALS
+    const int seals = payloadFd >= 0 ? fcntl(payloadFd, F_GET_SEALS) : -1;
+    const bool sealed = seals >= 0 && (seals & SERVICE_REQUIRED_PAYLOAD_SEALS) == SERVICE_REQUIRED_PAYLOAD_SEALS;
+    if (payloadFd >= 0 && !sealed) {
+        fprintf(stderr, "Client %u sent a payload without F_SEAL_SHRINK and F_SEAL_GROW, rejected!\n", clientIndex);
+    }
+
+    struct stat payloadStat;
+    void* payload = MAP_FAILED;
+    if (request->elemCount > 0 && request->elemCount <= SERVICE_MAX_ELEMENT_COUNT && sealed &&
+        fstat(payloadFd, &payloadStat) == 0 && (size_t)payloadStat.st_size >= payloadBytes) {
+        payload = mmap(NULL, (size_t)payloadStat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, payloadFd, 0);
+    }
+    if (payload == MAP_FAILED)
+    {
+        client->stats.failedJobCount++;
+        const struct ServiceReply reply = {
+            .type = SERVICE_MESSAGE_RESULT,
+            .requestId = request->requestId,
+            .result = VK_ERROR_INITIALIZATION_FAILED,
+            .batchSize = 0,
+            .stats = client->stats
+        };
+        SendServiceReply(client, &reply);
+        return;
+    }
+
+    struct ServiceJobSlot* slot = &service->slots[service->slotCount++];
+    slot->clientIndex = clientIndex;
+    slot->requestId = request->requestId;
+    slot->elemCount = request->elemCount;
+    slot->receiveTime = GetCurrentTimeNanoseconds();
+    slot->payload = payload;
+    slot->payloadSize = (size_t)payloadStat.st_size;
+    slot->pipelineState = NULL;
+    slot->result = VK_SUCCESS;
+}
+
+// Reads up to SERVICE_MAX_REQUESTS_PER_CLIENT requests of the client into the current batch without blocking.
+// Requests that are not read stay in the socket, which blocks the client once the socket buffer is full.
+// Returns false if the client has disconnected.
+static bool ReadServiceRequests(struct ComputeService* service, uint32_t clientIndex)
+{
+    struct ServiceClient* client = &service->clients[clientIndex];
+
+    for (uint32_t n = 0; n < SERVICE_MAX_REQUESTS_PER_CLIENT && service->slotCount < SERVICE_MAX_BATCH_SIZE && !service->stopRequested; n++)
+    {
+        struct ServiceRequest request;
+        int payloadFd = -1;
+        const ssize_t received = ReceiveServiceMessage(client->socketFd, &request, sizeof(request), MSG_DONTWAIT, &payloadFd);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (received != (ssize_t)sizeof(request))
+        {
+            if (payloadFd >= 0) {
+                close(payloadFd);
+            }
+            return false;
+        }
+
+        switch (request.type)
+        {
+        case SERVICE_MESSAGE_SUBMIT:
+            AddServiceJob(service, clientIndex, &request, payloadFd);
+            break;
+
+        case SERVICE_MESSAGE_QUERY_STATS:
+        {
+            const struct ServiceReply reply = {
+                .type = SERVICE_MESSAGE_STATS,
+                .requestId = request.requestId,
+                .result = VK_SUCCESS,
+                .batchSize = 0,
+                .stats = client->stats
+            };
+            SendServiceReply(client, &reply);
+            break;
+        }
+
+        case SERVICE_MESSAGE_SHUTDOWN:
+            service->stopRequested = true;
+            break;
+
+        default:
+            fprintf(stderr, "Unknown message type %u from client %u!\n", request.type, clientIndex);
+            break;
+        }
+
+        // The mapping of the payload stays valid after its descriptor is closed
+        if (payloadFd >= 0) {
+            close(payloadFd);
+        }
+    }
+
+    return true;
+}
+
+static void AcceptServiceClient(struct ComputeService* service)
+{
+    const int socketFd = accept4(service->listenFd, NULL, NULL, SOCK_CLOEXEC);
+    if (socketFd < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr, "accept4 failed: %d\n", errno);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < SERVICE_MAX_CLIENT_COUNT; i++)
+    {
+        if (service->clients[i].socketFd < 0)
+        {
+            memset(&service->clients[i], 0, sizeof(service->clients[i]));
+            service->clients[i].socketFd = socketFd;
+            return;
+        }
+    }
+    close(socketFd);
+}
+
+// Serves requests until a client sends SERVICE_MESSAGE_SHUTDOWN. The requests that arrived while the previous batch ran
+// form the next batch.
+static void RunComputeServiceLoop(struct ComputeService* service)
+{
+    while (!service->stopRequested)
+    {
+        struct pollfd pollFds[SERVICE_MAX_CLIENT_COUNT + 1];
+        uint32_t clientIndices[SERVICE_MAX_CLIENT_COUNT];
+        nfds_t clientPollCount = 0;
+        for (uint32_t n = 0; n < SERVICE_MAX_CLIENT_COUNT; n++)
+        {
+            // Starts at another client every round, so that no client always takes the first slots of a batch
+            const uint32_t i = (service->nextClientIndex + n) % SERVICE_MAX_CLIENT_COUNT;
+            // A client with pending replies waits until it has read them before more of its requests are read
+            const struct ServiceClient* client = &service->clients[i];
+            if (client->socketFd >= 0 && !client->disconnected)
+            {
+                const short events = client->pendingReplyCount > 0 ? POLLOUT : POLLIN;
+                pollFds[clientPollCount] = (struct pollfd){ .fd = client->socketFd, .events = events, .revents = 0 };
+                clientIndices[clientPollCount++] = i;
+            }
+        }
+        service->nextClientIndex = (service->nextClientIndex + 1) % SERVICE_MAX_CLIENT_COUNT;
+
+        // Connections beyond SERVICE_MAX_CLIENT_COUNT wait in the listen backlog
+        nfds_t pollCount = clientPollCount;
+        if (clientPollCount < SERVICE_MAX_CLIENT_COUNT) {
+            pollFds[pollCount++] = (struct pollfd){ .fd = service->listenFd, .events = POLLIN, .revents = 0 };
+        }
+
+        const int readyCount = poll(pollFds, pollCount, SERVICE_POLL_MILLISECONDS);
+        if (readyCount < 0)
+        {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "poll failed: %d\n", errno);
+            break;
+        }
+
+        for (nfds_t p = 0; p < clientPollCount; p++)
+        {
+            struct ServiceClient* client = &service->clients[clientIndices[p]];
+            if ((pollFds[p].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR)) == 0) {
+                continue;
+            }
+            if (client->pendingReplyCount > 0) {
+                client->disconnected = !FlushServiceReplies(client);
+            }
+            else if (!ReadServiceRequests(service, clientIndices[p])) {
+                client->disconnected = true;
+            }
+        }
+
+        if (service->slotCount > 0) {
+            RunServiceBatch(service);
+        }
+
+        for (uint32_t i = 0; i < SERVICE_MAX_CLIENT_COUNT; i++)
+        {
+            struct ServiceClient* client = &service->clients[i];
+            if (client->socketFd >= 0 && client->disconnected)
+            {
+                PrintServiceClientStats(i, &client->stats);
+                close(client->socketFd);
+                client->socketFd = -1;
+            }
+        }
+
+        if (pollCount > clientPollCount && (pollFds[clientPollCount].revents & POLLIN) != 0) {
+            AcceptServiceClient(service);
+        }
+    }
+}
+
+static int ComputeServiceThreadProc(void* arg)
+{
+    RunComputeServiceLoop(arg);
+    return 0;
+}
+
+static void DestroyComputeService(struct ComputeService* service)
+{
+    const VkDevice device = service->deviceContext->device;
+
+    for (uint32_t i = 0; i < SERVICE_MAX_CLIENT_COUNT; i++)
+    {
+        if (service->clients[i].socketFd >= 0) {
+            close(service->clients[i].socketFd);
+        }
+    }
+    if (service->listenFd >= 0)
+    {
+        close(service->listenFd);
+        unlink(service->socketPath);
+    }
+
+    for (uint32_t i = 0; i < SERVICE_MAX_BATCH_SIZE; i++) {
+        DestroyServiceJobSlot(device, &service->slots[i]);
+    }
+    DestroyComputePipelineCache(&service->pipelineCache);
+    if (service->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, service->fence, NULL);
+    }
+}
+
+// Creates the pipelines of all job sizes up front and starts listening on `socketPath`.
+// DestroyComputeService must be called even if this fails.
+static VkResult CreateComputeService(struct DeviceContext* deviceContext, const char* socketPath, struct ComputeService* service)
+{
+    memset(service, 0, sizeof(*service));
+    service->deviceContext = deviceContext;
+    service->pipelineCache.device = deviceContext->device;
+    service->listenFd = -1;
+    for (uint32_t i = 0; i < SERVICE_MAX_CLIENT_COUNT; i++) {
+        service->clients[i].socketFd = -1;
+    }
+
+    if (strlen(socketPath) >= MAX_SERVICE_SOCKET_PATH_LENGTH)
+    {
+        fprintf(stderr, "The socket path %s is too long!\n", socketPath);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    snprintf(service->socketPath, sizeof(service->socketPath), "%s", socketPath);
+
+    VkResult res = AcquireShaderModule(deviceContext, "typed_double", s_elementTypes[ELEMENT_TYPE_INT32].name, &service->pipelineCache.shaderModule);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "AcquireShaderModule failed!\n");
+        return res;
+    }
+    for (uint32_t elemCount = COMPUTE_WORKGROUP_SIZE; elemCount <= SERVICE_MAX_ELEMENT_COUNT && res == VK_SUCCESS; elemCount <<= 1)
+    {
+        const struct ComputePipelineState* state = NULL;
+        res = AcquireComputePipeline(&service->pipelineCache, elemCount, &state);
+        if (res == VK_SUCCESS) {
+            ReleaseComputePipeline(&service->pipelineCache, state);
+        }
+    }
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(deviceContext->device, &fenceCreateInfo, NULL, &service->fence);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+        return res;
+    }
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath);
+    // A socket file left behind by a previous run would make bind fail
+    unlink(socketPath);
+
+    // SOCK_SEQPACKET keeps the message boundaries, so every request and reply is received whole
+    service->listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (service->listenFd < 0 || bind(service->listenFd, (const struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(service->listenFd, SERVICE_MAX_CLIENT_COUNT) != 0)
+    {
+        fprintf(stderr, "Listening on %s failed: %d\n", socketPath, errno);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    return VK_SUCCESS;
+}
+
+struct ServiceTestClientArgs
+{
+    const char* socketPath;
+    uint32_t clientIndex;
+    bool passed;
+    struct ServiceClientStats stats;
+};
+
+struct ServiceTestPayload
+{
+    int fd;
+    int32_t* data;
+    size_t size;
+    uint32_t elemCount;
+    int firstElement;
+};
+
+// Submits SERVICE_TEST_JOBS_PER_CLIENT memfd payloads of varying sizes, keeps up to SERVICE_TEST_CLIENT_WINDOW of them in flight
+// and verifies every result in the shared memory
+static int ServiceTestClientThreadProc(void* arg)
+{
+    struct ServiceTestClientArgs* args = arg;
+    const int socketFd = ConnectServiceSocket(args->socketPath);
+    if (socketFd < 0)
+    {
+        fprintf(stderr, "Client %u failed to connect to %s: %d\n", args->clientIndex, args->socketPath, errno);
+        args->passed = false;
+        return 0;
+    }
+
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    struct ServiceTestPayload payloads[SERVICE_TEST_CLIENT_WINDOW];
+    for (uint32_t i = 0; i < SERVICE_TEST_CLIENT_WINDOW; i++) {
+        payloads[i] = (struct ServiceTestPayload){ .fd = -1, .data = NULL, .size = 0, .elemCount = 0, .firstElement = 0 };
+    }
+
+    bool passed = true;
+    uint32_t submittedCount = 0;
+    uint32_t completedCount = 0;
+    while (completedCount < SERVICE_TEST_JOBS_PER_CLIENT && passed)
+    {
+        while (submittedCount < SERVICE_TEST_JOBS_PER_CLIENT && submittedCount - completedCount < SERVICE_TEST_CLIENT_WINDOW && passed)
+        {
+            struct ServiceTestPayload* payload = &payloads[submittedCount % SERVICE_TEST_CLIENT_WINDOW];
+            // Sizes that are not multiples of the workgroup size exercise the rounding of the service
+            payload->elemCount = 1000U + (args->clientIndex * 7919U + submittedCount * 104729U) % (256U * 1024U);
+            payload->firstElement = (int)(args->clientIndex * 1000000U + submittedCount);
+            // Page sized payloads can usually be imported
+            payload->size = ((size_t)payload->elemCount * sizeof(int32_t) + pageSize - 1) / pageSize * pageSize;
+            payload->fd = memfd_create("vvb-payload", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (payload->fd >= 0 && ftruncate(payload->fd, (off_t)payload->size) == 0 &&
+                fcntl(payload->fd, F_ADD_SEALS, SERVICE_REQUIRED_PAYLOAD_SEALS) == 0)
+            {
+                void* data = mmap(NULL, payload->size, PROT_READ | PROT_WRITE, MAP_SHARED, payload->fd, 0);
+                payload->data = data != MAP_FAILED ? data : NULL;
+            }
+            if (payload->data == NULL)
+            {
+                fprintf(stderr, "Client %u failed to create a payload: %d\n", args->clientIndex, errno);
+                passed = false;
+                break;
+            }
+            InitializeSourceData(payload->data, (int)payload->elemCount, payload->firstElement);
+
+            const struct ServiceRequest request = {
+                .type = SERVICE_MESSAGE_SUBMIT,
+                .requestId = submittedCount,
+                .elemCount = payload->elemCount,
+                .reserved = 0
+            };
+            passed = SendServiceMessage(socketFd, &request, sizeof(request), payload->fd, 0);
+            submittedCount++;
+        }
+        if (!passed) {
+            break;
+        }
+
+        // The service replies to the jobs of one client in the order they were submitted
+        struct ServiceReply reply;
+        if (recv(socketFd, &reply, sizeof(reply), 0) != (ssize_t)sizeof(reply) || reply.type != SERVICE_MESSAGE_RESULT || reply.requestId != completedCount)
+        {
+            fprintf(stderr, "Client %u received an unexpected reply!\n", args->clientIndex);
+            passed = false;
+            break;
+        }
+
+        struct ServiceTestPayload* payload = &payloads[completedCount % SERVICE_TEST_CLIENT_WINDOW];
+        passed = reply.result == VK_SUCCESS;
+        for (uint32_t i = 0; i < payload->elemCount && passed; i++) {
+            passed = payload->data[i] == (payload->firstElement + (int)i) * 2;
+        }
+        if (!passed) {
+            fprintf(stderr, "Job %u of client %u failed: %d\n", completedCount, args->clientIndex, reply.result);
+        }
+
+        munmap(payload->data, payload->size);
+        close(payload->fd);
+        payload->data = NULL;
+        payload->fd = -1;
+        completedCount++;
+    }
+
+    if (passed)
+    {
+        const struct ServiceRequest request = { .type = SERVICE_MESSAGE_QUERY_STATS, .requestId = 0, .elemCount = 0, .reserved = 0 };
+        struct ServiceReply reply;
+        passed = SendServiceMessage(socketFd, &request, sizeof(request), -1, 0) && recv(socketFd, &reply, sizeof(reply), 0) == (ssize_t)sizeof(reply) &&
+            reply.type == SERVICE_MESSAGE_STATS && reply.stats.completedJobCount == SERVICE_TEST_JOBS_PER_CLIENT;
+        args->stats = reply.stats;
+    }
+
+    for (uint32_t i = 0; i < SERVICE_TEST_CLIENT_WINDOW; i++)
+    {
+        if (payloads[i].data != NULL) {
+            munmap(payloads[i].data, payloads[i].size);
+        }
+        if (payloads[i].fd >= 0) {
+            close(payloads[i].fd);
+        }
+    }
+    close(socketFd);
+
+    args->passed = passed;
+    return 0;
+}
+
+// Serves clients on `socketPath` until one of them sends SERVICE_MESSAGE_SHUTDOWN
+static bool RunComputeService(const char* socketPath)
+{
+    static struct ComputeService service;
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+
+    printf("\n================ Begin the compute service on %s ================\n\n", socketPath);
+
+    const bool passed = CreateComputeService(deviceContext, socketPath, &service) == VK_SUCCESS;
+    if (passed)
+    {
+        printf("Payloads are %s\n", deviceContext->getMemoryHostPointerProperties != NULL ?
+            "imported with VK_EXT_external_memory_host when page aligned" : "copied through staging buffers");
+        RunComputeServiceLoop(&service);
+        printf("%llu job(s) in %llu batch(es)\n", (unsigned long long)service.jobCount, (unsigned long long)service.batchCount);
+    }
+    DestroyComputeService(&service);
+
+    printf("\n================ Complete the compute service: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Starts the service on a private socket and lets `clientCount` client threads submit memfd payloads to it
+static bool RunServiceSelfTest(uint32_t clientCount)
+{
+    static struct ComputeService service;
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+    char socketPath[MAX_SERVICE_SOCKET_PATH_LENGTH];
+    snprintf(socketPath, sizeof(socketPath), "/tmp/vvb-service-%d.sock", (int)getpid());
+
+    printf("\n================ Begin the compute service test: %u client(s), %d jobs each, %s ================\n\n",
+        clientCount, SERVICE_TEST_JOBS_PER_CLIENT, socketPath);
+
+    bool passed = CreateComputeService(deviceContext, socketPath, &service) == VK_SUCCESS;
+    if (passed)
+    {
+        printf("Payloads are %s\n", deviceContext->getMemoryHostPointerProperties != NULL ?
+            "imported with VK_EXT_external_memory_host when page aligned" : "copied through staging buffers");
+    }
+
+    thrd_t serviceThread;
+    const bool serviceStarted = passed && thrd_create(&serviceThread, ComputeServiceThreadProc, &service) == thrd_success;
+    passed = serviceStarted;
+
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    struct ServiceTestClientArgs args[SERVICE_MAX_CLIENT_COUNT];
+    thrd_t threads[SERVICE_MAX_CLIENT_COUNT];
+    bool threadCreated[SERVICE_MAX_CLIENT_COUNT] = { false };
+    for (uint32_t i = 0; i < clientCount && passed; i++)
+    {
+        args[i] = (struct ServiceTestClientArgs){ .socketPath = socketPath, .clientIndex = i, .passed = false };
+        threadCreated[i] = thrd_create(&threads[i], ServiceTestClientThreadProc, &args[i]) == thrd_success;
+        if (!threadCreated[i])
+        {
+            fprintf(stderr, "thrd_create failed for client %u!\n", i);
+            passed = false;
+        }
+    }
+    for (uint32_t i = 0; i < clientCount; i++)
+    {
+        if (threadCreated[i])
+        {
+            thrd_join(threads[i], NULL);
+            passed = passed && args[i].passed;
+        }
+    }
+    const double elapsedMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+    if (serviceStarted)
+    {
+        // Stops the service the way any other client would
+        const int socketFd = ConnectServiceSocket(socketPath);
+        const struct ServiceRequest request = { .type = SERVICE_MESSAGE_SHUTDOWN, .requestId = 0, .elemCount = 0, .reserved = 0 };
+        if (socketFd < 0 || !SendServiceMessage(socketFd, &request, sizeof(request), -1, 0)) {
+            fprintf(stderr, "Failed to send the shutdown request: %d\n", errno);
+        }
+        thrd_join(serviceThread, NULL);
+        if (socketFd >= 0) {
+            close(socketFd);
+        }
+    }
+
+    if (passed)
+    {
+        printf("\n%llu job(s) in %llu batch(es), %.2f jobs per batch, %.3fms in total\n", (unsigned long long)service.jobCount,
+            (unsigned long long)service.batchCount, service.batchCount > 0 ? (double)service.jobCount / (double)service.batchCount : 0.0,
+            elapsedMilliseconds);
+    }
+    DestroyComputeService(&service);
+
+    printf("\n================ Complete the compute service test: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+#else
+
+static bool RunComputeService(const char* socketPath)
+{
+    fprintf(stderr, "The compute service needs UNIX domain sockets and memfd, it is only available on Linux!\n");
+    return false;
+}
+
+static bool RunServiceSelfTest(uint32_t clientCount)
+{
+    fprintf(stderr, "The compute service needs UNIX domain sockets and memfd, it is only available on Linux!\n");
+    return false;
+}
+
+#endif // __linux__
+
+// Runs the jobs on one backend and prints one row; `vulkanKernelMilliseconds` is the reference of the last column
+static bool MeasureBackendJobs(const char* label, uint32_t threadCount, enum COMPUTE_BACKEND backend, const struct ComputeJob jobs[],
+    struct ComputeJobResult results[], double vulkanKernelMilliseconds, double* pKernelMilliseconds)
+{
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    if (backend == COMPUTE_BACKEND_CPU)
+    {
+        ResetJobResults(results, BACKEND_BENCHMARK_JOB_COUNT);
+        RunCpuComputeJobs(jobs, results, BACKEND_BENCHMARK_JOB_COUNT, false);
+    }
+    else {
+        RunComputeJobs(jobs, results, BACKEND_BENCHMARK_JOB_COUNT, 0, false);
+    }
+    const double wallMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+
+    bool passed = true;
+    double kernelMilliseconds = 0.0;
+    for (uint32_t i = 0; i < BACKEND_BENCHMARK_JOB_COUNT; i++)
+    {
+        // A job that failed over has not measured the requested backend
+        if (!results[i].passed || results[i].backend != backend)
+        {
+            fprintf(stderr, "Job `%s` failed on the %s backend: %d\n", jobs[i].name, s_computeBackendNames[backend], results[i].result);
+            passed = false;
+        }
+        kernelMilliseconds += results[i].totalMilliseconds;
+    }
+
+    const double elementCount = (double)BACKEND_BENCHMARK_JOB_COUNT * jobs[0].iterations * jobs[0].elemCount;
+    // Every element is read once and written once
+    printf("%-40.40s %7u %10.3f %10.3f %10.2f %8.2f", label, threadCount, wallMilliseconds, kernelMilliseconds,
+        elementCount / (kernelMilliseconds * 1000.0), elementCount * 2.0 * sizeof(int) / (kernelMilliseconds * 1000000.0));
+    if (vulkanKernelMilliseconds > 0.0) {
+        printf(" %9.2fx\n", vulkanKernelMilliseconds / kernelMilliseconds);
+    }
+    else {
+        printf(" %10s\n", "-");
+    }
+
+    *pKernelMilliseconds = kernelMilliseconds;
+    return passed;
+}
+
+// Runs the same jobs on the Vulkan device, which is lavapipe with `--device=cpu`, and on the CPU backend with 1..N threads
+static bool RunBackendBenchmark(uint32_t elemCount)
+{
+    static struct ComputeJob jobs[BACKEND_BENCHMARK_JOB_COUNT];
+    static struct ComputeJobResult results[BACKEND_BENCHMARK_JOB_COUNT];
+
+    for (uint32_t i = 0; i < BACKEND_BENCHMARK_JOB_COUNT; i++)
+    {
+        memset(&jobs[i], 0, sizeof(jobs[i]));
+        snprintf(jobs[i].name, sizeof(jobs[i].name), "bench%u", i);
+        jobs[i].elemCount = elemCount;
+        jobs[i].iterations = BACKEND_BENCHMARK_ITERATIONS;
+    }
+
+    printf("\n================ Begin the backend benchmark: %d job(s) x %d iteration(s) x %u elements ================\n\n",
+        BACKEND_BENCHMARK_JOB_COUNT, BACKEND_BENCHMARK_ITERATIONS, elemCount);
+    printf("%-40s %7s %10s %10s %10s %8s %10s\n", "backend", "threads", "wall(ms)", "kernel(ms)", "Melem/s", "GB/s", "vs Vulkan");
+
+    bool passed = true;
+    double vulkanKernelMilliseconds = 0.0;
+    if (s_deviceContextCount > 0)
+    {
+        // Vulkan times include the transfers recorded with every dispatch
+        const VkPhysicalDeviceProperties* props = &s_deviceContexts[0].properties;
+        char label[64];
+        snprintf(label, sizeof(label), "vulkan: %s (%s)", props->deviceName, s_deviceTypes[props->deviceType]);
+        passed = MeasureBackendJobs(label, 0, COMPUTE_BACKEND_VULKAN, jobs, results, 0.0, &vulkanKernelMilliseconds);
+    }
+
+    const uint32_t maxThreadCount = min(s_options.cpuThreadCount > 0 ? s_options.cpuThreadCount : GetProcessorCount(),
+        (uint32_t)MAX_CPU_BACKEND_THREAD_COUNT);
+    for (uint32_t threadCount = 1; passed; threadCount = min(threadCount * 2, maxThreadCount))
+    {
+        DestroyCpuBackend(&s_cpuBackend);
+        if (!InitializeCpuBackend(&s_cpuBackend, threadCount))
+        {
+            passed = false;
+            break;
+        }
+
+        double kernelMilliseconds = 0.0;
+        passed = MeasureBackendJobs("cpu", s_cpuBackend.threadCount, COMPUTE_BACKEND_CPU, jobs, results, vulkanKernelMilliseconds, &kernelMilliseconds);
+        if (threadCount == maxThreadCount) {
+            break;
+        }
+    }
+
+    printf("\n================ Complete the backend benchmark: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// A BDA buffer placed in a block of a BufferPool. Kernels reach it only through its slot in the address table of the pool,
+// so the defragmenter can move it as long as it rewrites the slot.
+struct PooledBuffer
+{
+    bool live;
+    uint32_t blockIndex;
+    VkDeviceSize offset;
+    // Size of the VkBuffer and of its memory footprint in the block
+    VkDeviceSize size;
+    VkDeviceSize footprint;
+    VkDeviceSize alignment;
+    VkBuffer buffer;
+};
+
+struct BufferPool
+{
+    struct DeviceContext* deviceContext;
+    uint32_t memoryTypeIndex;
+    // VK_NULL_HANDLE for blocks that are not allocated; every block is BUFFER_POOL_BLOCK_SIZE bytes
+    VkDeviceMemory blocks[MAX_BUFFER_POOL_BLOCK_COUNT];
+    // Indexed by address table slot
+    struct PooledBuffer buffers[BUFFER_POOL_TABLE_SLOT_COUNT];
+    VkBuffer addressTableBuffer;
+    VkDeviceMemory addressTableMemory;
+    VkDeviceAddress* addressTable;
+    VkFence fence;
+    // Measured by the previous pass, turns the time budget of a pass into a number of bytes to move
+    double copyBytesPerMillisecond;
+};
+
+struct BufferPoolStats
+{
+    uint32_t blockCount;
+    uint32_t liveBufferCount;
+    VkDeviceSize committedBytes;
+    VkDeviceSize usedBytes;
+    VkDeviceSize freeBytes;
+    VkDeviceSize largestFreeRange;
+    uint32_t freeRangeCount;
+};
+
+struct DefragMove
+{
+    uint32_t slot;
+    struct PooledBuffer target;
+};
+
+struct DefragPassResult
+{
+    uint32_t movedBufferCount;
+    VkDeviceSize movedBytes;
+    uint32_t releasedBlockCount;
+    double milliseconds;
+};
+
+struct DefragMoveList
+{
+    const struct BufferPool* pool;
+    const struct DefragMove* moves;
+};
+
+// 0 when all free space is one range, approaching 1 as it is scattered over many small ranges
+static double GetFragmentation(const struct BufferPoolStats* stats)
+{
+    return stats->freeBytes > 0 ? 1.0 - (double)stats->largestFreeRange / (double)stats->freeBytes : 0.0;
+}
+
+static void GetBufferPoolStats(const struct BufferPool* pool, struct BufferPoolStats* pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+
+    for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT; s++)
+    {
+        if (pool->buffers[s].live)
+        {
+            pStats->liveBufferCount++;
+            pStats->usedBytes += pool->buffers[s].footprint;
+        }
+    }
+
+    for (uint32_t b = 0; b < MAX_BUFFER_POOL_BLOCK_COUNT; b++)
+    {
+        if (pool->blocks[b] == VK_NULL_HANDLE) {
+            continue;
+        }
+        pStats->blockCount++;
+        pStats->committedBytes += BUFFER_POOL_BLOCK_SIZE;
+
+        // Walks the live buffers of the block in offset order; the gaps between them are the free ranges
+        VkDeviceSize cursor = 0;
+        while (true)
+        {
+            const struct PooledBuffer* next = NULL;
+            for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT; s++)
+            {
+                const struct PooledBuffer* buffer = &pool->buffers[s];
+                if (buffer->live && buffer->blockIndex == b && buffer->offset >= cursor && (next == NULL || buffer->offset < next->offset)) {
+                    next = buffer;
+                }
+            }
+
+            const VkDeviceSize gapEnd = next != NULL ? next->offset : BUFFER_POOL_BLOCK_SIZE;
+            if (gapEnd > cursor)
+            {
+                pStats->freeRangeCount++;
+                pStats->freeBytes += gapEnd - cursor;
+                pStats->largestFreeRange = max(pStats->largestFreeRange, gapEnd - cursor);
+            }
+            if (next == NULL) {
+                break;
+            }
+            cursor = next->offset + next->footprint;
+        }
+    }
+}
+
+static bool RangesOverlap(VkDeviceSize offset1, VkDeviceSize size1, VkDeviceSize offset2, VkDeviceSize size2)
+{
+    return offset1 < offset2 + size2 && offset2 < offset1 + size1;
+}
+
+// Finds the lowest aligned offset in the block where `footprint` bytes touch neither a live buffer nor the target of a planned move
+static bool FindFreeRangeInBlock(const struct BufferPool* pool, uint32_t blockIndex, VkDeviceSize footprint, VkDeviceSize alignment,
+    const struct DefragMove plannedMoves[], uint32_t plannedMoveCount, VkDeviceSize* pOffset)
+{
+    VkDeviceSize offset = 0;
+    bool collided = true;
+    while (collided)
+    {
+        if (offset + footprint > BUFFER_POOL_BLOCK_SIZE) {
+            return false;
+        }
+
+        // There are few buffers, so every collision simply restarts the scan behind the colliding buffer
+        collided = false;
+        for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT + plannedMoveCount && !collided; s++)
+        {
+            const struct PooledBuffer* buffer = s < BUFFER_POOL_TABLE_SLOT_COUNT ? &pool->buffers[s] : &plannedMoves[s - BUFFER_POOL_TABLE_SLOT_COUNT].target;
+            if (buffer->live && buffer->blockIndex == blockIndex && RangesOverlap(offset, footprint, buffer->offset, buffer->footprint))
+            {
+                offset = (buffer->offset + buffer->footprint + alignment - 1) / alignment * alignment;
+                collided = true;
+            }
+        }
+    }
+
+    *pOffset = offset;
+    return true;
+}
+
+static VkResult CreatePoolBufferHandle(const struct BufferPool* pool, VkDeviceSize size, VkBuffer* pBuffer)
+{
+    const VkBufferCreateInfo bufCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &pool->deviceContext->queueFamilyIndex
+    };
+    const VkResult res = vkCreateBuffer(pool->deviceContext->device, &bufCreateInfo, NULL, pBuffer);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateBuffer failed: %d\n", res);
+    }
+    return res;
+}
+
+static VkResult AllocateBufferPoolBlock(struct BufferPool* pool, uint32_t blockIndex)
+{
+    const VkMemoryAllocateFlagsInfo memAllocFlagsInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+        .pNext = NULL,
+        .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+    };
+    const VkMemoryAllocateInfo memAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &memAllocFlagsInfo,
+        .allocationSize = BUFFER_POOL_BLOCK_SIZE,
+        .memoryTypeIndex = pool->memoryTypeIndex
+    };
+    const VkResult res = vkAllocateMemory(pool->deviceContext->device, &memAllocInfo, NULL, &pool->blocks[blockIndex]);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkAllocateMemory failed: %d\n", res);
+        pool->blocks[blockIndex] = VK_NULL_HANDLE;
+    }
+    else {
+        CountDeviceAllocation(memAllocInfo.allocationSize);
+    }
+    return res;
+}
+
+// Places the buffer at the lowest free range of the lowest block, allocating a block if none has room. Fails with
+// VK_ERROR_OUT_OF_DEVICE_MEMORY once all MAX_BUFFER_POOL_BLOCK_COUNT blocks are allocated, however much free space they have.
+static VkResult AllocatePooledBuffer(struct BufferPool* pool, VkDeviceSize size, uint32_t* pSlot)
+{
+    const VkDevice device = pool->deviceContext->device;
+
+    uint32_t slot = 0;
+    while (slot < BUFFER_POOL_TABLE_SLOT_COUNT && pool->buffers[slot].live) {
+        slot++;
+    }
+    if (slot == BUFFER_POOL_TABLE_SLOT_COUNT) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    struct PooledBuffer buffer = { .live = true, .size = size };
+    VkResult res = CreatePoolBufferHandle(pool, size, &buffer.buffer);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer.buffer, &memRequirements);
+    buffer.footprint = memRequirements.size;
+    buffer.alignment = memRequirements.alignment;
+
+    res = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    for (uint32_t b = 0; b < MAX_BUFFER_POOL_BLOCK_COUNT && res != VK_SUCCESS; b++)
+    {
+        if (pool->blocks[b] != VK_NULL_HANDLE && FindFreeRangeInBlock(pool, b, buffer.footprint, buffer.alignment, NULL, 0, &buffer.offset))
+        {
+            buffer.blockIndex = b;
+            res = VK_SUCCESS;
+        }
+    }
+    for (uint32_t b = 0; b < MAX_BUFFER_POOL_BLOCK_COUNT && res != VK_SUCCESS && buffer.footprint <= BUFFER_POOL_BLOCK_SIZE; b++)
+    {
+        if (pool->blocks[b] == VK_NULL_HANDLE && AllocateBufferPoolBlock(pool, b) == VK_SUCCESS)
+        {
+            buffer.blockIndex = b;
+            buffer.offset = 0;
+            res = VK_SUCCESS;
+        }
+    }
+    if (res == VK_SUCCESS) {
+        res = vkBindBufferMemory(device, buffer.buffer, pool->blocks[buffer.blockIndex], buffer.offset);
+    }
+    if (res != VK_SUCCESS)
+    {
+        vkDestroyBuffer(device, buffer.buffer, NULL);
+        return res;
+    }
+
+    pool->buffers[slot] = buffer;
+    pool->addressTable[slot] = GetBufferDeviceAddress(device, buffer.buffer);
+    *pSlot = slot;
+    return VK_SUCCESS;
+}
+
+static void FreePooledBuffer(struct BufferPool* pool, uint32_t slot)
+{
+    vkDestroyBuffer(pool->deviceContext->device, pool->buffers[slot].buffer, NULL);
+    memset(&pool->buffers[slot], 0, sizeof(pool->buffers[slot]));
+    pool->addressTable[slot] = 0;
+}
+
+static void DestroyBufferPool(struct BufferPool* pool)
+{
+    if (pool->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = pool->deviceContext->device;
+
+    for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT; s++)
+    {
+        if (pool->buffers[s].live) {
+            vkDestroyBuffer(device, pool->buffers[s].buffer, NULL);
+        }
+    }
+    for (uint32_t b = 0; b < MAX_BUFFER_POOL_BLOCK_COUNT; b++)
+    {
+        if (pool->blocks[b] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, pool->blocks[b], NULL);
+        }
+    }
+    if (pool->addressTableBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, pool->addressTableBuffer, NULL);
+    }
+    if (pool->addressTableMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, pool->addressTableMemory, NULL);
+    }
+    if (pool->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, pool->fence, NULL);
+    }
+    memset(pool, 0, sizeof(*pool));
+}
+
+static VkResult CreateBufferPool(struct DeviceContext* deviceContext, struct BufferPool* pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->deviceContext = deviceContext;
+    pool->copyBytesPerMillisecond = DEFRAG_INITIAL_COPY_BYTES_PER_MILLISECOND;
+    const VkDevice device = deviceContext->device;
+
+    // All pooled buffers have the same usage, so a probe buffer tells which memory types the blocks can use
+    VkBuffer probeBuffer = VK_NULL_HANDLE;
+    VkResult res = CreatePoolBufferHandle(pool, DEFRAG_MIN_BUFFER_SIZE, &probeBuffer);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, probeBuffer, &memRequirements);
+    vkDestroyBuffer(device, probeBuffer, NULL);
+
+    pool->memoryTypeIndex = FindMemoryTypeIndex(&deviceContext->memoryProperties, memRequirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, BUFFER_POOL_BLOCK_SIZE);
+    if (pool->memoryTypeIndex == UINT32_MAX)
+    {
+        fprintf(stderr, "No device local memory type for the buffer pool!\n");
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    res = CreateBufferWithMemory(deviceContext, BUFFER_POOL_TABLE_SLOT_COUNT * sizeof(VkDeviceAddress), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pool->addressTableBuffer, &pool->addressTableMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    res = vkMapMemory(device, pool->addressTableMemory, 0, VK_WHOLE_SIZE, 0, (void**)&pool->addressTable);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    memset(pool->addressTable, 0, BUFFER_POOL_TABLE_SLOT_COUNT * sizeof(VkDeviceAddress));
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &pool->fence);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+    }
+
+    return res;
+}
+
+static void RecordDefragMoves(const void* userData, VkCommandBuffer commandBuffer, uint32_t moveCount)
+{
+    const struct DefragMoveList* moveList = userData;
+    for (uint32_t i = 0; i < moveCount; i++)
+    {
+        const struct DefragMove* move = &moveList->moves[i];
+        const VkBufferCopy copyRegion = {
+            .srcOffset = 0,
+            .dstOffset = 0,
+            .size = move->target.size
+        };
+        vkCmdCopyBuffer(commandBuffer, moveList->pool->buffers[move->slot].buffer, move->target.buffer, 1, &copyRegion);
+    }
+    // Later submissions may read and write the moved buffers in any stage
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+}
+
+// Places `buffer1` after `buffer2` in pool order: by block, then by offset
+static bool IsPlacedAfter(const struct PooledBuffer* buffer1, const struct PooledBuffer* buffer2)
+{
+    return buffer1->blockIndex != buffer2->blockIndex ? buffer1->blockIndex > buffer2->blockIndex : buffer1->offset > buffer2->offset;
+}
+
+// One incremental step of the defragmenter, to be called while no submitted work uses the pool. Plans moves of the buffers
+// at the end of the pool into the lowest free ranges until the budget is used up, copies them on the GPU in one submission,
+// then rewrites their table slots and releases the blocks that became empty. Kernels recorded afterwards see the new addresses.
+static VkResult RunDefragmentationPass(struct BufferPool* pool, double budgetMilliseconds, struct DefragPassResult* pResult)
+{
+    const VkDevice device = pool->deviceContext->device;
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    const double byteBudget = budgetMilliseconds * pool->copyBytesPerMillisecond;
+    memset(pResult, 0, sizeof(*pResult));
+
+    struct DefragMove moves[BUFFER_POOL_TABLE_SLOT_COUNT];
+    uint32_t moveCount = 0;
+    bool considered[BUFFER_POOL_TABLE_SLOT_COUNT] = { false };
+    while (true)
+    {
+        uint32_t slot = UINT32_MAX;
+        for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT; s++)
+        {
+            if (pool->buffers[s].live && !considered[s] && (slot == UINT32_MAX || IsPlacedAfter(&pool->buffers[s], &pool->buffers[slot]))) {
+                slot = s;
+            }
+        }
+        if (slot == UINT32_MAX) {
+            break;
+        }
+        considered[slot] = true;
+
+        // The first move is always made, so that a pass makes progress with any budget
+        const struct PooledBuffer* source = &pool->buffers[slot];
+        const double elapsedMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+        if (moveCount > 0 && ((double)(pResult->movedBytes + source->size) > byteBudget || elapsedMilliseconds > budgetMilliseconds)) {
+            break;
+        }
+
+        struct PooledBuffer target = *source;
+        bool found = false;
+        for (uint32_t b = 0; b <= source->blockIndex && !found; b++)
+        {
+            found = pool->blocks[b] != VK_NULL_HANDLE &&
+                FindFreeRangeInBlock(pool, b, source->footprint, source->alignment, moves, moveCount, &target.offset) &&
+                (b < source->blockIndex || target.offset < source->offset);
+            target.blockIndex = b;
+        }
+        if (!found) {
+            continue;
+        }
+
+        VkResult res = CreatePoolBufferHandle(pool, source->size, &target.buffer);
+        if (res == VK_SUCCESS)
+        {
+            res = vkBindBufferMemory(device, target.buffer, pool->blocks[target.blockIndex], target.offset);
+            if (res != VK_SUCCESS)
+            {
+                fprintf(stderr, "vkBindBufferMemory failed: %d\n", res);
+                vkDestroyBuffer(device, target.buffer, NULL);
+            }
+        }
+        if (res != VK_SUCCESS) {
+            break;
+        }
+
+        moves[moveCount++] = (struct DefragMove){ .slot = slot, .target = target };
+        pResult->movedBytes += source->size;
+    }
+
+    VkResult res = VK_SUCCESS;
+    if (moveCount > 0)
+    {
+        const struct DefragMoveList moveList = { .pool = pool, .moves = moves };
+        const uint64_t copyBeginTime = GetCurrentTimeNanoseconds();
+        res = SubmitOneTimeCommands(pool->deviceContext, pool->fence, RecordDefragMoves, &moveList, moveCount);
+        const double copyMilliseconds = (double)(GetCurrentTimeNanoseconds() - copyBeginTime) / 1000000.0;
+
+        for (uint32_t i = 0; i < moveCount; i++)
+        {
+            const struct DefragMove* move = &moves[i];
+            // A failed copy leaves every buffer where it was
+            if (res != VK_SUCCESS)
+            {
+                vkDestroyBuffer(device, move->target.buffer, NULL);
+                continue;
+            }
+            vkDestroyBuffer(device, pool->buffers[move->slot].buffer, NULL);
+            pool->buffers[move->slot] = move->target;
+            pool->addressTable[move->slot] = GetBufferDeviceAddress(device, move->target.buffer);
+        }
+
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+        pResult->movedBufferCount = moveCount;
+        if (copyMilliseconds > 0.0) {
+            pool->copyBytesPerMillisecond = (double)pResult->movedBytes / copyMilliseconds;
+        }
+    }
+
+    for (uint32_t b = 0; b < MAX_BUFFER_POOL_BLOCK_COUNT; b++)
+    {
+        bool empty = pool->blocks[b] != VK_NULL_HANDLE;
+        for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT && empty; s++) {
+            empty = !pool->buffers[s].live || pool->buffers[s].blockIndex != b;
+        }
+        if (empty)
+        {
+            vkFreeMemory(device, pool->blocks[b], NULL);
+            pool->blocks[b] = VK_NULL_HANDLE;
+            pResult->releasedBlockCount++;
+        }
+    }
+
+    pResult->milliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+    return res;
+}
+
+// Every word of the buffer in slot `slot` holds this value
+static uint32_t GetDefragPattern(uint32_t slot)
+{
+    return 0x9E3779B9U * (slot + 1);
+}
+
+// Fills the buffer in slot `arg`, or all buffers when `arg` is UINT32_MAX
+static void RecordPooledBufferFills(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg)
+{
+    const struct BufferPool* pool = userData;
+    for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT; s++)
+    {
+        if (pool->buffers[s].live && (arg == UINT32_MAX || arg == s)) {
+            vkCmdFillBuffer(commandBuffer, pool->buffers[s].buffer, 0, VK_WHOLE_SIZE, GetDefragPattern(s));
+        }
+    }
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+}
+
+struct PooledBufferReadback
+{
+    VkBuffer source;
+    VkBuffer readbackBuffer;
+    VkDeviceSize size;
+};
+
+static void RecordPooledBufferReadback(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg)
+{
+    const struct PooledBufferReadback* readback = userData;
+    const VkBufferCopy copyRegion = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = readback->size
+    };
+    vkCmdCopyBuffer(commandBuffer, readback->source, readback->readbackBuffer, 1, &copyRegion);
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// Checks that every table slot holds the address of its buffer and that the buffer still holds the pattern of the slot
+static bool VerifyBufferPool(struct BufferPool* pool)
+{
+    struct DeviceContext* deviceContext = pool->deviceContext;
+    const VkDevice device = deviceContext->device;
+
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+    const uint32_t* readbackData = NULL;
+    bool passed = CreateBufferWithMemory(deviceContext, DEFRAG_LARGE_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, &readbackMemory) == VK_SUCCESS &&
+        vkMapMemory(device, readbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&readbackData) == VK_SUCCESS;
+
+    for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT && passed; s++)
+    {
+        const struct PooledBuffer* buffer = &pool->buffers[s];
+        if (!buffer->live) {
+            continue;
+        }
+        if (pool->addressTable[s] != GetBufferDeviceAddress(device, buffer->buffer))
+        {
+            fprintf(stderr, "Address table slot %u does not hold the address of its buffer!\n", s);
+            passed = false;
+            break;
+        }
+
+        const struct PooledBufferReadback readback = { .source = buffer->buffer, .readbackBuffer = readbackBuffer, .size = buffer->size };
+        passed = SubmitOneTimeCommands(deviceContext, pool->fence, RecordPooledBufferReadback, &readback, 0) == VK_SUCCESS;
+        for (VkDeviceSize i = 0; i < buffer->size / sizeof(uint32_t) && passed; i++)
+        {
+            if (readbackData[i] != GetDefragPattern(s))
+            {
+                fprintf(stderr, "The buffer of slot %u holds 0x%08X @ %llu instead of 0x%08X!\n", s, readbackData[i], (unsigned long long)i,
+                    GetDefragPattern(s));
+                passed = false;
+            }
+        }
+    }
+
+    if (readbackBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, readbackBuffer, NULL);
+    }
+    if (readbackMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, readbackMemory, NULL);
+    }
+    return passed;
+}
+
+static void PrintBufferPoolStats(const char* label, const struct BufferPool* pool)
+{
+    struct BufferPoolStats stats;
+    GetBufferPoolStats(pool, &stats);
+    printf("%-24s %3u buffer(s) in %u block(s), %6.1fMB used, %6.1fMB free in %3u range(s), largest %5.1fMB, fragmentation %.3f\n",
+        label, stats.liveBufferCount, stats.blockCount, (double)stats.usedBytes / (1024.0 * 1024.0), (double)stats.freeBytes / (1024.0 * 1024.0),
+        stats.freeRangeCount, (double)stats.largestFreeRange / (1024.0 * 1024.0), GetFragmentation(&stats));
+}
+
+// Fills a pool with buffers of mixed sizes and frees every other one, so that a large allocation fails although the free space
+// would hold it many times. Then defragments in passes of `budgetMilliseconds` until the allocation succeeds and nothing moves
+// anymore, and verifies every buffer through its table slot.
+static bool RunDefragmentationTest(uint32_t budgetMilliseconds)
+{
+    static struct BufferPool pool;
+
+    printf("\n================ Begin the defragmentation test: %d blocks of %dMB, %ums per pass ================\n\n",
+        MAX_BUFFER_POOL_BLOCK_COUNT, BUFFER_POOL_BLOCK_SIZE / (1024 * 1024), budgetMilliseconds);
+
+    bool passed = CreateBufferPool(&s_deviceContexts[0], &pool) == VK_SUCCESS;
+
+    // Sizes from DEFRAG_MIN_BUFFER_SIZE to 32 times that, from a fixed seed so that every run fragments alike
+    uint32_t seed = 12345U;
+    uint32_t slot = 0;
+    while (passed)
+    {
+        seed = seed * 1664525U + 1013904223U;
+        const VkResult res = AllocatePooledBuffer(&pool, (VkDeviceSize)DEFRAG_MIN_BUFFER_SIZE << ((seed >> 16) % 6), &slot);
+        if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY || res == VK_ERROR_TOO_MANY_OBJECTS) {
+            break;
+        }
+        passed = res == VK_SUCCESS;
+    }
+    passed = passed && SubmitOneTimeCommands(pool.deviceContext, pool.fence, RecordPooledBufferFills, &pool, UINT32_MAX) == VK_SUCCESS;
+    if (passed) {
+        PrintBufferPoolStats("Filled:", &pool);
+    }
+
+    for (uint32_t s = 0; s < BUFFER_POOL_TABLE_SLOT_COUNT && passed; s += 2)
+    {
+        if (pool.buffers[s].live) {
+            FreePooledBuffer(&pool, s);
+        }
+    }
+
+    uint32_t largeSlot = UINT32_MAX;
+    if (passed)
+    {
+        PrintBufferPoolStats("Every other one freed:", &pool);
+        if (AllocatePooledBuffer(&pool, DEFRAG_LARGE_BUFFER_SIZE, &largeSlot) == VK_SUCCESS) {
+            printf("A %dMB buffer fits without defragmentation\n", DEFRAG_LARGE_BUFFER_SIZE / (1024 * 1024));
+        }
+        else {
+            printf("A %dMB buffer does not fit before defragmentation\n", DEFRAG_LARGE_BUFFER_SIZE / (1024 * 1024));
+        }
+    }
+
+    // Each pass would run while the queue is idle, e.g. between frames or batches of jobs
+    uint32_t passCount = 0;
+    uint32_t totalMovedCount = 0;
+    VkDeviceSize totalMovedBytes = 0;
+    double totalMilliseconds = 0.0;
+    while (passed && passCount < DEFRAG_MAX_PASS_COUNT)
+    {
+        struct DefragPassResult passResult;
+        passed = RunDefragmentationPass(&pool, (double)budgetMilliseconds, &passResult) == VK_SUCCESS;
+        if (!passed || (passResult.movedBufferCount == 0 && passResult.releasedBlockCount == 0)) {
+            break;
+        }
+
+        passCount++;
+        totalMovedCount += passResult.movedBufferCount;
+        totalMovedBytes += passResult.movedBytes;
+        totalMilliseconds += passResult.milliseconds;
+
+        struct BufferPoolStats stats;
+        GetBufferPoolStats(&pool, &stats);
+        printf("Pass %3u: moved %3u buffer(s), %6.2fMB in %8.3fms, released %u block(s), fragmentation %.3f, largest free %5.1fMB\n",
+            passCount, passResult.movedBufferCount, (double)passResult.movedBytes / (1024.0 * 1024.0), passResult.milliseconds,
+            passResult.releasedBlockCount, GetFragmentation(&stats), (double)stats.largestFreeRange / (1024.0 * 1024.0));
+
+        if (largeSlot == UINT32_MAX && AllocatePooledBuffer(&pool, DEFRAG_LARGE_BUFFER_SIZE, &largeSlot) == VK_SUCCESS) {
+            printf("A %dMB buffer fits after pass %u\n", DEFRAG_LARGE_BUFFER_SIZE / (1024 * 1024), passCount);
+        }
+    }
+
+    if (passed)
+    {
+        printf("%u pass(es) moved %u buffer(s), %.2fMB in %.3fms\n", passCount, totalMovedCount, (double)totalMovedBytes / (1024.0 * 1024.0),
+            totalMilliseconds);
+        PrintBufferPoolStats("Defragmented:", &pool);
+        if (largeSlot == UINT32_MAX && AllocatePooledBuffer(&pool, DEFRAG_LARGE_BUFFER_SIZE, &largeSlot) != VK_SUCCESS)
+        {
+            fprintf(stderr, "The %dMB buffer still does not fit after defragmentation!\n", DEFRAG_LARGE_BUFFER_SIZE / (1024 * 1024));
+            passed = false;
+        }
+    }
+
+    // The large buffer gets its pattern too, then every buffer, moved or not, is checked through its table slot
+    passed = passed && SubmitOneTimeCommands(pool.deviceContext, pool.fence, RecordPooledBufferFills, &pool, largeSlot) == VK_SUCCESS;
+    passed = passed && VerifyBufferPool(&pool);
+
+    DestroyBufferPool(&pool);
+
+    printf("\n================ Complete the defragmentation test: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// A workload trace as written to disk, all fields in host byte order: TraceHeader, the buffer, pipeline and dispatch records,
+// then the initial contents of every buffer whose contentSize is not 0, in buffer order
+struct TraceHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t bufferCount;
+    uint32_t pipelineCount;
+    uint32_t dispatchCount;
+    uint32_t reserved;
+};
+
+struct TraceBufferRecord
+{
+    uint64_t size;
+    // Size of the dedicated allocation; the opaque memory address is only honored for an allocation of the same size
+    uint64_t allocationSize;
+    uint64_t deviceAddress;
+    uint64_t bufferOpaqueAddress;
+    uint64_t memoryOpaqueAddress;
+    // The opaque memory address is only valid for the memory type it was captured from
+    uint32_t memoryTypeIndex;
+    uint32_t reserved;
+    // 0 for buffers that start zeroed
+    uint64_t contentSize;
+    // FNV-1a of the contents after the dispatch sequence
+    uint64_t finalHash;
+};
+
+// Kernels with the layout of test.comp.glsl: the address table in a storage buffer at set 0 binding 0, the element count in constant 0
+struct TracePipelineRecord
+{
+    char shaderName[MAX_TRACE_NAME_LENGTH];
+    // Empty for the default variant
+    char variant[MAX_TRACE_NAME_LENGTH];
+    uint32_t elemCount;
+    uint32_t reserved;
+};
+
+struct TraceDispatchRecord
+{
+    uint32_t pipelineIndex;
+    // The buffer bound as the address table
+    uint32_t tableBufferIndex;
+    uint32_t groupCountX;
+    uint32_t reserved;
+    struct TestKernelChunk chunk;
+};
+
+struct WorkloadTrace
+{
+    struct TraceHeader header;
+    struct TraceBufferRecord buffers[MAX_TRACE_BUFFER_COUNT];
+    // Initial contents of the buffers, NULL for zeroed ones
+    void* contents[MAX_TRACE_BUFFER_COUNT];
+    struct TracePipelineRecord pipelines[MAX_TRACE_PIPELINE_COUNT];
+    struct TraceDispatchRecord dispatches[MAX_TRACE_DISPATCH_COUNT];
+};
+
+// Device objects of a trace, created by the capture session or recreated by the replayer
+struct TraceResources
+{
+    struct DeviceContext* deviceContext;
+    const struct WorkloadTrace* trace;
+    VkBuffer buffers[MAX_TRACE_BUFFER_COUNT];
+    VkDeviceMemory memories[MAX_TRACE_BUFFER_COUNT];
+    // Holds the initial contents of all buffers back to back, uploaded at the beginning of every execution
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    VkPipeline pipelines[MAX_TRACE_PIPELINE_COUNT];
+    VkPipelineLayout pipelineLayouts[MAX_TRACE_PIPELINE_COUNT];
+    VkDescriptorSetLayout descriptorSetLayouts[MAX_TRACE_PIPELINE_COUNT];
+    VkDescriptorPool descriptorPools[MAX_TRACE_DISPATCH_COUNT];
+    VkDescriptorSet descriptorSets[MAX_TRACE_DISPATCH_COUNT];
+    VkFence fence;
+};
+
+static uint64_t HashTraceContents(const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void FreeWorkloadTrace(struct WorkloadTrace* trace)
+{
+    for (uint32_t i = 0; i < MAX_TRACE_BUFFER_COUNT; i++) {
+        free(trace->contents[i]);
+    }
+    memset(trace, 0, sizeof(*trace));
+}
+
+static bool WriteWorkloadTrace(const char* filePath, const struct WorkloadTrace* trace, size_t* pFileSize)
+{
+    FILE* fp = OpenFileWithWrite(filePath);
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Failed to create the trace file `%s`!\n", filePath);
+        return false;
+    }
+
+    const struct TraceHeader* header = &trace->header;
+    bool succeeded = fwrite(header, sizeof(*header), 1, fp) == 1 &&
+        fwrite(trace->buffers, sizeof(trace->buffers[0]), header->bufferCount, fp) == header->bufferCount &&
+        fwrite(trace->pipelines, sizeof(trace->pipelines[0]), header->pipelineCount, fp) == header->pipelineCount &&
+        fwrite(trace->dispatches, sizeof(trace->dispatches[0]), header->dispatchCount, fp) == header->dispatchCount;
+    for (uint32_t i = 0; i < header->bufferCount && succeeded; i++)
+    {
+        const size_t contentSize = (size_t)trace->buffers[i].contentSize;
+        succeeded = contentSize == 0 || fwrite(trace->contents[i], 1, contentSize, fp) == contentSize;
+    }
+
+    *pFileSize = (size_t)ftell(fp);
+    fclose(fp);
+    if (!succeeded) {
+        fprintf(stderr, "Failed to write the trace file `%s`!\n", filePath);
+    }
+    return succeeded;
+}
+
+// Rejects traces whose records refer to objects they do not contain, so the replayer can index them without further checks
+static bool ValidateWorkloadTrace(const struct WorkloadTrace* trace)
+{
+    for (uint32_t i = 0; i < trace->header.bufferCount; i++)
+    {
+        const struct TraceBufferRecord* buffer = &trace->buffers[i];
+        if (buffer->size == 0 || buffer->size > buffer->allocationSize || (buffer->contentSize != 0 && buffer->contentSize != buffer->size) ||
+            buffer->memoryTypeIndex >= VK_MAX_MEMORY_TYPES) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < trace->header.pipelineCount; i++)
+    {
+        const struct TracePipelineRecord* pipeline = &trace->pipelines[i];
+        if (memchr(pipeline->shaderName, '\0', sizeof(pipeline->shaderName)) == NULL || memchr(pipeline->variant, '\0', sizeof(pipeline->variant)) == NULL ||
+            pipeline->elemCount == 0) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < trace->header.dispatchCount; i++)
+    {
+        const struct TraceDispatchRecord* dispatch = &trace->dispatches[i];
+        if (dispatch->pipelineIndex >= trace->header.pipelineCount || dispatch->tableBufferIndex >= trace->header.bufferCount ||
+            dispatch->groupCountX == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ReadWorkloadTrace(const char* filePath, struct WorkloadTrace* trace)
+{
+    memset(trace, 0, sizeof(*trace));
+
+    FILE* fp = OpenFileWithRead(filePath);
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Failed to open the trace file `%s`!\n", filePath);
+        return false;
+    }
+
+    struct TraceHeader* header = &trace->header;
+    bool succeeded = fread(header, sizeof(*header), 1, fp) == 1 && memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == TRACE_VERSION && header->bufferCount <= MAX_TRACE_BUFFER_COUNT && header->pipelineCount <= MAX_TRACE_PIPELINE_COUNT &&
+        header->dispatchCount <= MAX_TRACE_DISPATCH_COUNT;
+    succeeded = succeeded &&
+        fread(trace->buffers, sizeof(trace->buffers[0]), header->bufferCount, fp) == header->bufferCount &&
+        fread(trace->pipelines, sizeof(trace->pipelines[0]), header->pipelineCount, fp) == header->pipelineCount &&
+        fread(trace->dispatches, sizeof(trace->dispatches[0]), header->dispatchCount, fp) == header->dispatchCount &&
+        ValidateWorkloadTrace(trace);
+    for (uint32_t i = 0; i < header->bufferCount && succeeded; i++)
+    {
+        const size_t contentSize = (size_t)trace->buffers[i].contentSize;
+        if (contentSize == 0) {
+            continue;
+        }
+        trace->contents[i] = malloc(contentSize);
+        succeeded = trace->contents[i] != NULL && fread(trace->contents[i], 1, contentSize, fp) == contentSize;
+    }
+
+    fclose(fp);
+    if (!succeeded)
+    {
+        fprintf(stderr, "`%s` is not a valid trace file!\n", filePath);
+        FreeWorkloadTrace(trace);
+    }
+    return succeeded;
+}
+
+static void DestroyTraceResources(struct TraceResources* resources)
+{
+    if (resources->deviceContext == NULL) {
+        return;
+    }
+    const VkDevice device = resources->deviceContext->device;
+
+    for (uint32_t i = 0; i < MAX_TRACE_DISPATCH_COUNT; i++)
+    {
+        if (resources->descriptorPools[i] != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(device, resources->descriptorPools[i], NULL);
+        }
+    }
+    for (uint32_t i = 0; i < MAX_TRACE_PIPELINE_COUNT; i++)
+    {
+        if (resources->pipelines[i] != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, resources->pipelines[i], NULL);
+        }
+        if (resources->pipelineLayouts[i] != VK_NULL_HANDLE) {
+            vkDestroyPipelineLayout(device, resources->pipelineLayouts[i], NULL);
+        }
+        if (resources->descriptorSetLayouts[i] != VK_NULL_HANDLE) {
+            vkDestroyDescriptorSetLayout(device, resources->descriptorSetLayouts[i], NULL);
+        }
+    }
+    for (uint32_t i = 0; i < MAX_TRACE_BUFFER_COUNT; i++)
+    {
+        if (resources->buffers[i] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, resources->buffers[i], NULL);
+        }
+        if (resources->memories[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(device, resources->memories[i], NULL);
+        }
+    }
+    if (resources->stagingBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, resources->stagingBuffer, NULL);
+    }
+    if (resources->stagingMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, resources->stagingMemory, NULL);
+    }
+    if (resources->fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device, resources->fence, NULL);
+    }
+    memset(resources, 0, sizeof(*resources));
+}
+
+// Creates every buffer of the trace with a dedicated allocation that allows capture and replay of its address.
+// When capturing, the addresses and memory types the driver picked are recorded in the trace. When replaying, the recorded opaque
+// addresses are requested from the recorded memory types, and the resulting device addresses must equal the captured ones, or
+// pointers stored in buffer contents would dangle.
+// Replayed buffers must be created before any other allocation with an address, which could occupy the captured ranges.
+static VkResult CreateTraceBuffers(struct DeviceContext* deviceContext, struct WorkloadTrace* trace, bool replay, struct TraceResources* resources)
+{
+    const VkDevice device = deviceContext->device;
+    memset(resources, 0, sizeof(*resources));
+    resources->deviceContext = deviceContext;
+    resources->trace = trace;
+
+    if (deviceContext->getBufferOpaqueCaptureAddress == NULL)
+    {
+        fprintf(stderr, "The current device does not support bufferDeviceAddressCaptureReplay!\n");
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    }
+
+    for (uint32_t i = 0; i < trace->header.bufferCount; i++)
+    {
+        struct TraceBufferRecord* record = &trace->buffers[i];
+
+        const VkBufferOpaqueCaptureAddressCreateInfo opaqueAddressCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_OPAQUE_CAPTURE_ADDRESS_CREATE_INFO,
+            .pNext = NULL,
+            .opaqueCaptureAddress = record->bufferOpaqueAddress
+        };
+        const VkBufferCreateInfo bufCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext = replay ? &opaqueAddressCreateInfo : NULL,
+            .flags = VK_BUFFER_CREATE_DEVICE_ADDRESS_CAPTURE_REPLAY_BIT,
+            .size = record->size,
+            .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 1,
+            .pQueueFamilyIndices = &deviceContext->queueFamilyIndex
+        };
+        VkResult res = vkCreateBuffer(device, &bufCreateInfo, NULL, &resources->buffers[i]);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkCreateBuffer failed: %d\n", res);
+            return res;
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, resources->buffers[i], &memRequirements);
+        if (!replay)
+        {
+            record->allocationSize = memRequirements.size;
+            record->memoryTypeIndex = FindMemoryTypeIndex(&deviceContext->memoryProperties, memRequirements.memoryTypeBits,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, record->allocationSize);
+            if (record->memoryTypeIndex == UINT32_MAX)
+            {
+                fprintf(stderr, "No device local memory type for trace buffer %u!\n", i);
+                return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+            }
+        }
+        else if (record->memoryTypeIndex >= deviceContext->memoryProperties.memoryTypeCount ||
+            (memRequirements.memoryTypeBits & (1U << record->memoryTypeIndex)) == 0 || memRequirements.size > record->allocationSize)
+        {
+            fprintf(stderr, "Trace buffer %u cannot be recreated in its captured memory type %u! Traces only replay on the driver that captured them.\n",
+                i, record->memoryTypeIndex);
+            return VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS;
+        }
+
+        const VkMemoryOpaqueCaptureAddressAllocateInfo opaqueAddressAllocInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_OPAQUE_CAPTURE_ADDRESS_ALLOCATE_INFO,
+            .pNext = NULL,
+            .opaqueCaptureAddress = record->memoryOpaqueAddress
+        };
+        const VkMemoryAllocateFlagsInfo memAllocFlagsInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+            .pNext = replay ? &opaqueAddressAllocInfo : NULL,
+            .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_CAPTURE_REPLAY_BIT
+        };
+        const VkMemoryAllocateInfo memAllocInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = &memAllocFlagsInfo,
+            .allocationSize = record->allocationSize,
+            .memoryTypeIndex = record->memoryTypeIndex
+        };
+        res = vkAllocateMemory(device, &memAllocInfo, NULL, &resources->memories[i]);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkAllocateMemory for trace buffer %u failed: %d\n", i, res);
+            return res;
+        }
+        res = vkBindBufferMemory(device, resources->buffers[i], resources->memories[i], 0);
+        if (res != VK_SUCCESS)
+        {
+            fprintf(stderr, "vkBindBufferMemory failed: %d\n", res);
+            return res;
+        }
+
+        const VkDeviceAddress deviceAddress = GetBufferDeviceAddress(device, resources->buffers[i]);
+        if (replay)
+        {
+            if (deviceAddress != record->deviceAddress)
+            {
+                fprintf(stderr, "Trace buffer %u was recreated at 0x%016llX instead of 0x%016llX! Traces only replay on the driver that captured them.\n",
+                    i, (unsigned long long)deviceAddress, (unsigned long long)record->deviceAddress);
+                return VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS;
+            }
+            continue;
+        }
+
+        const VkBufferDeviceAddressInfo bufferAddressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .pNext = NULL,
+            .buffer = resources->buffers[i]
+        };
+        const VkDeviceMemoryOpaqueCaptureAddressInfo memoryAddressInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_MEMORY_OPAQUE_CAPTURE_ADDRESS_INFO,
+            .pNext = NULL,
+            .memory = resources->memories[i]
+        };
+        record->deviceAddress = deviceAddress;
+        record->bufferOpaqueAddress = deviceContext->getBufferOpaqueCaptureAddress(device, &bufferAddressInfo);
+        record->memoryOpaqueAddress = deviceContext->getDeviceMemoryOpaqueCaptureAddress(device, &memoryAddressInfo);
+    }
+
+    return VK_SUCCESS;
+}
+
+// Creates the staging buffer with the initial contents, the pipelines and one descriptor set per dispatch
+static VkResult PrepareTraceExecution(struct TraceResources* resources)
+{
+    struct DeviceContext* deviceContext = resources->deviceContext;
+    const struct WorkloadTrace* trace = resources->trace;
+    const VkDevice device = deviceContext->device;
+
+    VkDeviceSize stagingSize = 0;
+    for (uint32_t i = 0; i < trace->header.bufferCount; i++) {
+        stagingSize += trace->buffers[i].contentSize;
+    }
+    VkResult res = CreateBufferWithMemory(deviceContext, max(stagingSize, (VkDeviceSize)sizeof(uint32_t)), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &resources->stagingBuffer, &resources->stagingMemory);
+    if (res != VK_SUCCESS) {
+        return res;
+    }
+    uint8_t* stagingData = NULL;
+    res = vkMapMemory(device, resources->stagingMemory, 0, VK_WHOLE_SIZE, 0, (void**)&stagingData);
+    if (res != VK_SUCCESS)
+    {
+        fprintf(stderr, "vkMapMemory failed: %d\n", res);
+        return res;
+    }
+    for (uint32_t i = 0; i < trace->header.bufferCount; i++)
+    {
+        if (trace->buffers[i].contentSize > 0)
+        {
+            memcpy(stagingData, trace->contents[i], (size_t)trace->buffers[i].contentSize);
+            stagingData += trace->buffers[i].contentSize;
+        }
+    }
+    vkUnmapMemory(device, resources->stagingMemory);
+
+    for (uint32_t i = 0; i < trace->header.pipelineCount; i++)
+    {
+        const struct TracePipelineRecord* record = &trace->pipelines[i];
+        VkShaderModule shaderModule = VK_NULL_HANDLE;
+        res = AcquireShaderModule(deviceContext, record->shaderName, record->variant[0] != '\0' ? record->variant : NULL, &shaderModule);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+        res = CreateComputePipeline(device, shaderModule, &resources->pipelines[i], &resources->pipelineLayouts[i], &resources->descriptorSetLayouts[i],
+            record->elemCount);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+    }
+
+    for (uint32_t i = 0; i < trace->header.dispatchCount; i++)
+    {
+        const struct TraceDispatchRecord* record = &trace->dispatches[i];
+        res = CreateDescriptorSets(device, resources->buffers[record->tableBufferIndex], trace->buffers[record->tableBufferIndex].size,
+            resources->descriptorSetLayouts[record->pipelineIndex], &resources->descriptorPools[i], &resources->descriptorSets[i]);
+        if (res != VK_SUCCESS) {
+            return res;
+        }
+    }
+
+    const VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0
+    };
+    res = vkCreateFence(device, &fenceCreateInfo, NULL, &resources->fence);
+    if (res != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateFence failed: %d\n", res);
+    }
+
+    return res;
+}
+
+// Restores the initial contents of all buffers, then runs the dispatch sequence in order
+static void RecordTraceExecution(const void* userData, VkCommandBuffer commandBuffer, uint32_t arg)
+{
+    const struct TraceResources* resources = userData;
+    const struct WorkloadTrace* trace = resources->trace;
+
+    VkDeviceSize stagingOffset = 0;
+    for (uint32_t i = 0; i < trace->header.bufferCount; i++)
+    {
+        const struct TraceBufferRecord* record = &trace->buffers[i];
+        if (record->contentSize == 0)
+        {
+            vkCmdFillBuffer(commandBuffer, resources->buffers[i], 0, VK_WHOLE_SIZE, 0);
+            continue;
+        }
+        const VkBufferCopy copyRegion = {
+            .srcOffset = stagingOffset,
+            .dstOffset = 0,
+            .size = record->contentSize
+        };
+        vkCmdCopyBuffer(commandBuffer, resources->stagingBuffer, resources->buffers[i], 1, &copyRegion);
+        stagingOffset += record->contentSize;
+    }
+    RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    for (uint32_t i = 0; i < trace->header.dispatchCount; i++)
+    {
+        const struct TraceDispatchRecord* record = &trace->dispatches[i];
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources->pipelines[record->pipelineIndex]);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, resources->pipelineLayouts[record->pipelineIndex], 0, 1,
+            &resources->descriptorSets[i], 0, NULL);
+        PushTestKernelChunk(commandBuffer, resources->pipelineLayouts[record->pipelineIndex], record->chunk);
+        vkCmdDispatch(commandBuffer, record->groupCountX, 1, 1);
+
+        // A later dispatch may reach the output of this one through any address
+        RecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+            VK_ACCESS_TRANSFER_READ_BIT);
+    }
+}
+
+// Reads every buffer back and hashes its contents
+static bool HashTraceBuffers(const struct TraceResources* resources, uint64_t hashes[])
+{
+    struct DeviceContext* deviceContext = resources->deviceContext;
+    const struct WorkloadTrace* trace = resources->trace;
+    const VkDevice device = deviceContext->device;
+
+    VkDeviceSize maxSize = 0;
+    for (uint32_t i = 0; i < trace->header.bufferCount; i++) {
+        maxSize = max(maxSize, trace->buffers[i].size);
+    }
+
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+    const void* readbackData = NULL;
+    bool succeeded = CreateBufferWithMemory(deviceContext, maxSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, &readbackMemory) == VK_SUCCESS &&
+        vkMapMemory(device, readbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&readbackData) == VK_SUCCESS;
+
+    for (uint32_t i = 0; i < trace->header.bufferCount && succeeded; i++)
+    {
+        const struct PooledBufferReadback readback = { .source = resources->buffers[i], .readbackBuffer = readbackBuffer, .size = trace->buffers[i].size };
+        succeeded = SubmitOneTimeCommands(deviceContext, resources->fence, RecordPooledBufferReadback, &readback, 0) == VK_SUCCESS;
+        if (succeeded) {
+            hashes[i] = HashTraceContents(readbackData, (size_t)trace->buffers[i].size);
+        }
+    }
+
+    if (readbackBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, readbackBuffer, NULL);
+    }
+    if (readbackMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, readbackMemory, NULL);
+    }
+    return succeeded;
+}
+
+static bool ExecuteTrace(struct TraceResources* resources, double* pMilliseconds)
+{
+    const uint64_t beginTime = GetCurrentTimeNanoseconds();
+    const VkResult res = SubmitOneTimeCommands(resources->deviceContext, resources->fence, RecordTraceExecution, resources, 0);
+    *pMilliseconds = (double)(GetCurrentTimeNanoseconds() - beginTime) / 1000000.0;
+    return res == VK_SUCCESS;
+}
+
+// Address table of one dispatch of the test kernel, written by the capture once the addresses of the buffers are known
+struct TraceDispatchLinks
+{
+    uint32_t dstBufferIndex;
+    uint32_t srcBufferIndex;
+    // UINT32_MAX if the source is the output of an earlier dispatch, otherwise its initial contents start at this value
+    uint32_t srcFirstElement;
+};
+
+// Creates the buffers of `trace`, writes the initial contents described by `links` (one per dispatch), runs the dispatches once
+// and writes the trace with a hash of every buffer afterwards. Frees the contents of the trace.
+static bool CaptureWorkloadTrace(const char* filePath, struct WorkloadTrace* trace, const struct TraceDispatchLinks links[])
+{
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+
+    struct TraceResources resources;
+    bool passed = CreateTraceBuffers(deviceContext, trace, false, &resources) == VK_SUCCESS;
+
+    // The initial contents can only be written once the addresses are known. Repeated dispatches of a job share their buffers.
+    for (uint32_t k = 0; k < trace->header.dispatchCount && passed; k++)
+    {
+        const struct TraceDispatchLinks* link = &links[k];
+        const uint32_t srcIndex = link->srcBufferIndex;
+        if (link->srcFirstElement != UINT32_MAX && trace->contents[srcIndex] == NULL)
+        {
+            trace->buffers[srcIndex].contentSize = trace->buffers[srcIndex].size;
+            trace->contents[srcIndex] = malloc((size_t)trace->buffers[srcIndex].size);
+            passed = trace->contents[srcIndex] != NULL;
+            if (passed) {
+                InitializeSourceData(trace->contents[srcIndex], (int)(trace->buffers[srcIndex].size / sizeof(int)), (int)link->srcFirstElement);
+            }
+        }
+
+        const uint32_t tableIndex = trace->dispatches[k].tableBufferIndex;
+        if (!passed || trace->contents[tableIndex] != NULL) {
+            continue;
+        }
+        trace->buffers[tableIndex].contentSize = trace->buffers[tableIndex].size;
+        VkDeviceAddress* table = calloc(1, (size_t)trace->buffers[tableIndex].size);
+        trace->contents[tableIndex] = table;
+        passed = table != NULL;
+        if (passed)
+        {
+            table[0] = trace->buffers[link->dstBufferIndex].deviceAddress;
+            table[1] = trace->buffers[srcIndex].deviceAddress;
+        }
+    }
+
+    double milliseconds = 0.0;
+    uint64_t hashes[MAX_TRACE_BUFFER_COUNT];
+    passed = passed && PrepareTraceExecution(&resources) == VK_SUCCESS && ExecuteTrace(&resources, &milliseconds) &&
+        HashTraceBuffers(&resources, hashes);
+    for (uint32_t i = 0; i < trace->header.bufferCount && passed; i++) {
+        trace->buffers[i].finalHash = hashes[i];
+    }
+
+    size_t fileSize = 0;
+    passed = passed && WriteWorkloadTrace(filePath, trace, &fileSize);
+    if (passed)
+    {
+        printf("Captured %u buffer(s), %u pipeline(s) and %u dispatch(es) in %.3fms\n", trace->header.bufferCount, trace->header.pipelineCount,
+            trace->header.dispatchCount, milliseconds);
+        for (uint32_t i = 0; i < trace->header.bufferCount; i++)
+        {
+            printf("  buffer %2u: %10llu bytes at 0x%016llX, opaque 0x%016llX, memory type %u, %s\n", i, (unsigned long long)trace->buffers[i].size,
+                (unsigned long long)trace->buffers[i].deviceAddress, (unsigned long long)trace->buffers[i].bufferOpaqueAddress,
+                trace->buffers[i].memoryTypeIndex, trace->buffers[i].contentSize > 0 ? "initial contents stored" : "zeroed");
+        }
+        printf("Wrote %zu bytes to `%s`\n", fileSize, filePath);
+    }
+
+    DestroyTraceResources(&resources);
+    FreeWorkloadTrace(trace);
+    return passed;
+}
+
+// Records a session of chained test kernels: pass k doubles the output of pass k - 1, which it finds through the device addresses
+// stored in its own address table buffer. The buffers, their addresses and initial contents, the pipeline and the dispatches
+// go into the trace, together with a hash of every buffer after the session.
+static bool RunWorkloadCapture(const char* filePath)
+{
+    static struct WorkloadTrace trace;
+    const uint32_t elemCount = CAPTURE_SESSION_ELEMENT_COUNT;
+    const uint32_t passCount = CAPTURE_SESSION_PASS_COUNT;
+
+    printf("\n================ Begin the workload capture into `%s` ================\n\n", filePath);
+
+    // Buffer 0 is the source, buffers 1..passCount the outputs, the rest the address tables of the passes
+    memset(&trace, 0, sizeof(trace));
+    memcpy(trace.header.magic, TRACE_MAGIC, sizeof(trace.header.magic));
+    trace.header.version = TRACE_VERSION;
+    trace.header.bufferCount = 1 + passCount * 2;
+    trace.header.pipelineCount = 1;
+    trace.header.dispatchCount = passCount;
+    for (uint32_t i = 0; i <= passCount; i++) {
+        trace.buffers[i].size = elemCount * sizeof(int);
+    }
+    struct TraceDispatchLinks links[CAPTURE_SESSION_PASS_COUNT];
+    for (uint32_t k = 0; k < passCount; k++)
+    {
+        trace.buffers[1 + passCount + k].size = ADDITIONAL_ADDRESS_BUFFER_SIZE;
+        trace.dispatches[k] = (struct TraceDispatchRecord){
+            .pipelineIndex = 0,
+            .tableBufferIndex = 1 + passCount + k,
+            .groupCountX = elemCount / COMPUTE_WORKGROUP_SIZE
+        };
+        links[k] = (struct TraceDispatchLinks){
+            .dstBufferIndex = 1 + k,
+            .srcBufferIndex = k,
+            .srcFirstElement = k == 0 ? 0 : UINT32_MAX
+        };
+    }
+    snprintf(trace.pipelines[0].shaderName, sizeof(trace.pipelines[0].shaderName), "test");
+    trace.pipelines[0].elemCount = elemCount;
+
+    const bool passed = CaptureWorkloadTrace(filePath, &trace, links);
+
+    printf("\n================ Complete the workload capture: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Captures the dispatches of job API jobs: every job gets its own source, output and address table buffer, and is dispatched
+// `iterations` times. Jobs of the same element count share a pipeline.
+static bool CaptureComputeJobs(const char* filePath, const struct ComputeJob jobs[], uint32_t jobCount)
+{
+    static struct WorkloadTrace trace;
+    static struct TraceDispatchLinks links[MAX_TRACE_DISPATCH_COUNT];
+
+    printf("\n================ Begin the capture of %u job(s) into `%s` ================\n\n", jobCount, filePath);
+
+    memset(&trace, 0, sizeof(trace));
+    memcpy(trace.header.magic, TRACE_MAGIC, sizeof(trace.header.magic));
+    trace.header.version = TRACE_VERSION;
+    bool passed = true;
+    for (uint32_t j = 0; j < jobCount && passed; j++)
+    {
+        const struct ComputeJob* job = &jobs[j];
+        if (trace.header.bufferCount + 3 > MAX_TRACE_BUFFER_COUNT || job->iterations > MAX_TRACE_DISPATCH_COUNT - trace.header.dispatchCount)
+        {
+            fprintf(stderr, "Job %s does not fit into a trace (%d buffers and %d dispatches at most)!\n", job->name, MAX_TRACE_BUFFER_COUNT,
+                MAX_TRACE_DISPATCH_COUNT);
+            passed = false;
+            break;
+        }
+
+        uint32_t pipelineIndex = 0;
+        while (pipelineIndex < trace.header.pipelineCount && trace.pipelines[pipelineIndex].elemCount != job->elemCount) {
+            pipelineIndex++;
+        }
+        if (pipelineIndex == MAX_TRACE_PIPELINE_COUNT)
+        {
+            fprintf(stderr, "Job %s does not fit into a trace (%d element counts at most)!\n", job->name, MAX_TRACE_PIPELINE_COUNT);
+            passed = false;
+            break;
+        }
+        if (pipelineIndex == trace.header.pipelineCount)
+        {
+            snprintf(trace.pipelines[pipelineIndex].shaderName, sizeof(trace.pipelines[pipelineIndex].shaderName), "test");
+            trace.pipelines[pipelineIndex].elemCount = job->elemCount;
+            trace.header.pipelineCount++;
+        }
+
+        const uint32_t srcIndex = trace.header.bufferCount;
+        trace.buffers[srcIndex].size = job->elemCount * sizeof(int);
+        trace.buffers[srcIndex + 1].size = job->elemCount * sizeof(int);
+        trace.buffers[srcIndex + 2].size = ADDITIONAL_ADDRESS_BUFFER_SIZE;
+        trace.header.bufferCount += 3;
+        for (uint32_t i = 0; i < job->iterations; i++)
+        {
+            const uint32_t k = trace.header.dispatchCount++;
+            trace.dispatches[k] = (struct TraceDispatchRecord){
+                .pipelineIndex = pipelineIndex,
+                .tableBufferIndex = srcIndex + 2,
+                .groupCountX = job->elemCount / COMPUTE_WORKGROUP_SIZE,
+                .chunk = GetTestKernelChunk(job)
+            };
+            links[k] = (struct TraceDispatchLinks){
+                .dstBufferIndex = srcIndex + 1,
+                .srcBufferIndex = srcIndex,
+                .srcFirstElement = job->firstElement
+            };
+        }
+    }
+
+    passed = passed && CaptureWorkloadTrace(filePath, &trace, links);
+    FreeWorkloadTrace(&trace);
+
+    printf("\n================ Complete the job capture: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Recreates the buffers of a trace at their captured addresses, runs the dispatch sequence REPLAY_ITERATIONS times
+// and checks that every buffer ends up with the captured contents
+static bool RunWorkloadReplay(const char* filePath)
+{
+    static struct WorkloadTrace trace;
+    struct DeviceContext* deviceContext = &s_deviceContexts[0];
+
+    printf("\n================ Begin the workload replay of `%s` ================\n\n", filePath);
+
+    if (!ReadWorkloadTrace(filePath, &trace)) {
+        return false;
+    }
+
+    struct TraceResources resources;
+    bool passed = CreateTraceBuffers(deviceContext, &trace, true, &resources) == VK_SUCCESS && PrepareTraceExecution(&resources) == VK_SUCCESS;
+    if (passed)
+    {
+        printf("Recreated %u buffer(s) at their captured addresses, replaying %u dispatch(es) %d times\n", trace.header.bufferCount,
+            trace.header.dispatchCount, REPLAY_ITERATIONS);
+    }
+
+    double totalMilliseconds = 0.0;
+    double minMilliseconds = 0.0;
+    double maxMilliseconds = 0.0;
+    for (uint32_t i = 0; i < REPLAY_ITERATIONS && passed; i++)
+    {
+        double milliseconds = 0.0;
+        passed = ExecuteTrace(&resources, &milliseconds);
+        totalMilliseconds += milliseconds;
+        minMilliseconds = i == 0 ? milliseconds : min(minMilliseconds, milliseconds);
+        maxMilliseconds = max(maxMilliseconds, milliseconds);
+    }
+    if (passed) {
+        printf("Replay time: avg %.3fms, min %.3fms, max %.3fms\n", totalMilliseconds / REPLAY_ITERATIONS, minMilliseconds, maxMilliseconds);
+    }
+
+    uint64_t hashes[MAX_TRACE_BUFFER_COUNT];
+    passed = passed && HashTraceBuffers(&resources, hashes);
+    for (uint32_t i = 0; i < trace.header.bufferCount && passed; i++)
+    {
+        if (hashes[i] != trace.buffers[i].finalHash)
+        {
+            fprintf(stderr, "Buffer %u differs from the capture after the replay!\n", i);
+            passed = false;
+        }
+    }
+    if (passed) {
+        puts("All buffers match the capture");
+    }
+
+    DestroyTraceResources(&resources);
+    FreeWorkloadTrace(&trace);
+
+    printf("\n================ Complete the workload replay: %s ================\n\n", passed ? "passed" : "failed");
+
+    return passed;
+}
+
+// Batch file format: one job per line, `<name> <element count> [iterations]`.
+// Empty lines and lines beginning with '#' are ignored.
+static bool LoadBatchJobs(const char* filePath, struct ComputeJob jobs[], uint32_t maxJobCount, uint32_t* pJobCount)
+{
+    FILE* fp = OpenFileWithRead(filePath);
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Batch file %s not found!\n", filePath);
+        return false;
+    }
+
+    bool success = true;
+    uint32_t jobCount = 0;
+    uint32_t lineNumber = 0;
+    char line[MAX_BATCH_LINE_LENGTH];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        lineNumber++;
+
+        const char* p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        if (jobCount == maxJobCount)
+        {
+            fprintf(stderr, "%s:%u: too many jobs, at most %u jobs are supported\n", filePath, lineNumber, maxJobCount);
+            success = false;
+            break;
+        }
+
+        struct ComputeJob* job = &jobs[jobCount];
+        memset(job, 0, sizeof(*job));
+
+        size_t nameLen = 0;
+        while (p[nameLen] != '\0' && !isspace((unsigned char)p[nameLen])) {
+            nameLen++;
+        }
+        if (nameLen >= sizeof(job->name))
+        {
+            fprintf(stderr, "%s:%u: job name is too long\n", filePath, lineNumber);
+            success = false;
+            break;
+        }
+        memcpy(job->name, p, nameLen);
+        p += nameLen;
+
+        char* endPtr = NULL;
+        errno = 0;
+        const unsigned long elemCount = strtoul(p, &endPtr, 0);
+        if (errno != 0 || endPtr == p || elemCount == 0 || elemCount > UINT32_MAX / sizeof(int) ||
+            elemCount % COMPUTE_WORKGROUP_SIZE != 0)
+        {
+            fprintf(stderr, "%s:%u: element count must be a positive multiple of %d\n", filePath, lineNumber, COMPUTE_WORKGROUP_SIZE);
+            success = false;
+            break;
+        }
+        job->elemCount = (uint32_t)elemCount;
+        p = endPtr;
+
+        job->iterations = 1;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p != '\0' && *p != '#')
+        {
+            errno = 0;
+            const unsigned long iterations = strtoul(p, &endPtr, 10);
+            if (errno != 0 || endPtr == p || iterations == 0 || iterations > UINT32_MAX)
+            {
+                fprintf(stderr, "%s:%u: invalid iteration count\n", filePath, lineNumber);
+                success = false;
+                break;
+            }
+            job->iterations = (uint32_t)iterations;
+        }
+
+        jobCount++;
+    }
+
+    fclose(fp);
+
+    *pJobCount = jobCount;
+    return success;
+}
+
+static void WriteJsonString(FILE* fp, const char* str)
+{
+    fputc('"', fp);
+    for (const char* p = str; *p != '\0'; p++)
+    {
+        if (*p == '"' || *p == '\\') {
+            fprintf(fp, "\\%c", *p);
+        }
+        else if ((unsigned char)*p < 0x20) {
+            fprintf(fp, "\\u%04x", (unsigned)(unsigned char)*p);
+        }
+        else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void WriteBatchResults(FILE* fp, const struct ComputeJob jobs[], const struct ComputeJobResult results[], uint32_t jobCount)
+{
+    fputs("{\n  \"devices\": [", fp);
+    for (uint32_t i = 0; i < s_deviceContextCount; i++)
+    {
+        fputs(i == 0 ? "\n    {\"name\": " : ",\n    {\"name\": ", fp);
+        WriteJsonString(fp, s_deviceContexts[i].properties.deviceName);
+        fputs(", \"type\": ", fp);
+        WriteJsonString(fp, s_deviceTypes[s_deviceContexts[i].properties.deviceType]);
+        fprintf(fp, ", \"queues\": %u}", s_deviceContexts[i].queueCount);
+    }
+    fputs("\n  ],\n  \"jobs\": [", fp);
+
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        const struct ComputeJobResult* r = &results[i];
+        fputs(i == 0 ? "\n    {\"name\": " : ",\n    {\"name\": ", fp);
+        WriteJsonString(fp, jobs[i].name);
+        fprintf(fp, ", \"elements\": %u, \"iterations\": %u, \"completedIterations\": %u, \"status\": \"%s\", \"vkResult\": %d, "
+            "\"backend\": \"%s\", \"device\": %u, \"queue\": %u, \"setupMs\": %.3f, \"totalMs\": %.3f, \"avgMs\": %.3f, \"minMs\": %.3f, \"maxMs\": %.3f}",
+            jobs[i].elemCount, jobs[i].iterations, r->completedIterations, r->passed ? "passed" : "failed", (int)r->result,
+            s_computeBackendNames[r->backend], r->deviceIndex, r->queueIndex,
+            r->setupMilliseconds, r->totalMilliseconds, r->completedIterations > 0 ? r->totalMilliseconds / r->completedIterations : 0.0,
+            r->minMilliseconds, r->maxMilliseconds);
+    }
+
+    fputs("\n  ]\n}\n", fp);
+}
+
+// One JSON object per line, so that a dump file can be read while it is being written
+static void WriteInstrumentationJson(FILE* fp, const struct InstrumentationSnapshot* pSnapshot)
+{
+    fprintf(fp, "{\"elapsedMs\": %.3f, \"host\": {", (double)pSnapshot->elapsedNanoseconds / 1000000.0);
+    for (uint32_t i = 0; i < HOST_COUNTER_COUNT; i++) {
+        fprintf(fp, "%s\"%s\": %llu", i == 0 ? "" : ", ", s_hostCounterNames[i], (unsigned long long)pSnapshot->hostCounters[i]);
+    }
+    fputs("}, \"devices\": [", fp);
+
+    for (uint32_t i = 0; i < pSnapshot->deviceCount; i++)
+    {
+        const struct DeviceContext* deviceContext = &s_deviceContexts[i];
+        const struct DeviceCounters* counters = &pSnapshot->devices[i];
+        fputs(i == 0 ? "{\"name\": " : ", {\"name\": ", fp);
+        WriteJsonString(fp, deviceContext->properties.deviceName);
+        fprintf(fp, ", \"profiledDispatches\": %llu, \"computeShaderInvocations\": ", (unsigned long long)counters->profiledDispatchCount);
+        // null marks counters the device cannot provide
+        if (deviceContext->supportPipelineStatistics) {
+            fprintf(fp, "%llu", (unsigned long long)counters->computeShaderInvocations);
+        }
+        else {
+            fputs("null", fp);
+        }
+        fprintf(fp, ", \"dispatchMs\": %.3f, \"performanceCounters\": {", counters->dispatchMilliseconds);
+        for (uint32_t j = 0; j < deviceContext->performanceCounterCount; j++)
+        {
+            if (j > 0) {
+                fputs(", ", fp);
+            }
+            WriteJsonString(fp, deviceContext->performanceCounterNames[j]);
+            fprintf(fp, ": %.17g", counters->performanceCounterTotals[j]);
+        }
+        fputs("}}", fp);
+    }
+
+    fputs("]}\n", fp);
+}
+
+static void WriteCounterDump(void)
+{
+    struct InstrumentationSnapshot snapshot;
+    GetInstrumentationSnapshot(&snapshot);
+    WriteInstrumentationJson(s_instrumentation.dumpFile, &snapshot);
+    fflush(s_instrumentation.dumpFile);
+}
+
+static int CounterDumpThreadProc(void* arg)
+{
+    (void)arg;
+    mtx_lock(&s_instrumentation.mutex);
+    while (!s_instrumentation.dumpStopRequested)
+    {
+        struct timespec deadline;
+        timespec_get(&deadline, TIME_UTC);
+        deadline.tv_sec += s_instrumentation.dumpIntervalMilliseconds / 1000;
+        deadline.tv_nsec += (long)(s_instrumentation.dumpIntervalMilliseconds % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        // A spurious wakeup only restarts the interval; the snapshot takes the mutex itself
+        if (cnd_timedwait(&s_instrumentation.dumpCondition, &s_instrumentation.mutex, &deadline) == thrd_timedout)
+        {
+            mtx_unlock(&s_instrumentation.mutex);
+            WriteCounterDump();
+            mtx_lock(&s_instrumentation.mutex);
+        }
+    }
+    mtx_unlock(&s_instrumentation.mutex);
+    return 0;
+}
+
+// Writes a snapshot of the counters to `filePath` every `intervalMilliseconds` until StopCounterDumps
+static bool StartCounterDumps(const char* filePath, uint32_t intervalMilliseconds)
+{
+    s_instrumentation.dumpFile = OpenFileWithWrite(filePath);
+    if (s_instrumentation.dumpFile == NULL)
+    {
+        fprintf(stderr, "Cannot open counter file %s for writing!\n", filePath);
+        return false;
+    }
+    s_instrumentation.dumpIntervalMilliseconds = intervalMilliseconds;
+    s_instrumentation.dumpStopRequested = false;
+
+    if (thrd_create(&s_instrumentation.dumpThread, CounterDumpThreadProc, NULL) != thrd_success)
+    {
+        fprintf(stderr, "Failed to create the counter dump thread!\n");
+        fclose(s_instrumentation.dumpFile);
+        s_instrumentation.dumpFile = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Stops the dump thread and writes the final snapshot
+static void StopCounterDumps(void)
+{
+    if (s_instrumentation.dumpFile == NULL) {
+        return;
+    }
+
+    mtx_lock(&s_instrumentation.mutex);
+    s_instrumentation.dumpStopRequested = true;
+    cnd_signal(&s_instrumentation.dumpCondition);
+    mtx_unlock(&s_instrumentation.mutex);
+    thrd_join(s_instrumentation.dumpThread, NULL);
+
+    WriteCounterDump();
+    fclose(s_instrumentation.dumpFile);
+    s_instrumentation.dumpFile = NULL;
+}
+
+static void PrintInstrumentationSummary(void)
+{
+    struct InstrumentationSnapshot snapshot;
+    GetInstrumentationSnapshot(&snapshot);
+
+    printf("Counters after %.3f ms:\n", (double)snapshot.elapsedNanoseconds / 1000000.0);
+    for (uint32_t i = 0; i < HOST_COUNTER_COUNT; i++) {
+        printf("  %-16s %llu\n", s_hostCounterNames[i], (unsigned long long)snapshot.hostCounters[i]);
+    }
+    for (uint32_t i = 0; i < snapshot.deviceCount; i++)
+    {
+        const struct DeviceContext* deviceContext = &s_deviceContexts[i];
+        const struct DeviceCounters* counters = &snapshot.devices[i];
+        printf("  Device context %u (%s): %llu profiled dispatch(es), %.3f ms", i, deviceContext->properties.deviceName,
+            (unsigned long long)counters->profiledDispatchCount, counters->dispatchMilliseconds);
+        if (deviceContext->supportPipelineStatistics) {
+            printf(", %llu compute shader invocations", (unsigned long long)counters->computeShaderInvocations);
+        }
+        putchar('\n');
+        for (uint32_t j = 0; j < deviceContext->performanceCounterCount; j++) {
+            printf("    %-40s %.6g\n", deviceContext->performanceCounterNames[j], counters->performanceCounterTotals[j]);
+        }
+    }
+}
+
+// Returns the number of failed jobs, or -1 if the batch file cannot be loaded
+static int RunBatchJobs(const char* batchFilePath, const char* resultsFilePath)
+{
+    static struct ComputeJob jobs[MAX_BATCH_JOB_COUNT];
+    static struct ComputeJobResult results[MAX_BATCH_JOB_COUNT];
+
+    uint32_t jobCount = 0;
+    if (!LoadBatchJobs(batchFilePath, jobs, MAX_BATCH_JOB_COUNT, &jobCount)) {
+        return -1;
+    }
+    printf("Loaded %u job(s) from %s\n", jobCount, batchFilePath);
+
+    // Batch jobs are independent, so they are spread over all created queues of all device contexts
+    if (s_deviceContextCount > 1) {
+        RunMultiDeviceJobs(jobs, results, jobCount, true);
+    }
+    else {
+        RunComputeJobs(jobs, results, jobCount, 0, true);
+    }
+
+    int failedCount = 0;
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        if (!results[i].passed) {
+            failedCount++;
+        }
+    }
+
+    FILE* fp = stdout;
+    if (resultsFilePath != NULL)
+    {
+        fp = OpenFileWithWrite(resultsFilePath);
+        if (fp == NULL)
+        {
+            fprintf(stderr, "Cannot open results file %s for writing!\n", resultsFilePath);
+            return failedCount > 0 ? failedCount : 1;
+        }
+    }
+
+    WriteBatchResults(fp, jobs, results, jobCount);
+
+    if (fp != stdout) {
+        fclose(fp);
+    }
+
+    printf("Batch complete: %u job(s), %d failed\n", jobCount, failedCount);
+
+    // The jobs are captured after they ran, so a capture that cannot replay does not change the batch results
+    if (s_options.captureFilePath != NULL && !CaptureComputeJobs(s_options.captureFilePath, jobs, jobCount)) {
+        return failedCount > 0 ? failedCount : 1;
+    }
+    return failedCount;
+}
+
+static void PrintUsage(const char* programName)
+{
+    printf("Usage: %s [--device=<index|discrete|integrated|virtual|cpu|name>] [--queues=<n>] [--queue-priorities=<p0,p1,...>]\n"
+        "       [--shader-dir=<dir>] [--glsl-dir=<dir> [--shader-cache=<dir>] [--bench-shader-compile]]\n"
+        "       [--multi-device [--logical-devices=<n>]] [--batch=<file> [--results=<file>]] [--bench-queues[=<job count>]]\n"
+        "       [--async[=<job count>]] [--bench-coalescing[=<job count>] [--coalesce=<max jobs>,<window us>]]\n"
+        "       [--bench-recording[=<job count>]] [--bench-graph]\n"
+        "       [--indirect[=<element count>]] [--device-heap[=<element count>]] [--persistent[=<job count>]]\n"
+        "       [--sparse[=<max element count>]] [--bench-types[=<element count>]] [--bench-access] [--bench-gather-scatter]\n"
+        "       [--bench-compressed-upload[=<element count>]]\n"
+        "       [--serve=<socket path>] [--serve-test[=<client count>]]\n"
+        "       [--backend=<auto|vulkan|cpu>] [--cpu-threads=<n>] [--bench-backends[=<element count>]]\n"
+        "       [--wait=<block|spin|adaptive>] [--spin-us=<us>] [--bench-wait[=<job count>]]\n"
+        "       [--defrag[=<budget ms>]] [--capture=<trace file>] [--replay=<trace file>]\n"
+        "       [--counters[=<json file>] [--counters-interval=<ms>]]\n", programName);
+    puts("  --device            chooses the working device; if omitted, " DEVICE_SELECTOR_ENV_NAME " is used, otherwise the best scored device.");
+    puts("  --shader-dir        loads <name>[_<variant>].spv from <dir> instead of the embedded SPIR-V; " SHADER_DIRECTORY_ENV_NAME " if omitted.");
+    puts("                      Cannot be combined with --glsl-dir, which also makes " SHADER_DIRECTORY_ENV_NAME " ignored.");
+    puts("  --glsl-dir          compiles the shaders from the GLSL sources in <dir> at runtime (needs a VVB_USE_SHADERC build).");
+    puts("  --shader-cache      caches the runtime compiled SPIR-V in <dir>, keyed by a hash of the source and options.");
+    puts("  --bench-shader-compile measures compiling every shader (cold) against loading it from the shader cache (warm).");
+    puts("  --backend           runs the jobs on Vulkan, on the CPU or (auto, the default) on the CPU when Vulkan is unavailable or fails.");
+    puts("  --cpu-threads       number of worker threads of the CPU backend, one per processor by default.");
+    puts("  --wait              waits for job completions by blocking (default), by polling, then blocking, or adaptively.");
+    puts("  --spin-us           the longest a wait polls before it blocks, 200 us by default.");
+    puts("  --bench-wait        measures latency and CPU cost of every wait strategy on fences and timeline semaphores.");
+    puts("  --queues            number of compute queues to create, all queues of the selected queue family by default.");
+    puts("  --queue-priorities  queue priorities in [0, 1]; the last one is repeated for the remaining queues.");
+    puts("  --multi-device      creates a logical device on every eligible device and distributes the jobs across them.");
+    puts("  --logical-devices   number of logical devices per physical device in multi-device mode, 1 by default.");
+    puts("  --batch             runs the jobs listed in <file>, one `<name> <element count> [iterations]` per line.");
+    puts("  --results           writes the JSON results of the batch run to <file> instead of stdout.");
+    puts("  --bench-queues      measures the aggregate throughput of independent jobs with 1..N queues.");
+    puts("  --bench-coalescing  submits small jobs arriving at a steady rate one by one and in batches with a timeline semaphore.");
+    puts("  --coalesce          measures only batches of up to <max jobs> jobs, submitted when their first job waited <window us>.");
+    puts("  --bench-recording   measures the throughput of recording secondary command buffers with 1..N threads.");
+    puts("  --bench-graph       compares planned barriers of a multi-pass compute graph with a barrier after every pass.");
+    puts("  --indirect          sums <element count> elements with GPU driven indirect dispatches and with a CPU driven loop.");
+    puts("  --device-heap       filters <element count> elements into blocks that the kernel allocates from a device heap.");
+    puts("  --persistent        compares the latency of tiny jobs run by a persistent kernel with a submission per job.");
+    puts("  --sparse            grows the data in sparse buffers whose memory is committed on demand at stable addresses.");
+    puts("  --bench-types       doubles <element count> elements of every supported element type and reports GB/s per type.");
+    puts("  --bench-access      compares reaching 1..64 buffers through device addresses, descriptor arrays and fixed bindings.");
+    puts("  --bench-gather-scatter gathers and scatters (atomic add/min/max) along index streams over 1..64 buffers of an address table.");
+    puts("  --bench-compressed-upload uploads <element count> elements raw and compressed, decoded on the device, per dataset.");
+    puts("  --serve             serves jobs sent as memfd payloads over the UNIX domain socket at <socket path> (Linux only).");
+    puts("  --serve-test        runs the compute service with <client count> local clients and verifies their results.");
+    puts("  --bench-backends    runs the same jobs of <element count> elements on the Vulkan device and on the CPU backend.");
+    puts("  --defrag            fragments a pool of BDA buffers, then moves them in passes of <budget ms> and patches their table slots.");
+    puts("  --capture           records chained kernels, their buffers, device addresses and contents into <trace file>.");
+    puts("                      With --batch, records the jobs of the batch file instead, after they ran.");
+    puts("  --replay            recreates the buffers of <trace file> at the captured addresses and replays the dispatches with timing.");
+    puts("  --async             submits independent jobs through the asynchronous API and waits on their futures.");
+    puts("  --counters          collects submit, transfer, allocation and map counters, pipeline statistics, dispatch timestamps and");
+    puts("                      VK_KHR_performance_query counters, prints them at exit and dumps them to <json file> as JSON lines.");
+    puts("  --counters-interval period of the counter dumps, 1000 ms by default.");
+}
+
+// Parses the decimal value behind `prefix` of `arg` into `*pValue`. Prints an error with the valid range and returns false
+// if it is not a number from `minValue` to `maxValue`.
+static bool ParseUnsignedOption(const char* arg, const char* prefix, uint32_t minValue, uint32_t maxValue, uint32_t* pValue)
+{
+    const char* valueStr = arg + strlen(prefix);
+    char* endPtr = NULL;
+    errno = 0;
+    const unsigned long value = strtoul(valueStr, &endPtr, 10);
+    if (errno != 0 || endPtr == valueStr || *endPtr != '\0' || *valueStr == '-' || value < minValue || value > maxValue)
+    {
+        fprintf(stderr, "Invalid value of %.*s: %s (%u to %u)\n", (int)strlen(prefix) - 1, prefix, valueStr, minValue, maxValue);
+        return false;
+    }
+    *pValue = (uint32_t)value;
+    return true;
+}
+
+static bool ParseProgramOptions(int argc, const char* argv[], struct ProgramOptions* pOptions)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--device=", 9) == 0) {
+            pOptions->deviceSelector = arg + 9;
+        }
+        else if (strncmp(arg, "--shader-dir=", 13) == 0 && arg[13] != '\0') {
+            pOptions->shaderDirectory = arg + 13;
+        }
+        else if (strncmp(arg, "--glsl-dir=", 11) == 0 && arg[11] != '\0') {
+            pOptions->glslDirectory = arg + 11;
+        }
+        else if (strncmp(arg, "--shader-cache=", 15) == 0 && arg[15] != '\0') {
+            pOptions->shaderCacheDirectory = arg + 15;
+        }
+        else if (strncmp(arg, "--batch=", 8) == 0) {
+            pOptions->batchFilePath = arg + 8;
+        }
+        else if (strncmp(arg, "--results=", 10) == 0) {
+            pOptions->resultsFilePath = arg + 10;
+        }
+        else if (strncmp(arg, "--queues=", 9) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--queues=", 1, MAX_COMPUTE_QUEUE_COUNT, &pOptions->queueCount)) {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--queue-priorities=", 19) == 0)
+        {
+            const char* p = arg + 19;
+            pOptions->queuePriorityCount = 0;
+            while (*p != '\0')
+            {
+                char* endPtr = NULL;
+                const double priority = strtod(p, &endPtr);
+                if (endPtr == p || priority < 0.0 || priority > 1.0 || pOptions->queuePriorityCount == MAX_COMPUTE_QUEUE_COUNT)
+                {
+                    fprintf(stderr, "Invalid queue priorities: %s\n", arg + 19);
+                    return false;
+                }
+                pOptions->queuePriorities[pOptions->queuePriorityCount++] = (float)priority;
+                p = *endPtr == ',' ? endPtr + 1 : endPtr;
+                if (*endPtr != ',' && *endPtr != '\0')
+                {
+                    fprintf(stderr, "Invalid queue priorities: %s\n", arg + 19);
+                    return false;
+                }
+            }
+        }
+        else if (strcmp(arg, "--multi-device") == 0) {
+            pOptions->multiDevice = true;
+        }
+        else if (strncmp(arg, "--logical-devices=", 18) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--logical-devices=", 1, MAX_DEVICE_CONTEXT_COUNT, &pOptions->logicalDevicesPerGpu)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench-queues") == 0) {
+            pOptions->queueBenchmarkJobCount = DEFAULT_QUEUE_BENCHMARK_JOB_COUNT;
+        }
+        else if (strncmp(arg, "--bench-queues=", 15) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--bench-queues=", 1, MAX_BATCH_JOB_COUNT, &pOptions->queueBenchmarkJobCount)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench-recording") == 0) {
+            pOptions->recordingBenchmarkJobCount = DEFAULT_RECORDING_BENCHMARK_JOB_COUNT;
+        }
+        else if (strncmp(arg, "--bench-recording=", 18) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--bench-recording=", 1, MAX_BATCH_JOB_COUNT, &pOptions->recordingBenchmarkJobCount)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench-graph") == 0) {
+            pOptions->graphBenchmark = true;
+        }
+        else if (strcmp(arg, "--bench-shader-compile") == 0) {
+            pOptions->shaderCompileBenchmark = true;
+        }
+        else if (strcmp(arg, "--bench-access") == 0) {
+            pOptions->accessBenchmark = true;
+        }
+        else if (strcmp(arg, "--bench-gather-scatter") == 0) {
+            pOptions->gatherScatterBenchmark = true;
+        }
+        else if (strcmp(arg, "--bench-compressed-upload") == 0) {
+            pOptions->compressedUploadElementCount = DEFAULT_COMPRESSED_UPLOAD_ELEMENT_COUNT;
+        }
+        else if (strncmp(arg, "--bench-compressed-upload=", 26) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--bench-compressed-upload=", 1, MAX_COMPRESSED_UPLOAD_ELEMENT_COUNT, &pOptions->compressedUploadElementCount)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--indirect") == 0) {
+            pOptions->indirectElementCount = DEFAULT_INDIRECT_ELEMENT_COUNT;
+        }
+        else if (strncmp(arg, "--indirect=", 11) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--indirect=", 1, UINT32_MAX / (uint32_t)sizeof(uint32_t), &pOptions->indirectElementCount)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--device-heap") == 0) {
+            pOptions->deviceHeapElementCount = DEFAULT_DEVICE_HEAP_ELEMENT_COUNT;
+        }
+        else if (strncmp(arg, "--device-heap=", 14) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--device-heap=", 1, MAX_DEVICE_HEAP_ELEMENT_COUNT, &pOptions->deviceHeapElementCount)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--persistent") == 0) {
+            pOptions->persistentJobCount = DEFAULT_PERSISTENT_QUEUE_JOB_COUNT;
+        }
+        else if (strncmp(arg, "--persistent=", 13) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--persistent=", 1, MAX_PERSISTENT_QUEUE_JOB_COUNT, &pOptions->persistentJobCount)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--sparse") == 0) {
+            pOptions->sparseElementCount = DEFAULT_SPARSE_ELEMENT_COUNT;
+        }
+        else if (strncmp(arg, "--sparse=", 9) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--sparse=", 1, INT_MAX / 2, &pOptions->sparseElementCount)) {
+                return false;
+            }
+            if (pOptions->sparseElementCount % COMPUTE_WORKGROUP_SIZE != 0)
+            {
+                fprintf(stderr, "Invalid element count: %s (a multiple of %d)\n", arg + 9, COMPUTE_WORKGROUP_SIZE);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench-types") == 0) {
+            pOptions->elementTypeElementCount = DEFAULT_ELEMENT_TYPE_ELEMENT_COUNT;
+        }
+        else if (strncmp(arg, "--bench-types=", 14) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--bench-types=", 1, MAX_ELEMENT_TYPE_ELEMENT_COUNT, &pOptions->elementTypeElementCount)) {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--serve=", 8) == 0 && arg[8] != '\0') {
+            pOptions->serviceSocketPath = arg + 8;
+        }
+        else if (strcmp(arg, "--serve-test") == 0) {
+            pOptions->serviceTestClientCount = DEFAULT_SERVICE_TEST_CLIENT_COUNT;
+        }
+        else if (strncmp(arg, "--serve-test=", 13) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--serve-test=", 1, SERVICE_MAX_CLIENT_COUNT, &pOptions->serviceTestClientCount)) {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--backend=", 10) == 0)
+        {
+            if (CompareStringIgnoreCase(arg + 10, "auto") == 0) {
+                pOptions->backendSelection = BACKEND_SELECTION_AUTO;
+            }
+            else if (CompareStringIgnoreCase(arg + 10, "vulkan") == 0) {
+                pOptions->backendSelection = BACKEND_SELECTION_VULKAN;
+            }
+            else if (CompareStringIgnoreCase(arg + 10, "cpu") == 0) {
+                pOptions->backendSelection = BACKEND_SELECTION_CPU;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid backend: %s (auto, vulkan or cpu)\n", arg + 10);
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--wait=", 7) == 0)
+        {
+            int strategy = 0;
+            while (strategy < WAIT_STRATEGY_COUNT && CompareStringIgnoreCase(arg + 7, s_waitStrategyNames[strategy]) != 0) {
+                strategy++;
+            }
+            if (strategy == WAIT_STRATEGY_COUNT)
+            {
+                fprintf(stderr, "Invalid wait strategy: %s (block, spin or adaptive)\n", arg + 7);
+                return false;
+            }
+            pOptions->waitStrategy = (enum WAIT_STRATEGY)strategy;
+        }
+        else if (strncmp(arg, "--spin-us=", 10) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--spin-us=", 1, MAX_SPIN_MICROSECONDS, &pOptions->maxSpinMicroseconds)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench-wait") == 0) {
+            pOptions->waitBenchmarkJobCount = DEFAULT_WAIT_BENCHMARK_JOB_COUNT;
+        }
+        else if (strncmp(arg, "--bench-wait=", 13) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--bench-wait=", 1, MAX_WAIT_BENCHMARK_JOB_COUNT, &pOptions->waitBenchmarkJobCount)) {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--cpu-threads=", 14) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--cpu-threads=", 1, MAX_CPU_BACKEND_THREAD_COUNT, &pOptions->cpuThreadCount)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench-backends") == 0) {
+            pOptions->backendBenchmarkElementCount = DEFAULT_BACKEND_BENCHMARK_ELEMENT_COUNT;
+        }
+        else if (strncmp(arg, "--bench-backends=", 17) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--bench-backends=", 1, MAX_BACKEND_BENCHMARK_ELEMENT_COUNT, &pOptions->backendBenchmarkElementCount)) {
+                return false;
+            }
+            if (pOptions->backendBenchmarkElementCount % COMPUTE_WORKGROUP_SIZE != 0)
+            {
+                fprintf(stderr, "Invalid element count: %s (a multiple of %d)\n", arg + 17, COMPUTE_WORKGROUP_SIZE);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--defrag") == 0) {
+            pOptions->defragPassBudgetMilliseconds = DEFAULT_DEFRAG_PASS_BUDGET_MILLISECONDS;
+        }
+        else if (strncmp(arg, "--defrag=", 9) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--defrag=", 1, MAX_DEFRAG_PASS_BUDGET_MILLISECONDS, &pOptions->defragPassBudgetMilliseconds)) {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--capture=", 10) == 0 && arg[10] != '\0') {
+            pOptions->captureFilePath = arg + 10;
+        }
+        else if (strncmp(arg, "--replay=", 9) == 0 && arg[9] != '\0') {
+            pOptions->replayFilePath = arg + 9;
+        }
+        else if (strcmp(arg, "--counters") == 0) {
+            pOptions->countersEnabled = true;
+        }
+        else if (strncmp(arg, "--counters=", 11) == 0 && arg[11] != '\0')
+        {
+            pOptions->countersEnabled = true;
+            pOptions->countersFilePath = arg + 11;
+        }
+        else if (strncmp(arg, "--counters-interval=", 20) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--counters-interval=", 1, MAX_COUNTER_DUMP_INTERVAL_MILLISECONDS, &pOptions->counterDumpIntervalMilliseconds)) {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench-coalescing") == 0) {
+            pOptions->coalescingJobCount = DEFAULT_COALESCING_JOB_COUNT;
+        }
+        else if (strncmp(arg, "--bench-coalescing=", 19) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--bench-coalescing=", 1, MAX_BATCH_JOB_COUNT, &pOptions->coalescingJobCount)) {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--coalesce=", 11) == 0)
+        {
+            char* endPtr = NULL;
+            const unsigned long batchSize = strtoul(arg + 11, &endPtr, 10);
+            const char* windowStr = endPtr + 1;
+            const unsigned long window = *endPtr == ',' ? strtoul(windowStr, &endPtr, 10) : 0;
+            if (batchSize == 0 || batchSize > MAX_COALESCED_BATCH_SIZE || endPtr == windowStr || *endPtr != '\0' ||
+                window > MAX_COALESCING_WINDOW_MICROSECONDS)
+            {
+                fprintf(stderr, "Invalid coalescing parameters: %s (1 to %d jobs, 0 to %d us)\n", arg + 11, MAX_COALESCED_BATCH_SIZE,
+                    MAX_COALESCING_WINDOW_MICROSECONDS);
+                return false;
+            }
+            pOptions->coalescingBatchSize = (uint32_t)batchSize;
+            pOptions->coalescingWindowMicroseconds = (uint32_t)window;
+        }
+        else if (strcmp(arg, "--async") == 0) {
+            pOptions->asyncJobCount = DEFAULT_ASYNC_JOB_COUNT;
+        }
+        else if (strncmp(arg, "--async=", 8) == 0)
+        {
+            if (!ParseUnsignedOption(arg, "--async=", 1, MAX_BATCH_JOB_COUNT, &pOptions->asyncJobCount)) {
+                return false;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return false;
+        }
+    }
+    if (pOptions->counterDumpIntervalMilliseconds > 0 && pOptions->countersFilePath == NULL) {
+        fprintf(stderr, "--counters-interval is ignored without --counters=<json file>\n");
+    }
+    if (pOptions->shaderDirectory != NULL && pOptions->glslDirectory != NULL)
+    {
+        fprintf(stderr, "--shader-dir and --glsl-dir cannot be combined\n");
+        return false;
+    }
+    return true;
+}
+
+// Returns the option of a requested mode that needs a Vulkan device, or NULL if only job API modes were requested
+static const char* GetVulkanOnlyModeOption(void)
+{
+    if (s_options.shaderCompileBenchmark) {
+        return "--bench-shader-compile";
+    }
+    if (s_options.queueBenchmarkJobCount > 0) {
+        return "--bench-queues";
+    }
+    if (s_options.indirectElementCount > 0) {
+        return "--indirect";
+    }
+    if (s_options.deviceHeapElementCount > 0) {
+        return "--device-heap";
+    }
+    if (s_options.persistentJobCount > 0) {
+        return "--persistent";
+    }
+    if (s_options.sparseElementCount > 0) {
+        return "--sparse";
+    }
+    if (s_options.accessBenchmark) {
+        return "--bench-access";
+    }
+    if (s_options.gatherScatterBenchmark) {
+        return "--bench-gather-scatter";
+    }
+    if (s_options.compressedUploadElementCount > 0) {
+        return "--bench-compressed-upload";
+    }
+    if (s_options.elementTypeElementCount > 0) {
+        return "--bench-types";
+    }
+    if (s_options.serviceSocketPath != NULL) {
+        return "--serve";
+    }
+    if (s_options.serviceTestClientCount > 0) {
+        return "--serve-test";
+    }
+    if (s_options.defragPassBudgetMilliseconds > 0) {
+        return "--defrag";
+    }
+    if (s_options.captureFilePath != NULL) {
+        return "--capture";
+    }
+    if (s_options.replayFilePath != NULL) {
+        return "--replay";
+    }
+    if (s_options.graphBenchmark) {
+        return "--bench-graph";
+    }
+    if (s_options.recordingBenchmarkJobCount > 0) {
+        return "--bench-recording";
+    }
+    if (s_options.coalescingJobCount > 0 || s_options.coalescingBatchSize > 0) {
+        return s_options.coalescingJobCount > 0 ? "--bench-coalescing" : "--coalesce";
+    }
+    if (s_options.waitBenchmarkJobCount > 0) {
+        return "--bench-wait";
+    }
+    if (s_options.asyncJobCount > 0) {
+        return "--async";
+    }
+    if (s_options.multiDevice) {
+        return "--multi-device";
+    }
+    return NULL;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (!ParseProgramOptions(argc, argv, &s_options))
+    {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The command line directory takes precedence over the environment variable
+    static char envShaderDirectory[MAX_SHADER_PATH_LENGTH];
+    if (s_options.shaderDirectory == NULL && s_options.glslDirectory == NULL && GetEnvironmentString(SHADER_DIRECTORY_ENV_NAME, envShaderDirectory, sizeof(envShaderDirectory))) {
+        s_options.shaderDirectory = envShaderDirectory;
+    }
+    if (s_options.shaderDirectory != NULL) {
+        printf("Loading shaders from %s instead of the embedded SPIR-V\n", s_options.shaderDirectory);
+    }
+
+    static char defaultShaderCacheDirectory[MAX_SHADER_PATH_LENGTH];
+    if (s_options.glslDirectory != NULL)
+    {
+        if (s_options.shaderCacheDirectory == NULL)
+        {
+            snprintf(defaultShaderCacheDirectory, sizeof(defaultShaderCacheDirectory), "%s/cache", s_options.glslDirectory);
+            s_options.shaderCacheDirectory = defaultShaderCacheDirectory;
+        }
+        if (!CreateDirectoryIfMissing(s_options.shaderCacheDirectory)) {
+            fprintf(stderr, "Failed to create the shader cache directory %s!\n", s_options.shaderCacheDirectory);
+        }
+#ifdef VVB_USE_SHADERC
+        s_shaderCompiler = shaderc_compiler_initialize();
+#endif // VVB_USE_SHADERC
+    }
+
+    // Counters include the allocations of the device initialization
+    if (s_options.countersEnabled && !InitializeInstrumentation()) {
+        return EXIT_FAILURE;
+    }
+
+    int exitCode = EXIT_FAILURE;
+    const bool vulkanReady = s_options.backendSelection != BACKEND_SELECTION_CPU && InitializeInstanceAndeDevice() == VK_SUCCESS;
+    if (!vulkanReady) {
+        // Releases what a failed initialization left behind before the dump thread may look at the device contexts
+        DestroyInstanceAndDevice();
+    }
+    bool countersReady = true;
+    if (s_options.countersFilePath != NULL)
+    {
+        const uint32_t interval = s_options.counterDumpIntervalMilliseconds > 0 ? s_options.counterDumpIntervalMilliseconds :
+            DEFAULT_COUNTER_DUMP_INTERVAL_MILLISECONDS;
+        countersReady = StartCounterDumps(s_options.countersFilePath, interval);
+    }
+
+    if (!countersReady) {
+        // Runs nothing whose counters could not be written as requested
+        exitCode = EXIT_FAILURE;
+    }
+    else if (vulkanReady)
+    {
+        if (s_options.shaderCompileBenchmark) {
+            exitCode = RunShaderCompileBenchmark() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.batchFilePath != NULL) {
+            exitCode = RunBatchJobs(s_options.batchFilePath, s_options.resultsFilePath) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.queueBenchmarkJobCount > 0) {
+            exitCode = RunQueueScalingBenchmark(s_options.queueBenchmarkJobCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.indirectElementCount > 0) {
+            exitCode = RunIndirectReductionTest(s_options.indirectElementCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.deviceHeapElementCount > 0) {
+            exitCode = RunDeviceHeapTest(s_options.deviceHeapElementCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.persistentJobCount > 0) {
+            exitCode = RunPersistentQueueBenchmark(s_options.persistentJobCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.sparseElementCount > 0) {
+            exitCode = RunSparseGrowthTest(s_options.sparseElementCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.accessBenchmark) {
+            exitCode = RunAccessPatternBenchmark() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.gatherScatterBenchmark) {
+            exitCode = RunGatherScatterBenchmark() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.compressedUploadElementCount > 0) {
+            exitCode = RunCompressedUploadBenchmark(s_options.compressedUploadElementCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.elementTypeElementCount > 0) {
+            exitCode = RunElementTypeBenchmark(s_options.elementTypeElementCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.serviceSocketPath != NULL) {
+            exitCode = RunComputeService(s_options.serviceSocketPath) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.serviceTestClientCount > 0) {
+            exitCode = RunServiceSelfTest(s_options.serviceTestClientCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.backendBenchmarkElementCount > 0) {
+            exitCode = RunBackendBenchmark(s_options.backendBenchmarkElementCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.defragPassBudgetMilliseconds > 0) {
+            exitCode = RunDefragmentationTest(s_options.defragPassBudgetMilliseconds) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.captureFilePath != NULL) {
+            exitCode = RunWorkloadCapture(s_options.captureFilePath) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.replayFilePath != NULL) {
+            exitCode = RunWorkloadReplay(s_options.replayFilePath) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.graphBenchmark) {
+            exitCode = RunGraphBarrierBenchmark() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.recordingBenchmarkJobCount > 0) {
+            exitCode = RunRecordingScalingBenchmark(s_options.recordingBenchmarkJobCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.coalescingJobCount > 0 || s_options.coalescingBatchSize > 0)
+        {
+            const uint32_t jobCount = s_options.coalescingJobCount > 0 ? s_options.coalescingJobCount : DEFAULT_COALESCING_JOB_COUNT;
+            exitCode = RunSubmissionCoalescingBenchmark(jobCount, s_options.coalescingBatchSize, s_options.coalescingWindowMicroseconds) ?
+                EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.waitBenchmarkJobCount > 0) {
+            exitCode = RunCompletionWaitBenchmark(s_options.waitBenchmarkJobCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.asyncJobCount > 0) {
+            exitCode = RunAsyncSubmissionTest(s_options.asyncJobCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.multiDevice) {
+            exitCode = RunMultiDeviceTest(DEFAULT_ELEMENT_COUNT) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else {
+            exitCode = RunComputeTest() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    else if (s_options.backendSelection != BACKEND_SELECTION_VULKAN)
+    {
+        // Only the modes built on the job API run without a device; the jobs then go to the CPU backend
+        if (s_options.backendSelection == BACKEND_SELECTION_AUTO) {
+            puts("No usable Vulkan device, falling back to the CPU backend.");
+        }
+
+        const char* vulkanOnlyOption = GetVulkanOnlyModeOption();
+        if (vulkanOnlyOption != NULL) {
+            fprintf(stderr, "%s needs a Vulkan device and does not run on the CPU backend!\n", vulkanOnlyOption);
+        }
+        else if (s_options.backendBenchmarkElementCount > 0) {
+            exitCode = RunBackendBenchmark(s_options.backendBenchmarkElementCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (s_options.batchFilePath != NULL) {
+            exitCode = RunBatchJobs(s_options.batchFilePath, s_options.resultsFilePath) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else {
+            exitCode = RunComputeTest() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (s_options.countersEnabled)
+    {
+        StopCounterDumps();
+        PrintInstrumentationSummary();
+        DestroyInstrumentation();
+    }
+
+    DestroyInstanceAndDevice();
+    DestroyCpuBackend(&s_cpuBackend);
+
+#ifdef VVB_USE_SHADERC
+    if (s_shaderCompiler != NULL) {
+        shaderc_compiler_release(s_shaderCompiler);
+    }
+#endif // VVB_USE_SHADERC
+
+    return exitCode;
 }
 
 // 运行程序: Ctrl + F5 或调试 >“开始执行(不调试)”菜单
@@ -0,0 +1,108 @@
+#version 450
+#extension GL_ARB_gpu_shader_int64 : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : enable
+#extension GL_EXT_buffer_reference : enable
+#extension GL_EXT_buffer_reference2 : enable
+
+// Reads `buffer_count` buffers `reads_per_buffer` times per invocation. How the buffers are reached is chosen when a
+// variant is compiled, see glsl_builder.bat:
+// ACCESS_BDA_RELOAD        address table, every access reloads and null-checks its pointer
+// ACCESS_BDA_HOISTED       address table, the pointers are loaded once per invocation
+// ACCESS_DESCRIPTOR_ARRAY  an array of storage buffer descriptors indexed dynamically
+// ACCESS_FIXED_BINDINGS    one binding per buffer, up to 8 buffers
+
+layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+
+// Elements of every data buffer, a power of 2
+layout(constant_id = 0) const highp uint elem_count = 1024U;
+layout(constant_id = 1) const highp uint buffer_count = 1U;
+// Elements between the reads of adjacent invocations
+layout(constant_id = 2) const highp uint access_stride = 1U;
+layout(constant_id = 3) const highp uint reads_per_buffer = 1U;
+
+// Elements between the reads of one invocation from the same buffer
+const highp uint READ_OFFSET = 4099U;
+
+layout(std430, set = 0, binding = 0) buffer writeonly result {
+    highp uint sums[];
+};
+
+#if defined(ACCESS_BDA_RELOAD) || defined(ACCESS_BDA_HOISTED)
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer readonly DataBufferType {
+    highp uint data[];
+};
+
+layout(std430, set = 0, binding = 1) buffer readonly addressTable {
+    DataBufferType dataBuffers[buffer_count];
+};
+
+#elif defined(ACCESS_DESCRIPTOR_ARRAY)
+
+// Must match ACCESS_BENCHMARK_MAX_BUFFER_COUNT on the host, only the first buffer_count descriptors are read
+#define MAX_BUFFER_COUNT    64
+
+layout(std430, set = 0, binding = 1) buffer readonly DataBuffers {
+    highp uint data[];
+} dataBuffers[MAX_BUFFER_COUNT];
+
+#else
+
+layout(std430, set = 0, binding = 1) buffer readonly DataBuffer0 { highp uint data[]; } dataBuffer0;
+layout(std430, set = 0, binding = 2) buffer readonly DataBuffer1 { highp uint data[]; } dataBuffer1;
+layout(std430, set = 0, binding = 3) buffer readonly DataBuffer2 { highp uint data[]; } dataBuffer2;
+layout(std430, set = 0, binding = 4) buffer readonly DataBuffer3 { highp uint data[]; } dataBuffer3;
+layout(std430, set = 0, binding = 5) buffer readonly DataBuffer4 { highp uint data[]; } dataBuffer4;
+layout(std430, set = 0, binding = 6) buffer readonly DataBuffer5 { highp uint data[]; } dataBuffer5;
+layout(std430, set = 0, binding = 7) buffer readonly DataBuffer6 { highp uint data[]; } dataBuffer6;
+layout(std430, set = 0, binding = 8) buffer readonly DataBuffer7 { highp uint data[]; } dataBuffer7;
+
+#endif
+
+void main(void)
+{
+    const uint gid = gl_GlobalInvocationID.x;
+    const uint baseIndex = gid * access_stride;
+    uint sum = 0U;
+
+#if defined(ACCESS_BDA_HOISTED)
+    DataBufferType buffers[buffer_count];
+    for (uint b = 0U; b < buffer_count; b++) {
+        buffers[b] = dataBuffers[b];
+    }
+#endif
+
+    for (uint r = 0U; r < reads_per_buffer; r++)
+    {
+        const uint index = (baseIndex + r * READ_OFFSET) & (elem_count - 1U);
+
+#if defined(ACCESS_BDA_RELOAD)
+        for (uint b = 0U; b < buffer_count; b++)
+        {
+            DataBufferType dataBuffer = dataBuffers[b];
+            if (uint64_t(dataBuffer) != 0) {
+                sum += dataBuffer.data[index];
+            }
+        }
+#elif defined(ACCESS_BDA_HOISTED)
+        for (uint b = 0U; b < buffer_count; b++) {
+            sum += buffers[b].data[index];
+        }
+#elif defined(ACCESS_DESCRIPTOR_ARRAY)
+        for (uint b = 0U; b < buffer_count; b++) {
+            sum += dataBuffers[b].data[index];
+        }
+#else
+        if (buffer_count > 0U) sum += dataBuffer0.data[index];
+        if (buffer_count > 1U) sum += dataBuffer1.data[index];
+        if (buffer_count > 2U) sum += dataBuffer2.data[index];
+        if (buffer_count > 3U) sum += dataBuffer3.data[index];
+        if (buffer_count > 4U) sum += dataBuffer4.data[index];
+        if (buffer_count > 5U) sum += dataBuffer5.data[index];
+        if (buffer_count > 6U) sum += dataBuffer6.data[index];
+        if (buffer_count > 7U) sum += dataBuffer7.data[index];
+#endif
+    }
+
+    sums[gid] = sum;
+}
@@ -0,0 +1,83 @@
+#version 450
+#extension GL_EXT_buffer_reference : enable
+#extension GL_EXT_buffer_reference2 : enable
+
+// Decodes a compressed upload into the destination buffer, one block of 1024 elements per workgroup. Every block is
+// bit-packed at its own width and encoded in one of two modes:
+// frame of reference   data[i] = base + packed[i]
+// delta                data[i] = base + i * reference + packed[0] + ... + packed[i], packed[0] is always 0
+// A block of width 0 has no packed words.
+
+layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+
+layout(constant_id = 0) const highp uint total_data_elem_count = 1024U;
+
+const uint BLOCK_ENCODING_DELTA = 1U;
+
+// modeAndWidth holds the mode in bits 8.. and the bit width in bits 0..7; wordOffset indexes the packed words
+struct BlockHeader {
+    highp uint modeAndWidth;
+    highp uint base;
+    highp uint reference;
+    highp uint wordOffset;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer DataBufferType {
+    highp uint data[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer HeaderBufferType {
+    BlockHeader headers[];
+};
+
+layout(std430, set = 0, binding = 0) buffer readonly addressTable {
+    DataBufferType dstBuffer;
+    HeaderBufferType headerBuffer;
+    DataBufferType wordBuffer;
+};
+
+shared uint prefixSums[1024];
+
+void main(void)
+{
+    const uint gid = gl_GlobalInvocationID.x;
+    const uint lid = gl_LocalInvocationID.x;
+    const BlockHeader header = headerBuffer.headers[gl_WorkGroupID.x];
+    const uint bitWidth = header.modeAndWidth & 0xFFU;
+
+    uint packed = 0U;
+    if (bitWidth != 0U)
+    {
+        const uint bitOffset = lid * bitWidth;
+        const uint wordIndex = header.wordOffset + (bitOffset >> 5U);
+        const uint shift = bitOffset & 31U;
+        packed = wordBuffer.data[wordIndex] >> shift;
+        if (shift + bitWidth > 32U) {
+            packed |= wordBuffer.data[wordIndex + 1U] << (32U - shift);
+        }
+        if (bitWidth < 32U) {
+            packed &= (1U << bitWidth) - 1U;
+        }
+    }
+
+    uint value = header.base + packed;
+    // The mode is the same for the whole workgroup, so the barriers are in uniform control flow
+    if ((header.modeAndWidth >> 8U) == BLOCK_ENCODING_DELTA)
+    {
+        // Inclusive prefix sum of the packed deltas
+        prefixSums[lid] = packed;
+        barrier();
+        for (uint stride = 1U; stride < 1024U; stride <<= 1U)
+        {
+            const uint addend = lid >= stride ? prefixSums[lid - stride] : 0U;
+            barrier();
+            prefixSums[lid] += addend;
+            barrier();
+        }
+        value = header.base + lid * header.reference + prefixSums[lid];
+    }
+
+    if (gid < total_data_elem_count) {
+        dstBuffer.data[gid] = value;
+    }
+}
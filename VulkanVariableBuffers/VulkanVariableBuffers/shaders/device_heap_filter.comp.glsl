@@ -0,0 +1,103 @@
+#version 450
+#extension GL_EXT_buffer_reference : enable
+#extension GL_EXT_buffer_reference2 : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : enable
+
+layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer SourceBufferType {
+    highp uint data[];
+};
+
+// The heap starts with this header, blocks are carved out behind it. `top` and `listHead` are byte offsets from the heap address.
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer DeviceHeapType {
+    highp uint top;
+    highp uint capacity;
+    highp uint listHead;
+    highp uint failedCount;
+};
+
+layout(buffer_reference) buffer OutputBlockType;
+
+// An output block, linked to the previously allocated one. A null `next` ends the list.
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer OutputBlockType {
+    OutputBlockType next;
+    highp uint count;
+    highp uint reserved;
+    highp uint data[];
+};
+
+layout(std430, set = 0, binding = 0) buffer readonly addressTable {
+    SourceBufferType srcBuffer;
+    DeviceHeapType heap;
+};
+
+layout(push_constant) uniform FilterParams {
+    highp uint elemCount;
+    highp uint selectivity;
+} params;
+
+const uint BLOCK_HEADER_SIZE = 16U;
+
+shared uint s_keptCount;
+shared uint s_blockOffset;
+
+// Keeps about `selectivity` percent of the elements, depending on their values
+bool Keep(uint value)
+{
+    return ((value * 2654435761U) >> 16U) % 100U < params.selectivity;
+}
+
+// Bump allocation from the device heap, returns 0 when the heap is exhausted
+uint Allocate(uint size)
+{
+    const uint offset = atomicAdd(heap.top, size);
+    return offset + size <= heap.capacity ? offset : 0U;
+}
+
+// Every workgroup compacts the elements it keeps into one block of exactly the required size
+void main(void)
+{
+    const uint gid = gl_GlobalInvocationID.x;
+    const uint lid = gl_LocalInvocationID.x;
+
+    if (lid == 0U) {
+        s_keptCount = 0U;
+    }
+    barrier();
+
+    const bool keep = gid < params.elemCount && Keep(srcBuffer.data[gid]);
+    uint slot = 0U;
+    if (keep) {
+        slot = atomicAdd(s_keptCount, 1U);
+    }
+    barrier();
+
+    if (lid == 0U)
+    {
+        s_blockOffset = 0U;
+        if (s_keptCount > 0U)
+        {
+            const uint64_t heapAddress = uint64_t(heap);
+            const uint offset = Allocate((BLOCK_HEADER_SIZE + s_keptCount * 4U + 15U) & ~15U);
+            if (offset != 0U)
+            {
+                const uint previous = atomicExchange(heap.listHead, offset);
+                OutputBlockType block = OutputBlockType(heapAddress + offset);
+                block.next = OutputBlockType(previous != 0U ? heapAddress + previous : uint64_t(0));
+                block.count = s_keptCount;
+                s_blockOffset = offset;
+            }
+            else {
+                atomicAdd(heap.failedCount, s_keptCount);
+            }
+        }
+    }
+    barrier();
+
+    if (keep && s_blockOffset != 0U)
+    {
+        OutputBlockType block = OutputBlockType(uint64_t(heap) + s_blockOffset);
+        block.data[slot] = srcBuffer.data[gid];
+    }
+}
@@ -0,0 +1,53 @@
+#version 450
+#extension GL_EXT_buffer_reference : enable
+
+// Gathers from or scatters into many buffers along an index stream of (buffer slot, offset) pairs; the slot selects a device
+// address of the address table. The operation is chosen when a variant is compiled, see glsl_builder.bat:
+// GATHER_SCATTER_GATHER    values[i] = buffer[slot].data[offset]
+// GATHER_SCATTER_ADD       buffer[slot].data[offset] += values[i], atomically
+// GATHER_SCATTER_MIN       buffer[slot].data[offset] = min(buffer[slot].data[offset], values[i]), atomically
+// GATHER_SCATTER_MAX       buffer[slot].data[offset] = max(buffer[slot].data[offset], values[i]), atomically
+
+layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+
+// The stream has been sorted by the host pre-pass; order[i] is the position of entry i in the unsorted stream, which the
+// values still follow
+layout(constant_id = 0) const bool use_order = false;
+
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer DataBufferType {
+    highp uint data[];
+};
+
+layout(std430, set = 0, binding = 0) buffer readonly indexStream {
+    highp uvec2 entries[];
+};
+
+layout(std430, set = 0, binding = 1) buffer readonly addressTable {
+    DataBufferType dataBuffers[];
+};
+
+layout(std430, set = 0, binding = 2) buffer valueStream {
+    highp uint values[];
+};
+
+layout(std430, set = 0, binding = 3) buffer readonly orderStream {
+    highp uint order[];
+};
+
+void main(void)
+{
+    const uint gid = gl_GlobalInvocationID.x;
+    const uvec2 entry = entries[gid];
+    const uint valueIndex = use_order ? order[gid] : gid;
+    DataBufferType dataBuffer = dataBuffers[entry.x];
+
+#if defined(GATHER_SCATTER_GATHER)
+    values[valueIndex] = dataBuffer.data[entry.y];
+#elif defined(GATHER_SCATTER_ADD)
+    atomicAdd(dataBuffer.data[entry.y], values[valueIndex]);
+#elif defined(GATHER_SCATTER_MIN)
+    atomicMin(dataBuffer.data[entry.y], values[valueIndex]);
+#else
+    atomicMax(dataBuffer.data[entry.y], values[valueIndex]);
+#endif
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Counterpart of glsl_builder.bat for builds outside Visual Studio; keep both lists in sync.
+# Uses glslangValidator of the Vulkan SDK when VULKAN_SDK is set, otherwise the one on PATH.
+set -e
+cd "$(dirname "$0")"
+GLSLANG="${VULKAN_SDK:+$VULKAN_SDK/bin/}glslangValidator"
+
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -o test.spv  test.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  --vn test_spv  -o test.spv.h  test.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -o reduce_step.spv  reduce_step.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  --vn reduce_step_spv  -o reduce_step.spv.h  reduce_step.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -o device_heap_filter.spv  device_heap_filter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  --vn device_heap_filter_spv  -o device_heap_filter.spv.h  device_heap_filter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -o persistent_queue.spv  persistent_queue.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  --vn persistent_queue_spv  -o persistent_queue.spv.h  persistent_queue.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_INT8  -o typed_double_int8.spv  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_INT8  --vn typed_double_int8_spv  -o typed_double_int8.spv.h  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_FP16  -o typed_double_fp16.spv  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_FP16  --vn typed_double_fp16_spv  -o typed_double_fp16.spv.h  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_INT32  -o typed_double_int32.spv  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_INT32  --vn typed_double_int32_spv  -o typed_double_int32.spv.h  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_FP32  -o typed_double_fp32.spv  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_FP32  --vn typed_double_fp32_spv  -o typed_double_fp32.spv.h  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_INT64  -o typed_double_int64.spv  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_INT64  --vn typed_double_int64_spv  -o typed_double_int64.spv.h  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_FP64  -o typed_double_fp64.spv  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DELEMENT_TYPE_FP64  --vn typed_double_fp64_spv  -o typed_double_fp64.spv.h  typed_double.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DACCESS_BDA_RELOAD  -o access_pattern_bda_reload.spv  access_pattern.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DACCESS_BDA_RELOAD  --vn access_pattern_bda_reload_spv  -o access_pattern_bda_reload.spv.h  access_pattern.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DACCESS_BDA_HOISTED  -o access_pattern_bda_hoisted.spv  access_pattern.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DACCESS_BDA_HOISTED  --vn access_pattern_bda_hoisted_spv  -o access_pattern_bda_hoisted.spv.h  access_pattern.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DACCESS_DESCRIPTOR_ARRAY  -o access_pattern_descriptor_array.spv  access_pattern.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DACCESS_DESCRIPTOR_ARRAY  --vn access_pattern_descriptor_array_spv  -o access_pattern_descriptor_array.spv.h  access_pattern.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DACCESS_FIXED_BINDINGS  -o access_pattern_fixed_bindings.spv  access_pattern.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DACCESS_FIXED_BINDINGS  --vn access_pattern_fixed_bindings_spv  -o access_pattern_fixed_bindings.spv.h  access_pattern.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DGATHER_SCATTER_GATHER  -o gather_scatter_gather.spv  gather_scatter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DGATHER_SCATTER_GATHER  --vn gather_scatter_gather_spv  -o gather_scatter_gather.spv.h  gather_scatter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DGATHER_SCATTER_ADD  -o gather_scatter_scatter_add.spv  gather_scatter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DGATHER_SCATTER_ADD  --vn gather_scatter_scatter_add_spv  -o gather_scatter_scatter_add.spv.h  gather_scatter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DGATHER_SCATTER_MIN  -o gather_scatter_scatter_min.spv  gather_scatter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DGATHER_SCATTER_MIN  --vn gather_scatter_scatter_min_spv  -o gather_scatter_scatter_min.spv.h  gather_scatter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DGATHER_SCATTER_MAX  -o gather_scatter_scatter_max.spv  gather_scatter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -DGATHER_SCATTER_MAX  --vn gather_scatter_scatter_max_spv  -o gather_scatter_scatter_max.spv.h  gather_scatter.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  -o decode_blocks.spv  decode_blocks.comp.glsl
+"$GLSLANG"  -V100  -Os  --target-env spirv1.3  --vn decode_blocks_spv  -o decode_blocks.spv.h  decode_blocks.comp.glsl
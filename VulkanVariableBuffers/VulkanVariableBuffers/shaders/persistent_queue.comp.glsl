@@ -0,0 +1,128 @@
+#version 450
+#extension GL_EXT_buffer_reference : enable
+#extension GL_EXT_buffer_reference2 : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : enable
+
+layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+
+// Job data lives in host visible memory that the host rewrites while the kernel is running
+layout(buffer_reference, std430, buffer_reference_align = 16) coherent buffer DataBufferType {
+    highp uint data[];
+};
+
+// `sequence` is written last by the host and hands the slot over, `completion` is written back once the job is done
+struct JobSlot {
+    uint64_t srcAddress;
+    uint64_t dstAddress;
+    highp uint elemCount;
+    highp uint op;
+    highp uint sequence;
+    highp uint completion;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) coherent volatile buffer RingType {
+    highp uint completedCount;
+    highp uint state;
+    highp uint reserved0;
+    highp uint reserved1;
+    JobSlot slots[];
+};
+
+layout(std430, set = 0, binding = 0) buffer readonly addressTable {
+    RingType ring;
+};
+
+layout(push_constant) uniform QueueParams {
+    highp uint capacity;
+    highp uint maxIdlePolls;
+} params;
+
+// Must match `enum PERSISTENT_JOB_OP` and `enum PERSISTENT_QUEUE_STATE` of main.c
+const uint OP_DOUBLE = 1U;
+const uint OP_SHUTDOWN = 2U;
+const uint OP_IDLE_EXIT = 3U;
+
+const uint STATE_RUNNING = 1U;
+const uint STATE_IDLE_EXIT = 2U;
+const uint STATE_SHUT_DOWN = 3U;
+
+shared uint s_sequence;
+shared uint s_op;
+shared uint s_elemCount;
+shared uint64_t s_srcAddress;
+shared uint64_t s_dstAddress;
+
+// A single workgroup that stays resident and runs the jobs published in the ring in order. Thread 0 polls the ring,
+// the whole workgroup processes the job. The kernel leaves on a shutdown job, or after `maxIdlePolls` polls without
+// a job, which keeps every launch below the GPU timeout of the OS; the host relaunches it when new jobs arrive.
+void main(void)
+{
+    const uint lid = gl_LocalInvocationID.x;
+
+    if (lid == 0U)
+    {
+        s_sequence = ring.completedCount;
+        ring.state = STATE_RUNNING;
+    }
+    barrier();
+
+    uint sequence = s_sequence;
+    uint op = OP_IDLE_EXIT;
+    while (true)
+    {
+        const uint slot = sequence % params.capacity;
+        if (lid == 0U)
+        {
+            s_op = OP_IDLE_EXIT;
+            for (uint polls = 0U; polls < params.maxIdlePolls; polls++)
+            {
+                if (ring.slots[slot].sequence == sequence + 1U)
+                {
+                    s_op = ring.slots[slot].op;
+                    s_elemCount = ring.slots[slot].elemCount;
+                    s_srcAddress = ring.slots[slot].srcAddress;
+                    s_dstAddress = ring.slots[slot].dstAddress;
+                    break;
+                }
+            }
+        }
+        barrier();
+
+        op = s_op;
+        if (op != OP_DOUBLE) {
+            break;
+        }
+
+        DataBufferType srcBuffer = DataBufferType(s_srcAddress);
+        DataBufferType dstBuffer = DataBufferType(s_dstAddress);
+        const uint elemCount = s_elemCount;
+        for (uint i = lid; i < elemCount; i += 1024U) {
+            dstBuffer.data[i] = srcBuffer.data[i] * 2U;
+        }
+
+        // The output has to be visible before the completion is
+        memoryBarrierBuffer();
+        barrier();
+
+        if (lid == 0U)
+        {
+            ring.slots[slot].completion = sequence + 1U;
+            ring.completedCount = sequence + 1U;
+        }
+        sequence++;
+    }
+
+    if (lid == 0U)
+    {
+        if (op == OP_SHUTDOWN)
+        {
+            // The state is set first, so the host sees it once the shutdown job has completed
+            ring.state = STATE_SHUT_DOWN;
+            ring.slots[sequence % params.capacity].completion = sequence + 1U;
+            ring.completedCount = sequence + 1U;
+        }
+        else {
+            ring.state = STATE_IDLE_EXIT;
+        }
+    }
+}
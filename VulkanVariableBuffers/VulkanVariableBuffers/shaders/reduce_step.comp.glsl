@@ -0,0 +1,62 @@
+#version 450
+#extension GL_EXT_buffer_reference : enable
+#extension GL_EXT_buffer_reference2 : enable
+
+layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer DataBufferType {
+    highp uint data[];
+};
+
+// groupCountX/Y/Z are the VkDispatchIndirectCommand of the step, elemCount is the size of its input
+struct StepState {
+    highp uint groupCountX;
+    highp uint groupCountY;
+    highp uint groupCountZ;
+    highp uint elemCount;
+    highp uint value;
+    highp uint reserved0;
+    highp uint reserved1;
+    highp uint reserved2;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer StepStateBufferType {
+    StepState states[];
+};
+
+layout(std430, set = 0, binding = 0) buffer readonly addressTable {
+    DataBufferType dataBuffers[2];
+    StepStateBufferType stateBuffer;
+};
+
+layout(push_constant) uniform StepParams {
+    highp uint step;
+} params;
+
+// One step of a pairwise sum reduction. Even steps read dataBuffers[0] and write dataBuffers[1], odd steps the other way round.
+// The step writes the dispatch arguments and the input size of the next step, so the whole loop runs without the host.
+void main(void)
+{
+    DataBufferType srcBuffer = dataBuffers[params.step & 1U];
+    DataBufferType dstBuffer = dataBuffers[(params.step & 1U) ^ 1U];
+
+    const uint elemCount = stateBuffer.states[params.step].elemCount;
+    const uint nextCount = (elemCount + 1U) / 2U;
+
+    const uint gid = gl_GlobalInvocationID.x;
+    if (gid < nextCount)
+    {
+        const uint i = gid * 2U;
+        dstBuffer.data[gid] = srcBuffer.data[i] + (i + 1U < elemCount ? srcBuffer.data[i + 1U] : 0U);
+    }
+
+    if (gid == 0U)
+    {
+        // Converged steps still dispatch one workgroup, which carries the single element over
+        const uint followingCount = (nextCount + 1U) / 2U;
+        stateBuffer.states[params.step + 1U].groupCountX = max((followingCount + 1023U) / 1024U, 1U);
+        stateBuffer.states[params.step + 1U].groupCountY = 1U;
+        stateBuffer.states[params.step + 1U].groupCountZ = 1U;
+        stateBuffer.states[params.step + 1U].elemCount = nextCount;
+    }
+}
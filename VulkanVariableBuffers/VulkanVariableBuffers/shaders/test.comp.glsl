@@ -16,6 +16,13 @@ layout(std430, set = 0, binding = 0) buffer readonly src {
     DataBufferType srcWrapperBuffer[];
 };
 
+// Both 0 for a whole array, otherwise the offset of this chunk in an array of total_elem_count elements,
+// so that the gathered chunks match the output of a single run
+layout(push_constant) uniform Chunk {
+    uint offset;
+    uint total_elem_count;
+} chunk;
+
 void main(void)
 {
     DataBufferType dstBuffer = srcWrapperBuffer[0];
@@ -28,8 +35,8 @@ void main(void)
     const uint gid = gl_GlobalInvocationID.x;
     dstBuffer.data[gid] = srcBuffer.data[gid] + srcBuffer.data[gid];
 
-    if (gid == 0) {
-        dstBuffer.data[gid] = int(total_data_elem_count);
+    if (gid + chunk.offset == 0) {
+        dstBuffer.data[gid] = chunk.total_elem_count == 0 ? int(total_data_elem_count) : int(chunk.total_elem_count);
     }
 }
 
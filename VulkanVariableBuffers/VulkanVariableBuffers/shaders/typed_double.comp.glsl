@@ -0,0 +1,43 @@
+#version 450
+#extension GL_EXT_buffer_reference : enable
+#extension GL_EXT_buffer_reference2 : enable
+#extension GL_EXT_shader_explicit_arithmetic_types : enable
+
+// The element type is chosen when a variant is compiled, see glsl_builder.bat
+#if defined(ELEMENT_TYPE_INT8)
+#extension GL_EXT_shader_8bit_storage : enable
+#define ELEMENT_TYPE int8_t
+#elif defined(ELEMENT_TYPE_FP16)
+#extension GL_EXT_shader_16bit_storage : enable
+#define ELEMENT_TYPE float16_t
+#elif defined(ELEMENT_TYPE_FP32)
+#define ELEMENT_TYPE float
+#elif defined(ELEMENT_TYPE_INT64)
+#define ELEMENT_TYPE int64_t
+#elif defined(ELEMENT_TYPE_FP64)
+#define ELEMENT_TYPE double
+#else
+#define ELEMENT_TYPE int
+#endif
+
+layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+
+layout(constant_id = 0) const highp uint total_data_elem_count = 1024U;
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer DataBufferType {
+    ELEMENT_TYPE data[];
+};
+
+layout(std430, set = 0, binding = 0) buffer readonly addressTable {
+    DataBufferType dstBuffer;
+    DataBufferType srcBuffer;
+};
+
+// dst[i] = src[i] + src[i] in the element type of the variant
+void main(void)
+{
+    const uint gid = gl_GlobalInvocationID.x;
+    if (gid < total_data_elem_count) {
+        dstBuffer.data[gid] = srcBuffer.data[gid] + srcBuffer.data[gid];
+    }
+}